@@ -0,0 +1,1004 @@
+/* GStreamer
+ *
+ * gstav1parser.c: AV1 OBU bitstream parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:gstav1parser
+ * @title: GstAV1Parser
+ * @short_description: Convenience library for parsing AV1 video bitstream.
+ *
+ * The parser splits an AV1 bitstream into Open Bitstream Units (OBUs) with
+ * gst_av1_parser_identify_obu() and parses the sequence header and the
+ * leading part of the frame header, which is enough to find key frames,
+ * the stream properties and the frame sizes without decoding.
+ *
+ * For the Annex B length delimited format, the temporal_unit_size,
+ * frame_unit_size and obu_length fields are read with
+ * gst_av1_read_leb128() and each OBU is then passed to
+ * gst_av1_parser_identify_obu() with the size from obu_length.
+ *
+ * For more details about the structures, you can refer to the
+ * specification: https://aomediacodec.github.io/av1-spec/
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/base/gstbitreader.h>
+#include "parserutils.h"
+#include "gstav1parser.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_av1_parser_debug);
+#define GST_CAT_DEFAULT gst_av1_parser_debug
+
+static gboolean initialized = FALSE;
+#define INITIALIZE_DEBUG_CATEGORY \
+  if (!initialized) { \
+    GST_DEBUG_CATEGORY_INIT (gst_av1_parser_debug, "codecparsers_av1", 0, \
+        "av1 parser library"); \
+    initialized = TRUE; \
+  }
+
+#define GST_AV1_PARSER_GET_PRIVATE(parser)  ((GstAV1ParserPrivate *)(parser->priv))
+
+#define READ_BOOL(br, val) G_STMT_START { \
+  guint8 _b; \
+  READ_UINT8 (br, _b, 1); \
+  val = _b; \
+} G_STMT_END
+
+typedef struct
+{
+  gboolean valid;
+  gboolean size_known;
+  GstAV1FrameType frame_type;
+  guint32 upscaled_width;
+  guint32 frame_width;
+  guint32 frame_height;
+  guint32 render_width;
+  guint32 render_height;
+  guint32 order_hint;
+} GstAV1ReferenceFrame;
+
+typedef struct
+{
+  GstAV1ReferenceFrame ref[GST_AV1_NUM_REF_FRAMES];
+} GstAV1ParserPrivate;
+
+/* 4.10.5 uvlc() */
+static gboolean
+gst_av1_read_uvlc (GstBitReader * br, guint32 * value)
+{
+  guint leading_zeros = 0;
+  guint32 bits = 0;
+  guint8 done;
+
+  for (;;) {
+    READ_UINT8 (br, done, 1);
+    if (done)
+      break;
+    leading_zeros++;
+  }
+
+  if (leading_zeros >= 32) {
+    *value = G_MAXUINT32;
+    return TRUE;
+  }
+
+  if (leading_zeros > 0)
+    READ_UINT32 (br, bits, leading_zeros);
+
+  *value = bits + (1U << leading_zeros) - 1;
+  return TRUE;
+
+failed:
+  return FALSE;
+}
+
+/* 5.5.3 timing_info() */
+static gboolean
+gst_av1_parse_timing_info (GstBitReader * br, GstAV1TimingInfo * timing_info)
+{
+  READ_UINT32 (br, timing_info->num_units_in_display_tick, 32);
+  READ_UINT32 (br, timing_info->time_scale, 32);
+  if (!timing_info->num_units_in_display_tick || !timing_info->time_scale) {
+    GST_WARNING ("invalid timing info");
+    goto failed;
+  }
+
+  READ_BOOL (br, timing_info->equal_picture_interval);
+  if (timing_info->equal_picture_interval) {
+    if (!gst_av1_read_uvlc (br, &timing_info->num_ticks_per_picture_minus_1))
+      goto failed;
+    if (timing_info->num_ticks_per_picture_minus_1 == G_MAXUINT32) {
+      GST_WARNING ("invalid num_ticks_per_picture_minus_1");
+      goto failed;
+    }
+  }
+
+  return TRUE;
+
+failed:
+  return FALSE;
+}
+
+/* 5.5.4 decoder_model_info() */
+static gboolean
+gst_av1_parse_decoder_model_info (GstBitReader * br,
+    GstAV1DecoderModelInfo * info)
+{
+  READ_UINT8 (br, info->buffer_delay_length_minus_1, 5);
+  READ_UINT32 (br, info->num_units_in_decoding_tick, 32);
+  READ_UINT8 (br, info->buffer_removal_time_length_minus_1, 5);
+  READ_UINT8 (br, info->frame_presentation_time_length_minus_1, 5);
+
+  return TRUE;
+
+failed:
+  return FALSE;
+}
+
+/* 5.5.2 color_config() */
+static gboolean
+gst_av1_parse_color_config (GstBitReader * br,
+    GstAV1SequenceHeaderOBU * seq_header)
+{
+  GstAV1ColorConfig *cc = &seq_header->color_config;
+  guint8 val;
+
+  READ_BOOL (br, cc->high_bitdepth);
+  if (seq_header->seq_profile == GST_AV1_PROFILE_2 && cc->high_bitdepth) {
+    READ_BOOL (br, cc->twelve_bit);
+    cc->bit_depth = cc->twelve_bit ? 12 : 10;
+  } else {
+    cc->bit_depth = cc->high_bitdepth ? 10 : 8;
+  }
+
+  if (seq_header->seq_profile == GST_AV1_PROFILE_1)
+    cc->mono_chrome = FALSE;
+  else
+    READ_BOOL (br, cc->mono_chrome);
+
+  READ_BOOL (br, cc->color_description_present_flag);
+  if (cc->color_description_present_flag) {
+    READ_UINT8 (br, val, 8);
+    cc->color_primaries = val;
+    READ_UINT8 (br, val, 8);
+    cc->transfer_characteristics = val;
+    READ_UINT8 (br, val, 8);
+    cc->matrix_coefficients = val;
+  } else {
+    cc->color_primaries = GST_AV1_CP_UNSPECIFIED;
+    cc->transfer_characteristics = GST_AV1_TC_UNSPECIFIED;
+    cc->matrix_coefficients = GST_AV1_MC_UNSPECIFIED;
+  }
+
+  if (cc->mono_chrome) {
+    READ_BOOL (br, cc->color_range);
+    cc->subsampling_x = cc->subsampling_y = 1;
+    cc->chroma_sample_position = GST_AV1_CSP_UNKNOWN;
+    cc->separate_uv_delta_q = FALSE;
+    return TRUE;
+  } else if (cc->color_primaries == GST_AV1_CP_BT_709 &&
+      cc->transfer_characteristics == GST_AV1_TC_SRGB &&
+      cc->matrix_coefficients == GST_AV1_MC_IDENTITY) {
+    cc->color_range = TRUE;
+    cc->subsampling_x = cc->subsampling_y = 0;
+    if (seq_header->seq_profile != GST_AV1_PROFILE_1 &&
+        !(seq_header->seq_profile == GST_AV1_PROFILE_2 &&
+            cc->bit_depth == 12)) {
+      GST_WARNING ("sRGB is only allowed with 4:4:4 sampling");
+      goto failed;
+    }
+  } else {
+    READ_BOOL (br, cc->color_range);
+    if (seq_header->seq_profile == GST_AV1_PROFILE_0) {
+      cc->subsampling_x = cc->subsampling_y = 1;
+    } else if (seq_header->seq_profile == GST_AV1_PROFILE_1) {
+      cc->subsampling_x = cc->subsampling_y = 0;
+    } else if (cc->bit_depth == 12) {
+      READ_UINT8 (br, cc->subsampling_x, 1);
+      if (cc->subsampling_x)
+        READ_UINT8 (br, cc->subsampling_y, 1);
+      else
+        cc->subsampling_y = 0;
+    } else {
+      cc->subsampling_x = 1;
+      cc->subsampling_y = 0;
+    }
+
+    if (cc->subsampling_x && cc->subsampling_y) {
+      READ_UINT8 (br, val, 2);
+      cc->chroma_sample_position = val;
+    }
+  }
+
+  READ_BOOL (br, cc->separate_uv_delta_q);
+
+  return TRUE;
+
+failed:
+  return FALSE;
+}
+
+/* 5.9.8 superres_params() and 7.21 compute_image_size() */
+static gboolean
+gst_av1_parse_superres_params (GstBitReader * br,
+    const GstAV1SequenceHeaderOBU * seq_header,
+    GstAV1FrameHeaderOBU * frame_header)
+{
+  guint8 coded_denom;
+
+  if (seq_header->enable_superres)
+    READ_BOOL (br, frame_header->use_superres);
+  else
+    frame_header->use_superres = FALSE;
+
+  if (frame_header->use_superres) {
+    READ_UINT8 (br, coded_denom, GST_AV1_SUPERRES_DENOM_BITS);
+    frame_header->superres_denom = coded_denom + GST_AV1_SUPERRES_DENOM_MIN;
+  } else {
+    frame_header->superres_denom = GST_AV1_SUPERRES_NUM;
+  }
+
+  frame_header->upscaled_width = frame_header->frame_width;
+  frame_header->frame_width =
+      (frame_header->upscaled_width * GST_AV1_SUPERRES_NUM +
+      (frame_header->superres_denom / 2)) / frame_header->superres_denom;
+
+  return TRUE;
+
+failed:
+  return FALSE;
+}
+
+/* 5.9.5 frame_size() */
+static gboolean
+gst_av1_parse_frame_size (GstBitReader * br,
+    const GstAV1SequenceHeaderOBU * seq_header,
+    GstAV1FrameHeaderOBU * frame_header)
+{
+  if (frame_header->frame_size_override_flag) {
+    READ_UINT32 (br, frame_header->frame_width,
+        seq_header->frame_width_bits_minus_1 + 1);
+    READ_UINT32 (br, frame_header->frame_height,
+        seq_header->frame_height_bits_minus_1 + 1);
+    frame_header->frame_width++;
+    frame_header->frame_height++;
+  } else {
+    frame_header->frame_width = seq_header->max_frame_width_minus_1 + 1;
+    frame_header->frame_height = seq_header->max_frame_height_minus_1 + 1;
+  }
+
+  return gst_av1_parse_superres_params (br, seq_header, frame_header);
+
+failed:
+  return FALSE;
+}
+
+/* 5.9.6 render_size() */
+static gboolean
+gst_av1_parse_render_size (GstBitReader * br,
+    GstAV1FrameHeaderOBU * frame_header)
+{
+  gboolean render_and_frame_size_different;
+
+  READ_BOOL (br, render_and_frame_size_different);
+  if (render_and_frame_size_different) {
+    READ_UINT32 (br, frame_header->render_width, 16);
+    READ_UINT32 (br, frame_header->render_height, 16);
+    frame_header->render_width++;
+    frame_header->render_height++;
+  } else {
+    frame_header->render_width = frame_header->upscaled_width;
+    frame_header->render_height = frame_header->frame_height;
+  }
+
+  return TRUE;
+
+failed:
+  return FALSE;
+}
+
+/* 5.9.7 frame_size_with_refs() */
+static gboolean
+gst_av1_parse_frame_size_with_refs (GstAV1Parser * parser, GstBitReader * br,
+    GstAV1FrameHeaderOBU * frame_header)
+{
+  GstAV1ParserPrivate *priv = GST_AV1_PARSER_GET_PRIVATE (parser);
+  const GstAV1SequenceHeaderOBU *seq_header = &parser->seq_header;
+  gboolean found_ref = FALSE;
+  guint i;
+
+  for (i = 0; i < GST_AV1_REFS_PER_FRAME; i++) {
+    READ_BOOL (br, found_ref);
+    if (found_ref) {
+      const GstAV1ReferenceFrame *ref =
+          &priv->ref[frame_header->ref_frame_idx[i]];
+
+      if (!ref->size_known) {
+        GST_DEBUG ("frame size taken from unknown reference %d",
+            frame_header->ref_frame_idx[i]);
+        frame_header->frame_size_known = FALSE;
+        return TRUE;
+      }
+
+      frame_header->frame_width = ref->upscaled_width;
+      frame_header->frame_height = ref->frame_height;
+      frame_header->render_width = ref->render_width;
+      frame_header->render_height = ref->render_height;
+      break;
+    }
+  }
+
+  if (!found_ref) {
+    if (!gst_av1_parse_frame_size (br, seq_header, frame_header))
+      goto failed;
+    return gst_av1_parse_render_size (br, frame_header);
+  }
+
+  return gst_av1_parse_superres_params (br, seq_header, frame_header);
+
+failed:
+  return FALSE;
+}
+
+/* 7.20 reference frame update process */
+static void
+gst_av1_parser_update_references (GstAV1Parser * parser,
+    const GstAV1FrameHeaderOBU * frame_header)
+{
+  GstAV1ParserPrivate *priv = GST_AV1_PARSER_GET_PRIVATE (parser);
+  GstAV1ReferenceFrame ref;
+  guint i;
+
+  if (frame_header->show_existing_frame) {
+    /* 7.21 reference frame loading process, then a refresh of all slots */
+    if (frame_header->frame_type != GST_AV1_KEY_FRAME)
+      return;
+    ref = priv->ref[frame_header->frame_to_show_map_idx];
+  } else {
+    ref.valid = TRUE;
+    ref.size_known = frame_header->frame_size_known;
+    ref.frame_type = frame_header->frame_type;
+    ref.upscaled_width = frame_header->upscaled_width;
+    ref.frame_width = frame_header->frame_width;
+    ref.frame_height = frame_header->frame_height;
+    ref.render_width = frame_header->render_width;
+    ref.render_height = frame_header->render_height;
+    ref.order_hint = frame_header->order_hint;
+  }
+
+  for (i = 0; i < GST_AV1_NUM_REF_FRAMES; i++) {
+    if (frame_header->refresh_frame_flags & (1 << i))
+      priv->ref[i] = ref;
+  }
+}
+
+/******** API *************/
+
+/**
+ * gst_av1_parser_new:
+ *
+ * Creates a new #GstAV1Parser. It should be freed with
+ * gst_av1_parser_free() after use.
+ *
+ * Returns: a new #GstAV1Parser
+ *
+ * Since: 1.18
+ */
+GstAV1Parser *
+gst_av1_parser_new (void)
+{
+  GstAV1Parser *parser;
+
+  INITIALIZE_DEBUG_CATEGORY;
+  GST_DEBUG ("Create AV1 Parser");
+
+  parser = g_slice_new0 (GstAV1Parser);
+  parser->priv = g_slice_new0 (GstAV1ParserPrivate);
+
+  return parser;
+}
+
+/**
+ * gst_av1_parser_reset:
+ * @parser: the #GstAV1Parser
+ *
+ * Forgets the sequence header and the reference frames, e.g. after a seek
+ * or when the stream changes.
+ *
+ * Since: 1.18
+ */
+void
+gst_av1_parser_reset (GstAV1Parser * parser)
+{
+  g_return_if_fail (parser != NULL);
+
+  memset (parser->priv, 0, sizeof (GstAV1ParserPrivate));
+  memset (&parser->seq_header, 0, sizeof (parser->seq_header));
+  parser->have_seq_header = FALSE;
+}
+
+/**
+ * gst_av1_parser_free:
+ * @parser: the #GstAV1Parser to free
+ *
+ * Frees @parser.
+ *
+ * Since: 1.18
+ */
+void
+gst_av1_parser_free (GstAV1Parser * parser)
+{
+  if (parser) {
+    if (parser->priv) {
+      g_slice_free (GstAV1ParserPrivate, parser->priv);
+      parser->priv = NULL;
+    }
+    g_slice_free (GstAV1Parser, parser);
+  }
+}
+
+/**
+ * gst_av1_read_leb128:
+ * @data: The data to parse
+ * @size: The size of @data
+ * @value: (out): the decoded value
+ * @len: (out): the number of bytes the value was coded with
+ *
+ * Reads a leb128() coded value (section 4.10.5), as used for obu_size and
+ * for the size fields of the Annex B format.
+ *
+ * Returns: %GST_AV1_PARSER_OK, %GST_AV1_PARSER_NO_MORE_DATA if @data ends
+ *   within the value, or %GST_AV1_PARSER_BROKEN_DATA if the value is not
+ *   valid
+ *
+ * Since: 1.18
+ */
+GstAV1ParserResult
+gst_av1_read_leb128 (const guint8 * data, gsize size, guint32 * value,
+    guint * len)
+{
+  guint64 v = 0;
+  guint i;
+
+  g_return_val_if_fail (data != NULL || size == 0, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (value != NULL, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (len != NULL, GST_AV1_PARSER_ERROR);
+
+  for (i = 0; i < 8; i++) {
+    if (i >= size)
+      return GST_AV1_PARSER_NO_MORE_DATA;
+
+    v |= ((guint64) (data[i] & 0x7f)) << (i * 7);
+    if (!(data[i] & 0x80)) {
+      if (v > G_MAXUINT32)
+        return GST_AV1_PARSER_BROKEN_DATA;
+      *value = v;
+      *len = i + 1;
+      return GST_AV1_PARSER_OK;
+    }
+  }
+
+  return GST_AV1_PARSER_BROKEN_DATA;
+}
+
+/**
+ * gst_av1_parser_identify_obu:
+ * @parser: The #GstAV1Parser
+ * @data: The data to parse, starting with an OBU header
+ * @size: The size of @data
+ * @obu: (out): The #GstAV1OBU to fill
+ *
+ * Parses the OBU header at the start of @data. If the OBU has no obu_size
+ * field it is assumed to extend to the end of @data, which is the case for
+ * the OBUs of the Annex B format when @size is the obu_length.
+ *
+ * Returns: a #GstAV1ParserResult, %GST_AV1_PARSER_NO_MORE_DATA if @data
+ *   does not contain the complete OBU
+ *
+ * Since: 1.18
+ */
+GstAV1ParserResult
+gst_av1_parser_identify_obu (GstAV1Parser * parser, const guint8 * data,
+    gsize size, GstAV1OBU * obu)
+{
+  GstAV1ParserResult res;
+  guint pos = 1, len;
+  guint32 obu_size;
+
+  g_return_val_if_fail (parser != NULL, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (data != NULL || size == 0, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (obu != NULL, GST_AV1_PARSER_ERROR);
+
+  memset (obu, 0, sizeof (*obu));
+
+  if (size < 1)
+    return GST_AV1_PARSER_NO_MORE_DATA;
+
+  if (data[0] & 0x80) {
+    GST_WARNING ("obu_forbidden_bit is set");
+    return GST_AV1_PARSER_BROKEN_DATA;
+  }
+
+  obu->header.obu_type = (data[0] >> 3) & 0x0f;
+  obu->header.obu_extention_flag = (data[0] >> 2) & 0x01;
+  obu->header.obu_has_size_field = (data[0] >> 1) & 0x01;
+
+  if (obu->header.obu_extention_flag) {
+    if (size < 2)
+      return GST_AV1_PARSER_NO_MORE_DATA;
+    obu->header.obu_temporal_id = data[1] >> 5;
+    obu->header.obu_spatial_id = (data[1] >> 3) & 0x03;
+    pos++;
+  }
+
+  if (obu->header.obu_has_size_field) {
+    res = gst_av1_read_leb128 (data + pos, size - pos, &obu_size, &len);
+    if (res != GST_AV1_PARSER_OK)
+      return res;
+    pos += len;
+
+    if (obu_size > size - pos)
+      return GST_AV1_PARSER_NO_MORE_DATA;
+  } else {
+    obu_size = size - pos;
+  }
+
+  obu->obu_size = obu_size;
+  obu->header_size = pos;
+  obu->data = data + pos;
+
+  GST_LOG ("obu type %d, size %u (header %u)", obu->header.obu_type,
+      obu->obu_size, obu->header_size);
+
+  return GST_AV1_PARSER_OK;
+}
+
+/**
+ * gst_av1_parser_parse_sequence_header_obu:
+ * @parser: The #GstAV1Parser
+ * @obu: a #GstAV1OBU of type %GST_AV1_OBU_SEQUENCE_HEADER
+ * @seq_header: (out): The #GstAV1SequenceHeaderOBU to fill
+ *
+ * Parses the sequence header OBU @obu. On success the sequence header is
+ * also kept in @parser, as it is needed to parse the frame headers.
+ *
+ * Returns: a #GstAV1ParserResult
+ *
+ * Since: 1.18
+ */
+GstAV1ParserResult
+gst_av1_parser_parse_sequence_header_obu (GstAV1Parser * parser,
+    const GstAV1OBU * obu, GstAV1SequenceHeaderOBU * seq_header)
+{
+  GstBitReader bit_reader;
+  GstBitReader *br = &bit_reader;
+  guint8 val;
+  guint i;
+
+  g_return_val_if_fail (parser != NULL, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (obu != NULL, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (obu->header.obu_type == GST_AV1_OBU_SEQUENCE_HEADER,
+      GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (seq_header != NULL, GST_AV1_PARSER_ERROR);
+
+  gst_bit_reader_init (br, obu->data, obu->obu_size);
+  memset (seq_header, 0, sizeof (*seq_header));
+
+  READ_UINT8 (br, val, 3);
+  if (val >= GST_AV1_PROFILE_UNDEFINED) {
+    GST_WARNING ("unsupported profile %d", val);
+    goto failed;
+  }
+  seq_header->seq_profile = val;
+
+  READ_BOOL (br, seq_header->still_picture);
+  READ_BOOL (br, seq_header->reduced_still_picture_header);
+
+  if (seq_header->reduced_still_picture_header) {
+    seq_header->operating_points_cnt_minus_1 = 0;
+    READ_UINT8 (br, seq_header->operating_points[0].seq_level_idx, 5);
+  } else {
+    READ_BOOL (br, seq_header->timing_info_present_flag);
+    if (seq_header->timing_info_present_flag) {
+      if (!gst_av1_parse_timing_info (br, &seq_header->timing_info))
+        goto failed;
+
+      READ_BOOL (br, seq_header->decoder_model_info_present_flag);
+      if (seq_header->decoder_model_info_present_flag &&
+          !gst_av1_parse_decoder_model_info (br,
+              &seq_header->decoder_model_info))
+        goto failed;
+    }
+
+    READ_BOOL (br, seq_header->initial_display_delay_present_flag);
+    READ_UINT8 (br, seq_header->operating_points_cnt_minus_1, 5);
+
+    for (i = 0; i <= seq_header->operating_points_cnt_minus_1; i++) {
+      GstAV1OperatingPoint *op = &seq_header->operating_points[i];
+
+      READ_UINT16 (br, op->idc, 12);
+      READ_UINT8 (br, op->seq_level_idx, 5);
+      if (op->seq_level_idx > 7)
+        READ_UINT8 (br, op->seq_tier, 1);
+
+      if (seq_header->decoder_model_info_present_flag) {
+        READ_BOOL (br, op->decoder_model_present_for_this_op);
+        if (op->decoder_model_present_for_this_op) {
+          guint n =
+              seq_header->decoder_model_info.buffer_delay_length_minus_1 + 1;
+
+          READ_UINT32 (br, op->decoder_buffer_delay, n);
+          READ_UINT32 (br, op->encoder_buffer_delay, n);
+          READ_BOOL (br, op->low_delay_mode_flag);
+        }
+      }
+
+      if (seq_header->initial_display_delay_present_flag) {
+        READ_BOOL (br, op->initial_display_delay_present_for_this_op);
+        if (op->initial_display_delay_present_for_this_op)
+          READ_UINT8 (br, op->initial_display_delay_minus_1, 4);
+      }
+    }
+  }
+
+  READ_UINT8 (br, seq_header->frame_width_bits_minus_1, 4);
+  READ_UINT8 (br, seq_header->frame_height_bits_minus_1, 4);
+  READ_UINT16 (br, seq_header->max_frame_width_minus_1,
+      seq_header->frame_width_bits_minus_1 + 1);
+  READ_UINT16 (br, seq_header->max_frame_height_minus_1,
+      seq_header->frame_height_bits_minus_1 + 1);
+
+  if (!seq_header->reduced_still_picture_header)
+    READ_BOOL (br, seq_header->frame_id_numbers_present_flag);
+  if (seq_header->frame_id_numbers_present_flag) {
+    READ_UINT8 (br, seq_header->delta_frame_id_length_minus_2, 4);
+    READ_UINT8 (br, seq_header->additional_frame_id_length_minus_1, 3);
+  }
+
+  READ_BOOL (br, seq_header->use_128x128_superblock);
+  READ_BOOL (br, seq_header->enable_filter_intra);
+  READ_BOOL (br, seq_header->enable_intra_edge_filter);
+
+  if (seq_header->reduced_still_picture_header) {
+    seq_header->seq_force_screen_content_tools =
+        GST_AV1_SELECT_SCREEN_CONTENT_TOOLS;
+    seq_header->seq_force_integer_mv = GST_AV1_SELECT_INTEGER_MV;
+  } else {
+    READ_BOOL (br, seq_header->enable_interintra_compound);
+    READ_BOOL (br, seq_header->enable_masked_compound);
+    READ_BOOL (br, seq_header->enable_warped_motion);
+    READ_BOOL (br, seq_header->enable_dual_filter);
+    READ_BOOL (br, seq_header->enable_order_hint);
+    if (seq_header->enable_order_hint) {
+      READ_BOOL (br, seq_header->enable_jnt_comp);
+      READ_BOOL (br, seq_header->enable_ref_frame_mvs);
+    }
+
+    READ_BOOL (br, seq_header->seq_choose_screen_content_tools);
+    if (seq_header->seq_choose_screen_content_tools)
+      seq_header->seq_force_screen_content_tools =
+          GST_AV1_SELECT_SCREEN_CONTENT_TOOLS;
+    else
+      READ_UINT8 (br, seq_header->seq_force_screen_content_tools, 1);
+
+    if (seq_header->seq_force_screen_content_tools > 0) {
+      READ_BOOL (br, seq_header->seq_choose_integer_mv);
+      if (seq_header->seq_choose_integer_mv)
+        seq_header->seq_force_integer_mv = GST_AV1_SELECT_INTEGER_MV;
+      else
+        READ_UINT8 (br, seq_header->seq_force_integer_mv, 1);
+    } else {
+      seq_header->seq_force_integer_mv = GST_AV1_SELECT_INTEGER_MV;
+    }
+
+    if (seq_header->enable_order_hint) {
+      READ_UINT8 (br, seq_header->order_hint_bits_minus_1, 3);
+      seq_header->order_hint_bits = seq_header->order_hint_bits_minus_1 + 1;
+    }
+  }
+
+  READ_BOOL (br, seq_header->enable_superres);
+  READ_BOOL (br, seq_header->enable_cdef);
+  READ_BOOL (br, seq_header->enable_restoration);
+
+  if (!gst_av1_parse_color_config (br, seq_header))
+    goto failed;
+
+  READ_BOOL (br, seq_header->film_grain_params_present);
+
+  GST_DEBUG ("sequence header: profile %d, %ux%u max, %u bit",
+      seq_header->seq_profile, seq_header->max_frame_width_minus_1 + 1,
+      seq_header->max_frame_height_minus_1 + 1,
+      seq_header->color_config.bit_depth);
+
+  parser->seq_header = *seq_header;
+  parser->have_seq_header = TRUE;
+
+  return GST_AV1_PARSER_OK;
+
+failed:
+  GST_WARNING ("error parsing sequence header");
+  return GST_AV1_PARSER_BROKEN_DATA;
+}
+
+/**
+ * gst_av1_parser_parse_frame_header_obu:
+ * @parser: The #GstAV1Parser
+ * @obu: a #GstAV1OBU of type %GST_AV1_OBU_FRAME_HEADER, %GST_AV1_OBU_FRAME
+ *   or %GST_AV1_OBU_REDUNDANT_FRAME_HEADER
+ * @frame_header: (out): The #GstAV1FrameHeaderOBU to fill
+ *
+ * Parses the leading part of the uncompressed frame header in @obu, up to
+ * and including the frame size, and updates the reference frame slots of
+ * @parser accordingly. A sequence header must have been parsed before.
+ *
+ * Redundant copies of a frame header should not be passed again, as the
+ * reference frame slots would be updated twice.
+ *
+ * Returns: a #GstAV1ParserResult
+ *
+ * Since: 1.18
+ */
+GstAV1ParserResult
+gst_av1_parser_parse_frame_header_obu (GstAV1Parser * parser,
+    const GstAV1OBU * obu, GstAV1FrameHeaderOBU * frame_header)
+{
+  GstAV1ParserPrivate *priv;
+  const GstAV1SequenceHeaderOBU *seq_header;
+  GstBitReader bit_reader;
+  GstBitReader *br = &bit_reader;
+  gboolean frame_is_intra;
+  guint id_len = 0;
+  guint8 val;
+  guint i;
+
+  g_return_val_if_fail (parser != NULL, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (obu != NULL, GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (obu->header.obu_type == GST_AV1_OBU_FRAME_HEADER ||
+      obu->header.obu_type == GST_AV1_OBU_FRAME ||
+      obu->header.obu_type == GST_AV1_OBU_REDUNDANT_FRAME_HEADER,
+      GST_AV1_PARSER_ERROR);
+  g_return_val_if_fail (frame_header != NULL, GST_AV1_PARSER_ERROR);
+
+  memset (frame_header, 0, sizeof (*frame_header));
+
+  if (!parser->have_seq_header) {
+    GST_DEBUG ("no sequence header yet");
+    return GST_AV1_PARSER_MISSING_OBU_REFERENCE;
+  }
+
+  priv = GST_AV1_PARSER_GET_PRIVATE (parser);
+  seq_header = &parser->seq_header;
+  gst_bit_reader_init (br, obu->data, obu->obu_size);
+
+  if (seq_header->frame_id_numbers_present_flag)
+    id_len = seq_header->additional_frame_id_length_minus_1 +
+        seq_header->delta_frame_id_length_minus_2 + 3;
+
+  if (seq_header->reduced_still_picture_header) {
+    frame_header->frame_type = GST_AV1_KEY_FRAME;
+    frame_header->show_frame = TRUE;
+    frame_header->error_resilient_mode = TRUE;
+  } else {
+    READ_BOOL (br, frame_header->show_existing_frame);
+    if (frame_header->show_existing_frame) {
+      const GstAV1ReferenceFrame *ref;
+
+      READ_UINT8 (br, frame_header->frame_to_show_map_idx, 3);
+      ref = &priv->ref[frame_header->frame_to_show_map_idx];
+      if (!ref->valid) {
+        GST_DEBUG ("frame to show %d was not seen",
+            frame_header->frame_to_show_map_idx);
+        return GST_AV1_PARSER_MISSING_OBU_REFERENCE;
+      }
+
+      /* temporal_point_info() */
+      if (seq_header->decoder_model_info_present_flag &&
+          !seq_header->timing_info.equal_picture_interval)
+        SKIP (br, seq_header->decoder_model_info.
+            frame_presentation_time_length_minus_1 + 1);
+      if (seq_header->frame_id_numbers_present_flag)
+        READ_UINT32 (br, frame_header->current_frame_id, id_len);
+
+      frame_header->show_frame = TRUE;
+      frame_header->frame_type = ref->frame_type;
+      frame_header->frame_size_known = ref->size_known;
+      frame_header->upscaled_width = ref->upscaled_width;
+      frame_header->frame_width = ref->frame_width;
+      frame_header->frame_height = ref->frame_height;
+      frame_header->render_width = ref->render_width;
+      frame_header->render_height = ref->render_height;
+      frame_header->order_hint = ref->order_hint;
+      if (frame_header->frame_type == GST_AV1_KEY_FRAME)
+        frame_header->refresh_frame_flags = 0xff;
+
+      goto done;
+    }
+
+    READ_UINT8 (br, val, 2);
+    frame_header->frame_type = val;
+    READ_BOOL (br, frame_header->show_frame);
+
+    if (frame_header->show_frame &&
+        seq_header->decoder_model_info_present_flag &&
+        !seq_header->timing_info.equal_picture_interval)
+      SKIP (br, seq_header->decoder_model_info.
+          frame_presentation_time_length_minus_1 + 1);
+
+    if (frame_header->show_frame)
+      frame_header->showable_frame =
+          frame_header->frame_type != GST_AV1_KEY_FRAME;
+    else
+      READ_BOOL (br, frame_header->showable_frame);
+
+    if (frame_header->frame_type == GST_AV1_SWITCH_FRAME ||
+        (frame_header->frame_type == GST_AV1_KEY_FRAME &&
+            frame_header->show_frame))
+      frame_header->error_resilient_mode = TRUE;
+    else
+      READ_BOOL (br, frame_header->error_resilient_mode);
+  }
+
+  frame_is_intra = frame_header->frame_type == GST_AV1_KEY_FRAME ||
+      frame_header->frame_type == GST_AV1_INTRA_ONLY_FRAME;
+
+  READ_BOOL (br, frame_header->disable_cdf_update);
+
+  if (seq_header->seq_force_screen_content_tools ==
+      GST_AV1_SELECT_SCREEN_CONTENT_TOOLS)
+    READ_UINT8 (br, frame_header->allow_screen_content_tools, 1);
+  else
+    frame_header->allow_screen_content_tools =
+        seq_header->seq_force_screen_content_tools;
+
+  if (frame_header->allow_screen_content_tools) {
+    if (seq_header->seq_force_integer_mv == GST_AV1_SELECT_INTEGER_MV)
+      READ_UINT8 (br, frame_header->force_integer_mv, 1);
+    else
+      frame_header->force_integer_mv = seq_header->seq_force_integer_mv;
+  }
+  if (frame_is_intra)
+    frame_header->force_integer_mv = 1;
+
+  if (seq_header->frame_id_numbers_present_flag)
+    READ_UINT32 (br, frame_header->current_frame_id, id_len);
+
+  if (frame_header->frame_type == GST_AV1_SWITCH_FRAME)
+    frame_header->frame_size_override_flag = TRUE;
+  else if (!seq_header->reduced_still_picture_header)
+    READ_BOOL (br, frame_header->frame_size_override_flag);
+
+  if (seq_header->order_hint_bits)
+    READ_UINT32 (br, frame_header->order_hint, seq_header->order_hint_bits);
+
+  if (frame_is_intra || frame_header->error_resilient_mode)
+    frame_header->primary_ref_frame = GST_AV1_PRIMARY_REF_NONE;
+  else
+    READ_UINT8 (br, frame_header->primary_ref_frame, 3);
+
+  if (seq_header->decoder_model_info_present_flag) {
+    gboolean buffer_removal_time_present_flag;
+
+    READ_BOOL (br, buffer_removal_time_present_flag);
+    if (buffer_removal_time_present_flag) {
+      for (i = 0; i <= seq_header->operating_points_cnt_minus_1; i++) {
+        const GstAV1OperatingPoint *op = &seq_header->operating_points[i];
+        gboolean in_temporal_layer, in_spatial_layer;
+
+        if (!op->decoder_model_present_for_this_op)
+          continue;
+
+        in_temporal_layer = (op->idc >> obu->header.obu_temporal_id) & 1;
+        in_spatial_layer = (op->idc >> (obu->header.obu_spatial_id + 8)) & 1;
+        if (op->idc == 0 || (in_temporal_layer && in_spatial_layer))
+          SKIP (br, seq_header->decoder_model_info.
+              buffer_removal_time_length_minus_1 + 1);
+      }
+    }
+  }
+
+  if (frame_header->frame_type == GST_AV1_SWITCH_FRAME ||
+      (frame_header->frame_type == GST_AV1_KEY_FRAME &&
+          frame_header->show_frame))
+    frame_header->refresh_frame_flags = 0xff;
+  else
+    READ_UINT8 (br, frame_header->refresh_frame_flags, 8);
+
+  if (frame_header->frame_type == GST_AV1_INTRA_ONLY_FRAME &&
+      frame_header->refresh_frame_flags == 0xff) {
+    GST_WARNING ("intra only frame refreshes all references");
+    goto failed;
+  }
+
+  if ((!frame_is_intra || frame_header->refresh_frame_flags != 0xff) &&
+      frame_header->error_resilient_mode && seq_header->enable_order_hint) {
+    for (i = 0; i < GST_AV1_NUM_REF_FRAMES; i++) {
+      guint32 ref_order_hint;
+
+      READ_UINT32 (br, ref_order_hint, seq_header->order_hint_bits);
+      if (ref_order_hint != priv->ref[i].order_hint) {
+        priv->ref[i].valid = FALSE;
+        priv->ref[i].order_hint = ref_order_hint;
+      }
+    }
+  }
+
+  frame_header->frame_size_known = TRUE;
+
+  if (frame_is_intra) {
+    if (!gst_av1_parse_frame_size (br, seq_header, frame_header) ||
+        !gst_av1_parse_render_size (br, frame_header))
+      goto failed;
+
+    if (frame_header->allow_screen_content_tools &&
+        frame_header->upscaled_width == frame_header->frame_width)
+      READ_BOOL (br, frame_header->allow_intrabc);
+  } else {
+    if (seq_header->enable_order_hint)
+      READ_BOOL (br, frame_header->frame_refs_short_signaling);
+
+    if (frame_header->frame_refs_short_signaling) {
+      /* only LAST_FRAME and GOLDEN_FRAME are signalled, the others are
+       * derived by the set_frame_refs() process of section 7.8, which needs
+       * the order hints of all references and is not done here */
+      READ_UINT8 (br, frame_header->ref_frame_idx[0], 3);
+      READ_UINT8 (br, frame_header->ref_frame_idx[3], 3);
+    }
+
+    for (i = 0; i < GST_AV1_REFS_PER_FRAME; i++) {
+      if (!frame_header->frame_refs_short_signaling)
+        READ_UINT8 (br, frame_header->ref_frame_idx[i], 3);
+      if (seq_header->frame_id_numbers_present_flag)
+        SKIP (br, seq_header->delta_frame_id_length_minus_2 + 2);
+    }
+
+    if (frame_header->frame_size_override_flag &&
+        !frame_header->error_resilient_mode) {
+      if (frame_header->frame_refs_short_signaling) {
+        GST_DEBUG ("frame size of short signaled references is unknown");
+        frame_header->frame_size_known = FALSE;
+      } else if (!gst_av1_parse_frame_size_with_refs (parser, br,
+              frame_header)) {
+        goto failed;
+      }
+    } else {
+      if (!gst_av1_parse_frame_size (br, seq_header, frame_header) ||
+          !gst_av1_parse_render_size (br, frame_header))
+        goto failed;
+    }
+  }
+
+done:
+  GST_LOG ("frame header: type %d, show_frame %d, show_existing_frame %d, "
+      "%ux%u", frame_header->frame_type, frame_header->show_frame,
+      frame_header->show_existing_frame, frame_header->frame_width,
+      frame_header->frame_height);
+
+  gst_av1_parser_update_references (parser, frame_header);
+
+  return GST_AV1_PARSER_OK;
+
+failed:
+  GST_WARNING ("error parsing frame header");
+  return GST_AV1_PARSER_BROKEN_DATA;
+}
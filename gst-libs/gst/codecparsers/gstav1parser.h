@@ -0,0 +1,646 @@
+/* GStreamer
+ *
+ * gstav1parser.h: AV1 OBU bitstream parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef GST_AV1_PARSER_H
+#define GST_AV1_PARSER_H
+
+#ifndef GST_USE_UNSTABLE_API
+#warning "The AV1 parsing library is unstable API and may change in future."
+#warning "You can define GST_USE_UNSTABLE_API to avoid this warning."
+#endif
+
+#include <gst/gst.h>
+#include <gst/codecparsers/codecparsers-prelude.h>
+
+G_BEGIN_DECLS
+
+#define GST_AV1_MAX_OPERATING_POINTS  32
+#define GST_AV1_NUM_REF_FRAMES        8
+#define GST_AV1_REFS_PER_FRAME        7
+#define GST_AV1_PRIMARY_REF_NONE      7
+#define GST_AV1_SUPERRES_NUM          8
+#define GST_AV1_SUPERRES_DENOM_MIN    9
+#define GST_AV1_SUPERRES_DENOM_BITS   3
+
+#define GST_AV1_SELECT_SCREEN_CONTENT_TOOLS 2
+#define GST_AV1_SELECT_INTEGER_MV           2
+
+typedef struct _GstAV1Parser               GstAV1Parser;
+typedef struct _GstAV1OBUHeader            GstAV1OBUHeader;
+typedef struct _GstAV1OBU                  GstAV1OBU;
+typedef struct _GstAV1OperatingPoint       GstAV1OperatingPoint;
+typedef struct _GstAV1TimingInfo           GstAV1TimingInfo;
+typedef struct _GstAV1DecoderModelInfo     GstAV1DecoderModelInfo;
+typedef struct _GstAV1ColorConfig          GstAV1ColorConfig;
+typedef struct _GstAV1SequenceHeaderOBU    GstAV1SequenceHeaderOBU;
+typedef struct _GstAV1FrameHeaderOBU       GstAV1FrameHeaderOBU;
+
+/**
+ * GstAV1ParserResult:
+ * @GST_AV1_PARSER_OK: The parsing went well
+ * @GST_AV1_PARSER_BROKEN_DATA: The data to parse is broken
+ * @GST_AV1_PARSER_NO_MORE_DATA: The data ends before the end of the OBU
+ * @GST_AV1_PARSER_MISSING_OBU_REFERENCE: A sequence header is needed
+ *   before this OBU can be parsed
+ * @GST_AV1_PARSER_ERROR: An error occured during the parsing
+ *
+ * Result type of any parsing function.
+ *
+ * Since: 1.18
+ */
+typedef enum
+{
+  GST_AV1_PARSER_OK,
+  GST_AV1_PARSER_BROKEN_DATA,
+  GST_AV1_PARSER_NO_MORE_DATA,
+  GST_AV1_PARSER_MISSING_OBU_REFERENCE,
+  GST_AV1_PARSER_ERROR
+} GstAV1ParserResult;
+
+/**
+ * GstAV1OBUType:
+ * @GST_AV1_OBU_RESERVED_0: reserved
+ * @GST_AV1_OBU_SEQUENCE_HEADER: sequence header
+ * @GST_AV1_OBU_TEMPORAL_DELIMITER: temporal delimiter, starts a temporal unit
+ * @GST_AV1_OBU_FRAME_HEADER: frame header
+ * @GST_AV1_OBU_TILE_GROUP: tile group
+ * @GST_AV1_OBU_METADATA: metadata
+ * @GST_AV1_OBU_FRAME: frame header followed by a tile group
+ * @GST_AV1_OBU_REDUNDANT_FRAME_HEADER: copy of a previous frame header
+ * @GST_AV1_OBU_TILE_LIST: tile list, for large scale tile decoding
+ * @GST_AV1_OBU_PADDING: padding
+ *
+ * Type of an Open Bitstream Unit, see section 6.2.2 of the AV1
+ * specification.
+ *
+ * Since: 1.18
+ */
+typedef enum
+{
+  GST_AV1_OBU_RESERVED_0 = 0,
+  GST_AV1_OBU_SEQUENCE_HEADER = 1,
+  GST_AV1_OBU_TEMPORAL_DELIMITER = 2,
+  GST_AV1_OBU_FRAME_HEADER = 3,
+  GST_AV1_OBU_TILE_GROUP = 4,
+  GST_AV1_OBU_METADATA = 5,
+  GST_AV1_OBU_FRAME = 6,
+  GST_AV1_OBU_REDUNDANT_FRAME_HEADER = 7,
+  GST_AV1_OBU_TILE_LIST = 8,
+  GST_AV1_OBU_PADDING = 15
+} GstAV1OBUType;
+
+/**
+ * GstAV1Profile:
+ * @GST_AV1_PROFILE_0: Main profile, 8 and 10 bit 4:2:0 and monochrome
+ * @GST_AV1_PROFILE_1: High profile, adds 4:4:4
+ * @GST_AV1_PROFILE_2: Professional profile, adds 4:2:2 and 12 bit
+ * @GST_AV1_PROFILE_UNDEFINED: Undefined profile
+ *
+ * AV1 Profiles
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_AV1_PROFILE_0,
+  GST_AV1_PROFILE_1,
+  GST_AV1_PROFILE_2,
+  GST_AV1_PROFILE_UNDEFINED
+} GstAV1Profile;
+
+/**
+ * GstAV1FrameType:
+ * @GST_AV1_KEY_FRAME: Key frame, resets all references when shown
+ * @GST_AV1_INTER_FRAME: Inter frame
+ * @GST_AV1_INTRA_ONLY_FRAME: Intra only frame, does not reset references
+ * @GST_AV1_SWITCH_FRAME: Switch frame, for switching between streams
+ *
+ * AV1 frame types
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_AV1_KEY_FRAME = 0,
+  GST_AV1_INTER_FRAME = 1,
+  GST_AV1_INTRA_ONLY_FRAME = 2,
+  GST_AV1_SWITCH_FRAME = 3
+} GstAV1FrameType;
+
+/**
+ * GstAV1ColorPrimaries:
+ * @GST_AV1_CP_BT_709: BT.709
+ * @GST_AV1_CP_UNSPECIFIED: Unspecified
+ * @GST_AV1_CP_BT_470_M: BT.470 System M (historical)
+ * @GST_AV1_CP_BT_470_B_G: BT.470 System B, G (historical)
+ * @GST_AV1_CP_BT_601: BT.601
+ * @GST_AV1_CP_SMPTE_240: SMPTE 240
+ * @GST_AV1_CP_GENERIC_FILM: Generic film (color filters using illuminant C)
+ * @GST_AV1_CP_BT_2020: BT.2020, BT.2100
+ * @GST_AV1_CP_XYZ: SMPTE 428 (CIE 1921 XYZ)
+ * @GST_AV1_CP_SMPTE_431: SMPTE RP 431-2
+ * @GST_AV1_CP_SMPTE_432: SMPTE EG 432-1
+ * @GST_AV1_CP_EBU_3213: EBU Tech. 3213-E
+ *
+ * Color primaries as signalled in the color config, see section 6.4.2 of
+ * the AV1 specification.
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_AV1_CP_BT_709 = 1,
+  GST_AV1_CP_UNSPECIFIED = 2,
+  GST_AV1_CP_BT_470_M = 4,
+  GST_AV1_CP_BT_470_B_G = 5,
+  GST_AV1_CP_BT_601 = 6,
+  GST_AV1_CP_SMPTE_240 = 7,
+  GST_AV1_CP_GENERIC_FILM = 8,
+  GST_AV1_CP_BT_2020 = 9,
+  GST_AV1_CP_XYZ = 10,
+  GST_AV1_CP_SMPTE_431 = 11,
+  GST_AV1_CP_SMPTE_432 = 12,
+  GST_AV1_CP_EBU_3213 = 22
+} GstAV1ColorPrimaries;
+
+/**
+ * GstAV1TransferCharacteristics:
+ * @GST_AV1_TC_RESERVED_0: reserved
+ * @GST_AV1_TC_BT_709: BT.709
+ * @GST_AV1_TC_UNSPECIFIED: Unspecified
+ * @GST_AV1_TC_RESERVED_3: reserved
+ * @GST_AV1_TC_BT_470_M: BT.470 System M (historical)
+ * @GST_AV1_TC_BT_470_B_G: BT.470 System B, G (historical)
+ * @GST_AV1_TC_BT_601: BT.601
+ * @GST_AV1_TC_SMPTE_240: SMPTE 240 M
+ * @GST_AV1_TC_LINEAR: Linear
+ * @GST_AV1_TC_LOG_100: Logarithmic (100 : 1 range)
+ * @GST_AV1_TC_LOG_100_SQRT10: Logarithmic (100 * Sqrt(10) : 1 range)
+ * @GST_AV1_TC_IEC_61966: IEC 61966-2-4
+ * @GST_AV1_TC_BT_1361: BT.1361
+ * @GST_AV1_TC_SRGB: sRGB or sYCC
+ * @GST_AV1_TC_BT_2020_10_BIT: BT.2020 10-bit systems
+ * @GST_AV1_TC_BT_2020_12_BIT: BT.2020 12-bit systems
+ * @GST_AV1_TC_SMPTE_2084: SMPTE ST 2084, ITU BT.2100 PQ
+ * @GST_AV1_TC_SMPTE_428: SMPTE ST 428
+ * @GST_AV1_TC_HLG: BT.2100 HLG, ARIB STD-B67
+ *
+ * Transfer characteristics as signalled in the color config, see section
+ * 6.4.2 of the AV1 specification.
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_AV1_TC_RESERVED_0 = 0,
+  GST_AV1_TC_BT_709 = 1,
+  GST_AV1_TC_UNSPECIFIED = 2,
+  GST_AV1_TC_RESERVED_3 = 3,
+  GST_AV1_TC_BT_470_M = 4,
+  GST_AV1_TC_BT_470_B_G = 5,
+  GST_AV1_TC_BT_601 = 6,
+  GST_AV1_TC_SMPTE_240 = 7,
+  GST_AV1_TC_LINEAR = 8,
+  GST_AV1_TC_LOG_100 = 9,
+  GST_AV1_TC_LOG_100_SQRT10 = 10,
+  GST_AV1_TC_IEC_61966 = 11,
+  GST_AV1_TC_BT_1361 = 12,
+  GST_AV1_TC_SRGB = 13,
+  GST_AV1_TC_BT_2020_10_BIT = 14,
+  GST_AV1_TC_BT_2020_12_BIT = 15,
+  GST_AV1_TC_SMPTE_2084 = 16,
+  GST_AV1_TC_SMPTE_428 = 17,
+  GST_AV1_TC_HLG = 18
+} GstAV1TransferCharacteristics;
+
+/**
+ * GstAV1MatrixCoefficients:
+ * @GST_AV1_MC_IDENTITY: Identity matrix
+ * @GST_AV1_MC_BT_709: BT.709
+ * @GST_AV1_MC_UNSPECIFIED: Unspecified
+ * @GST_AV1_MC_RESERVED_3: reserved
+ * @GST_AV1_MC_FCC: US FCC 73.628
+ * @GST_AV1_MC_BT_470_B_G: BT.470 System B, G (historical)
+ * @GST_AV1_MC_BT_601: BT.601
+ * @GST_AV1_MC_SMPTE_240: SMPTE 240 M
+ * @GST_AV1_MC_SMPTE_YCGCO: YCgCo
+ * @GST_AV1_MC_BT_2020_NCL: BT.2020 non-constant luminance, BT.2100 YCbCr
+ * @GST_AV1_MC_BT_2020_CL: BT.2020 constant luminance
+ * @GST_AV1_MC_SMPTE_2085: SMPTE ST 2085 YDzDx
+ * @GST_AV1_MC_CHROMAT_NCL: Chromaticity-derived non-constant luminance
+ * @GST_AV1_MC_CHROMAT_CL: Chromaticity-derived constant luminance
+ * @GST_AV1_MC_ICTCP: BT.2100 ICtCp
+ *
+ * Matrix coefficients as signalled in the color config, see section 6.4.2
+ * of the AV1 specification.
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_AV1_MC_IDENTITY = 0,
+  GST_AV1_MC_BT_709 = 1,
+  GST_AV1_MC_UNSPECIFIED = 2,
+  GST_AV1_MC_RESERVED_3 = 3,
+  GST_AV1_MC_FCC = 4,
+  GST_AV1_MC_BT_470_B_G = 5,
+  GST_AV1_MC_BT_601 = 6,
+  GST_AV1_MC_SMPTE_240 = 7,
+  GST_AV1_MC_SMPTE_YCGCO = 8,
+  GST_AV1_MC_BT_2020_NCL = 9,
+  GST_AV1_MC_BT_2020_CL = 10,
+  GST_AV1_MC_SMPTE_2085 = 11,
+  GST_AV1_MC_CHROMAT_NCL = 12,
+  GST_AV1_MC_CHROMAT_CL = 13,
+  GST_AV1_MC_ICTCP = 14
+} GstAV1MatrixCoefficients;
+
+/**
+ * GstAV1ChromaSamplePosition:
+ * @GST_AV1_CSP_UNKNOWN: Unknown (in this case the source video transfer
+ *   function must be signaled outside the AV1 bitstream)
+ * @GST_AV1_CSP_VERTICAL: Horizontally co-located with (0, 0) luma sample,
+ *   vertical position in the middle between two luma samples
+ * @GST_AV1_CSP_COLOCATED: co-located with (0, 0) luma sample
+ * @GST_AV1_CSP_RESERVED: reserved
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_AV1_CSP_UNKNOWN = 0,
+  GST_AV1_CSP_VERTICAL = 1,
+  GST_AV1_CSP_COLOCATED = 2,
+  GST_AV1_CSP_RESERVED = 3
+} GstAV1ChromaSamplePosition;
+
+/**
+ * GstAV1OBUHeader:
+ * @obu_type: the #GstAV1OBUType
+ * @obu_extention_flag: whether the extension header is present
+ * @obu_has_size_field: whether the obu_size field is present
+ * @obu_temporal_id: temporal layer of the OBU, from the extension header
+ * @obu_spatial_id: spatial layer of the OBU, from the extension header
+ *
+ * OBU header, see section 5.3.
+ *
+ * Since: 1.18
+ */
+struct _GstAV1OBUHeader {
+  GstAV1OBUType obu_type;
+  gboolean obu_extention_flag;
+  gboolean obu_has_size_field;
+  guint8 obu_temporal_id;
+  guint8 obu_spatial_id;
+};
+
+/**
+ * GstAV1OBU:
+ * @header: the #GstAV1OBUHeader
+ * @obu_size: size of the OBU payload, after the header and size field
+ * @header_size: size of the OBU header, including the extension header and
+ *   the obu_size field if present
+ * @data: the OBU payload, pointing into the parsed data
+ *
+ * An Open Bitstream Unit as found by gst_av1_parser_identify_obu(). The
+ * whole OBU spans @header_size + @obu_size bytes.
+ *
+ * Since: 1.18
+ */
+struct _GstAV1OBU {
+  GstAV1OBUHeader header;
+  guint32 obu_size;
+  guint header_size;
+  const guint8 *data;
+};
+
+/**
+ * GstAV1OperatingPoint:
+ * @idc: operating_point_idc, which temporal and spatial layers the operating
+ *   point decodes (0 if all)
+ * @seq_level_idx: level of the operating point
+ * @seq_tier: tier of the operating point
+ * @decoder_model_present_for_this_op: whether the decoder model parameters
+ *   are present
+ * @decoder_buffer_delay: decoder buffer delay, in decoding ticks
+ * @encoder_buffer_delay: encoder buffer delay, in decoding ticks
+ * @low_delay_mode_flag: whether the operating point is in low delay mode
+ * @initial_display_delay_present_for_this_op: whether
+ *   @initial_display_delay_minus_1 is present
+ * @initial_display_delay_minus_1: number of decoded frames that should be
+ *   present in the buffer pool before display starts, minus 1
+ *
+ * Since: 1.18
+ */
+struct _GstAV1OperatingPoint {
+  guint16 idc;
+  guint8 seq_level_idx;
+  guint8 seq_tier;
+  gboolean decoder_model_present_for_this_op;
+  guint32 decoder_buffer_delay;
+  guint32 encoder_buffer_delay;
+  gboolean low_delay_mode_flag;
+  gboolean initial_display_delay_present_for_this_op;
+  guint8 initial_display_delay_minus_1;
+};
+
+/**
+ * GstAV1TimingInfo:
+ * @num_units_in_display_tick: number of time units of a clock at @time_scale
+ *   that corresponds to one display tick
+ * @time_scale: number of time units that pass in one second
+ * @equal_picture_interval: whether pictures are displayed at a constant
+ *   rate of @num_ticks_per_picture_minus_1 + 1 display ticks
+ * @num_ticks_per_picture_minus_1: number of display ticks per picture,
+ *   minus 1
+ *
+ * Since: 1.18
+ */
+struct _GstAV1TimingInfo {
+  guint32 num_units_in_display_tick;
+  guint32 time_scale;
+  gboolean equal_picture_interval;
+  guint32 num_ticks_per_picture_minus_1;
+};
+
+/**
+ * GstAV1DecoderModelInfo:
+ * @buffer_delay_length_minus_1: length of the buffer delay fields, minus 1
+ * @num_units_in_decoding_tick: number of time units of a decoding tick
+ * @buffer_removal_time_length_minus_1: length of the buffer_removal_time
+ *   fields of the frame header, minus 1
+ * @frame_presentation_time_length_minus_1: length of the
+ *   frame_presentation_time fields of the frame header, minus 1
+ *
+ * Since: 1.18
+ */
+struct _GstAV1DecoderModelInfo {
+  guint8 buffer_delay_length_minus_1;
+  guint32 num_units_in_decoding_tick;
+  guint8 buffer_removal_time_length_minus_1;
+  guint8 frame_presentation_time_length_minus_1;
+};
+
+/**
+ * GstAV1ColorConfig:
+ * @high_bitdepth: together with @twelve_bit, selects the bit depth
+ * @twelve_bit: whether the bit depth is 12 (profile 2 only)
+ * @bit_depth: the resulting bit depth, 8, 10 or 12
+ * @mono_chrome: whether the video is monochrome
+ * @color_description_present_flag: whether @color_primaries,
+ *   @transfer_characteristics and @matrix_coefficients are present
+ * @color_primaries: a #GstAV1ColorPrimaries
+ * @transfer_characteristics: a #GstAV1TransferCharacteristics
+ * @matrix_coefficients: a #GstAV1MatrixCoefficients
+ * @color_range: 0 for studio swing, 1 for full swing
+ * @subsampling_x: horizontal chroma subsampling
+ * @subsampling_y: vertical chroma subsampling
+ * @chroma_sample_position: a #GstAV1ChromaSamplePosition
+ * @separate_uv_delta_q: whether the U and V planes may have separate delta
+ *   quantizer values
+ *
+ * Since: 1.18
+ */
+struct _GstAV1ColorConfig {
+  gboolean high_bitdepth;
+  gboolean twelve_bit;
+  guint8 bit_depth;
+  gboolean mono_chrome;
+  gboolean color_description_present_flag;
+  GstAV1ColorPrimaries color_primaries;
+  GstAV1TransferCharacteristics transfer_characteristics;
+  GstAV1MatrixCoefficients matrix_coefficients;
+  gboolean color_range;
+  guint8 subsampling_x;
+  guint8 subsampling_y;
+  GstAV1ChromaSamplePosition chroma_sample_position;
+  gboolean separate_uv_delta_q;
+};
+
+/**
+ * GstAV1SequenceHeaderOBU:
+ * @seq_profile: the #GstAV1Profile
+ * @still_picture: whether the stream is a single coded frame
+ * @reduced_still_picture_header: whether the syntax elements not needed by
+ *   a still picture are omitted
+ * @timing_info_present_flag: whether @timing_info is present
+ * @timing_info: the #GstAV1TimingInfo
+ * @decoder_model_info_present_flag: whether @decoder_model_info is present
+ * @decoder_model_info: the #GstAV1DecoderModelInfo
+ * @initial_display_delay_present_flag: whether initial display delays are
+ *   present for the operating points
+ * @operating_points_cnt_minus_1: number of operating points, minus 1
+ * @operating_points: the #GstAV1OperatingPoint
+ * @frame_width_bits_minus_1: number of bits of the frame width fields,
+ *   minus 1
+ * @frame_height_bits_minus_1: number of bits of the frame height fields,
+ *   minus 1
+ * @max_frame_width_minus_1: maximum frame width, minus 1
+ * @max_frame_height_minus_1: maximum frame height, minus 1
+ * @frame_id_numbers_present_flag: whether frame ids are present
+ * @delta_frame_id_length_minus_2: number of bits of delta_frame_id_minus_1,
+ *   minus 2
+ * @additional_frame_id_length_minus_1: number of additional bits of the frame
+ *   ids, minus 1
+ * @use_128x128_superblock: whether superblocks are 128x128 instead of 64x64
+ * @enable_filter_intra: whether filter intra may be used
+ * @enable_intra_edge_filter: whether the intra edge filter may be used
+ * @enable_interintra_compound: whether inter-intra compound may be used
+ * @enable_masked_compound: whether masked compound may be used
+ * @enable_warped_motion: whether warped motion may be used
+ * @enable_dual_filter: whether dual filters may be used
+ * @enable_order_hint: whether order hints are present
+ * @enable_jnt_comp: whether distance weights may be used
+ * @enable_ref_frame_mvs: whether reference frame motion vectors may be used
+ * @seq_choose_screen_content_tools: whether each frame signals
+ *   allow_screen_content_tools
+ * @seq_force_screen_content_tools: allow_screen_content_tools of all
+ *   frames, or %GST_AV1_SELECT_SCREEN_CONTENT_TOOLS
+ * @seq_choose_integer_mv: whether each frame signals force_integer_mv
+ * @seq_force_integer_mv: force_integer_mv of all frames, or
+ *   %GST_AV1_SELECT_INTEGER_MV
+ * @order_hint_bits_minus_1: number of bits of the order hints, minus 1
+ * @order_hint_bits: number of bits of the order hints, 0 if not present
+ * @enable_superres: whether superres may be used
+ * @enable_cdef: whether CDEF filtering may be used
+ * @enable_restoration: whether loop restoration may be used
+ * @color_config: the #GstAV1ColorConfig
+ * @film_grain_params_present: whether film grain parameters are present
+ *
+ * Sequence header OBU, see section 5.5.
+ *
+ * Since: 1.18
+ */
+struct _GstAV1SequenceHeaderOBU {
+  GstAV1Profile seq_profile;
+  gboolean still_picture;
+  gboolean reduced_still_picture_header;
+
+  gboolean timing_info_present_flag;
+  GstAV1TimingInfo timing_info;
+  gboolean decoder_model_info_present_flag;
+  GstAV1DecoderModelInfo decoder_model_info;
+  gboolean initial_display_delay_present_flag;
+  guint8 operating_points_cnt_minus_1;
+  GstAV1OperatingPoint operating_points[GST_AV1_MAX_OPERATING_POINTS];
+
+  guint8 frame_width_bits_minus_1;
+  guint8 frame_height_bits_minus_1;
+  guint16 max_frame_width_minus_1;
+  guint16 max_frame_height_minus_1;
+  gboolean frame_id_numbers_present_flag;
+  guint8 delta_frame_id_length_minus_2;
+  guint8 additional_frame_id_length_minus_1;
+
+  gboolean use_128x128_superblock;
+  gboolean enable_filter_intra;
+  gboolean enable_intra_edge_filter;
+  gboolean enable_interintra_compound;
+  gboolean enable_masked_compound;
+  gboolean enable_warped_motion;
+  gboolean enable_dual_filter;
+  gboolean enable_order_hint;
+  gboolean enable_jnt_comp;
+  gboolean enable_ref_frame_mvs;
+  gboolean seq_choose_screen_content_tools;
+  guint8 seq_force_screen_content_tools;
+  gboolean seq_choose_integer_mv;
+  guint8 seq_force_integer_mv;
+  guint8 order_hint_bits_minus_1;
+  guint8 order_hint_bits;
+  gboolean enable_superres;
+  gboolean enable_cdef;
+  gboolean enable_restoration;
+
+  GstAV1ColorConfig color_config;
+
+  gboolean film_grain_params_present;
+};
+
+/**
+ * GstAV1FrameHeaderOBU:
+ * @show_existing_frame: whether the frame in @frame_to_show_map_idx is to
+ *   be output instead of decoding a new frame
+ * @frame_to_show_map_idx: reference slot of the frame to output
+ * @frame_type: the #GstAV1FrameType
+ * @show_frame: whether the frame is output immediately
+ * @showable_frame: whether the frame may be output later with
+ *   @show_existing_frame
+ * @error_resilient_mode: whether error resilient mode is enabled
+ * @disable_cdf_update: whether CDF updates are disabled
+ * @allow_screen_content_tools: whether palette and intra block copy may be
+ *   used
+ * @force_integer_mv: whether motion vectors are integer
+ * @current_frame_id: frame id, if frame ids are present
+ * @frame_size_override_flag: whether the frame size is coded in the frame
+ *   header instead of taken from the sequence header
+ * @order_hint: order hint of the frame
+ * @primary_ref_frame: reference frame the probabilities are loaded from, or
+ *   %GST_AV1_PRIMARY_REF_NONE
+ * @refresh_frame_flags: bitmask of the reference slots the frame is stored
+ *   into
+ * @frame_refs_short_signaling: whether the references are derived from
+ *   @last_frame_idx and @gold_frame_idx
+ * @ref_frame_idx: reference slots used by inter frames
+ * @frame_size_known: whether @frame_width and the following sizes could be
+ *   derived; they can not for inter frames that use short reference
+ *   signaling and take their size from a reference
+ * @frame_width: width of the coded frame
+ * @frame_height: height of the coded frame
+ * @upscaled_width: width of the frame after superres upscaling
+ * @render_width: intended display width
+ * @render_height: intended display height
+ * @use_superres: whether superres is used
+ * @superres_denom: superres scale denominator, %GST_AV1_SUPERRES_NUM if not
+ *   used
+ * @allow_intrabc: whether intra block copy may be used
+ *
+ * The leading part of the uncompressed frame header, see section 5.9, up to
+ * and including the frame size. This is what is needed to classify and
+ * size frames; the coding tool parameters that follow are not parsed.
+ *
+ * Since: 1.18
+ */
+struct _GstAV1FrameHeaderOBU {
+  gboolean show_existing_frame;
+  guint8 frame_to_show_map_idx;
+  GstAV1FrameType frame_type;
+  gboolean show_frame;
+  gboolean showable_frame;
+  gboolean error_resilient_mode;
+  gboolean disable_cdf_update;
+  guint8 allow_screen_content_tools;
+  guint8 force_integer_mv;
+  guint32 current_frame_id;
+  gboolean frame_size_override_flag;
+  guint32 order_hint;
+  guint8 primary_ref_frame;
+  guint8 refresh_frame_flags;
+  gboolean frame_refs_short_signaling;
+  guint8 ref_frame_idx[GST_AV1_REFS_PER_FRAME];
+
+  gboolean frame_size_known;
+  guint32 frame_width;
+  guint32 frame_height;
+  guint32 upscaled_width;
+  guint32 render_width;
+  guint32 render_height;
+  gboolean use_superres;
+  guint8 superres_denom;
+  gboolean allow_intrabc;
+};
+
+/**
+ * GstAV1Parser:
+ * @priv: private state, the reference frame slots
+ * @seq_header: the last parsed sequence header, valid if @have_seq_header
+ * @have_seq_header: whether a sequence header was parsed
+ *
+ * Parser context that needs to be live across OBUs
+ *
+ * Since: 1.18
+ */
+struct _GstAV1Parser
+{
+  /* private struct for tracking state variables across frames */
+  void *priv;
+
+  GstAV1SequenceHeaderOBU seq_header;
+  gboolean have_seq_header;
+};
+
+GST_CODEC_PARSERS_API
+GstAV1Parser *     gst_av1_parser_new (void);
+
+GST_CODEC_PARSERS_API
+void               gst_av1_parser_reset (GstAV1Parser * parser);
+
+GST_CODEC_PARSERS_API
+GstAV1ParserResult gst_av1_read_leb128 (const guint8 * data, gsize size, guint32 * value, guint * len);
+
+GST_CODEC_PARSERS_API
+GstAV1ParserResult gst_av1_parser_identify_obu (GstAV1Parser * parser, const guint8 * data, gsize size, GstAV1OBU * obu);
+
+GST_CODEC_PARSERS_API
+GstAV1ParserResult gst_av1_parser_parse_sequence_header_obu (GstAV1Parser * parser, const GstAV1OBU * obu, GstAV1SequenceHeaderOBU * seq_header);
+
+GST_CODEC_PARSERS_API
+GstAV1ParserResult gst_av1_parser_parse_frame_header_obu (GstAV1Parser * parser, const GstAV1OBU * obu, GstAV1FrameHeaderOBU * frame_header);
+
+GST_CODEC_PARSERS_API
+void               gst_av1_parser_free (GstAV1Parser * parser);
+
+G_END_DECLS
+
+#endif /* GST_AV1_PARSER_H */
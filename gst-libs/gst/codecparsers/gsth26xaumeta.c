@@ -0,0 +1,217 @@
+/* GStreamer
+ *
+ * gsth26xaumeta.c: per access unit H.264/H.265 parse results
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:gsth26xaumeta
+ * @title: GstH26xAUMeta
+ * @short_description: H.264/H.265 access unit parse results
+ *
+ * #GstH26xAUMeta is attached by h264parse and h265parse to each access unit
+ * they push. It lists where every NAL unit is in the buffer along with the
+ * per picture values the parser found (slice types, frame_num, picture
+ * order count, parameter set ids), so that downstream elements can look
+ * them up without scanning or parsing the access unit again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gsth26xaumeta.h"
+
+GST_DEBUG_CATEGORY_STATIC (h26x_au_meta_debug);
+#define GST_CAT_DEFAULT h26x_au_meta_debug
+
+static gboolean
+gst_h26x_au_meta_init (GstH26xAUMeta * au_meta, gpointer params,
+    GstBuffer * buffer)
+{
+  au_meta->codec = GST_H26X_AU_META_CODEC_H264;
+  au_meta->flags = GST_H26X_AU_META_FLAG_NONE;
+  au_meta->n_nals = 0;
+  au_meta->nals = NULL;
+  au_meta->slice_types = 0;
+  au_meta->frame_num = 0;
+  au_meta->poc = 0;
+  au_meta->recovery_cnt = -1;
+  au_meta->vps_id = au_meta->sps_id = au_meta->pps_id = -1;
+
+  return TRUE;
+}
+
+static void
+gst_h26x_au_meta_free (GstH26xAUMeta * au_meta, GstBuffer * buffer)
+{
+  g_free (au_meta->nals);
+}
+
+static gboolean
+gst_h26x_au_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstH26xAUMeta *smeta, *dmeta;
+
+  smeta = (GstH26xAUMeta *) meta;
+
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    GstMetaTransformCopy *copy = data;
+
+    if (!copy->region) {
+      /* only copy if the complete data is copied as well, the offsets
+       * are meaningless otherwise */
+      dmeta = gst_buffer_add_h26x_au_meta (dest, smeta->codec, smeta->nals,
+          smeta->n_nals);
+
+      if (!dmeta)
+        return FALSE;
+
+      dmeta->flags = smeta->flags;
+      dmeta->slice_types = smeta->slice_types;
+      dmeta->frame_num = smeta->frame_num;
+      dmeta->poc = smeta->poc;
+      dmeta->recovery_cnt = smeta->recovery_cnt;
+      dmeta->vps_id = smeta->vps_id;
+      dmeta->sps_id = smeta->sps_id;
+      dmeta->pps_id = smeta->pps_id;
+    }
+  } else {
+    /* return FALSE, if transform type is not supported */
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+GType
+gst_h26x_au_meta_api_get_type (void)
+{
+  static volatile GType type;
+  /* the NAL offsets are only valid for the memory of the buffer */
+  static const gchar *tags[] = { GST_META_TAG_MEMORY_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstH26xAUMetaAPI", tags);
+    GST_DEBUG_CATEGORY_INIT (h26x_au_meta_debug, "h26xaumeta", 0,
+        "H.264/H.265 access unit GstMeta");
+
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+gst_h26x_au_meta_get_info (void)
+{
+  static const GstMetaInfo *h26x_au_meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & h26x_au_meta_info)) {
+    const GstMetaInfo *meta = gst_meta_register (GST_H26X_AU_META_API_TYPE,
+        "GstH26xAUMeta", sizeof (GstH26xAUMeta),
+        (GstMetaInitFunction) gst_h26x_au_meta_init,
+        (GstMetaFreeFunction) gst_h26x_au_meta_free,
+        (GstMetaTransformFunction) gst_h26x_au_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & h26x_au_meta_info,
+        (GstMetaInfo *) meta);
+  }
+
+  return h26x_au_meta_info;
+}
+
+/**
+ * gst_buffer_add_h26x_au_meta:
+ * @buffer: a #GstBuffer
+ * @codec: the #GstH26xAUMetaCodec of the access unit in @buffer
+ * @nals: (array length=n_nals) (allow-none): the NAL units of the access unit
+ * @n_nals: number of entries in @nals
+ *
+ * Creates and adds a #GstH26xAUMeta to a @buffer. @nals is copied, the
+ * remaining fields are left unset for the caller to fill in.
+ *
+ * Returns: (transfer none): a newly created #GstH26xAUMeta
+ *
+ * Since: 1.18
+ */
+GstH26xAUMeta *
+gst_buffer_add_h26x_au_meta (GstBuffer * buffer, GstH26xAUMetaCodec codec,
+    const GstH26xAUNal * nals, guint n_nals)
+{
+  GstH26xAUMeta *au_meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (nals != NULL || n_nals == 0, NULL);
+
+  au_meta = (GstH26xAUMeta *) gst_buffer_add_meta (buffer,
+      GST_H26X_AU_META_INFO, NULL);
+
+  GST_LOG ("codec %d, %u nals", codec, n_nals);
+
+  au_meta->codec = codec;
+  if (n_nals > 0) {
+    au_meta->nals = g_memdup (nals, n_nals * sizeof (GstH26xAUNal));
+    au_meta->n_nals = n_nals;
+  }
+
+  return au_meta;
+}
+
+/**
+ * gst_h26x_au_meta_insert_nal:
+ * @meta: a #GstH26xAUMeta
+ * @offset: where the NAL unit was inserted in the buffer
+ * @size: size of the inserted NAL unit, including its start code or length
+ *   prefix
+ * @type: the NAL unit type
+ *
+ * Updates @meta after a (non-slice) NAL unit of @size bytes was inserted at
+ * @offset in the buffer, e.g. an access unit delimiter or parameter sets.
+ * The NAL units at or after @offset are moved up by @size.
+ *
+ * Since: 1.18
+ */
+void
+gst_h26x_au_meta_insert_nal (GstH26xAUMeta * meta, guint offset, guint size,
+    guint8 type)
+{
+  GstH26xAUNal *nal;
+  guint i, pos;
+
+  g_return_if_fail (meta != NULL);
+
+  pos = meta->n_nals;
+  for (i = 0; i < meta->n_nals; i++) {
+    if (meta->nals[i].offset >= offset) {
+      meta->nals[i].offset += size;
+      pos = MIN (pos, i);
+    }
+  }
+
+  meta->nals = g_renew (GstH26xAUNal, meta->nals, meta->n_nals + 1);
+  memmove (&meta->nals[pos + 1], &meta->nals[pos],
+      (meta->n_nals - pos) * sizeof (GstH26xAUNal));
+  meta->n_nals++;
+
+  nal = &meta->nals[pos];
+  nal->offset = offset;
+  nal->size = size;
+  nal->type = type;
+  nal->slice_type = -1;
+}
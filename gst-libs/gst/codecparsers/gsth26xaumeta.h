@@ -0,0 +1,173 @@
+/* GStreamer
+ *
+ * gsth26xaumeta.h: per access unit H.264/H.265 parse results
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_H26X_AU_META_H__
+#define __GST_H26X_AU_META_H__
+
+#ifndef GST_USE_UNSTABLE_API
+#warning "The H.264/H.265 parsing library is unstable API and may change in future."
+#warning "You can define GST_USE_UNSTABLE_API to avoid this warning."
+#endif
+
+#include <gst/gst.h>
+#include <gst/codecparsers/codecparsers-prelude.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstH26xAUMeta GstH26xAUMeta;
+typedef struct _GstH26xAUNal GstH26xAUNal;
+
+/**
+ * GstH26xAUMetaCodec:
+ * @GST_H26X_AU_META_CODEC_H264: the access unit is H.264
+ * @GST_H26X_AU_META_CODEC_H265: the access unit is H.265
+ *
+ * The codec a #GstH26xAUMeta describes, which determines how NAL unit and
+ * slice types are to be interpreted.
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_H26X_AU_META_CODEC_H264,
+  GST_H26X_AU_META_CODEC_H265
+} GstH26xAUMetaCodec;
+
+/**
+ * GstH26xAUMetaFlags:
+ * @GST_H26X_AU_META_FLAG_NONE: no flags
+ * @GST_H26X_AU_META_FLAG_KEYFRAME: decoding can start at this access unit
+ * @GST_H26X_AU_META_FLAG_IDR: the access unit is an IDR picture
+ * @GST_H26X_AU_META_FLAG_RECOVERY_POINT: the access unit carries a recovery
+ *   point SEI message
+ *
+ * Since: 1.18
+ */
+typedef enum {
+  GST_H26X_AU_META_FLAG_NONE = 0,
+  GST_H26X_AU_META_FLAG_KEYFRAME = (1 << 0),
+  GST_H26X_AU_META_FLAG_IDR = (1 << 1),
+  GST_H26X_AU_META_FLAG_RECOVERY_POINT = (1 << 2)
+} GstH26xAUMetaFlags;
+
+/**
+ * GstH26xAUNal:
+ * @offset: offset of the NAL unit in the buffer, including its start code
+ *   or length prefix
+ * @size: size of the NAL unit, including its start code or length prefix
+ * @type: the NAL unit type
+ * @slice_type: the slice type for coded slices, -1 otherwise
+ *
+ * Location and type of a NAL unit of an access unit.
+ *
+ * Since: 1.18
+ */
+struct _GstH26xAUNal {
+  guint offset;
+  guint size;
+  guint8 type;
+  gint8 slice_type;
+};
+
+GST_CODEC_PARSERS_API
+GType gst_h26x_au_meta_api_get_type (void);
+#define GST_H26X_AU_META_API_TYPE  (gst_h26x_au_meta_api_get_type())
+#define GST_H26X_AU_META_INFO  (gst_h26x_au_meta_get_info())
+GST_CODEC_PARSERS_API
+const GstMetaInfo * gst_h26x_au_meta_get_info (void);
+
+/**
+ * GstH26xAUMeta:
+ * @meta: parent #GstMeta
+ * @codec: the #GstH26xAUMetaCodec of the access unit
+ * @flags: #GstH26xAUMetaFlags of the access unit
+ * @n_nals: number of entries in @nals
+ * @nals: the NAL units of the access unit, in buffer order
+ * @slice_types: bitmask of the slice types present, (1 << slice_type) for
+ *   each one
+ * @frame_num: frame_num of the picture, H.264 only
+ * @poc: picture order count of the picture, or of the field if the access
+ *   unit is a single field
+ * @recovery_cnt: recovery_frame_cnt (H.264) or recovery_poc_cnt (H.265)
+ *   of the recovery point SEI, -1 if there is none
+ * @vps_id: id of the VPS in use, H.265 only, -1 if unknown
+ * @sps_id: id of the SPS in use, -1 if unknown
+ * @pps_id: id of the PPS in use, -1 if unknown
+ *
+ * Extra buffer metadata describing an H.264 or H.265 access unit, as found
+ * by the parser that produced it.
+ *
+ * Can be used by downstream elements (decoders, muxers, analyzers) to avoid
+ * having to scan and parse the access unit again.
+ *
+ * @nals is only valid during the lifetime of the #GstH26xAUMeta. If
+ * elements wish to use it for longer, they are required to make a copy.
+ *
+ * Since: 1.18
+ */
+struct _GstH26xAUMeta {
+  GstMeta            meta;
+
+  GstH26xAUMetaCodec codec;
+  GstH26xAUMetaFlags flags;
+
+  guint              n_nals;
+  GstH26xAUNal      *nals;
+
+  guint              slice_types;
+  guint32            frame_num;
+  gint32             poc;
+  gint               recovery_cnt;
+
+  gint               vps_id;
+  gint               sps_id;
+  gint               pps_id;
+};
+
+/**
+ * GST_H26X_AU_META_HAS_SLICE_TYPE:
+ * @meta: a #GstH26xAUMeta
+ * @type: a slice type
+ *
+ * Whether the access unit contains slices of @type
+ *
+ * Since: 1.18
+ */
+#define GST_H26X_AU_META_HAS_SLICE_TYPE(meta,type) \
+  (((meta)->slice_types & (1 << (type))) != 0)
+
+#define gst_buffer_get_h26x_au_meta(b) ((GstH26xAUMeta*)gst_buffer_get_meta((b),GST_H26X_AU_META_API_TYPE))
+
+GST_CODEC_PARSERS_API
+GstH26xAUMeta *
+gst_buffer_add_h26x_au_meta (GstBuffer * buffer,
+                             GstH26xAUMetaCodec codec,
+                             const GstH26xAUNal * nals,
+                             guint n_nals);
+
+GST_CODEC_PARSERS_API
+void
+gst_h26x_au_meta_insert_nal (GstH26xAUMeta * meta,
+                             guint offset,
+                             guint size,
+                             guint8 type);
+
+G_END_DECLS
+
+#endif
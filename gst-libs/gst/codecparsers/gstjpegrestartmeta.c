@@ -0,0 +1,164 @@
+/* GStreamer
+ *
+ * gstjpegrestartmeta.c: JPEG restart marker locations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:gstjpegrestartmeta
+ * @title: GstJpegRestartMeta
+ * @short_description: JPEG restart marker locations
+ *
+ * #GstJpegRestartMeta is attached by jpegparse to images that use restart
+ * intervals. It lists where every RSTn marker is in the buffer, along with
+ * the restart interval and the scan each marker belongs to, so that
+ * decoders can split the entropy-coded data without scanning it again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstjpegrestartmeta.h"
+
+GST_DEBUG_CATEGORY_STATIC (jpeg_restart_meta_debug);
+#define GST_CAT_DEFAULT jpeg_restart_meta_debug
+
+static gboolean
+gst_jpeg_restart_meta_init (GstJpegRestartMeta * restart_meta,
+    gpointer params, GstBuffer * buffer)
+{
+  restart_meta->restart_interval = 0;
+  restart_meta->n_scans = 0;
+  restart_meta->n_markers = 0;
+  restart_meta->markers = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_jpeg_restart_meta_free (GstJpegRestartMeta * restart_meta,
+    GstBuffer * buffer)
+{
+  g_free (restart_meta->markers);
+}
+
+static gboolean
+gst_jpeg_restart_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstJpegRestartMeta *smeta, *dmeta;
+
+  smeta = (GstJpegRestartMeta *) meta;
+
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    GstMetaTransformCopy *copy = data;
+
+    if (!copy->region) {
+      /* only copy if the complete data is copied as well, the offsets
+       * are meaningless otherwise */
+      dmeta = gst_buffer_add_jpeg_restart_meta (dest, smeta->restart_interval,
+          smeta->n_scans, smeta->markers, smeta->n_markers);
+
+      if (!dmeta)
+        return FALSE;
+    }
+  } else {
+    /* return FALSE, if transform type is not supported */
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+GType
+gst_jpeg_restart_meta_api_get_type (void)
+{
+  static volatile GType type;
+  /* the marker offsets are only valid for the memory of the buffer, and
+   * the transform function refuses copies of only part of it */
+  static const gchar *tags[] = { GST_META_TAG_MEMORY_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstJpegRestartMetaAPI", tags);
+    GST_DEBUG_CATEGORY_INIT (jpeg_restart_meta_debug, "jpegrestartmeta", 0,
+        "JPEG restart marker GstMeta");
+
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+gst_jpeg_restart_meta_get_info (void)
+{
+  static const GstMetaInfo *jpeg_restart_meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & jpeg_restart_meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register (GST_JPEG_RESTART_META_API_TYPE,
+        "GstJpegRestartMeta", sizeof (GstJpegRestartMeta),
+        (GstMetaInitFunction) gst_jpeg_restart_meta_init,
+        (GstMetaFreeFunction) gst_jpeg_restart_meta_free,
+        (GstMetaTransformFunction) gst_jpeg_restart_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & jpeg_restart_meta_info,
+        (GstMetaInfo *) meta);
+  }
+
+  return jpeg_restart_meta_info;
+}
+
+/**
+ * gst_buffer_add_jpeg_restart_meta:
+ * @buffer: a #GstBuffer
+ * @restart_interval: number of MCUs per restart interval
+ * @n_scans: number of scans in the image
+ * @markers: (array length=n_markers) (allow-none): the restart markers of
+ *   the image in @buffer
+ * @n_markers: number of entries in @markers
+ *
+ * Creates and adds a #GstJpegRestartMeta to a @buffer. @markers is copied.
+ *
+ * Returns: (transfer none): a newly created #GstJpegRestartMeta
+ *
+ * Since: 1.18
+ */
+GstJpegRestartMeta *
+gst_buffer_add_jpeg_restart_meta (GstBuffer * buffer, guint restart_interval,
+    guint n_scans, const GstJpegRestartMarker * markers, guint n_markers)
+{
+  GstJpegRestartMeta *restart_meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (markers != NULL || n_markers == 0, NULL);
+
+  restart_meta = (GstJpegRestartMeta *) gst_buffer_add_meta (buffer,
+      GST_JPEG_RESTART_META_INFO, NULL);
+
+  GST_LOG ("restart interval %u, %u scans, %u markers", restart_interval,
+      n_scans, n_markers);
+
+  restart_meta->restart_interval = restart_interval;
+  restart_meta->n_scans = n_scans;
+  if (n_markers > 0) {
+    restart_meta->markers =
+        g_memdup (markers, n_markers * sizeof (GstJpegRestartMarker));
+    restart_meta->n_markers = n_markers;
+  }
+
+  return restart_meta;
+}
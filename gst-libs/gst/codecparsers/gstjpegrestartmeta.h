@@ -0,0 +1,104 @@
+/* GStreamer
+ *
+ * gstjpegrestartmeta.h: JPEG restart marker locations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_JPEG_RESTART_META_H__
+#define __GST_JPEG_RESTART_META_H__
+
+#ifndef GST_USE_UNSTABLE_API
+#warning "The JPEG parsing library is unstable API and may change in future."
+#warning "You can define GST_USE_UNSTABLE_API to avoid this warning."
+#endif
+
+#include <gst/gst.h>
+#include <gst/codecparsers/codecparsers-prelude.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstJpegRestartMeta GstJpegRestartMeta;
+typedef struct _GstJpegRestartMarker GstJpegRestartMarker;
+
+/**
+ * GstJpegRestartMarker:
+ * @offset: offset of the marker (its 0xff byte) in the buffer
+ * @index: n of the RSTn marker, from 0 to 7
+ * @scan: index of the scan the marker belongs to, counting from 0
+ *
+ * Location of a restart marker. The entropy-coded data of the restart
+ * interval following the marker starts at @offset + 2.
+ *
+ * Since: 1.18
+ */
+struct _GstJpegRestartMarker {
+  guint offset;
+  guint8 index;
+  guint16 scan;
+};
+
+GST_CODEC_PARSERS_API
+GType gst_jpeg_restart_meta_api_get_type (void);
+#define GST_JPEG_RESTART_META_API_TYPE  (gst_jpeg_restart_meta_api_get_type())
+#define GST_JPEG_RESTART_META_INFO  (gst_jpeg_restart_meta_get_info())
+GST_CODEC_PARSERS_API
+const GstMetaInfo * gst_jpeg_restart_meta_get_info (void);
+
+/**
+ * GstJpegRestartMeta:
+ * @meta: parent #GstMeta
+ * @restart_interval: number of MCUs per restart interval, as set by the
+ *   last DRI segment of the image, 0 if there was none
+ * @n_scans: number of scans in the image
+ * @n_markers: number of entries in @markers
+ * @markers: the restart markers of the image, in buffer order
+ *
+ * Extra buffer metadata listing where the restart markers of a JPEG image
+ * are, as found by the parser that produced it.
+ *
+ * Restart intervals are coded independently of each other, so decoders can
+ * use this to decode them in parallel without scanning the entropy-coded
+ * data for markers first.
+ *
+ * @markers is only valid during the lifetime of the #GstJpegRestartMeta.
+ * If elements wish to use it for longer, they are required to make a copy.
+ *
+ * Since: 1.18
+ */
+struct _GstJpegRestartMeta {
+  GstMeta               meta;
+
+  guint                 restart_interval;
+  guint                 n_scans;
+
+  guint                 n_markers;
+  GstJpegRestartMarker *markers;
+};
+
+#define gst_buffer_get_jpeg_restart_meta(b) ((GstJpegRestartMeta*)gst_buffer_get_meta((b),GST_JPEG_RESTART_META_API_TYPE))
+
+GST_CODEC_PARSERS_API
+GstJpegRestartMeta *
+gst_buffer_add_jpeg_restart_meta (GstBuffer * buffer,
+                                  guint restart_interval,
+                                  guint n_scans,
+                                  const GstJpegRestartMarker * markers,
+                                  guint n_markers);
+
+G_END_DECLS
+
+#endif
@@ -664,6 +664,80 @@ gst_vp9_parser_free (GstVp9Parser * parser)
   }
 }
 
+/**
+ * gst_vp9_parser_parse_superframe_info:
+ * @parser: The #GstVp9Parser
+ * @superframe_info: The #GstVp9SuperframeInfo to fill
+ * @data: The data to parse
+ * @size: The size of the @data to parse
+ *
+ * Looks for a superframe index at the end of @data and fills in
+ * @superframe_info with the sizes of the frames it contains. If @data holds
+ * a single frame, @superframe_info describes one frame of @size bytes.
+ *
+ * Returns: a #GstVp9ParserResult
+ *
+ * Since: 1.18
+ */
+GstVp9ParserResult
+gst_vp9_parser_parse_superframe_info (GstVp9Parser * parser,
+    GstVp9SuperframeInfo * superframe_info, const guint8 * data, gsize size)
+{
+  const guint8 *index;
+  guint32 total_size = 0;
+  guint8 marker;
+  guint i, j;
+
+  g_return_val_if_fail (parser != NULL, GST_VP9_PARSER_ERROR);
+  g_return_val_if_fail (superframe_info != NULL, GST_VP9_PARSER_ERROR);
+  g_return_val_if_fail (data != NULL, GST_VP9_PARSER_ERROR);
+  g_return_val_if_fail (size > 0, GST_VP9_PARSER_ERROR);
+
+  memset (superframe_info, 0, sizeof (*superframe_info));
+
+  /* the index is framed by the same marker byte on both ends */
+  marker = data[size - 1];
+  if ((marker >> 5) == GST_VP9_SUPERFRAME_MARKER) {
+    superframe_info->bytes_per_framesize = ((marker >> 3) & 0x3) + 1;
+    superframe_info->frames_in_superframe = (marker & 0x7) + 1;
+    superframe_info->superframe_index_size = 2 +
+        superframe_info->bytes_per_framesize *
+        superframe_info->frames_in_superframe;
+
+    if (superframe_info->superframe_index_size <= size &&
+        data[size - superframe_info->superframe_index_size] == marker) {
+      index = data + size - superframe_info->superframe_index_size + 1;
+
+      for (i = 0; i < superframe_info->frames_in_superframe; i++) {
+        guint32 frame_size = 0;
+
+        /* little endian */
+        for (j = 0; j < superframe_info->bytes_per_framesize; j++)
+          frame_size |= (guint32) (*index++) << (j * 8);
+
+        if (frame_size == 0 ||
+            frame_size > size - superframe_info->superframe_index_size -
+            total_size) {
+          GST_ERROR ("Invalid frame size %u in superframe index", frame_size);
+          return GST_VP9_PARSER_BROKEN_DATA;
+        }
+
+        superframe_info->frame_sizes[i] = frame_size;
+        total_size += frame_size;
+      }
+
+      return GST_VP9_PARSER_OK;
+    }
+  }
+
+  /* a single frame */
+  memset (superframe_info, 0, sizeof (*superframe_info));
+  superframe_info->frames_in_superframe = 1;
+  superframe_info->frame_sizes[0] = size;
+
+  return GST_VP9_PARSER_OK;
+}
+
 /**
  * gst_vp9_parser_parse_frame_header:
  * @parser: The #GstVp9Parser
@@ -63,6 +63,20 @@ ceil_log2 (guint32 v)
 
 /****** Nal parser ******/
 
+/* The emulation prevention bytes are removed while filling the 64 bit
+ * cache, as many bytes at a time as fit. A run of bytes without any zero
+ * byte can't contain an emulation prevention byte, other than as its first
+ * byte, so those are loaded in one go and only the rest byte by byte.
+ *
+ * epb_mask has a bit for each byte in the cache, the lowest for the last
+ * one, which is set if an emulation prevention byte was removed in front of
+ * it. Those of bytes that weren't started yet don't count for the position
+ * and the number of emulation prevention bytes. */
+
+#define HAS_ZERO_BYTE(v) \
+  (((v) - G_GUINT64_CONSTANT (0x0101010101010101)) & ~(v) & \
+      G_GUINT64_CONSTANT (0x8080808080808080))
+
 void
 nal_reader_init (NalReader * nr, const guint8 * data, guint size)
 {
@@ -72,14 +86,19 @@ nal_reader_init (NalReader * nr, const guint8 * data, guint size)
 
   nr->byte = 0;
   nr->bits_in_cache = 0;
-  /* fill with something other than 0 to detect emulation prevention bytes */
-  nr->first_byte = 0xff;
-  nr->cache = 0xff;
+  nr->zeros = 0;
+  nr->epb_mask = 0;
+  nr->cache = 0;
 }
 
+/* @nbits must not be more than 57, so that there is always room for at
+ * least one more byte while less bits are cached */
 gboolean
 nal_reader_read (NalReader * nr, guint nbits)
 {
+  if (nr->bits_in_cache >= nbits)
+    return TRUE;
+
   if (G_UNLIKELY (nr->byte * 8 + (nbits - nr->bits_in_cache) > nr->size * 8)) {
     GST_DEBUG ("Can not read %u bits, bits in cache %u, Byte * 8 %u, size in "
         "bits %u", nbits, nr->bits_in_cache, nr->byte * 8, nr->size * 8);
@@ -87,26 +106,56 @@ nal_reader_read (NalReader * nr, guint nbits)
   }
 
   while (nr->bits_in_cache < nbits) {
+    guint n_bytes = (64 - nr->bits_in_cache) / 8;
+    gboolean epb = FALSE;
     guint8 byte;
-    gboolean check_three_byte;
 
-    check_three_byte = TRUE;
-  next_byte:
+    if (G_LIKELY (nr->size - nr->byte >= 8)) {
+      guint64 word = GST_READ_UINT64_BE (nr->data + nr->byte);
+
+      /* Don't look at the bytes that don't fit */
+      if (n_bytes < 8)
+        word |= G_MAXUINT64 >> (8 * n_bytes);
+
+      if (!HAS_ZERO_BYTE (word) && (nr->zeros < 2 || (word >> 56) != 0x03)) {
+        if (n_bytes < 8)
+          nr->cache = (nr->cache << (8 * n_bytes)) | (word >> (64 - 8 *
+                  n_bytes));
+        else
+          nr->cache = word;
+        nr->epb_mask <<= n_bytes;
+        nr->byte += n_bytes;
+        nr->bits_in_cache += 8 * n_bytes;
+        nr->zeros = 0;
+        continue;
+      }
+    }
+
     if (G_UNLIKELY (nr->byte >= nr->size))
       return FALSE;
 
     byte = nr->data[nr->byte++];
 
     /* check if the byte is a emulation_prevention_three_byte */
-    if (check_three_byte && byte == 0x03 && nr->first_byte == 0x00 &&
-        ((nr->cache & 0xff) == 0)) {
-      /* next byte goes unconditionally to the cache, even if it's 0x03 */
-      check_three_byte = FALSE;
+    if (nr->zeros >= 2 && byte == 0x03) {
       nr->n_epb++;
-      goto next_byte;
+      epb = TRUE;
+
+      /* next byte goes unconditionally to the cache, even if it's 0x03.
+       * Without one, leave the emulation prevention byte to the next try so
+       * that the position and count don't include it */
+      if (G_UNLIKELY (nr->byte >= nr->size)) {
+        nr->byte--;
+        nr->n_epb--;
+        return FALSE;
+      }
+      byte = nr->data[nr->byte++];
+      nr->zeros = 0;
     }
-    nr->cache = (nr->cache << 8) | nr->first_byte;
-    nr->first_byte = byte;
+
+    nr->zeros = byte ? 0 : nr->zeros + 1;
+    nr->cache = (nr->cache << 8) | byte;
+    nr->epb_mask = (nr->epb_mask << 1) | epb;
     nr->bits_in_cache += 8;
   }
 
@@ -120,6 +169,13 @@ nal_reader_skip (NalReader * nr, guint nbits)
 {
   g_assert (nbits <= 8 * sizeof (nr->cache));
 
+  if (nbits > 32) {
+    if (G_UNLIKELY (!nal_reader_read (nr, 32)))
+      return FALSE;
+    nr->bits_in_cache -= 32;
+    nbits -= 32;
+  }
+
   if (G_UNLIKELY (!nal_reader_read (nr, nbits)))
     return FALSE;
 
@@ -146,10 +202,27 @@ nal_reader_skip_long (NalReader * nr, guint nbits)
   return TRUE;
 }
 
+/* Number of emulation prevention bytes in front of cached bytes that
+ * weren't started yet */
+static inline guint
+nal_reader_get_pending_epb_count (const NalReader * nr)
+{
+  guint mask = nr->epb_mask & ((1 << (nr->bits_in_cache / 8)) - 1);
+  guint count = 0;
+
+  while (mask) {
+    mask &= mask - 1;
+    count++;
+  }
+
+  return count;
+}
+
 guint
 nal_reader_get_pos (const NalReader * nr)
 {
-  return nr->byte * 8 - nr->bits_in_cache;
+  return (nr->byte - nal_reader_get_pending_epb_count (nr)) * 8 -
+      nr->bits_in_cache;
 }
 
 guint
@@ -161,28 +234,22 @@ nal_reader_get_remaining (const NalReader * nr)
 guint
 nal_reader_get_epb_count (const NalReader * nr)
 {
-  return nr->n_epb;
+  return nr->n_epb - nal_reader_get_pending_epb_count (nr);
 }
 
 #define NAL_READER_READ_BITS(bits) \
 gboolean \
 nal_reader_get_bits_uint##bits (NalReader *nr, guint##bits *val, guint nbits) \
 { \
-  guint shift; \
-  \
   if (!nal_reader_read (nr, nbits)) \
     return FALSE; \
   \
   /* bring the required bits down and truncate */ \
-  shift = nr->bits_in_cache - nbits; \
-  *val = nr->first_byte >> shift; \
-  \
-  *val |= nr->cache << (8 - shift); \
-  /* mask out required bits */ \
-  if (nbits < bits) \
-    *val &= ((guint##bits)1 << nbits) - 1; \
-  \
-  nr->bits_in_cache = shift; \
+  nr->bits_in_cache -= nbits; \
+  if (G_LIKELY (nbits > 0)) \
+    *val = (nr->cache >> nr->bits_in_cache) & (G_MAXUINT64 >> (64 - nbits)); \
+  else \
+    *val = 0; \
   \
   return TRUE; \
 } \
@@ -203,8 +270,26 @@ nal_reader_peek_bits_uint##bits (const NalReader *nr, guint##bits *val, guint nb
 
 NAL_READER_PEEK_BITS (8);
 
-gboolean
-nal_reader_get_ue (NalReader * nr, guint32 * val)
+static inline guint
+nal_clz32 (guint32 v)
+{
+#if defined(__GNUC__)
+  return __builtin_clz (v);
+#else
+  guint n = 0;
+
+  while (!(v & 0x80000000)) {
+    v <<= 1;
+    n++;
+  }
+
+  return n;
+#endif
+}
+
+/* Bit by bit, for the last few bits of the data */
+static gboolean
+nal_reader_get_ue_slow (NalReader * nr, guint32 * val)
 {
   guint i = 0;
   guint8 bit;
@@ -225,7 +310,33 @@ nal_reader_get_ue (NalReader * nr, guint32 * val)
   if (G_UNLIKELY (!nal_reader_get_bits_uint32 (nr, &value, i)))
     return FALSE;
 
-  *val = (1 << i) - 1 + value;
+  *val = (1U << i) - 1 + value;
+
+  return TRUE;
+}
+
+gboolean
+nal_reader_get_ue (NalReader * nr, guint32 * val)
+{
+  guint32 bits;
+  guint i;
+  guint32 value;
+
+  /* The leading zero bits and the 1 bit of any valid code fit in 32 bits */
+  if (G_UNLIKELY (!nal_reader_read (nr, 32)))
+    return nal_reader_get_ue_slow (nr, val);
+
+  bits = nr->cache >> (nr->bits_in_cache - 32);
+  if (G_UNLIKELY (bits == 0))
+    return FALSE;
+
+  i = nal_clz32 (bits);
+  nr->bits_in_cache -= i + 1;
+
+  if (G_UNLIKELY (!nal_reader_get_bits_uint32 (nr, &value, i)))
+    return FALSE;
+
+  *val = (1U << i) - 1 + value;
 
   return TRUE;
 }
@@ -249,7 +360,7 @@ nal_reader_get_se (NalReader * nr, gint32 * val)
 gboolean
 nal_reader_is_byte_aligned (NalReader * nr)
 {
-  if (nr->bits_in_cache != 0)
+  if (nr->bits_in_cache % 8 != 0)
     return FALSE;
   return TRUE;
 }
@@ -297,13 +408,171 @@ nal_reader_has_more_data (NalReader * nr)
 
 /***********  end of nal parser ***************/
 
+/***********  start code scanning ***************/
+
+/* All scanners return the offset of the first 00 00 01 sequence that is
+ * followed by at least one more byte, or -1 if there is none. The SIMD
+ * versions look for two consecutive zero bytes 16 or 32 positions at a time
+ * and only then check for the 01, which is rare in coded data. */
+
+static inline gint
+scan_for_start_codes_scalar (const guint8 * data, guint offset, guint size)
+{
+  guint i = offset;
+
+  if (G_UNLIKELY (size < 4))
+    return -1;
+
+  while (i <= size - 4) {
+    if (data[i + 2] > 1) {
+      i += 3;
+    } else if (data[i + 1]) {
+      i += 2;
+    } else if (data[i] || data[i + 2] != 1) {
+      i++;
+    } else {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static gint
+scan_for_start_codes_c (const guint8 * data, guint size)
+{
+  return scan_for_start_codes_scalar (data, 0, size);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAL_HAVE_X86_SIMD 1
+#include <immintrin.h>
+
+__attribute__ ((target ("sse2")))
+static gint
+scan_for_start_codes_sse2 (const guint8 * data, guint size)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i one = _mm_set1_epi8 (1);
+  guint i = 0;
+
+  /* The last candidate of a block needs 3 bytes and one more after it */
+  while (i + 16 + 3 <= size) {
+    const guint8 *p = data + i;
+    __m128i z0, z1, o2;
+    guint mask;
+
+    z0 = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) p), zero);
+    z1 = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (p + 1)), zero);
+    mask = _mm_movemask_epi8 (_mm_and_si128 (z0, z1));
+
+    if (G_UNLIKELY (mask)) {
+      o2 = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (p + 2)), one);
+      mask &= _mm_movemask_epi8 (o2);
+      if (mask)
+        return i + __builtin_ctz (mask);
+    }
+    i += 16;
+  }
+
+  return scan_for_start_codes_scalar (data, i, size);
+}
+
+__attribute__ ((target ("avx2")))
+static gint
+scan_for_start_codes_avx2 (const guint8 * data, guint size)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i one = _mm256_set1_epi8 (1);
+  guint i = 0;
+
+  while (i + 32 + 3 <= size) {
+    const guint8 *p = data + i;
+    __m256i z0, z1, o2;
+    guint mask;
+
+    z0 = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) p), zero);
+    z1 = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (p + 1)),
+        zero);
+    mask = _mm256_movemask_epi8 (_mm256_and_si256 (z0, z1));
+
+    if (G_UNLIKELY (mask)) {
+      o2 = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (p + 2)),
+          one);
+      mask &= _mm256_movemask_epi8 (o2);
+      if (mask)
+        return i + __builtin_ctz (mask);
+    }
+    i += 32;
+  }
+
+  return scan_for_start_codes_scalar (data, i, size);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NAL_HAVE_NEON 1
+#include <arm_neon.h>
+
+static gint
+scan_for_start_codes_neon (const guint8 * data, guint size)
+{
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  guint i = 0;
+
+  while (i + 16 + 3 <= size) {
+    uint8x16_t z;
+    uint8x8_t any;
+
+    z = vandq_u8 (vceqq_u8 (vld1q_u8 (data + i), zero),
+        vceqq_u8 (vld1q_u8 (data + i + 1), zero));
+    any = vorr_u8 (vget_low_u8 (z), vget_high_u8 (z));
+
+    /* There is no movemask, find the position in the block with the
+     * scalar scanner, limited to the candidates of this block */
+    if (G_UNLIKELY (vget_lane_u64 (vreinterpret_u64_u8 (any), 0))) {
+      gint off = scan_for_start_codes_scalar (data + i, 0, 16 + 3);
+
+      if (off >= 0)
+        return i + off;
+    }
+    i += 16;
+  }
+
+  return scan_for_start_codes_scalar (data, i, size);
+}
+#endif
+
+typedef gint (*ScanForStartCodesFunc) (const guint8 * data, guint size);
+
+static ScanForStartCodesFunc
+get_scan_for_start_codes_func (void)
+{
+  static gsize func = 0;
+
+  if (g_once_init_enter (&func)) {
+    ScanForStartCodesFunc f = scan_for_start_codes_c;
+
+#if defined(NAL_HAVE_X86_SIMD)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+      f = scan_for_start_codes_avx2;
+    else if (__builtin_cpu_supports ("sse2"))
+      f = scan_for_start_codes_sse2;
+#elif defined(NAL_HAVE_NEON)
+    f = scan_for_start_codes_neon;
+#endif
+
+    g_once_init_leave (&func, (gsize) f);
+  }
+
+  return (ScanForStartCodesFunc) func;
+}
+
+/* Also used by the MPEG-1/2, MPEG-4 part 2 and VC-1 parsers, which have the
+ * same 00 00 01 start code prefix */
 gint
 scan_for_start_codes (const guint8 * data, guint size)
 {
-  GstByteReader br;
-  gst_byte_reader_init (&br, data, size);
-
   /* NALU not empty, so we can at least expect 1 (even 2) bytes following sc */
-  return gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
-      0, size);
+  return get_scan_for_start_codes_func () (data, size);
 }
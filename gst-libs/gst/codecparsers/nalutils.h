@@ -49,8 +49,10 @@ typedef struct
   guint n_epb;                  /* Number of emulation prevention bytes */
   guint byte;                   /* Byte position */
   guint bits_in_cache;          /* bitpos in the cache of next bit */
-  guint8 first_byte;
-  guint64 cache;                /* cached bytes */
+  guint zeros;                  /* Number of zero bytes before byte */
+  guint8 epb_mask;              /* Cached bytes that followed an epb */
+  guint64 cache;                /* cached bytes, with emulation prevention
+                                 * bytes removed */
 } NalReader;
 
 G_GNUC_INTERNAL
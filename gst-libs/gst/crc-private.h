@@ -0,0 +1,291 @@
+/* GStreamer
+ *
+ * crc-private.h: CRC routines shared by the MPEG muxers, demuxers and GDP
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Two non-reflected CRCs are provided:
+ *
+ *   CRC-32/MPEG-2: polynomial 0x04c11db7, used by MPEG-TS/PS sections
+ *   CRC-16/CCITT:  polynomial 0x1021, used by the GStreamer Data Protocol
+ *
+ * Both are computed 8 bytes at a time with slicing-by-8 tables. On x86 CPUs
+ * with the carry-less multiply instruction, CRC-32 runs of at least
+ * GST_CRC32_PCLMUL_MIN_SIZE bytes are folded 64 bytes at a time with
+ * PCLMULQDQ instead.
+ *
+ * Everything is static so that this header can be used from both libraries
+ * and plugins without exporting anything. The tables are built on first
+ * use. */
+
+#ifndef __GST_CRC_PRIVATE_H__
+#define __GST_CRC_PRIVATE_H__
+
+#include <glib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GST_CRC_HAVE_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+G_BEGIN_DECLS
+
+#define GST_CRC32_MPEG2_POLY 0x04c11db7
+#define GST_CRC16_CCITT_POLY 0x1021
+
+/* Smaller runs are not worth setting up the SIMD registers for */
+#define GST_CRC32_PCLMUL_MIN_SIZE 128
+
+typedef struct
+{
+  guint32 crc32[8][256];
+  guint16 crc16[8][256];
+
+  gboolean have_pclmul;
+  /* x^n mod P for n = 576, 512, 192 and 128, to fold 64 and 16 bytes */
+  guint64 fold_64[2];
+  guint64 fold_16[2];
+} GstCrcTables;
+
+static inline guint32
+_gst_crc32_xpow_mod (guint n)
+{
+  guint32 r = 1;
+
+  while (n--)
+    r = (r << 1) ^ ((r & 0x80000000) ? GST_CRC32_MPEG2_POLY : 0);
+
+  return r;
+}
+
+static inline const GstCrcTables *
+_gst_crc_get_tables (void)
+{
+  static GstCrcTables tables;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    guint i, j;
+
+    for (i = 0; i < 256; i++) {
+      guint32 c32 = i << 24;
+      guint16 c16 = i << 8;
+
+      for (j = 0; j < 8; j++) {
+        c32 = (c32 << 1) ^ ((c32 & 0x80000000) ? GST_CRC32_MPEG2_POLY : 0);
+        c16 = (c16 << 1) ^ ((c16 & 0x8000) ? GST_CRC16_CCITT_POLY : 0);
+      }
+      tables.crc32[0][i] = c32;
+      tables.crc16[0][i] = c16;
+    }
+
+    for (i = 0; i < 256; i++) {
+      for (j = 1; j < 8; j++) {
+        guint32 c32 = tables.crc32[j - 1][i];
+        guint16 c16 = tables.crc16[j - 1][i];
+
+        tables.crc32[j][i] = (c32 << 8) ^ tables.crc32[0][c32 >> 24];
+        tables.crc16[j][i] = (c16 << 8) ^ tables.crc16[0][c16 >> 8];
+      }
+    }
+
+    tables.fold_64[0] = _gst_crc32_xpow_mod (512 + 64);
+    tables.fold_64[1] = _gst_crc32_xpow_mod (512);
+    tables.fold_16[0] = _gst_crc32_xpow_mod (128 + 64);
+    tables.fold_16[1] = _gst_crc32_xpow_mod (128);
+
+#ifdef GST_CRC_HAVE_PCLMUL
+    __builtin_cpu_init ();
+    tables.have_pclmul = __builtin_cpu_supports ("pclmul")
+        && __builtin_cpu_supports ("ssse3");
+#endif
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return &tables;
+}
+
+/* Byte at a time, for the head and tail of the slicing-by-8 loop */
+static inline guint32
+_gst_crc32_mpeg2_update_bytes (const GstCrcTables * t, guint32 crc,
+    const guint8 * data, gsize len)
+{
+  while (len--)
+    crc = (crc << 8) ^ t->crc32[0][(crc >> 24) ^ *data++];
+
+  return crc;
+}
+
+static inline guint32
+_gst_crc32_mpeg2_update_sb8 (const GstCrcTables * t, guint32 crc,
+    const guint8 * data, gsize len)
+{
+  while (len >= 8) {
+    crc ^= ((guint32) data[0] << 24) | ((guint32) data[1] << 16) |
+        ((guint32) data[2] << 8) | data[3];
+    crc = t->crc32[7][crc >> 24] ^ t->crc32[6][(crc >> 16) & 0xff] ^
+        t->crc32[5][(crc >> 8) & 0xff] ^ t->crc32[4][crc & 0xff] ^
+        t->crc32[3][data[4]] ^ t->crc32[2][data[5]] ^
+        t->crc32[1][data[6]] ^ t->crc32[0][data[7]];
+    data += 8;
+    len -= 8;
+  }
+
+  return _gst_crc32_mpeg2_update_bytes (t, crc, data, len);
+}
+
+#ifdef GST_CRC_HAVE_PCLMUL
+/* Each 16 byte block is loaded byte-swapped, so that the 128 bit register
+ * holds the block as a polynomial with the first bit as highest term.
+ * Folding multiplies the high and low 64 bits with x^(n+64) and x^n mod P,
+ * which keeps the accumulator congruent to the data processed so far
+ * followed by n zero bits. The remaining 16 bytes of accumulator are then
+ * run through the tables. */
+__attribute__ ((target ("pclmul,ssse3")))
+static inline __m128i
+_gst_crc32_fold (__m128i acc, __m128i k, __m128i data)
+{
+  return _mm_xor_si128 (data,
+      _mm_xor_si128 (_mm_clmulepi64_si128 (acc, k, 0x11),
+          _mm_clmulepi64_si128 (acc, k, 0x00)));
+}
+
+__attribute__ ((target ("pclmul,ssse3")))
+static inline guint32
+_gst_crc32_mpeg2_update_pclmul (const GstCrcTables * t, guint32 crc,
+    const guint8 * data, gsize len)
+{
+  const __m128i swap = _mm_set_epi8 (0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+      12, 13, 14, 15);
+  __m128i k64, k16, x0, x1, x2, x3;
+  guint8 tmp[16];
+
+  if (len < 64)
+    return _gst_crc32_mpeg2_update_sb8 (t, crc, data, len);
+
+  k64 = _mm_set_epi64x (t->fold_64[0], t->fold_64[1]);
+  k16 = _mm_set_epi64x (t->fold_16[0], t->fold_16[1]);
+
+#define LOAD(i) \
+  _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (data + 16 * (i))), swap)
+
+  /* The initial register value is the same as xor-ing it into the first
+   * 4 bytes */
+  x0 = _mm_xor_si128 (LOAD (0), _mm_set_epi32 (crc, 0, 0, 0));
+  x1 = LOAD (1);
+  x2 = LOAD (2);
+  x3 = LOAD (3);
+  data += 64;
+  len -= 64;
+
+  while (len >= 64) {
+    x0 = _gst_crc32_fold (x0, k64, LOAD (0));
+    x1 = _gst_crc32_fold (x1, k64, LOAD (1));
+    x2 = _gst_crc32_fold (x2, k64, LOAD (2));
+    x3 = _gst_crc32_fold (x3, k64, LOAD (3));
+    data += 64;
+    len -= 64;
+  }
+
+  x0 = _gst_crc32_fold (x0, k16, x1);
+  x0 = _gst_crc32_fold (x0, k16, x2);
+  x0 = _gst_crc32_fold (x0, k16, x3);
+
+  while (len >= 16) {
+    x0 = _gst_crc32_fold (x0, k16, LOAD (0));
+    data += 16;
+    len -= 16;
+  }
+
+#undef LOAD
+
+  _mm_storeu_si128 ((__m128i *) tmp, _mm_shuffle_epi8 (x0, swap));
+  crc = _gst_crc32_mpeg2_update_sb8 (t, 0, tmp, 16);
+
+  return _gst_crc32_mpeg2_update_sb8 (t, crc, data, len);
+}
+#endif
+
+/**
+ * gst_crc32_mpeg2_update:
+ * @crc: the CRC of the preceding data, or 0xffffffff
+ * @data: the data
+ * @len: the size of @data
+ *
+ * Returns: the CRC-32/MPEG-2 of the preceding data followed by @data
+ */
+static inline guint32
+gst_crc32_mpeg2_update (guint32 crc, const guint8 * data, gsize len)
+{
+  const GstCrcTables *t = _gst_crc_get_tables ();
+
+#ifdef GST_CRC_HAVE_PCLMUL
+  if (t->have_pclmul && len >= GST_CRC32_PCLMUL_MIN_SIZE)
+    return _gst_crc32_mpeg2_update_pclmul (t, crc, data, len);
+#endif
+
+  return _gst_crc32_mpeg2_update_sb8 (t, crc, data, len);
+}
+
+/**
+ * gst_crc32_mpeg2:
+ * @data: the data
+ * @len: the size of @data
+ *
+ * Returns: the CRC-32/MPEG-2 of @data, which is 0 for a section including
+ * its CRC field
+ */
+static inline guint32
+gst_crc32_mpeg2 (const guint8 * data, gsize len)
+{
+  return gst_crc32_mpeg2_update (0xffffffff, data, len);
+}
+
+/**
+ * gst_crc16_ccitt_update:
+ * @crc: the CRC register after the preceding data, or the initial value
+ * @data: the data
+ * @len: the size of @data
+ *
+ * Returns: the CRC-16/CCITT register after the preceding data followed by
+ * @data. No final xor is applied.
+ */
+static inline guint16
+gst_crc16_ccitt_update (guint16 crc, const guint8 * data, gsize len)
+{
+  const GstCrcTables *t = _gst_crc_get_tables ();
+
+  while (len >= 8) {
+    crc ^= (data[0] << 8) | data[1];
+    crc = t->crc16[7][crc >> 8] ^ t->crc16[6][crc & 0xff] ^
+        t->crc16[5][data[2]] ^ t->crc16[4][data[3]] ^
+        t->crc16[3][data[4]] ^ t->crc16[2][data[5]] ^
+        t->crc16[1][data[6]] ^ t->crc16[0][data[7]];
+    data += 8;
+    len -= 8;
+  }
+
+  while (len--)
+    crc = (crc << 8) ^ t->crc16[0][(crc >> 8) ^ *data++];
+
+  return crc;
+}
+
+G_END_DECLS
+
+#endif /* __GST_CRC_PRIVATE_H__ */
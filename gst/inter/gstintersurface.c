@@ -68,6 +68,7 @@ gst_inter_surface_unref (GstInterSurface * surface)
   g_mutex_lock (&mutex);
   if ((--surface->ref_count) == 0) {
     GList *g;
+    gint i;
 
     for (g = list; g; g = g_list_next (g)) {
       GstInterSurface *tmp = g->data;
@@ -78,7 +79,8 @@ gst_inter_surface_unref (GstInterSurface * surface)
     }
 
     g_mutex_clear (&surface->mutex);
-    gst_buffer_replace (&surface->video_buffer, NULL);
+    for (i = 0; i < GST_INTER_SURFACE_VIDEO_FRAMES; i++)
+      gst_buffer_replace (&surface->video_frames[i].buffer, NULL);
     gst_buffer_replace (&surface->sub_buffer, NULL);
     gst_object_unref (surface->audio_adapter);
     g_free (surface->name);
@@ -86,3 +88,146 @@ gst_inter_surface_unref (GstInterSurface * surface)
   }
   g_mutex_unlock (&mutex);
 }
+
+/*
+ * The video frames
+ *
+ * The sink writes the frames in a small ring with the surface mutex held,
+ * the sources read them without taking it. A source first counts itself in
+ * the frame's readers, then checks that the frame still has the id it
+ * expects before using it. The sink marks the frame as being replaced
+ * first, then waits for the readers to go away, so it never drops a buffer
+ * that a source is taking a reference to.
+ */
+
+static void
+gst_inter_video_frame_replace (GstInterVideoFrame * frame, guint id,
+    GstBuffer * buffer, GstClockTime time)
+{
+  GstBuffer *old;
+
+  g_atomic_int_set (&frame->seq, id - 1);
+  while (g_atomic_int_get (&frame->readers) > 0)
+    g_thread_yield ();
+
+  old = frame->buffer;
+  frame->buffer = buffer;
+  frame->time = time;
+  g_atomic_int_set (&frame->seq, id);
+
+  if (old)
+    gst_buffer_unref (old);
+}
+
+/* Returns the id of the frame and its time, 0 if there is no frame */
+static guint
+gst_inter_video_frame_peek (GstInterVideoFrame * frame, GstClockTime * time)
+{
+  guint id;
+
+  g_atomic_int_inc (&frame->readers);
+  id = g_atomic_int_get (&frame->seq);
+  if ((id & 1) || frame->buffer == NULL)
+    id = 0;
+  else
+    *time = frame->time;
+  g_atomic_int_add (&frame->readers, -1);
+
+  return id;
+}
+
+/* Returns a reference to the buffer of the frame if it still has @id */
+static GstBuffer *
+gst_inter_video_frame_ref (GstInterVideoFrame * frame, guint id)
+{
+  GstBuffer *buffer = NULL;
+
+  g_atomic_int_inc (&frame->readers);
+  if ((guint) g_atomic_int_get (&frame->seq) == id && frame->buffer)
+    buffer = gst_buffer_ref (frame->buffer);
+  g_atomic_int_add (&frame->readers, -1);
+
+  return buffer;
+}
+
+/* Must be called with the surface mutex held, takes ownership of @buffer.
+ * @time is when the frame is shown in clock time, or GST_CLOCK_TIME_NONE */
+void
+gst_inter_surface_push_video_frame (GstInterSurface * surface,
+    GstBuffer * buffer, GstClockTime time)
+{
+  GstInterVideoFrame *frame;
+
+  /* Ids are even and 0 means no frame */
+  surface->video_frame_id += 2;
+  if (surface->video_frame_id == 0)
+    surface->video_frame_id = 2;
+
+  frame = &surface->video_frames[(surface->video_frame_id / 2) %
+      GST_INTER_SURFACE_VIDEO_FRAMES];
+  gst_inter_video_frame_replace (frame, surface->video_frame_id, buffer, time);
+}
+
+/* Must be called with the surface mutex held */
+void
+gst_inter_surface_clear_video_frames (GstInterSurface * surface)
+{
+  gint i;
+
+  for (i = 0; i < GST_INTER_SURFACE_VIDEO_FRAMES; i++) {
+    GstInterVideoFrame *frame = &surface->video_frames[i];
+
+    if (frame->buffer)
+      gst_inter_video_frame_replace (frame, frame->seq, NULL,
+          GST_CLOCK_TIME_NONE);
+  }
+}
+
+/* Returns the frame closest to @time, in clock time, that is not older
+ * than the one at @cursor, and moves @cursor to it. Without a time, this is
+ * the latest frame. Returns NULL if there is none. Does not take the
+ * surface mutex, several sources can call it at the same time. */
+GstBuffer *
+gst_inter_surface_get_video_frame (GstInterSurface * surface,
+    GstClockTime time, guint * cursor)
+{
+  GstBuffer *buffer = NULL;
+
+  do {
+    GstClockTime best_diff = GST_CLOCK_TIME_NONE;
+    guint best_id = 0;
+    gint i, best = 0;
+
+    for (i = 0; i < GST_INTER_SURFACE_VIDEO_FRAMES; i++) {
+      GstClockTime frame_time = GST_CLOCK_TIME_NONE, diff = 0;
+      guint id;
+
+      id = gst_inter_video_frame_peek (&surface->video_frames[i], &frame_time);
+      if (id == 0 || (*cursor != 0 && (gint) (id - *cursor) < 0))
+        continue;
+
+      if (GST_CLOCK_TIME_IS_VALID (time) &&
+          GST_CLOCK_TIME_IS_VALID (frame_time))
+        diff = ABS (GST_CLOCK_DIFF (time, frame_time));
+
+      /* On a tie, the newer frame wins */
+      if (best_id == 0 || diff < best_diff ||
+          (diff == best_diff && (gint) (id - best_id) > 0)) {
+        best_id = id;
+        best_diff = diff;
+        best = i;
+      }
+    }
+
+    if (best_id == 0)
+      return NULL;
+
+    /* Try again if the sink replaced it in the meantime */
+    buffer = gst_inter_video_frame_ref (&surface->video_frames[best],
+        best_id);
+    if (buffer)
+      *cursor = best_id;
+  } while (buffer == NULL);
+
+  return buffer;
+}
@@ -27,6 +27,21 @@
 G_BEGIN_DECLS
 
 typedef struct _GstInterSurface GstInterSurface;
+typedef struct _GstInterVideoFrame GstInterVideoFrame;
+
+#define GST_INTER_SURFACE_VIDEO_FRAMES 8
+
+struct _GstInterVideoFrame
+{
+  /* Even id of the frame, odd while the sink replaces it */
+  volatile gint seq;
+  /* Sources looking at the frame right now */
+  volatile gint readers;
+
+  GstBuffer *buffer;
+  /* Clock time at which the sink shows it */
+  GstClockTime time;
+};
 
 struct _GstInterSurface
 {
@@ -37,7 +52,11 @@ struct _GstInterSurface
 
   /* video */
   GstVideoInfo video_info;
-  int video_buffer_count;
+  /* Changes along with video_info */
+  volatile gint video_info_cookie;
+  /* Id of the last frame, the sources read the frames without the mutex */
+  guint video_frame_id;
+  GstInterVideoFrame video_frames[GST_INTER_SURFACE_VIDEO_FRAMES];
 
   /* audio */
   GstAudioInfo audio_info;
@@ -45,7 +64,6 @@ struct _GstInterSurface
   guint64 audio_latency_time;
   guint64 audio_period_time;
 
-  GstBuffer *video_buffer;
   GstBuffer *sub_buffer;
   GstAdapter *audio_adapter;
 };
@@ -58,6 +76,12 @@ struct _GstInterSurface
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+void gst_inter_surface_push_video_frame (GstInterSurface *surface,
+    GstBuffer *buffer, GstClockTime time);
+void gst_inter_surface_clear_video_frames (GstInterSurface *surface);
+GstBuffer * gst_inter_surface_get_video_frame (GstInterSurface *surface,
+    GstClockTime time, guint *cursor);
+
 
 G_END_DECLS
 
@@ -199,6 +199,7 @@ gst_inter_video_sink_start (GstBaseSink * sink)
   intervideosink->surface = gst_inter_surface_get (intervideosink->channel);
   g_mutex_lock (&intervideosink->surface->mutex);
   memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
+  g_atomic_int_inc (&intervideosink->surface->video_info_cookie);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   return TRUE;
@@ -210,11 +211,9 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
   g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
+  gst_inter_surface_clear_video_frames (intervideosink->surface);
   memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
+  g_atomic_int_inc (&intervideosink->surface->video_info_cookie);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   gst_inter_surface_unref (intervideosink->surface);
@@ -234,8 +233,11 @@ gst_inter_video_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
     return FALSE;
   }
 
+  /* The frames in the ring don't match the new format */
   g_mutex_lock (&intervideosink->surface->mutex);
+  gst_inter_surface_clear_video_frames (intervideosink->surface);
   intervideosink->surface->video_info = info;
+  g_atomic_int_inc (&intervideosink->surface->video_info_cookie);
   intervideosink->info = info;
   g_mutex_unlock (&intervideosink->surface->mutex);
 
@@ -246,16 +248,23 @@ static GstFlowReturn
 gst_inter_video_sink_show_frame (GstVideoSink * sink, GstBuffer * buffer)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
+  GstClockTime running_time, time = GST_CLOCK_TIME_NONE;
 
   GST_DEBUG_OBJECT (intervideosink, "render ts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
 
+  /* The sources pick the frames by clock time, which both pipelines share
+   * when they use the same clock */
+  GST_OBJECT_LOCK (sink);
+  running_time = gst_segment_to_running_time (&GST_BASE_SINK (sink)->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  if (GST_CLOCK_TIME_IS_VALID (running_time))
+    time = running_time + GST_ELEMENT_CAST (sink)->base_time;
+  GST_OBJECT_UNLOCK (sink);
+
   g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
+  gst_inter_surface_push_video_frame (intervideosink->surface,
+      gst_buffer_ref (buffer), time);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   return GST_FLOW_OK;
@@ -24,6 +24,11 @@
  * in connection with a intervideosink element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * intervideosink keeps its last few frames. intervideosrc outputs the one
+ * that was shown closest to the time its own frame is shown, so both
+ * pipelines should use the same clock. Several intervideosrc elements can
+ * read from the same channel.
+ *
  * ## Example launch line
  * |[
  * gst-launch-1.0 -v intervideosrc ! queue ! xvimagesink
@@ -263,6 +268,11 @@ gst_inter_video_src_set_caps (GstBaseSrc * base, GstCaps * caps)
   gst_buffer_unref (src);
   intervideosrc->black_frame = dest;
 
+  /* Check the format of the surface again on the next frame */
+  if (intervideosrc->surface)
+    intervideosrc->video_info_cookie =
+        g_atomic_int_get (&intervideosrc->surface->video_info_cookie) - 1;
+
   return TRUE;
 }
 
@@ -276,6 +286,10 @@ gst_inter_video_src_start (GstBaseSrc * src)
   intervideosrc->surface = gst_inter_surface_get (intervideosrc->channel);
   intervideosrc->timestamp_offset = 0;
   intervideosrc->n_frames = 0;
+  intervideosrc->video_cursor = 0;
+  intervideosrc->n_repeats = 0;
+  intervideosrc->video_info_cookie =
+      g_atomic_int_get (&intervideosrc->surface->video_info_cookie) - 1;
 
   return TRUE;
 }
@@ -319,15 +333,46 @@ gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
   }
 }
 
+/* Returns the caps to switch to if the sink changed the format */
+static GstCaps *
+gst_inter_video_src_check_info (GstInterVideoSrc * intervideosrc,
+    const GstVideoInfo * info)
+{
+  GstVideoInfo tmp_info = *info;
+
+  /* We negotiate the framerate ourselves */
+  tmp_info.fps_n = intervideosrc->info.fps_n;
+  tmp_info.fps_d = intervideosrc->info.fps_d;
+  if (intervideosrc->info.flags & GST_VIDEO_FLAG_VARIABLE_FPS)
+    tmp_info.flags |= GST_VIDEO_FLAG_VARIABLE_FPS;
+  else
+    tmp_info.flags &= ~GST_VIDEO_FLAG_VARIABLE_FPS;
+
+  if (gst_video_info_is_equal (&tmp_info, &intervideosrc->info))
+    return NULL;
+
+  intervideosrc->timestamp_offset +=
+      gst_util_uint64_scale (GST_SECOND * intervideosrc->n_frames,
+      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+      GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+  intervideosrc->n_frames = 0;
+
+  return gst_video_info_to_caps (&tmp_info);
+}
+
 static GstFlowReturn
 gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
     GstBuffer ** buf)
 {
   GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+  GstInterSurface *surface = intervideosrc->surface;
   GstCaps *caps;
   GstBuffer *buffer;
   guint64 frames;
   gboolean is_gap = FALSE;
+  GstClockTime time;
+  guint cursor;
+  gint cookie;
 
   GST_DEBUG_OBJECT (intervideosrc, "create");
 
@@ -338,48 +383,55 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
       GST_VIDEO_INFO_FPS_N (&intervideosrc->info),
       GST_VIDEO_INFO_FPS_D (&intervideosrc->info) * GST_SECOND);
 
-  g_mutex_lock (&intervideosrc->surface->mutex);
-  if (intervideosrc->surface->video_info.finfo) {
-    GstVideoInfo tmp_info = intervideosrc->surface->video_info;
-
-    /* We negotiate the framerate ourselves */
-    tmp_info.fps_n = intervideosrc->info.fps_n;
-    tmp_info.fps_d = intervideosrc->info.fps_d;
-    if (intervideosrc->info.flags & GST_VIDEO_FLAG_VARIABLE_FPS)
-      tmp_info.flags |= GST_VIDEO_FLAG_VARIABLE_FPS;
-    else
-      tmp_info.flags &= ~GST_VIDEO_FLAG_VARIABLE_FPS;
-
-    if (!gst_video_info_is_equal (&tmp_info, &intervideosrc->info)) {
-      caps = gst_video_info_to_caps (&tmp_info);
-      intervideosrc->timestamp_offset +=
-          gst_util_uint64_scale (GST_SECOND * intervideosrc->n_frames,
-          GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
-          GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
-      intervideosrc->n_frames = 0;
-    }
+again:
+  /* Only take the mutex when the sink changed the format */
+  cookie = g_atomic_int_get (&surface->video_info_cookie);
+  if (cookie != intervideosrc->video_info_cookie) {
+    g_mutex_lock (&surface->mutex);
+    cookie = intervideosrc->video_info_cookie = surface->video_info_cookie;
+    if (caps)
+      gst_caps_unref (caps);
+    caps = NULL;
+    if (surface->video_info.finfo)
+      caps = gst_inter_video_src_check_info (intervideosrc,
+          &surface->video_info);
+    g_mutex_unlock (&surface->mutex);
   }
 
-  if (intervideosrc->surface->video_buffer) {
-    /* We have a buffer to push */
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
+  /* Take the frame the sink showed closest to when we show ours */
+  time = intervideosrc->timestamp_offset +
+      gst_util_uint64_scale (GST_SECOND * intervideosrc->n_frames,
+      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+      GST_VIDEO_INFO_FPS_N (&intervideosrc->info)) +
+      gst_element_get_base_time (GST_ELEMENT_CAST (src));
+
+  cursor = intervideosrc->video_cursor;
+  buffer = gst_inter_surface_get_video_frame (surface, time,
+      &intervideosrc->video_cursor);
+
+  /* The sink clears the frames when it changes the format, a frame pushed
+   * after that must not go out with the caps we just checked */
+  if (buffer && g_atomic_int_get (&surface->video_info_cookie) != cookie) {
+    gst_buffer_unref (buffer);
+    intervideosrc->video_cursor = cursor;
+    goto again;
+  }
+  if (buffer && intervideosrc->video_cursor != cursor)
+    intervideosrc->n_repeats = 0;
+  else
+    intervideosrc->n_repeats++;
 
-    /* Can only be true if timeout > 0 */
-    if (intervideosrc->surface->video_buffer_count == frames) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
-    }
+  /* Show black frames once the frame is older than the timeout */
+  if (buffer && intervideosrc->n_repeats > frames) {
+    gst_buffer_unref (buffer);
+    buffer = NULL;
   }
 
-  if (intervideosrc->surface->video_buffer_count != 0 &&
-      intervideosrc->surface->video_buffer_count != (frames + 1)) {
-    /* This is a repeat of the stored buffer or of a black frame */
+  if (intervideosrc->n_repeats != 0 && intervideosrc->n_repeats != frames + 1) {
+    /* This is a repeat of the last frame or of a black frame */
     is_gap = TRUE;
   }
 
-  intervideosrc->surface->video_buffer_count++;
-  g_mutex_unlock (&intervideosrc->surface->mutex);
-
   if (caps) {
     gboolean ret;
     GstStructure *s;
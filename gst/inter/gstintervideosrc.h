@@ -48,6 +48,11 @@ struct _GstInterVideoSrc
   GstBuffer *black_frame;
   int n_frames;
   GstClockTime timestamp_offset;
+
+  /* Last frame taken from the surface and how often it was repeated */
+  guint video_cursor;
+  guint64 n_repeats;
+  gint video_info_cookie;
 };
 
 struct _GstInterVideoSrcClass
@@ -31,6 +31,10 @@
  * image header searching for image properties such as width and height
  * among others. Jpegparse can also extract metadata (e.g. xmp).
  *
+ * Images using restart intervals get a #GstJpegRestartMeta listing where
+ * their restart markers are, so that decoders can decode the intervals in
+ * parallel.
+ *
  * ## Example launch line
  * |[
  * gst-launch-1.0 -v souphttpsrc location=... ! jpegparse ! matroskamux ! filesink location=...
@@ -51,6 +55,7 @@
 #include <string.h>
 #include <gst/base/gstbytereader.h>
 #include <gst/tag/tag.h>
+#include <gst/codecparsers/gstjpegrestartmeta.h>
 
 #include "gstjpegparse.h"
 
@@ -187,6 +192,40 @@ gst_jpeg_parse_parse_tag_has_entropy_segment (guint8 tag)
   return FALSE;
 }
 
+static void
+gst_jpeg_parse_reset_restart_state (GstJpegParse * parse)
+{
+  if (parse->restart_markers)
+    g_array_set_size (parse->restart_markers, 0);
+  parse->restart_interval = 0;
+  parse->n_scans = 0;
+}
+
+/* Remember what the marker at @pos tells about restart intervals, so they
+ * can be attached to the image as #GstJpegRestartMeta. */
+static void
+gst_jpeg_parse_record_marker (GstJpegParse * parse, const guint8 * data,
+    guint pos, guint8 marker, guint seglen)
+{
+  if (marker == SOS) {
+    parse->n_scans++;
+  } else if (marker >= RST0 && marker <= RST7) {
+    GstJpegRestartMarker rst;
+
+    /* restart markers outside of a scan are not ours to report */
+    if (parse->n_scans == 0)
+      return;
+
+    rst.offset = pos;
+    rst.index = marker - RST0;
+    rst.scan = parse->n_scans - 1;
+    g_array_append_val (parse->restart_markers, rst);
+  } else if (marker == DRI && seglen >= 4) {
+    /* caller made sure the whole segment is available */
+    parse->restart_interval = GST_READ_UINT16_BE (data + pos + 4);
+  }
+}
+
 /* returns image length in bytes if parsed successfully,
  * otherwise 0 if more data needed,
  * if < 0 the absolute value needs to be flushed */
@@ -220,9 +259,15 @@ gst_jpeg_parse_get_image_length (GstJpegParse * parse, GstMapInfo * mapinfo)
   /* resume from state offset */
   offset = parse->last_offset;
 
+  /* markers are recorded once they have been stepped over, so there is
+   * nothing to keep when starting over */
+  if (offset == 0)
+    gst_jpeg_parse_reset_restart_state (parse);
+
   while (1) {
-    guint frame_len;
+    guint frame_len, seglen, eseglen;
     guint32 value;
+    guint8 marker;
 
     noffset =
         gst_byte_reader_masked_scan_uint32_peek (&reader, 0x0000ff00,
@@ -282,25 +327,35 @@ gst_jpeg_parse_get_image_length (GstJpegParse * parse, GstMapInfo * mapinfo)
       goto need_more_data;
     }
 
+    marker = value;
+    seglen = frame_len;
     if (gst_jpeg_parse_parse_tag_has_entropy_segment (value)) {
-      guint eseglen = parse->last_entropy_len;
-
+      const guint8 *data = mapinfo->data;
+      const guint8 *ff;
+      guint start, pos;
+
+      /* The entropy-coded data is most of the image. Only 0xff bytes can
+       * end it, so let memchr() (vectorized in any decent libc) skip to
+       * them instead of testing every byte, and resume where the previous
+       * call stopped. */
       GST_DEBUG ("0x%08x: finding entropy segment length", offset + 2);
-      noffset = offset + 2 + frame_len + eseglen;
+      start = offset + 4 + frame_len;
+      pos = start + parse->last_entropy_len;
       while (1) {
-        noffset = gst_byte_reader_masked_scan_uint32_peek (&reader, 0x0000ff00,
-            0x0000ff00, noffset, size - noffset, &value);
-        if (noffset < 0) {
-          /* need more data */
-          parse->last_entropy_len = size - offset - 4 - frame_len - 2;
+        ff = memchr (data + pos, 0xff, size - pos);
+        if (ff == NULL || ff + 1 == data + size) {
+          /* need more data, the trailing 0xff is looked at again */
+          pos = (ff != NULL) ? ff - data : size;
+          parse->last_entropy_len = pos - start;
           goto need_more_data;
         }
-        if ((value & 0xff) != 0x00) {
-          eseglen = noffset - offset - frame_len - 2;
+        pos = ff - data;
+        /* anything but a stuffed 0x00 is a marker */
+        if (ff[1] != 0x00)
           break;
-        }
-        noffset++;
+        pos += 2;
       }
+      eseglen = pos - start;
       parse->last_entropy_len = 0;
       frame_len += eseglen;
       GST_DEBUG ("entropy segment length=%u => frame_len=%u", eseglen,
@@ -322,6 +377,9 @@ gst_jpeg_parse_get_image_length (GstJpegParse * parse, GstMapInfo * mapinfo)
       GST_DEBUG ("found sync at 0x%x", offset + 2);
     }
 
+    gst_jpeg_parse_record_marker (parse, mapinfo->data, offset + 2, marker,
+        seglen);
+
     offset += frame_len + 2;
   }
 
@@ -734,6 +792,12 @@ gst_jpeg_parse_pre_push_frame (GstBaseParse * bparse, GstBaseParseFrame * frame)
 
   GST_BUFFER_DURATION (outbuf) = parse->duration;
 
+  if (parse->restart_markers->len > 0) {
+    gst_buffer_add_jpeg_restart_meta (outbuf, parse->restart_interval,
+        parse->n_scans, (GstJpegRestartMarker *) parse->restart_markers->data,
+        parse->restart_markers->len);
+  }
+
   return GST_FLOW_OK;
 }
 
@@ -877,6 +941,10 @@ gst_jpeg_parse_start (GstBaseParse * bparse)
   parse->last_entropy_len = 0;
   parse->last_resync = FALSE;
 
+  parse->restart_markers =
+      g_array_new (FALSE, FALSE, sizeof (GstJpegRestartMarker));
+  gst_jpeg_parse_reset_restart_state (parse);
+
   parse->tags = NULL;
 
   return TRUE;
@@ -894,5 +962,10 @@ gst_jpeg_parse_stop (GstBaseParse * bparse)
     parse->tags = NULL;
   }
 
+  if (parse->restart_markers) {
+    g_array_free (parse->restart_markers, TRUE);
+    parse->restart_markers = NULL;
+  }
+
   return TRUE;
 }
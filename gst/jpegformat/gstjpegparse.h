@@ -53,6 +53,11 @@ struct _GstJpegParse {
   guint last_entropy_len;
   gboolean last_resync;
 
+  /* restart markers (GstJpegRestartMarker) of the image being parsed */
+  GArray *restart_markers;
+  guint restart_interval;
+  guint n_scans;
+
   /* negotiated state */
   gint caps_width, caps_height;
   gint caps_framerate_numerator;
@@ -95,6 +95,7 @@ static gboolean mpegts_base_parse_atsc_mgt (MpegTSBase * base,
     GstMpegtsSection * section);
 static gboolean remove_each_program (gpointer key, MpegTSBaseProgram * program,
     MpegTSBase * base);
+static void mpegts_base_sync_pid_filter (MpegTSBase * base);
 
 static void
 _extra_init (void)
@@ -222,6 +223,9 @@ mpegts_base_reset (MpegTSBase * base)
 
   if (klass->reset)
     klass->reset (base);
+
+  mpegts_base_sync_pid_filter (base);
+  mpegts_base_update_pid_filter (base);
 }
 
 static void
@@ -244,6 +248,10 @@ mpegts_base_init (MpegTSBase * base)
   base->parse_private_sections = FALSE;
   base->is_pes = g_new0 (guint8, 1024);
   base->known_psi = g_new0 (guint8, 1024);
+  base->pid_filter = g_new0 (guint8, 0x2000);
+  base->filter_pids = FALSE;
+  base->filter_pids_requested = FALSE;
+  base->pid_filter_dirty = FALSE;
   base->program_size = sizeof (MpegTSBaseProgram);
   base->stream_size = sizeof (MpegTSBaseStream);
 
@@ -263,6 +271,7 @@ mpegts_base_dispose (GObject * object)
     base->disposed = TRUE;
     g_free (base->known_psi);
     g_free (base->is_pes);
+    g_free (base->pid_filter);
   }
 
   if (G_OBJECT_CLASS (parent_class)->dispose)
@@ -502,6 +511,93 @@ mpegts_base_deactivate_and_free_program (MpegTSBase * base,
   mpegts_base_free_program (program);
 }
 
+/**
+ * mpegts_base_update_pid_filter:
+ * @base: a #MpegTSBase
+ *
+ * Rebuilds the PID filter table from the known PSI PIDs and the streams of
+ * the active programs the subclass wants. Needs to be called by subclasses
+ * whenever their #MpegTSBaseClass.is_program_wanted() result changes.
+ */
+void
+mpegts_base_update_pid_filter (MpegTSBase * base)
+{
+  MpegTSBaseClass *klass = GST_MPEGTS_BASE_GET_CLASS (base);
+  MpegTSBaseProgram *program;
+  GHashTableIter iter;
+  GList *tmp;
+  guint pid;
+
+  /* The table isn't maintained while it's not used */
+  if (!base->filter_pids)
+    return;
+
+  for (pid = 0; pid < 0x2000; pid++)
+    base->pid_filter[pid] = MPEGTS_BIT_IS_SET (base->known_psi, pid) ? 1 : 0;
+
+  g_hash_table_iter_init (&iter, base->programs);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & program)) {
+    if (!program->active)
+      continue;
+    if (klass->is_program_wanted && !klass->is_program_wanted (base, program))
+      continue;
+
+    GST_LOG_OBJECT (base, "Letting through program %d",
+        program->program_number);
+
+    /* This also contains the PCR PID */
+    for (tmp = program->stream_list; tmp; tmp = tmp->next)
+      base->pid_filter[((MpegTSBaseStream *) tmp->data)->pid] = 1;
+  }
+}
+
+/**
+ * mpegts_base_invalidate_pid_filter:
+ * @base: a #MpegTSBase
+ *
+ * Variant of mpegts_base_update_pid_filter() that can be called from any
+ * thread. The table is rebuilt by the streaming thread before it handles
+ * the next buffer.
+ */
+void
+mpegts_base_invalidate_pid_filter (MpegTSBase * base)
+{
+  g_atomic_int_set (&base->pid_filter_dirty, TRUE);
+}
+
+/**
+ * mpegts_base_set_pid_filtering:
+ * @base: a #MpegTSBase
+ * @enable: whether to filter
+ *
+ * If enabled, packets on PIDs that are neither known PSI nor part of a
+ * wanted program are dropped by the packetizer before any parsing. Can be
+ * called from any thread, the change applies from the next buffer on.
+ */
+void
+mpegts_base_set_pid_filtering (MpegTSBase * base, gboolean enable)
+{
+  GST_DEBUG_OBJECT (base, "PID filtering %s", enable ? "enabled" : "disabled");
+
+  g_atomic_int_set (&base->filter_pids_requested, enable);
+  mpegts_base_invalidate_pid_filter (base);
+}
+
+/* Apply pending changes of the PID filter. Called from the streaming
+ * thread, which owns the programs and the packetizer */
+static void
+mpegts_base_sync_pid_filter (MpegTSBase * base)
+{
+  if (!g_atomic_int_compare_and_exchange (&base->pid_filter_dirty, TRUE,
+          FALSE))
+    return;
+
+  base->filter_pids = g_atomic_int_get (&base->filter_pids_requested);
+  mpegts_base_update_pid_filter (base);
+  mpegts_packetizer_set_pid_filter (base->packetizer,
+      base->filter_pids ? base->pid_filter : NULL);
+}
+
 static void
 mpegts_base_remove_program (MpegTSBase * base, gint program_number)
 {
@@ -875,6 +971,8 @@ mpegts_base_deactivate_program (MpegTSBase * base, MpegTSBaseProgram * program)
   /* Inform subclasses we're deactivating this program */
   if (klass->program_stopped)
     klass->program_stopped (base, program);
+
+  mpegts_base_update_pid_filter (base);
 }
 
 static void
@@ -938,6 +1036,8 @@ mpegts_base_activate_program (MpegTSBase * base, MpegTSBaseProgram * program,
   if (klass->program_started != NULL)
     klass->program_started (base, program);
 
+  mpegts_base_update_pid_filter (base);
+
   GST_DEBUG_OBJECT (base, "new pmt activated");
 }
 
@@ -1048,6 +1148,9 @@ mpegts_base_apply_pat (MpegTSBase * base, GstMpegtsSection * section)
     g_ptr_array_unref (old_pat);
   }
 
+  /* PMT PIDs might have changed */
+  mpegts_base_update_pid_filter (base);
+
   return TRUE;
 }
 
@@ -1148,8 +1251,12 @@ same_program:
   }
 }
 
+/* @offset is the offset of the packet @section was completed in. Repeated
+ * sections can be shared with their earlier occurrences, in which case
+ * their own offset is the one of the first occurrence */
 static void
-mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
+mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section,
+    guint64 offset)
 {
   gboolean post_message = TRUE;
 
@@ -1161,9 +1268,8 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
       post_message = mpegts_base_apply_pat (base, section);
       if (base->seen_pat == FALSE) {
         base->seen_pat = TRUE;
-        GST_DEBUG ("First PAT offset: %" G_GUINT64_FORMAT, section->offset);
-        mpegts_packetizer_set_reference_offset (base->packetizer,
-            section->offset);
+        GST_DEBUG ("First PAT offset: %" G_GUINT64_FORMAT, offset);
+        mpegts_packetizer_set_reference_offset (base->packetizer, offset);
       }
       break;
     case GST_MPEGTS_SECTION_PMT:
@@ -1208,6 +1314,8 @@ mpegts_base_parse_atsc_mgt (MpegTSBase * base, GstMpegtsSection * section)
     }
   }
 
+  mpegts_base_update_pid_filter (base);
+
   return TRUE;
 }
 
@@ -1379,21 +1487,63 @@ mpegts_base_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
   return GST_MPEGTS_BASE_GET_CLASS (base)->sink_query (base, query);
 }
 
+/* Number of packets parsed in one go by the chain function */
+#define MPEGTS_BASE_PACKET_BATCH 64
+
+static GstFlowReturn
+mpegts_base_process_packet (MpegTSBase * base, MpegTSBaseClass * klass,
+    MpegTSPacketizerPacket * packet)
+{
+  GstFlowReturn res = GST_FLOW_OK;
+
+  if (klass->inspect_packet)
+    klass->inspect_packet (base, packet);
+
+  /* If it's a known PES, push it */
+  if (MPEGTS_BIT_IS_SET (base->is_pes, packet->pid)) {
+    /* push the packet downstream */
+    if (base->push_data)
+      res = klass->push (base, packet, NULL);
+  } else if (packet->payload
+      && MPEGTS_BIT_IS_SET (base->known_psi, packet->pid)) {
+    /* base PSI data */
+    GList *others, *tmp;
+    GstMpegtsSection *section;
+
+    section =
+        mpegts_packetizer_push_section (base->packetizer, packet, &others);
+    if (section)
+      mpegts_base_handle_psi (base, section, packet->offset);
+    if (G_UNLIKELY (others)) {
+      for (tmp = others; tmp; tmp = tmp->next)
+        mpegts_base_handle_psi (base, (GstMpegtsSection *) tmp->data,
+            packet->offset);
+      g_list_free (others);
+    }
+
+    /* we need to push section packet downstream */
+    if (base->push_section)
+      res = klass->push (base, packet, section);
+
+  } else if (packet->payload && packet->pid != 0x1fff)
+    GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet->pid);
+
+  return res;
+}
+
 static GstFlowReturn
 mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
   GstFlowReturn res = GST_FLOW_OK;
   MpegTSBase *base;
   MpegTSPacketizerPacketReturn pret;
-  MpegTSPacketizer2 *packetizer;
-  MpegTSPacketizerPacket packet;
+  MpegTSPacketizerPacket packets[MPEGTS_BASE_PACKET_BATCH];
+  guint i, n_packets;
   MpegTSBaseClass *klass;
 
   base = GST_MPEGTS_BASE (parent);
   klass = GST_MPEGTS_BASE_GET_CLASS (base);
 
-  packetizer = base->packetizer;
-
   if (klass->input_done)
     gst_buffer_ref (buf);
 
@@ -1415,53 +1565,28 @@ mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
       mpegts_packetizer_flush (base->packetizer, FALSE);
   }
 
+  mpegts_base_sync_pid_filter (base);
+
   mpegts_packetizer_push (base->packetizer, buf);
 
   while (res == GST_FLOW_OK) {
-    pret = mpegts_packetizer_next_packet (base->packetizer, &packet);
+    /* Parse a whole batch of packets at once, bad packets are skipped */
+    pret = mpegts_packetizer_next_packets (base->packetizer, packets,
+        MPEGTS_BASE_PACKET_BATCH, &n_packets);
 
     /* If we don't have enough data, return */
     if (G_UNLIKELY (pret == PACKET_NEED_MORE))
       break;
 
-    if (G_UNLIKELY (pret == PACKET_BAD)) {
-      /* bad header, skip the packet */
-      GST_DEBUG_OBJECT (base, "bad packet, skipping");
-      goto next;
-    }
-
-    if (klass->inspect_packet)
-      klass->inspect_packet (base, &packet);
-
-    /* If it's a known PES, push it */
-    if (MPEGTS_BIT_IS_SET (base->is_pes, packet.pid)) {
-      /* push the packet downstream */
-      if (base->push_data)
-        res = klass->push (base, &packet, NULL);
-    } else if (packet.payload
-        && MPEGTS_BIT_IS_SET (base->known_psi, packet.pid)) {
-      /* base PSI data */
-      GList *others, *tmp;
-      GstMpegtsSection *section;
-
-      section = mpegts_packetizer_push_section (packetizer, &packet, &others);
-      if (section)
-        mpegts_base_handle_psi (base, section);
-      if (G_UNLIKELY (others)) {
-        for (tmp = others; tmp; tmp = tmp->next)
-          mpegts_base_handle_psi (base, (GstMpegtsSection *) tmp->data);
-        g_list_free (others);
+    for (i = 0; i < n_packets; i++) {
+      res = mpegts_base_process_packet (base, klass, &packets[i]);
+      if (G_UNLIKELY (res != GST_FLOW_OK)) {
+        /* Keep the packets we didn't get to for the next call */
+        if (i + 1 < n_packets)
+          mpegts_packetizer_unget_packets (base->packetizer, &packets[i + 1]);
+        break;
       }
-
-      /* we need to push section packet downstream */
-      if (base->push_section)
-        res = klass->push (base, &packet, section);
-
-    } else if (packet.payload && packet.pid != 0x1fff)
-      GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet.pid);
-
-  next:
-    mpegts_packetizer_clear_packet (base->packetizer, &packet);
+    }
   }
 
   if (klass->input_done) {
@@ -1489,6 +1614,10 @@ mpegts_base_scan (MpegTSBase * base)
 
   GST_DEBUG ("Scanning for initial sync point");
 
+  /* The PCR packets are needed for the duration and seeking, whatever the
+   * program filter lets through */
+  mpegts_packetizer_set_pid_filter (base->packetizer, NULL);
+
   /* Find initial sync point and at least 5 PCR values */
   for (i = 0; i < 20 && !done; i++) {
     GST_DEBUG ("Grabbing %d => %d", i * 65536, (i + 1) * 65536);
@@ -1575,10 +1704,14 @@ mpegts_base_scan (MpegTSBase * base)
 
 beach:
   mpegts_packetizer_clear (base->packetizer);
+  mpegts_packetizer_set_pid_filter (base->packetizer,
+      base->filter_pids ? base->pid_filter : NULL);
   return ret;
 
 no_initial_pcr:
   mpegts_packetizer_clear (base->packetizer);
+  mpegts_packetizer_set_pid_filter (base->packetizer,
+      base->filter_pids ? base->pid_filter : NULL);
   GST_WARNING_OBJECT (base, "Couldn't find any PCR within the first %d bytes",
       10 * 65536);
   return GST_FLOW_OK;
@@ -132,6 +132,17 @@ struct _MpegTSBase {
   guint8 *known_psi;
   guint8 *is_pes;
 
+  /* Dense table with one entry per PID, non-zero if the PID is wanted:
+   * known PSI plus the streams of the programs the subclass selected.
+   * Only used when pid filtering is enabled, see
+   * mpegts_base_set_pid_filtering() */
+  guint8 *pid_filter;
+  gboolean filter_pids;
+  /* Set from any thread, applied by the streaming thread, see
+   * mpegts_base_invalidate_pid_filter() */
+  gint filter_pids_requested;
+  gint pid_filter_dirty;
+
   gboolean disposed;
 
   /* size of the MpegTSBaseProgram structure, can be overridden
@@ -182,6 +193,9 @@ struct _MpegTSBaseClass {
    * If the subclass responds TRUE, it should call mpegts_base_deactivate_and_free_program()
    * when it wants to remove it */
   gboolean (*can_remove_program) (MpegTSBase *base, MpegTSBaseProgram *program);
+  /* Whether the streams of an active program should go through the pid
+   * filter. If not implemented, all programs are wanted */
+  gboolean (*is_program_wanted) (MpegTSBase *base, MpegTSBaseProgram *program);
 
   /* stream_added is called whenever a new stream has been identified */
   gboolean (*stream_added) (MpegTSBase *base, MpegTSBaseStream *stream, MpegTSBaseProgram *program);
@@ -235,6 +249,10 @@ G_GNUC_INTERNAL gboolean gst_mpegtsbase_plugin_init (GstPlugin * plugin);
 
 G_GNUC_INTERNAL void mpegts_base_deactivate_and_free_program (MpegTSBase *base, MpegTSBaseProgram *program);
 
+G_GNUC_INTERNAL void mpegts_base_set_pid_filtering (MpegTSBase *base, gboolean enable);
+G_GNUC_INTERNAL void mpegts_base_update_pid_filter (MpegTSBase *base);
+G_GNUC_INTERNAL void mpegts_base_invalidate_pid_filter (MpegTSBase *base);
+
 G_END_DECLS
 
 #endif /* GST_MPEG_TS_BASE_H */
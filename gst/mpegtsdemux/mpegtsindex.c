@@ -0,0 +1,330 @@
+/*
+ * mpegtsindex.c : MPEG-TS seek index
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Index of PCR and keyframe positions of a transport stream, so that seeks
+ * can go straight to the right byte offset instead of estimating it from
+ * the bitrate and then scanning.
+ *
+ * The index can be stored in a sidecar file with the following layout, all
+ * values big endian:
+ *
+ *   4 bytes   magic "TSIX"
+ *   4 bytes   version (1)
+ *   8 bytes   size of the indexed stream in bytes
+ *   4 bytes   number of entries
+ *   4 bytes   reserved
+ *
+ * followed by the entries, 16 bytes each:
+ *
+ *   8 bytes   flags in the upper 8 bits, offset in the lower 56 bits
+ *   8 bytes   timestamp in nanoseconds
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/base/gstbytereader.h>
+#include <gst/base/gstbytewriter.h>
+
+#include "mpegtsindex.h"
+
+GST_DEBUG_CATEGORY_STATIC (mpegts_index_debug);
+#define GST_CAT_DEFAULT mpegts_index_debug
+
+#define INDEX_MAGIC 0x54534958      /* "TSIX" */
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 24
+#define INDEX_ENTRY_SIZE 16
+#define INDEX_OFFSET_MASK G_GUINT64_CONSTANT (0x00ffffffffffffff)
+
+/* Minimum distance between two PCR-only entries */
+#define INDEX_PCR_INTERVAL GST_SECOND
+
+/* Entries further away than this from the looked up timestamp are not
+ * used, the index probably doesn't cover that area yet */
+#define INDEX_MAX_DISTANCE (10 * GST_SECOND)
+
+MpegTSIndex *
+mpegts_index_new (guint64 stream_size)
+{
+  MpegTSIndex *index = g_slice_new0 (MpegTSIndex);
+
+  index->entries = g_array_new (FALSE, FALSE, sizeof (MpegTSIndexEntry));
+  index->stream_size = stream_size;
+
+  return index;
+}
+
+void
+mpegts_index_free (MpegTSIndex * index)
+{
+  g_array_free (index->entries, TRUE);
+  g_slice_free (MpegTSIndex, index);
+}
+
+/* Returns the position of the first entry with an offset >= @offset */
+static guint
+mpegts_index_find_offset (MpegTSIndex * index, guint64 offset)
+{
+  guint lo = 0, hi = index->entries->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (index->entries, MpegTSIndexEntry, mid).offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/**
+ * mpegts_index_add_entry:
+ * @index: a #MpegTSIndex
+ * @offset: offset of the packet
+ * @ts: timestamp of the packet
+ * @flags: what the packet contains
+ *
+ * Adds an entry to @index. Entries are usually added in increasing offset
+ * order, which is the fast path, but can come in any order after seeks.
+ * PCR-only entries closer than a second to the previous entry are ignored
+ * to keep the index small.
+ */
+void
+mpegts_index_add_entry (MpegTSIndex * index, guint64 offset,
+    GstClockTime ts, MpegTSIndexEntryFlags flags)
+{
+  MpegTSIndexEntry entry, *prev = NULL;
+  guint pos;
+
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (ts));
+
+  if (G_UNLIKELY (offset > INDEX_OFFSET_MASK))
+    return;
+
+  pos = index->entries->len;
+  if (pos > 0 && g_array_index (index->entries, MpegTSIndexEntry,
+          pos - 1).offset >= offset)
+    pos = mpegts_index_find_offset (index, offset);
+
+  if (pos < index->entries->len) {
+    MpegTSIndexEntry *next =
+        &g_array_index (index->entries, MpegTSIndexEntry, pos);
+
+    /* Already known, possibly with different flags */
+    if (next->offset == offset) {
+      if ((next->flags | flags) != next->flags) {
+        next->flags |= flags;
+        index->dirty = TRUE;
+      }
+      return;
+    }
+  }
+
+  if (pos > 0)
+    prev = &g_array_index (index->entries, MpegTSIndexEntry, pos - 1);
+
+  if (flags == MPEGTS_INDEX_ENTRY_PCR && prev && ts >= prev->ts
+      && ts - prev->ts < INDEX_PCR_INTERVAL)
+    return;
+
+  GST_LOG ("Adding entry offset %" G_GUINT64_FORMAT " ts %" GST_TIME_FORMAT
+      " flags 0x%x", offset, GST_TIME_ARGS (ts), flags);
+
+  entry.offset = offset;
+  entry.ts = ts;
+  entry.flags = flags;
+  g_array_insert_val (index->entries, pos, entry);
+  index->dirty = TRUE;
+}
+
+/**
+ * mpegts_index_lookup:
+ * @index: a #MpegTSIndex
+ * @ts: the timestamp to look for
+ * @flags: the type of entry wanted
+ *
+ * Looks for the last entry with any of @flags set, whose timestamp is not
+ * after @ts. Timestamps are assumed to increase with the offset.
+ *
+ * Returns: the entry, or %NULL if there is none close enough to @ts.
+ */
+const MpegTSIndexEntry *
+mpegts_index_lookup (MpegTSIndex * index, GstClockTime ts,
+    MpegTSIndexEntryFlags flags)
+{
+  guint lo = 0, hi = index->entries->len;
+
+  /* Find the first entry after ts */
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (index->entries, MpegTSIndexEntry, mid).ts <= ts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* And walk back to a matching one */
+  while (lo > 0) {
+    const MpegTSIndexEntry *entry =
+        &g_array_index (index->entries, MpegTSIndexEntry, lo - 1);
+
+    if (entry->ts > ts || ts - entry->ts > INDEX_MAX_DISTANCE)
+      break;
+
+    if (entry->flags & flags) {
+      GST_DEBUG ("Found entry offset %" G_GUINT64_FORMAT " ts %"
+          GST_TIME_FORMAT " for %" GST_TIME_FORMAT, entry->offset,
+          GST_TIME_ARGS (entry->ts), GST_TIME_ARGS (ts));
+      return entry;
+    }
+    lo--;
+  }
+
+  GST_DEBUG ("No entry for %" GST_TIME_FORMAT, GST_TIME_ARGS (ts));
+
+  return NULL;
+}
+
+/**
+ * mpegts_index_load:
+ * @location: the file to load
+ * @error: return location for a #GError
+ *
+ * Returns: (transfer full): the index stored in @location, or %NULL.
+ */
+MpegTSIndex *
+mpegts_index_load (const gchar * location, GError ** error)
+{
+  MpegTSIndex *index = NULL;
+  GstByteReader br;
+  gchar *contents;
+  gsize size;
+  guint32 magic, version, n_entries, i;
+  guint64 stream_size;
+
+  if (!g_file_get_contents (location, &contents, &size, error))
+    return NULL;
+
+  gst_byte_reader_init (&br, (const guint8 *) contents, size);
+
+  if (!gst_byte_reader_get_uint32_be (&br, &magic) || magic != INDEX_MAGIC)
+    goto invalid;
+  if (!gst_byte_reader_get_uint32_be (&br, &version)
+      || version != INDEX_VERSION)
+    goto invalid;
+  if (!gst_byte_reader_get_uint64_be (&br, &stream_size)
+      || !gst_byte_reader_get_uint32_be (&br, &n_entries)
+      || !gst_byte_reader_skip (&br, 4))
+    goto invalid;
+  if (gst_byte_reader_get_remaining (&br) / INDEX_ENTRY_SIZE < n_entries)
+    goto invalid;
+
+  index = mpegts_index_new (stream_size);
+  g_array_set_size (index->entries, n_entries);
+
+  for (i = 0; i < n_entries; i++) {
+    MpegTSIndexEntry *entry =
+        &g_array_index (index->entries, MpegTSIndexEntry, i);
+    guint64 val = gst_byte_reader_get_uint64_be_unchecked (&br);
+
+    entry->offset = val & INDEX_OFFSET_MASK;
+    entry->flags = val >> 56;
+    entry->ts = gst_byte_reader_get_uint64_be_unchecked (&br);
+
+    if (i > 0 && entry->offset <= entry[-1].offset) {
+      mpegts_index_free (index);
+      goto invalid;
+    }
+  }
+
+  GST_INFO ("Loaded %u entries from %s", n_entries, location);
+
+  g_free (contents);
+  return index;
+
+invalid:
+  g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_FORMAT,
+      "%s is not a valid index file", location);
+  g_free (contents);
+  return NULL;
+}
+
+/**
+ * mpegts_index_save:
+ * @index: a #MpegTSIndex
+ * @location: the file to write to
+ * @error: return location for a #GError
+ *
+ * Atomically replaces @location with the contents of @index.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+mpegts_index_save (MpegTSIndex * index, const gchar * location,
+    GError ** error)
+{
+  GstByteWriter bw;
+  gboolean ret;
+  guint8 *data;
+  gsize size;
+  guint i;
+
+  size = INDEX_HEADER_SIZE + index->entries->len * INDEX_ENTRY_SIZE;
+  gst_byte_writer_init_with_size (&bw, size, TRUE);
+
+  gst_byte_writer_put_uint32_be_unchecked (&bw, INDEX_MAGIC);
+  gst_byte_writer_put_uint32_be_unchecked (&bw, INDEX_VERSION);
+  gst_byte_writer_put_uint64_be_unchecked (&bw, index->stream_size);
+  gst_byte_writer_put_uint32_be_unchecked (&bw, index->entries->len);
+  gst_byte_writer_put_uint32_be_unchecked (&bw, 0);
+
+  for (i = 0; i < index->entries->len; i++) {
+    MpegTSIndexEntry *entry =
+        &g_array_index (index->entries, MpegTSIndexEntry, i);
+
+    gst_byte_writer_put_uint64_be_unchecked (&bw,
+        ((guint64) entry->flags << 56) | entry->offset);
+    gst_byte_writer_put_uint64_be_unchecked (&bw, entry->ts);
+  }
+
+  data = gst_byte_writer_reset_and_get_data (&bw);
+  ret = g_file_set_contents (location, (const gchar *) data, size, error);
+  g_free (data);
+
+  if (ret) {
+    GST_INFO ("Saved %u entries to %s", index->entries->len, location);
+    index->dirty = FALSE;
+  }
+
+  return ret;
+}
+
+void
+init_mpegts_index (void)
+{
+  GST_DEBUG_CATEGORY_INIT (mpegts_index_debug, "mpegtsindex", 0,
+      "MPEG transport stream seek index");
+}
@@ -0,0 +1,69 @@
+/*
+ * mpegtsindex.h : MPEG-TS seek index
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __MPEGTS_INDEX_H__
+#define __MPEGTS_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  MPEGTS_INDEX_ENTRY_PCR      = 1 << 0,
+  MPEGTS_INDEX_ENTRY_KEYFRAME = 1 << 1
+} MpegTSIndexEntryFlags;
+
+typedef struct
+{
+  /* Offset of the first packet */
+  guint64 offset;
+  /* PCR time or keyframe PTS, in the same time base as the output */
+  GstClockTime ts;
+  MpegTSIndexEntryFlags flags;
+} MpegTSIndexEntry;
+
+typedef struct
+{
+  /* MpegTSIndexEntry, sorted by offset */
+  GArray *entries;
+
+  /* Size in bytes of the indexed stream */
+  guint64 stream_size;
+
+  /* Whether entries were added since loading */
+  gboolean dirty;
+} MpegTSIndex;
+
+G_GNUC_INTERNAL MpegTSIndex *mpegts_index_new (guint64 stream_size);
+G_GNUC_INTERNAL void mpegts_index_free (MpegTSIndex * index);
+
+G_GNUC_INTERNAL void mpegts_index_add_entry (MpegTSIndex * index,
+    guint64 offset, GstClockTime ts, MpegTSIndexEntryFlags flags);
+G_GNUC_INTERNAL const MpegTSIndexEntry *mpegts_index_lookup (MpegTSIndex * index,
+    GstClockTime ts, MpegTSIndexEntryFlags flags);
+
+G_GNUC_INTERNAL MpegTSIndex *mpegts_index_load (const gchar * location,
+    GError ** error);
+G_GNUC_INTERNAL gboolean mpegts_index_save (MpegTSIndex * index,
+    const gchar * location, GError ** error);
+
+G_GNUC_INTERNAL void init_mpegts_index (void);
+
+G_END_DECLS
+#endif /* __MPEGTS_INDEX_H__ */
@@ -45,6 +45,16 @@ G_DEFINE_TYPE_EXTENDED (MpegTSPacketizer2, mpegts_packetizer, G_TYPE_OBJECT, 0,
 
 #define ABSDIFF(a,b) ((a) < (b) ? (b) - (a) : (a) - (b))
 
+/* Maximum number of sections kept in the section cache. EIT schedules are
+ * the biggest users, with up to a few thousand sections per multiplex */
+#define SECTION_CACHE_MAX_ENTRIES 8192
+
+typedef struct
+{
+  guint64 key;
+  GstMpegtsSection *section;
+} MpegTSPacketizerCachedSection;
+
 #define PACKETIZER_GROUP_LOCK(p) g_mutex_lock(&((p)->group_lock))
 #define PACKETIZER_GROUP_UNLOCK(p) g_mutex_unlock(&((p)->group_lock))
 
@@ -61,6 +71,11 @@ static void record_pcr (MpegTSPacketizer2 * packetizer, MpegTSPCR * pcrtable,
 #define TABLE_ID_UNSET 0xFF
 #define PACKET_SYNC_BYTE 0x47
 
+/* Whether the packet at @data is on a PID we don't want */
+#define PACKET_IS_FILTERED(packetizer, data) \
+  ((packetizer)->pid_filter && \
+   !(packetizer)->pid_filter[GST_READ_UINT16_BE ((data) + 1) & 0x1FFF])
+
 static inline MpegTSPCR *
 get_pcr_table (MpegTSPacketizer2 * packetizer, guint16 pid)
 {
@@ -178,6 +193,77 @@ seen_section_before (MpegTSPacketizerStream * stream, guint8 table_id,
   return MPEGTS_BIT_IS_SET (subtable->seen_section, section_number);
 }
 
+static void
+cached_section_free (MpegTSPacketizerCachedSection * cached)
+{
+  gst_mpegts_section_unref (cached->section);
+  g_slice_free (MpegTSPacketizerCachedSection, cached);
+}
+
+/* Creates a section from @data (of which ownership is taken), or returns
+ * the cached one if the exact same section was seen before on that PID.
+ * Cached sections keep their parsed content (the PAT, PMT, EIT, ... and
+ * their descriptors), which is only created on first access.
+ *
+ * Sections handed out elsewhere, for example in bus messages, are only
+ * reused once their content was parsed, so that it is never built by two
+ * threads at once, and they keep the offset of their first occurrence. */
+static GstMpegtsSection *
+mpegts_packetizer_new_section (MpegTSPacketizer2 * packetizer, guint16 pid,
+    guint8 * data, guint section_length, guint64 offset)
+{
+  MpegTSPacketizerCachedSection *cached;
+  GstMpegtsSection *section;
+  guint64 key;
+
+  if (G_UNLIKELY (section_length < 3))
+    return gst_mpegts_section_new (pid, data, section_length);
+
+  key = ((guint64) pid << 32) | ((guint64) data[0] << 24);
+  if ((data[1] & 0x80) && section_length >= 8)
+    key |= ((guint64) ((data[5] >> 1) & 0x1f) << 48) |
+        (GST_READ_UINT16_BE (data + 3) << 8) | data[6];
+
+  cached = g_hash_table_lookup (packetizer->section_cache, &key);
+  if (cached && cached->section->section_length == section_length
+      && memcmp (cached->section->data, data, section_length) == 0) {
+    section = cached->section;
+    if (GST_MINI_OBJECT_REFCOUNT_VALUE (section) == 1) {
+      section->offset = offset;
+    } else if (g_atomic_pointer_get (&section->cached_parsed) == NULL) {
+      GST_LOG ("PID 0x%04x table_id 0x%02x cached section in use and not "
+          "parsed yet", pid, data[0]);
+      goto create;
+    }
+    GST_LOG ("PID 0x%04x table_id 0x%02x reusing cached section", pid,
+        data[0]);
+    g_free (data);
+    return gst_mpegts_section_ref (section);
+  }
+
+create:
+  section = gst_mpegts_section_new (pid, data, section_length);
+  if (section == NULL)
+    return NULL;
+  section->offset = offset;
+
+  if (cached) {
+    gst_mpegts_section_unref (cached->section);
+  } else {
+    if (G_UNLIKELY (g_hash_table_size (packetizer->section_cache) >=
+            SECTION_CACHE_MAX_ENTRIES)) {
+      GST_DEBUG ("Section cache full, clearing it");
+      g_hash_table_remove_all (packetizer->section_cache);
+    }
+    cached = g_slice_new (MpegTSPacketizerCachedSection);
+    cached->key = key;
+    g_hash_table_insert (packetizer->section_cache, &cached->key, cached);
+  }
+  cached->section = gst_mpegts_section_ref (section);
+
+  return section;
+}
+
 static MpegTSPacketizerStreamSubtable *
 mpegts_packetizer_stream_subtable_new (guint8 table_id,
     guint16 subtable_extension, guint8 last_section_number)
@@ -261,6 +347,13 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
   packetizer->need_sync = FALSE;
+  packetizer->pid_filter = NULL;
+  packetizer->keep_buffers = FALSE;
+  g_queue_init (&packetizer->buffers);
+  packetizer->buffers_start = 0;
+  packetizer->flushed = 0;
+  packetizer->section_cache = g_hash_table_new_full (g_int64_hash,
+      g_int64_equal, NULL, (GDestroyNotify) cached_section_free);
 
   memset (packetizer->pcrtablelut, 0xff, 0x2000);
   memset (packetizer->observations, 0x0, sizeof (packetizer->observations));
@@ -272,6 +365,18 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   packetizer->pcr_discont_threshold = GST_SECOND;
 }
 
+static void
+mpegts_packetizer_drop_buffers (MpegTSPacketizer2 * packetizer)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (&packetizer->buffers)))
+    gst_buffer_unref (buf);
+
+  packetizer->buffers_start = 0;
+  packetizer->flushed = 0;
+}
+
 static void
 mpegts_packetizer_dispose (GObject * object)
 {
@@ -291,6 +396,8 @@ mpegts_packetizer_dispose (GObject * object)
 
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
+    mpegts_packetizer_drop_buffers (packetizer);
+    g_hash_table_unref (packetizer->section_cache);
     g_mutex_clear (&packetizer->group_lock);
     packetizer->disposed = TRUE;
     packetizer->offset = 0;
@@ -524,8 +631,8 @@ mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
   /* TODO ? : Replace this by an efficient version (where we provide all
    * pre-parsed header data) */
   res =
-      gst_mpegts_section_new (stream->pid, stream->section_data,
-      stream->section_length);
+      mpegts_packetizer_new_section (packetizer, stream->pid,
+      stream->section_data, stream->section_length, stream->offset);
   stream->section_data = NULL;
   mpegts_packetizer_clear_section (stream);
 
@@ -547,7 +654,6 @@ mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
      * on all sections (including those we would not use) is just not worth it.
      * */
     MPEGTS_BIT_SET (subtable->seen_section, stream->section_number);
-    res->offset = stream->offset;
   }
 
   return res;
@@ -572,6 +678,8 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
   }
 
   gst_adapter_clear (packetizer->adapter);
+  mpegts_packetizer_drop_buffers (packetizer);
+  g_hash_table_remove_all (packetizer->section_cache);
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->need_sync = FALSE;
@@ -611,6 +719,7 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
     }
   }
   gst_adapter_clear (packetizer->adapter);
+  mpegts_packetizer_drop_buffers (packetizer);
 
   packetizer->offset = 0;
   packetizer->empty = TRUE;
@@ -637,6 +746,7 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
   if (hard) {
     /* For pull mode seeks in tsdemux the observation must be preserved */
     flush_observations (packetizer);
+    g_hash_table_remove_all (packetizer->section_cache);
   }
 }
 
@@ -674,6 +784,8 @@ mpegts_packetizer_push (MpegTSPacketizer2 * packetizer, GstBuffer * buffer)
   GST_DEBUG ("Pushing %" G_GSIZE_FORMAT " byte from offset %"
       G_GUINT64_FORMAT, gst_buffer_get_size (buffer),
       GST_BUFFER_OFFSET (buffer));
+  if (packetizer->keep_buffers)
+    g_queue_push_tail (&packetizer->buffers, gst_buffer_ref (buffer));
   gst_adapter_push (packetizer->adapter, buffer);
   /* If the buffer has a valid timestamp, store it - preferring DTS,
    * which is where upstream arrival times should be stored */
@@ -686,8 +798,21 @@ static void
 mpegts_packetizer_flush_bytes (MpegTSPacketizer2 * packetizer, gsize size)
 {
   if (size > 0) {
+    GstBuffer *buf;
+
     GST_LOG ("flushing %" G_GSIZE_FORMAT " bytes from adapter", size);
     gst_adapter_flush (packetizer->adapter, size);
+    packetizer->flushed += size;
+
+    /* Release the input buffers that are now completely gone */
+    while ((buf = g_queue_peek_head (&packetizer->buffers))) {
+      gsize buf_size = gst_buffer_get_size (buf);
+
+      if (packetizer->buffers_start + buf_size > packetizer->flushed)
+        break;
+      packetizer->buffers_start += buf_size;
+      gst_buffer_unref (g_queue_pop_head (&packetizer->buffers));
+    }
   }
 
   packetizer->map_data = NULL;
@@ -722,11 +847,27 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   return TRUE;
 }
 
+/* Returns the offset of the first sync byte in data[start..end), or end.
+ * memchr() is vectorized by the C library, which makes skipping over
+ * garbage much faster than testing byte by byte */
+static inline gsize
+mpegts_packetizer_find_sync_byte (const guint8 * data, gsize start, gsize end)
+{
+  const guint8 *sync;
+
+  if (G_UNLIKELY (start >= end))
+    return end;
+
+  sync = memchr (data + start, PACKET_SYNC_BYTE, end - start);
+
+  return sync ? sync - data : end;
+}
+
 static gboolean
 mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 {
   guint8 *data;
-  gsize size, i, j;
+  gsize size, limit, i, j;
 
   static const guint psizes[] = {
     MPEGTS_NORMAL_PACKETSIZE,
@@ -741,11 +882,11 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
   size = packetizer->map_size - packetizer->map_offset;
   data = packetizer->map_data + packetizer->map_offset;
 
-  for (i = 0; i + 3 * MPEGTS_MAX_PACKETSIZE < size; i++) {
-    /* find a sync byte */
-    if (data[i] != PACKET_SYNC_BYTE)
-      continue;
+  limit = size - 3 * MPEGTS_MAX_PACKETSIZE;
 
+  /* jump from sync byte to sync byte */
+  for (i = mpegts_packetizer_find_sync_byte (data, 0, limit); i < limit;
+      i = mpegts_packetizer_find_sync_byte (data, i + 1, limit)) {
     /* check for 4 consecutive sync bytes with each possible packet size */
     for (j = 0; j < G_N_ELEMENTS (psizes); j++) {
       guint packet_size = psizes[j];
@@ -784,7 +925,7 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
   gboolean found = FALSE;
   guint8 *data;
   guint packet_size;
-  gsize size, sync_offset, i;
+  gsize size, limit, sync_offset, i;
 
   packet_size = packetizer->packet_size;
 
@@ -799,9 +940,11 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
   else
     sync_offset = 0;
 
-  for (i = sync_offset; i + 2 * packet_size < size; i++) {
-    if (data[i] == PACKET_SYNC_BYTE &&
-        data[i + packet_size] == PACKET_SYNC_BYTE &&
+  limit = size - 2 * packet_size;
+
+  for (i = mpegts_packetizer_find_sync_byte (data, sync_offset, limit);
+      i < limit; i = mpegts_packetizer_find_sync_byte (data, i + 1, limit)) {
+    if (data[i + packet_size] == PACKET_SYNC_BYTE &&
         data[i + 2 * packet_size] == PACKET_SYNC_BYTE) {
       found = TRUE;
       break;
@@ -853,6 +996,10 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
     if (G_UNLIKELY (*packet_data != PACKET_SYNC_BYTE)) {
       GST_DEBUG ("lost sync");
       packetizer->need_sync = TRUE;
+    } else if (PACKET_IS_FILTERED (packetizer, packet_data)) {
+      /* Not interested in this PID, skip it without parsing */
+      packetizer->offset += packet_size;
+      packetizer->map_offset += packet_size;
     } else {
       /* ALL mpeg-ts variants contain 188 bytes of data. Those with bigger
        * packet sizes contain either extra data (timesync, FEC, ..) either
@@ -869,6 +1016,129 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
   }
 }
 
+/**
+ * mpegts_packetizer_next_packets:
+ * @packetizer: a #MpegTSPacketizer2
+ * @packets: array of at least @max_packets packets to fill in
+ * @max_packets: size of @packets
+ * @n_packets: (out): number of valid packets stored in @packets
+ *
+ * Parses as many packets as are available in the currently mapped data, up
+ * to @max_packets, in one pass. The packets are consumed right away and
+ * stay valid until the next call to any mpegts_packetizer_next_packet*()
+ * function. Packets with bad headers or on filtered PIDs (see
+ * mpegts_packetizer_set_pid_filter()) are skipped and not returned, so
+ * @n_packets can be 0 even if some data was consumed. A packet carrying a
+ * PCR is only ever returned as the first packet of a batch.
+ *
+ * Returns: %PACKET_NEED_MORE if no packet could be consumed, else %PACKET_OK
+ */
+MpegTSPacketizerPacketReturn
+mpegts_packetizer_next_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packets, guint max_packets, guint * n_packets)
+{
+  guint8 *data;
+  guint packet_size;
+  gsize sync_offset, avail, i;
+  guint n = 0;
+
+  *n_packets = 0;
+
+  packet_size = packetizer->packet_size;
+  if (G_UNLIKELY (!packet_size)) {
+    if (!mpegts_try_discover_packet_size (packetizer))
+      return PACKET_NEED_MORE;
+    packet_size = packetizer->packet_size;
+  }
+
+  /* M2TS packets don't start with the sync byte, all other variants do */
+  if (packet_size == MPEGTS_M2TS_PACKETSIZE)
+    sync_offset = 4;
+  else
+    sync_offset = 0;
+
+  if (packetizer->need_sync) {
+    if (!mpegts_packetizer_sync (packetizer))
+      return PACKET_NEED_MORE;
+    packetizer->need_sync = FALSE;
+  }
+
+  if (!mpegts_packetizer_map (packetizer, packet_size))
+    return PACKET_NEED_MORE;
+
+  data = packetizer->map_data + packetizer->map_offset;
+  avail = (packetizer->map_size - packetizer->map_offset) / packet_size;
+  avail = MIN (avail, max_packets);
+
+  for (i = 0; i < avail; i++, data += packet_size) {
+    MpegTSPacketizerPacket *packet = &packets[n];
+    guint8 *packet_data = data + sync_offset;
+
+    if (G_UNLIKELY (*packet_data != PACKET_SYNC_BYTE)) {
+      GST_DEBUG ("lost sync");
+      packetizer->need_sync = TRUE;
+      break;
+    }
+
+    if (PACKET_IS_FILTERED (packetizer, packet_data)) {
+      packetizer->offset += packet_size;
+      packetizer->map_offset += packet_size;
+      continue;
+    }
+
+    /* Parsing a PCR updates the clock observations, which must not happen
+     * before the preceding packets were processed. End the batch before
+     * any PCR-carrying packet that isn't the first one */
+    if (i > 0 && FLAGS_HAS_AFC (packet_data[3]) && packet_data[4] > 0
+        && (packet_data[5] & MPEGTS_AFC_PCR_FLAG))
+      break;
+
+    packet->data_start = packet_data;
+    packet->data_end = packet->data_start + 188;
+    packet->offset = packetizer->offset;
+    packetizer->offset += packet_size;
+    packetizer->map_offset += packet_size;
+
+    if (G_LIKELY (mpegts_packetizer_parse_packet (packetizer,
+                packet) == PACKET_OK))
+      n++;
+    else
+      GST_DEBUG ("bad packet at offset %" G_GUINT64_FORMAT ", skipping",
+          packet->offset);
+  }
+
+  GST_LOG ("parsed %u packets out of %" G_GSIZE_FORMAT, n, i);
+
+  *n_packets = n;
+
+  return PACKET_OK;
+}
+
+/**
+ * mpegts_packetizer_unget_packets:
+ * @packetizer: a #MpegTSPacketizer2
+ * @packet: a packet returned by the last mpegts_packetizer_next_packets()
+ *
+ * Puts back @packet and all packets after it, so that they get returned
+ * again by the next call. Used when processing of a batch is aborted.
+ */
+void
+mpegts_packetizer_unget_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packet)
+{
+  gsize sync_offset;
+
+  /* Nothing to put back if the packetizer was flushed in the meantime */
+  if (packetizer->map_data == NULL)
+    return;
+
+  sync_offset = packetizer->packet_size == MPEGTS_M2TS_PACKETSIZE ? 4 : 0;
+
+  packetizer->map_offset =
+      packet->data_start - sync_offset - packetizer->map_data;
+  packetizer->offset = packet->offset;
+}
+
 MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet (MpegTSPacketizer2 * packetizer)
 {
@@ -1094,10 +1364,10 @@ section_start:
     /* Only do fast-path if we have enough byte */
     if (section_length < packet->data_end - data) {
       if ((section =
-              gst_mpegts_section_new (packet->pid, g_memdup (data,
-                      section_length), section_length))) {
+              mpegts_packetizer_new_section (packetizer, packet->pid,
+                  g_memdup (data, section_length), section_length,
+                  packet->offset))) {
         GST_DEBUG ("PID 0x%04x Short section complete !", packet->pid);
-        section->offset = packet->offset;
         if (res)
           others = g_list_append (others, section);
         else
@@ -2468,6 +2738,94 @@ mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
   PACKETIZER_GROUP_UNLOCK (packetizer);
 }
 
+/**
+ * mpegts_packetizer_set_pid_filter:
+ * @packetizer: a #MpegTSPacketizer2
+ * @pid_filter: (allow-none): table of 8192 entries, or %NULL
+ *
+ * Only packets on PIDs with a non-zero entry in @pid_filter will be returned
+ * by the packetizer, all others are skipped before being parsed. The table
+ * is not copied and can be updated by the caller at any time. Set %NULL to
+ * get all packets.
+ */
+void
+mpegts_packetizer_set_pid_filter (MpegTSPacketizer2 * packetizer,
+    const guint8 * pid_filter)
+{
+  packetizer->pid_filter = pid_filter;
+}
+
+/**
+ * mpegts_packetizer_set_keep_buffers:
+ * @packetizer: a #MpegTSPacketizer2
+ * @keep_buffers: whether to keep track of the input buffers
+ *
+ * Makes the packetizer remember which input buffer each byte of the adapter
+ * came from, so that mpegts_packetizer_get_packet_buffer() can be used.
+ * Only buffers pushed after this call are tracked.
+ */
+void
+mpegts_packetizer_set_keep_buffers (MpegTSPacketizer2 * packetizer,
+    gboolean keep_buffers)
+{
+  if (keep_buffers == packetizer->keep_buffers)
+    return;
+
+  packetizer->keep_buffers = keep_buffers;
+  if (keep_buffers) {
+    /* Data already in the adapter is not covered */
+    g_assert (g_queue_is_empty (&packetizer->buffers));
+    packetizer->buffers_start = packetizer->flushed +
+        gst_adapter_available (packetizer->adapter);
+  } else {
+    GstBuffer *buf;
+
+    while ((buf = g_queue_pop_head (&packetizer->buffers)))
+      gst_buffer_unref (buf);
+  }
+}
+
+/**
+ * mpegts_packetizer_get_packet_buffer:
+ * @packetizer: a #MpegTSPacketizer2
+ * @packet: a packet returned by the packetizer, still valid
+ * @offset: (out): offset of the 188 bytes of @packet in the returned buffer
+ *
+ * Returns: (transfer none): the input buffer that contains the whole of
+ * @packet, or %NULL if the packet spans several input buffers or input
+ * buffers are not tracked.
+ */
+GstBuffer *
+mpegts_packetizer_get_packet_buffer (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packet, gsize * offset)
+{
+  guint64 pos, start;
+  GList *l;
+
+  if (!packetizer->keep_buffers || packetizer->map_data == NULL)
+    return NULL;
+
+  pos = packetizer->flushed + (packet->data_start - packetizer->map_data);
+  if (pos < packetizer->buffers_start)
+    return NULL;
+
+  start = packetizer->buffers_start;
+  for (l = packetizer->buffers.head; l; l = l->next) {
+    GstBuffer *buf = l->data;
+    guint64 end = start + gst_buffer_get_size (buf);
+
+    if (pos < end) {
+      if (pos + 188 > end)
+        return NULL;
+      *offset = pos - start;
+      return buf;
+    }
+    start = end;
+  }
+
+  return NULL;
+}
+
 void
 mpegts_packetizer_set_pcr_discont_threshold (MpegTSPacketizer2 * packetizer,
     GstClockTime threshold)
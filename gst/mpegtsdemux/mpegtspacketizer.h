@@ -269,6 +269,27 @@ struct _MpegTSPacketizer2 {
   gsize map_size;
   gboolean need_sync;
 
+  /* Optional table with one entry per PID. Packets on PIDs whose entry
+   * is 0 are dropped right after the header check (owned by the caller) */
+  const guint8 *pid_filter;
+
+  /* Input buffers that still have data in the adapter, oldest first, so
+   * packets can be handed out as sub-buffers. Only tracked if
+   * keep_buffers is set */
+  gboolean keep_buffers;
+  GQueue buffers;
+  /* Adapter position of the first buffer in @buffers */
+  guint64 buffers_start;
+  /* Number of bytes flushed from the adapter since it was last cleared,
+   * which is also the adapter position of map_data */
+  guint64 flushed;
+
+  /* Recently seen sections, so that sections repeating with the same
+   * content are handed out again instead of being re-created and
+   * re-parsed. MpegTSPacketizerCachedSection hashed by
+   * PID/table_id/version/subtable_extension/section_number */
+  GHashTable *section_cache;
+
   /* Reference offset */
   guint64 refoffset;
 
@@ -345,6 +366,11 @@ G_GNUC_INTERNAL gboolean mpegts_packetizer_has_packets (MpegTSPacketizer2 *packe
 G_GNUC_INTERNAL MpegTSPacketizerPacketReturn mpegts_packetizer_next_packet (MpegTSPacketizer2 *packetizer,
   MpegTSPacketizerPacket *packet);
 G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
+mpegts_packetizer_next_packets (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacket *packets, guint max_packets, guint *n_packets);
+G_GNUC_INTERNAL void mpegts_packetizer_unget_packets (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacket *packet);
+G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet(MpegTSPacketizer2 * packetizer);
 G_GNUC_INTERNAL void mpegts_packetizer_clear_packet (MpegTSPacketizer2 *packetizer,
 				     MpegTSPacketizerPacket *packet);
@@ -374,6 +400,16 @@ G_GNUC_INTERNAL void
 mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
 					guint64 refoffset);
 G_GNUC_INTERNAL void
+mpegts_packetizer_set_pid_filter (MpegTSPacketizer2 * packetizer,
+				  const guint8 * pid_filter);
+G_GNUC_INTERNAL void
+mpegts_packetizer_set_keep_buffers (MpegTSPacketizer2 * packetizer,
+				    gboolean keep_buffers);
+G_GNUC_INTERNAL GstBuffer *
+mpegts_packetizer_get_packet_buffer (MpegTSPacketizer2 * packetizer,
+				     MpegTSPacketizerPacket * packet,
+				     gsize * offset);
+G_GNUC_INTERNAL void
 mpegts_packetizer_set_pcr_discont_threshold (MpegTSPacketizer2 * packetizer,
 					GstClockTime threshold);
 G_END_DECLS
@@ -64,6 +64,22 @@ struct _MpegTSParsePad
 
   /* the return of the latest push */
   GstFlowReturn flow_return;
+
+  /* split-programs mode: buffers waiting to be pushed at the end of the
+   * current input buffer */
+  GstBufferList *pending;
+  /* current run of contiguous packets from the same input buffer, pushed
+   * as one sub-buffer */
+  GstBuffer *run_buffer;
+  gsize run_offset;
+  gsize run_size;
+  /* the rewritten PAT, repeated whenever the input repeats its PAT, and
+   * its continuity counter */
+  guint8 pat_packet[188];
+  gboolean have_pat;
+  guint8 pat_cc;
+  /* whether caps and segment were sent */
+  gboolean prepared;
 };
 
 static GstStaticPadTemplate src_template =
@@ -84,6 +100,7 @@ enum
   PROP_SET_TIMESTAMPS,
   PROP_SMOOTHING_LATENCY,
   PROP_PCR_PID,
+  PROP_SPLIT_PROGRAMS,
   /* FILL ME */
 };
 
@@ -115,6 +132,7 @@ static void mpegts_parse_release_pad (GstElement * element, GstPad * pad);
 static gboolean mpegts_parse_src_pad_query (GstPad * pad, GstObject * parent,
     GstQuery * query);
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
+static void mpegts_parse_tspad_clear_pending (MpegTSParsePad * tspad);
 
 #define mpegts_parse_parent_class parent_class
 G_DEFINE_TYPE (MpegTSParse2, mpegts_parse, GST_TYPE_MPEGTS_BASE);
@@ -160,6 +178,22 @@ mpegts_parse_class_init (MpegTSParse2Class * klass)
           "Set the PID to use for PCR values (-1 for auto)",
           -1, G_MAXINT, -1, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * tsparse:split-programs:
+   *
+   * Automatically create a program_%u source pad for each program of the
+   * stream. Each pad gets a PAT that only lists its program, followed by the
+   * packets of that program as sub-buffers of the input buffers. A single
+   * parser can thereby split a multi-program stream in one pass.
+   *
+   * Since: 1.18
+   */
+  g_object_class_install_property (gobject_class, PROP_SPLIT_PROGRAMS,
+      g_param_spec_boolean ("split-programs", "Split programs",
+          "Create one source pad per program, carrying a rewritten PAT and "
+          "the program packets without copying them", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   element_class->pad_removed = mpegts_parse_pad_removed;
   element_class->request_new_pad = mpegts_parse_request_new_pad;
@@ -213,6 +247,7 @@ static void
 mpegts_parse_reset (MpegTSBase * base)
 {
   MpegTSParse2 *parse = (MpegTSParse2 *) base;
+  GList *tmp;
 
   /* Set the various know PIDs we are interested in */
 
@@ -250,6 +285,18 @@ mpegts_parse_reset (MpegTSBase * base)
   parse->bytes_since_pcr = 0;
   parse->pcr_pid = parse->user_pcr_pid;
   parse->ts_offset = 0;
+  parse->pat_tsid = -1;
+  parse->pat_version = -1;
+
+  GST_OBJECT_LOCK (parse);
+  for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
+    MpegTSParsePad *tspad = gst_pad_get_element_private (tmp->data);
+
+    mpegts_parse_tspad_clear_pending (tspad);
+    tspad->have_pat = FALSE;
+    tspad->prepared = FALSE;
+  }
+  GST_OBJECT_UNLOCK (parse);
 }
 
 static void
@@ -270,6 +317,15 @@ mpegts_parse_set_property (GObject * object, guint prop_id,
     case PROP_PCR_PID:
       parse->pcr_pid = parse->user_pcr_pid = g_value_get_int (value);
       break;
+    case PROP_SPLIT_PROGRAMS:
+      parse->split_programs = g_value_get_boolean (value);
+      mpegts_packetizer_set_keep_buffers (GST_MPEGTS_BASE (parse)->packetizer,
+          parse->split_programs);
+      if (parse->split_programs) {
+        GST_MPEGTS_BASE (parse)->push_data = TRUE;
+        GST_MPEGTS_BASE (parse)->push_section = TRUE;
+      }
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -291,6 +347,9 @@ mpegts_parse_get_property (GObject * object, guint prop_id,
     case PROP_PCR_PID:
       g_value_set_int (value, parse->pcr_pid);
       break;
+    case PROP_SPLIT_PROGRAMS:
+      g_value_set_boolean (value, parse->split_programs);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -416,6 +475,8 @@ mpegts_parse_create_tspad (MpegTSParse2 * parse, const gchar * pad_name)
 static void
 mpegts_parse_destroy_tspad (MpegTSParse2 * parse, MpegTSParsePad * tspad)
 {
+  mpegts_parse_tspad_clear_pending (tspad);
+
   /* free the wrapper */
   g_free (tspad);
 }
@@ -436,7 +497,7 @@ mpegts_parse_pad_removed (GstElement * element, GstPad * pad)
 
     parse->srcpads = g_list_remove_all (parse->srcpads, pad);
   }
-  if (parse->srcpads == NULL) {
+  if (parse->srcpads == NULL && !parse->split_programs) {
     base->push_data = FALSE;
     base->push_section = FALSE;
   }
@@ -525,11 +586,10 @@ mpegts_parse_release_pad (GstElement * element, GstPad * pad)
   gst_element_remove_pad (element, pad);
 }
 
-static GstFlowReturn
-mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
-    GstMpegtsSection * section, MpegTSPacketizerPacket * packet)
+static gboolean
+mpegts_parse_tspad_wants_section (MpegTSParse2 * parse,
+    MpegTSParsePad * tspad, GstMpegtsSection * section)
 {
-  GstFlowReturn ret = GST_FLOW_OK;
   gboolean to_push = TRUE;
 
   if (tspad->program_number != -1) {
@@ -553,7 +613,35 @@ mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
       "pushing section: %d program number: %d table_id: %d", to_push,
       tspad->program_number, section->table_id);
 
-  if (to_push) {
+  return to_push;
+}
+
+static gboolean
+mpegts_parse_tspad_wants_packet (MpegTSParse2 * parse, MpegTSParsePad * tspad,
+    MpegTSPacketizerPacket * packet)
+{
+  MpegTSBaseProgram *bp = NULL;
+
+  if (tspad->program_number != -1) {
+    if (tspad->program)
+      bp = (MpegTSBaseProgram *) tspad->program;
+    else
+      bp = mpegts_base_get_program ((MpegTSBase *) parse,
+          tspad->program_number);
+  }
+
+  /* push if there's no filter or if the pid is in the filter */
+  return bp && (packet->pid == bp->pmt_pid || bp->streams == NULL
+      || bp->streams[packet->pid]);
+}
+
+static GstFlowReturn
+mpegts_parse_tspad_push_section (MpegTSParse2 * parse, MpegTSParsePad * tspad,
+    GstMpegtsSection * section, MpegTSPacketizerPacket * packet)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (mpegts_parse_tspad_wants_section (parse, tspad, section)) {
     GstBuffer *buf =
         gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
     gst_buffer_fill (buf, 0, packet->data_start,
@@ -571,29 +659,260 @@ mpegts_parse_tspad_push (MpegTSParse2 * parse, MpegTSParsePad * tspad,
     MpegTSPacketizerPacket * packet)
 {
   GstFlowReturn ret = GST_FLOW_OK;
-  MpegTSBaseProgram *bp = NULL;
 
-  if (tspad->program_number != -1) {
-    if (tspad->program)
-      bp = (MpegTSBaseProgram *) tspad->program;
-    else
-      bp = mpegts_base_get_program ((MpegTSBase *) parse,
-          tspad->program_number);
+  if (mpegts_parse_tspad_wants_packet (parse, tspad, packet)) {
+    GstBuffer *buf =
+        gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
+    gst_buffer_fill (buf, 0, packet->data_start,
+        packet->data_end - packet->data_start);
+    ret = gst_pad_push (tspad->pad, buf);
+    ret = gst_flow_combiner_update_flow (parse->flowcombiner, ret);
   }
+  GST_DEBUG_OBJECT (parse, "Returning %s", gst_flow_get_name (ret));
 
-  if (bp) {
-    if (packet->pid == bp->pmt_pid || bp->streams == NULL
-        || bp->streams[packet->pid]) {
-      GstBuffer *buf =
-          gst_buffer_new_and_alloc (packet->data_end - packet->data_start);
-      gst_buffer_fill (buf, 0, packet->data_start,
-          packet->data_end - packet->data_start);
-      /* push if there's no filter or if the pid is in the filter */
-      ret = gst_pad_push (tspad->pad, buf);
-      ret = gst_flow_combiner_update_flow (parse->flowcombiner, ret);
+  return ret;
+}
+
+/* split-programs mode: instead of pushing every packet on its own, the
+ * packets for each pad are collected while parsing an input buffer and then
+ * pushed as one buffer list. Consecutive packets of the same input buffer
+ * are merged into a single sub-buffer of it. */
+
+static void
+mpegts_parse_tspad_add_pending (MpegTSParsePad * tspad, GstBuffer * buf)
+{
+  if (tspad->pending == NULL)
+    tspad->pending = gst_buffer_list_new ();
+  gst_buffer_list_add (tspad->pending, buf);
+}
+
+static void
+mpegts_parse_tspad_flush_run (MpegTSParsePad * tspad)
+{
+  if (tspad->run_buffer == NULL)
+    return;
+
+  mpegts_parse_tspad_add_pending (tspad,
+      gst_buffer_copy_region (tspad->run_buffer, GST_BUFFER_COPY_MEMORY,
+          tspad->run_offset, tspad->run_size));
+  gst_buffer_unref (tspad->run_buffer);
+  tspad->run_buffer = NULL;
+}
+
+static void
+mpegts_parse_tspad_clear_pending (MpegTSParsePad * tspad)
+{
+  if (tspad->run_buffer) {
+    gst_buffer_unref (tspad->run_buffer);
+    tspad->run_buffer = NULL;
+  }
+  if (tspad->pending) {
+    gst_buffer_list_unref (tspad->pending);
+    tspad->pending = NULL;
+  }
+}
+
+static void
+mpegts_parse_tspad_queue_packet (MpegTSParse2 * parse, MpegTSParsePad * tspad,
+    MpegTSPacketizerPacket * packet)
+{
+  MpegTSBase *base = (MpegTSBase *) parse;
+  GstBuffer *buf;
+  gsize offset;
+
+  buf = mpegts_packetizer_get_packet_buffer (base->packetizer, packet, &offset);
+
+  /* Extend the current run if the packet directly follows it */
+  if (buf && buf == tspad->run_buffer
+      && offset == tspad->run_offset + tspad->run_size) {
+    tspad->run_size += 188;
+    return;
+  }
+
+  mpegts_parse_tspad_flush_run (tspad);
+
+  if (buf) {
+    tspad->run_buffer = gst_buffer_ref (buf);
+    tspad->run_offset = offset;
+    tspad->run_size = 188;
+  } else {
+    /* The packet is split over two input buffers */
+    buf = gst_buffer_new_and_alloc (188);
+    gst_buffer_fill (buf, 0, packet->data_start, 188);
+    mpegts_parse_tspad_add_pending (tspad, buf);
+  }
+}
+
+/* Returns the next copy of the PAT packet of @tspad */
+static GstBuffer *
+mpegts_parse_tspad_next_pat (MpegTSParsePad * tspad)
+{
+  GstBuffer *buf = gst_buffer_new_and_alloc (188);
+
+  /* payload only */
+  tspad->pat_packet[3] = 0x10 | tspad->pat_cc;
+  tspad->pat_cc = (tspad->pat_cc + 1) & 0x0f;
+  gst_buffer_fill (buf, 0, tspad->pat_packet, 188);
+
+  return buf;
+}
+
+/* Creates the PAT packet only listing the program of @tspad, based on the
+ * last PAT of the input */
+static gboolean
+mpegts_parse_tspad_make_pat (MpegTSParse2 * parse, MpegTSParsePad * tspad)
+{
+  MpegTSBaseProgram *program = (MpegTSBaseProgram *) tspad->program;
+  GstMpegtsPatProgram *pat_program;
+  GstMpegtsSection *pat;
+  GPtrArray *programs;
+  guint8 *data;
+  gsize size;
+
+  programs = gst_mpegts_pat_new ();
+  pat_program = gst_mpegts_pat_program_new ();
+  pat_program->program_number = program->program_number;
+  pat_program->network_or_program_map_PID = program->pmt_pid;
+  g_ptr_array_add (programs, pat_program);
+
+  pat = gst_mpegts_section_from_pat (programs, parse->pat_tsid);
+  pat->version_number = parse->pat_version;
+
+  data = gst_mpegts_section_packetize (pat, &size);
+  if (data && size <= 188 - 5) {
+    tspad->pat_packet[0] = 0x47;
+    /* payload_unit_start_indicator, PID 0 */
+    tspad->pat_packet[1] = 0x40;
+    tspad->pat_packet[2] = 0x00;
+    /* pointer_field */
+    tspad->pat_packet[4] = 0x00;
+    memcpy (tspad->pat_packet + 5, data, size);
+    memset (tspad->pat_packet + 5 + size, 0xff, 188 - 5 - size);
+    tspad->have_pat = TRUE;
+  } else {
+    GST_WARNING_OBJECT (parse, "Failed to create PAT for program %d",
+        program->program_number);
+    tspad->have_pat = FALSE;
+  }
+
+  gst_mpegts_section_unref (pat);
+
+  return tspad->have_pat;
+}
+
+static GstFlowReturn
+mpegts_parse_queue (MpegTSParse2 * parse, MpegTSPacketizerPacket * packet,
+    GstMpegtsSection * section)
+{
+  GList *tmp;
+
+  if (section && section->table_id == 0x00) {
+    parse->pat_tsid = section->subtable_extension;
+    parse->pat_version = section->version_number;
+  }
+
+  GST_OBJECT_LOCK (parse);
+  for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
+    MpegTSParsePad *tspad = gst_pad_get_element_private (tmp->data);
+
+    if (section) {
+      if (!mpegts_parse_tspad_wants_section (parse, tspad, section))
+        continue;
+
+      /* Replace the PAT by one only listing the program of the pad */
+      if (section->table_id == 0x00 && tspad->program) {
+        if (mpegts_parse_tspad_make_pat (parse, tspad)) {
+          mpegts_parse_tspad_flush_run (tspad);
+          mpegts_parse_tspad_add_pending (tspad,
+              mpegts_parse_tspad_next_pat (tspad));
+        }
+        continue;
+      }
+    } else if (packet->pid == 0x00) {
+      /* An unchanged PAT doesn't make it to a section. Repeat the PAT of
+       * the pad along with the input so that the output can be joined at
+       * any point */
+      if (tspad->program && parse->pat_tsid != -1
+          && packet->payload_unit_start_indicator
+          && (tspad->have_pat || mpegts_parse_tspad_make_pat (parse, tspad))) {
+        mpegts_parse_tspad_flush_run (tspad);
+        mpegts_parse_tspad_add_pending (tspad,
+            mpegts_parse_tspad_next_pat (tspad));
+      }
+      continue;
+    } else if (!mpegts_parse_tspad_wants_packet (parse, tspad, packet)) {
+      continue;
     }
+
+    mpegts_parse_tspad_queue_packet (parse, tspad, packet);
   }
-  GST_DEBUG_OBJECT (parse, "Returning %s", gst_flow_get_name (ret));
+  GST_OBJECT_UNLOCK (parse);
+
+  return GST_FLOW_OK;
+}
+
+static void
+mpegts_parse_prepare_tspad (MpegTSParse2 * parse, MpegTSParsePad * tspad)
+{
+  GstEvent *event;
+  GstCaps *caps;
+
+  caps = gst_caps_new_simple ("video/mpegts",
+      "systemstream", G_TYPE_BOOLEAN, TRUE,
+      "packetsize", G_TYPE_INT, 188, NULL);
+  gst_pad_set_caps (tspad->pad, caps);
+  gst_caps_unref (caps);
+
+  /* Same segment as the main source pad */
+  event = gst_pad_get_sticky_event (parse->srcpad, GST_EVENT_SEGMENT, 0);
+  if (event)
+    gst_pad_push_event (tspad->pad, event);
+
+  tspad->prepared = TRUE;
+}
+
+/* Pushes out everything that was queued for the program pads while
+ * parsing the last input buffer */
+static GstFlowReturn
+mpegts_parse_push_pending (MpegTSParse2 * parse)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *tmp, *pads = NULL;
+
+  GST_OBJECT_LOCK (parse);
+  for (tmp = parse->srcpads; tmp; tmp = tmp->next) {
+    MpegTSParsePad *tspad = gst_pad_get_element_private (tmp->data);
+
+    mpegts_parse_tspad_flush_run (tspad);
+    if (tspad->pending)
+      pads = g_list_prepend (pads, gst_object_ref (tmp->data));
+  }
+  GST_OBJECT_UNLOCK (parse);
+
+  pads = g_list_reverse (pads);
+  for (tmp = pads; tmp; tmp = tmp->next) {
+    GstPad *pad = tmp->data;
+    MpegTSParsePad *tspad = gst_pad_get_element_private (pad);
+    GstBufferList *list;
+
+    GST_OBJECT_LOCK (parse);
+    list = tspad->pending;
+    tspad->pending = NULL;
+    GST_OBJECT_UNLOCK (parse);
+
+    if (list == NULL)
+      continue;
+
+    if (G_UNLIKELY (!tspad->prepared))
+      mpegts_parse_prepare_tspad (parse, tspad);
+
+    GST_LOG_OBJECT (pad, "Pushing %u buffers", gst_buffer_list_length (list));
+
+    tspad->flow_return = gst_pad_push_list (pad, list);
+    ret = gst_flow_combiner_update_flow (parse->flowcombiner,
+        tspad->flow_return);
+  }
+  g_list_free_full (pads, gst_object_unref);
 
   return ret;
 }
@@ -619,6 +938,9 @@ mpegts_parse_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
   GstFlowReturn ret;
   GList *srcpads;
 
+  if (parse->split_programs)
+    return mpegts_parse_queue (parse, packet, section);
+
   GST_OBJECT_LOCK (parse);
   srcpads = parse->srcpads;
 
@@ -881,6 +1203,15 @@ mpegts_parse_input_done (MpegTSBase * base, GstBuffer * buffer)
   if (!prepare_src_pad (base, parse))
     return GST_FLOW_OK;
 
+  if (parse->split_programs) {
+    ret = mpegts_parse_push_pending (parse);
+    if (ret != GST_FLOW_OK) {
+      if (buffer)
+        gst_buffer_unref (buffer);
+      return ret;
+    }
+  }
+
   if (parse->pending_buffers != NULL) {
     /* Don't keep pending_buffers if not setting output timestamps */
     gboolean drain_all = (parse->set_timestamps == FALSE);
@@ -915,6 +1246,30 @@ find_pad_for_program (MpegTSParse2 * parse, guint program_number)
   return NULL;
 }
 
+/* Requests a program pad on behalf of the application in split-programs
+ * mode */
+static MpegTSParsePad *
+mpegts_parse_add_program_pad (MpegTSParse2 * parse, gint program_number)
+{
+  MpegTSParsePad *tspad;
+  GstPad *pad;
+  gchar *pad_name;
+
+  pad_name = g_strdup_printf ("program_%d", program_number);
+  GST_DEBUG_OBJECT (parse, "Adding pad %s", pad_name);
+  pad = gst_element_get_request_pad (GST_ELEMENT_CAST (parse), pad_name);
+  g_free (pad_name);
+
+  if (pad == NULL)
+    return NULL;
+
+  tspad = gst_pad_get_element_private (pad);
+  /* The element keeps its own reference */
+  gst_object_unref (pad);
+
+  return tspad;
+}
+
 static void
 mpegts_parse_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
 {
@@ -925,6 +1280,9 @@ mpegts_parse_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
   /* If we have a request pad for that program, activate it */
   tspad = find_pad_for_program (parse, program->program_number);
 
+  if (tspad == NULL && parse->split_programs)
+    tspad = mpegts_parse_add_program_pad (parse, program->program_number);
+
   if (tspad) {
     tspad->program = parseprogram;
     parseprogram->tspad = tspad;
@@ -71,6 +71,14 @@ struct _MpegTSParse2 {
   gboolean first;
   gboolean set_timestamps;
 
+  /* Create one source pad per program and push the packets as sub-buffers
+   * of the input once per input buffer */
+  gboolean split_programs;
+  /* transport_stream_id and version of the last PAT, -1 if none yet,
+   * used for the PATs of the program pads */
+  gint pat_tsid;
+  gint pat_version;
+
   /* Pending buffer state */
   GList *pending_buffers;
   GstClockTime previous_pcr;
@@ -282,6 +282,8 @@ enum
   PROP_0,
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
+  PROP_PROGRAM_FILTER,
+  PROP_INDEX_LOCATION,
   /* FILL ME */
 };
 
@@ -298,6 +300,9 @@ gst_ts_demux_program_stopped (MpegTSBase * base, MpegTSBaseProgram * program);
 static gboolean
 gst_ts_demux_can_remove_program (MpegTSBase * base,
     MpegTSBaseProgram * program);
+static gboolean
+gst_ts_demux_is_program_wanted (MpegTSBase * base,
+    MpegTSBaseProgram * program);
 static void gst_ts_demux_reset (MpegTSBase * base);
 static GstFlowReturn
 gst_ts_demux_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
@@ -321,6 +326,8 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
 static void gst_ts_demux_stream_flush (TSDemuxStream * stream,
     GstTSDemux * demux, gboolean hard);
 
+static void gst_ts_demux_save_index (GstTSDemux * demux);
+
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
 static gboolean sink_query (MpegTSBase * base, GstQuery * query);
 static void gst_ts_demux_check_and_sync_streams (GstTSDemux * demux,
@@ -349,6 +356,10 @@ gst_ts_demux_dispose (GObject * object)
 
   gst_flow_combiner_free (demux->flowcombiner);
 
+  gst_ts_demux_save_index (demux);
+  g_free (demux->index_location);
+  demux->index_location = NULL;
+
   GST_CALL_PARENT (G_OBJECT_CLASS, dispose, (object));
 }
 
@@ -374,6 +385,36 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           "Emit messages for every pcr/opcr/pts/dts", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstTSDemux:program-filter:
+   *
+   * Drop all packets that are neither PSI nor part of the selected program
+   * (see #GstTSDemux:program-number) right after reading their header,
+   * without parsing them any further. This speeds up demuxing a single
+   * service from a multi program transport stream.
+   *
+   * Since: 1.18
+   */
+  g_object_class_install_property (gobject_class, PROP_PROGRAM_FILTER,
+      g_param_spec_boolean ("program-filter", "Program filter",
+          "Drop packets not belonging to the selected program before parsing",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstTSDemux:index-location:
+   *
+   * Location of a sidecar file to store the seek index in. In pull mode the
+   * PCR and keyframe positions are recorded during playback and saved to
+   * this file when stopping. If the file already exists and matches the
+   * stream, seeks go straight to the indexed keyframe.
+   *
+   * Since: 1.18
+   */
+  g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+      g_param_spec_string ("index-location", "Index location",
+          "Location of the seek index sidecar file (NULL to not use one)",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
@@ -400,6 +441,7 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
   ts_class->program_stopped = GST_DEBUG_FUNCPTR (gst_ts_demux_program_stopped);
   ts_class->update_program = GST_DEBUG_FUNCPTR (gst_ts_demux_update_program);
   ts_class->can_remove_program = gst_ts_demux_can_remove_program;
+  ts_class->is_program_wanted = gst_ts_demux_is_program_wanted;
   ts_class->stream_added = gst_ts_demux_stream_added;
   ts_class->stream_removed = gst_ts_demux_stream_removed;
   ts_class->seek = GST_DEBUG_FUNCPTR (gst_ts_demux_do_seek);
@@ -434,6 +476,8 @@ gst_ts_demux_reset (MpegTSBase * base)
 
   demux->last_seek_offset = -1;
   demux->program_generation = 0;
+
+  gst_ts_demux_save_index (demux);
 }
 
 static void
@@ -464,10 +508,21 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
       /* FIXME: do something if program is switched as opposed to set at
        * beginning */
       demux->requested_program_number = g_value_get_int (value);
+      mpegts_base_invalidate_pid_filter (GST_MPEGTS_BASE (demux));
       break;
     case PROP_EMIT_STATS:
       demux->emit_statistics = g_value_get_boolean (value);
       break;
+    case PROP_PROGRAM_FILTER:
+      mpegts_base_set_pid_filtering (GST_MPEGTS_BASE (demux),
+          g_value_get_boolean (value));
+      break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_free (demux->index_location);
+      demux->index_location = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -486,6 +541,15 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       g_value_set_boolean (value, demux->emit_statistics);
       break;
+    case PROP_PROGRAM_FILTER:
+      g_value_set_boolean (value,
+          g_atomic_int_get (&GST_MPEGTS_BASE (demux)->filter_pids_requested));
+      break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_string (value, demux->index_location);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -822,6 +886,103 @@ gst_ts_demux_adjust_seek_offset_for_keyframe (TSDemuxStream * stream,
   return TRUE;
 }
 
+/* Returns the seek index, loading it from the sidecar file first if needed.
+ * Only available in pull mode, where packet offsets are file offsets */
+static MpegTSIndex *
+gst_ts_demux_get_index (GstTSDemux * demux)
+{
+  MpegTSBase *base = (MpegTSBase *) demux;
+  GError *err = NULL;
+  gint64 size;
+
+  if (G_LIKELY (demux->index || demux->index_disabled))
+    return demux->index;
+
+  if (demux->index_location == NULL || base->mode == BASE_MODE_PUSHING)
+    return NULL;
+
+  /* The stream size identifies the stream the index belongs to */
+  if (!gst_pad_peer_query_duration (base->sinkpad, GST_FORMAT_BYTES, &size)
+      || size <= 0) {
+    GST_INFO_OBJECT (demux, "Unknown stream size, not using an index");
+    demux->index_disabled = TRUE;
+    return NULL;
+  }
+
+  demux->index = mpegts_index_load (demux->index_location, &err);
+  if (err) {
+    GST_INFO_OBJECT (demux, "Could not load index: %s", err->message);
+    g_clear_error (&err);
+  } else if (demux->index->stream_size != size) {
+    GST_INFO_OBJECT (demux, "Index is for another stream, discarding it");
+    mpegts_index_free (demux->index);
+    demux->index = NULL;
+  }
+
+  if (demux->index == NULL)
+    demux->index = mpegts_index_new (size);
+
+  return demux->index;
+}
+
+static void
+gst_ts_demux_save_index (GstTSDemux * demux)
+{
+  GError *err = NULL;
+
+  if (demux->index == NULL)
+    goto done;
+
+  if (demux->index->dirty && demux->index_location) {
+    if (!mpegts_index_save (demux->index, demux->index_location, &err)) {
+      GST_WARNING_OBJECT (demux, "Could not save index: %s", err->message);
+      g_clear_error (&err);
+    }
+  }
+
+  mpegts_index_free (demux->index);
+  demux->index = NULL;
+
+done:
+  demux->index_disabled = FALSE;
+}
+
+static inline void
+gst_ts_demux_index_add (GstTSDemux * demux, guint64 offset, GstClockTime ts,
+    MpegTSIndexEntryFlags flags)
+{
+  MpegTSIndex *index;
+
+  /* Only record what is read during normal playback */
+  if (((MpegTSBase *) demux)->mode != BASE_MODE_STREAMING
+      || !GST_CLOCK_TIME_IS_VALID (ts))
+    return;
+
+  index = gst_ts_demux_get_index (demux);
+  if (index)
+    mpegts_index_add_entry (index, offset, ts, flags);
+}
+
+/* Returns the offset to start reading at for a seek to @ts, or -1 if the
+ * index can't tell */
+static guint64
+gst_ts_demux_index_lookup (GstTSDemux * demux, GstClockTime ts)
+{
+  MpegTSIndex *index = gst_ts_demux_get_index (demux);
+  const MpegTSIndexEntry *entry;
+
+  if (index == NULL)
+    return -1;
+
+  entry = mpegts_index_lookup (index, ts, MPEGTS_INDEX_ENTRY_KEYFRAME);
+  if (entry == NULL)
+    entry = mpegts_index_lookup (index,
+        ts > SEEK_TIMESTAMP_OFFSET ? ts - SEEK_TIMESTAMP_OFFSET : 0,
+        MPEGTS_INDEX_ENTRY_PCR);
+
+  return entry ? entry->offset : -1;
+}
+
 static GstFlowReturn
 gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
 {
@@ -857,9 +1018,11 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
   GST_DEBUG_OBJECT (demux, "configuring seek");
 
   if (start_type != GST_SEEK_TYPE_NONE) {
-    start_offset =
-        mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
-            start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
+    start_offset = gst_ts_demux_index_lookup (demux, MAX (0, start));
+    if (start_offset == -1)
+      start_offset =
+          mpegts_packetizer_ts_to_offset (base->packetizer, MAX (0,
+              start - SEEK_TIMESTAMP_OFFSET), demux->program->pcr_pid);
 
     if (G_UNLIKELY (start_offset == -1)) {
       GST_WARNING ("Couldn't convert start position to an offset");
@@ -1954,6 +2117,18 @@ gst_ts_demux_can_remove_program (MpegTSBase * base, MpegTSBaseProgram * program)
   return TRUE;
 }
 
+static gboolean
+gst_ts_demux_is_program_wanted (MpegTSBase * base, MpegTSBaseProgram * program)
+{
+  GstTSDemux *demux = GST_TS_DEMUX (base);
+
+  if (demux->requested_program_number != -1)
+    return program->program_number == demux->requested_program_number;
+
+  /* Without a requested program, keep everything until one got selected */
+  return demux->program == NULL || demux->program == program;
+}
+
 static void
 gst_ts_demux_update_program (MpegTSBase * base, MpegTSBaseProgram * program)
 {
@@ -2416,6 +2591,15 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
 
       /* parse the header */
       gst_ts_demux_parse_pes_header (demux, stream, data, size, packet->offset);
+
+      /* Record video random access points in the seek index */
+      if (G_UNLIKELY (demux->index_location
+              && packet->afc_flags & MPEGTS_AFC_RANDOM_ACCES_FLAGS)
+          && stream->state == PENDING_PACKET_BUFFER
+          && gst_stream_get_stream_type (stream->stream.stream_object) &
+          GST_STREAM_TYPE_VIDEO)
+        gst_ts_demux_index_add (demux, packet->offset, stream->pts,
+            MPEGTS_INDEX_ENTRY_KEYFRAME);
       break;
     }
     case PENDING_PACKET_BUFFER:
@@ -3193,6 +3377,13 @@ gst_ts_demux_push (MpegTSBase * base, MpegTSPacketizerPacket * packet,
   GstFlowReturn res = GST_FLOW_OK;
 
   if (G_LIKELY (demux->program)) {
+    if (G_UNLIKELY (demux->index_location && packet->pcr != G_MAXUINT64
+            && packet->pid == demux->program->pcr_pid))
+      gst_ts_demux_index_add (demux, packet->offset,
+          mpegts_packetizer_pts_to_ts (base->packetizer,
+              PCRTIME_TO_GSTTIME (packet->pcr), packet->pid),
+          MPEGTS_INDEX_ENTRY_PCR);
+
     stream = (TSDemuxStream *) demux->program->streams[packet->pid];
 
     if (stream) {
@@ -3208,6 +3399,7 @@ gst_ts_demux_plugin_init (GstPlugin * plugin)
   GST_DEBUG_CATEGORY_INIT (ts_demux_debug, "tsdemux", 0,
       "MPEG transport stream demuxer");
   init_pes_parser ();
+  init_mpegts_index ();
 
   return gst_element_register (plugin, "tsdemux",
       GST_RANK_PRIMARY, GST_TYPE_TS_DEMUX);
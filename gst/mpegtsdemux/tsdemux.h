@@ -32,6 +32,7 @@
 #include <gst/base/gstflowcombiner.h>
 #include "mpegtsbase.h"
 #include "mpegtspacketizer.h"
+#include "mpegtsindex.h"
 
 /* color specifications for JPEG 2000 stream over MPEG TS */
 typedef enum
@@ -101,6 +102,12 @@ struct _GstTSDemux
 
   /* Used when seeking for a keyframe to go backward in the stream */
   guint64 last_seek_offset;
+
+  /* Seek index sidecar file, and the index built/loaded in pull mode */
+  gchar *index_location;
+  MpegTSIndex *index;
+  /* TRUE if the index can't be used for the current stream */
+  gboolean index_disabled;
 };
 
 struct _GstTSDemuxClass
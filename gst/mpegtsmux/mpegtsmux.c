@@ -115,11 +115,21 @@ enum
   PROP_PAT_INTERVAL,
   PROP_PMT_INTERVAL,
   PROP_ALIGNMENT,
-  PROP_SI_INTERVAL
+  PROP_SI_INTERVAL,
+  PROP_BATCH_PACKETS,
+  PROP_BITRATE,
+  PROP_PCR_INTERVAL,
+  PROP_PACKETIZE_THREADS
 };
 
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
+#define MPEGTSMUX_DEFAULT_BATCH_PACKETS FALSE
+#define MPEGTSMUX_DEFAULT_BITRATE      0
+#define MPEGTSMUX_DEFAULT_PACKETIZE_THREADS 0
+
+/* packets per output buffer in batch mode when alignment is not set */
+#define MPEGTSMUX_DEFAULT_CHUNK_PACKETS 32
 
 static GstStaticPadTemplate mpegtsmux_sink_factory =
     GST_STATIC_PAD_TEMPLATE ("sink_%d",
@@ -182,6 +192,12 @@ static GstFlowReturn mpegtsmux_collect_packet (MpegTsMux * mux,
 static GstFlowReturn mpegtsmux_push_packets (MpegTsMux * mux, gboolean force);
 static gboolean new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf,
     gint64 new_pcr);
+static guint8 *alloc_chunk_packet_cb (void *user_data);
+static gboolean new_chunk_packet_cb (guint8 * packet, void *user_data,
+    gint64 new_pcr);
+static void mpegtsmux_finish_chunks (MpegTsMux * mux);
+static void mpegtsmux_free_chunks (MpegTsMux * mux);
+static void packetize_job_cb (void *job_data, void *user_data);
 
 static void mpegtsmux_prepare_srcpad (MpegTsMux * mux);
 GstFlowReturn mpegtsmux_clip_inc_running_time (GstCollectPads * pads,
@@ -216,6 +232,17 @@ typedef struct
   GstBuffer *buffer;
 } StreamData;
 
+/* Output state of a buffer whose packets are prepared by the packetizing
+ * threads, restored when they are written out */
+typedef struct
+{
+  gboolean is_delta;
+  gboolean is_header;
+  GstClockTime last_ts;
+} PacketizeJobData;
+
+static void packetize_job_data_free (PacketizeJobData * data);
+
 G_DEFINE_TYPE (MpegTsMux, mpegtsmux, GST_TYPE_ELEMENT)
 
 /* Takes over the ref on the buffer */
@@ -305,6 +332,46 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
           "Set the interval (in ticks of the 90kHz clock) for writing out the Service"
           "Information tables", 1, G_MAXUINT, TSMUX_DEFAULT_SI_INTERVAL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_BATCH_PACKETS,
+      g_param_spec_boolean ("batch-packets", "Batch packets",
+          "Write packets directly into pooled output buffers of 'alignment' "
+          "packets (32 if alignment is auto or 0) instead of allocating "
+          "one buffer per packet",
+          MPEGTSMUX_DEFAULT_BATCH_PACKETS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_BITRATE,
+      g_param_spec_uint64 ("bitrate", "Bitrate (in bits per second)",
+          "Set the target bitrate, will insert null packets as padding "
+          "to achieve multiplex-wide constant bitrate (0 = no padding)",
+          0, G_MAXUINT64, MPEGTSMUX_DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_PCR_INTERVAL,
+      g_param_spec_uint ("pcr-interval", "PCR interval",
+          "Set the interval (in ticks of the 90kHz clock) for writing PCR",
+          1, G_MAXUINT, TSMUX_DEFAULT_PCR_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * mpegtsmux:packetize-threads:
+   *
+   * Number of threads splitting the input buffers into TS packets. With many
+   * streams, the packets of different streams are then prepared in parallel
+   * and interleaved in the same order as without threads, so the output is
+   * the same. Only used without constant bitrate.
+   *
+   * Since: 1.18
+   */
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_PACKETIZE_THREADS, g_param_spec_uint ("packetize-threads",
+          "Packetize threads",
+          "Number of threads preparing TS packets of the streams in parallel "
+          "(0 = in the streaming thread)", 0, 64,
+          MPEGTSMUX_DEFAULT_PACKETIZE_THREADS,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+          G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -330,6 +397,7 @@ mpegtsmux_init (MpegTsMux * mux)
 
   mux->adapter = gst_adapter_new ();
   mux->out_adapter = gst_adapter_new ();
+  mux->m2ts_pending = g_array_new (FALSE, FALSE, sizeof (guint8 *));
 
   /* properties */
   mux->m2ts_mode = MPEGTSMUX_DEFAULT_M2TS;
@@ -338,6 +406,10 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->si_interval = TSMUX_DEFAULT_SI_INTERVAL;
   mux->prog_map = NULL;
   mux->alignment = MPEGTSMUX_DEFAULT_ALIGNMENT;
+  mux->batch_packets = MPEGTSMUX_DEFAULT_BATCH_PACKETS;
+  mux->bitrate = MPEGTSMUX_DEFAULT_BITRATE;
+  mux->pcr_interval = TSMUX_DEFAULT_PCR_INTERVAL;
+  mux->packetize_threads = MPEGTSMUX_DEFAULT_PACKETIZE_THREADS;
 
   /* initial state */
   mpegtsmux_reset (mux, TRUE);
@@ -385,6 +457,7 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
   mux->previous_offset = 0;
   mux->pcr_rate_num = mux->pcr_rate_den = 1;
   mux->last_ts = 0;
+  mux->packetize_last_ts = 0;
   mux->is_delta = TRUE;
   mux->is_header = FALSE;
 
@@ -403,6 +476,7 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     gst_adapter_clear (mux->adapter);
   if (mux->out_adapter)
     gst_adapter_clear (mux->out_adapter);
+  mpegtsmux_free_chunks (mux);
 
   if (mux->tsmux) {
     tsmux_free (mux->tsmux);
@@ -431,6 +505,12 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->tsmux = tsmux_new ();
     tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
     tsmux_set_alloc_func (mux->tsmux, alloc_packet_cb, mux);
+    tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+    tsmux_set_packet_size (mux->tsmux, mux->m2ts_mode ? M2TS_PACKET_LENGTH :
+        NORMAL_TS_PACKET_LENGTH);
+    tsmux_set_pcr_interval (mux->tsmux, mux->pcr_interval);
+    tsmux_set_packetize_threads (mux->tsmux, mux->packetize_threads);
+    tsmux_set_job_func (mux->tsmux, packetize_job_cb, mux);
   }
 }
 
@@ -449,6 +529,10 @@ mpegtsmux_dispose (GObject * object)
     g_object_unref (mux->out_adapter);
     mux->out_adapter = NULL;
   }
+  if (mux->m2ts_pending) {
+    g_array_free (mux->m2ts_pending, TRUE);
+    mux->m2ts_pending = NULL;
+  }
   if (mux->collect) {
     gst_object_unref (mux->collect);
     mux->collect = NULL;
@@ -475,6 +559,9 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
     case PROP_M2TS_MODE:
       /*set incase if the output stream need to be of 192 bytes */
       mux->m2ts_mode = g_value_get_boolean (value);
+      if (mux->tsmux)
+        tsmux_set_packet_size (mux->tsmux, mux->m2ts_mode ?
+            M2TS_PACKET_LENGTH : NORMAL_TS_PACKET_LENGTH);
       break;
     case PROP_PROG_MAP:
     {
@@ -511,6 +598,34 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
       mux->si_interval = g_value_get_uint (value);
       tsmux_set_si_interval (mux->tsmux, mux->si_interval);
       break;
+    case PROP_BATCH_PACKETS:
+      mux->batch_packets = g_value_get_boolean (value);
+      break;
+    case PROP_BITRATE:
+      mux->bitrate = g_value_get_uint64 (value);
+      if (mux->tsmux)
+        tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+      break;
+    case PROP_PCR_INTERVAL:
+      mux->pcr_interval = g_value_get_uint (value);
+      if (mux->tsmux)
+        tsmux_set_pcr_interval (mux->tsmux, mux->pcr_interval);
+      break;
+    case PROP_PACKETIZE_THREADS:
+      /* The jobs in flight belong to the running threads */
+      GST_OBJECT_LOCK (mux);
+      if (GST_STATE (mux) > GST_STATE_READY ||
+          GST_STATE_PENDING (mux) > GST_STATE_READY) {
+        GST_OBJECT_UNLOCK (mux);
+        GST_WARNING_OBJECT (mux, "packetize-threads can only be changed in "
+            "the NULL or READY state");
+        break;
+      }
+      GST_OBJECT_UNLOCK (mux);
+      mux->packetize_threads = g_value_get_uint (value);
+      if (mux->tsmux)
+        tsmux_set_packetize_threads (mux->tsmux, mux->packetize_threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -542,6 +657,18 @@ gst_mpegtsmux_get_property (GObject * object, guint prop_id,
     case PROP_SI_INTERVAL:
       g_value_set_uint (value, mux->si_interval);
       break;
+    case PROP_BATCH_PACKETS:
+      g_value_set_boolean (value, mux->batch_packets);
+      break;
+    case PROP_BITRATE:
+      g_value_set_uint64 (value, mux->bitrate);
+      break;
+    case PROP_PCR_INTERVAL:
+      g_value_set_uint (value, mux->pcr_interval);
+      break;
+    case PROP_PACKETIZE_THREADS:
+      g_value_set_uint (value, mux->packetize_threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1349,6 +1476,9 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
   GST_DEBUG_OBJECT (mux, "Pads collected");
 
   if (G_UNLIKELY (mux->first)) {
+    /* Packets still being prepared from before a flush */
+    tsmux_drop_jobs (mux->tsmux);
+
     ret = mpegtsmux_create_streams (mux);
     if (G_UNLIKELY (ret != GST_FLOW_OK)) {
       if (buf)
@@ -1364,6 +1494,8 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
   if (G_UNLIKELY (best == NULL)) {
     /* EOS */
     GST_INFO_OBJECT (mux, "EOS");
+    if (!tsmux_flush_jobs (mux->tsmux, TRUE))
+      goto flush_fail;
     /* drain some possibly cached data */
     new_packet_m2ts (mux, NULL, -1);
     mpegtsmux_push_packets (mux, TRUE);
@@ -1401,6 +1533,12 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
       guint count;
       GList *cur;
 
+      /* the event and the tables go after everything muxed so far */
+      if (!tsmux_flush_jobs (mux->tsmux, TRUE)) {
+        gst_event_unref (event);
+        goto flush_fail;
+      }
+
       mux->pending_key_unit_ts = GST_CLOCK_TIME_NONE;
       gst_event_replace (&mux->force_key_unit_event, NULL);
 
@@ -1426,6 +1564,10 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
   }
 
   if (G_UNLIKELY (prog->pcr_stream == NULL)) {
+    /* The packetizing threads check which stream carries the PCR */
+    if (!tsmux_flush_jobs (mux->tsmux, TRUE))
+      goto flush_fail;
+
     /* Take the first data stream for the PCR */
     GST_DEBUG_OBJECT (COLLECT_DATA_PAD (best),
         "Use stream (pid=%d) from pad as PCR for program (prog_id = %d)",
@@ -1480,6 +1622,10 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
 
   GST_DEBUG_OBJECT (mux, "delta: %d", delta);
 
+  /* The stream must not be in use by a packetizing thread */
+  if (!tsmux_wait_stream (mux->tsmux, best->stream))
+    goto flush_fail;
+
   stream_data = stream_data_new (buf);
   tsmux_stream_add_data (best->stream, stream_data->map_info.data,
       stream_data->map_info.size, stream_data, pts, dts, !delta);
@@ -1492,6 +1638,31 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
         GST_BUFFER_DTS (buf) : GST_BUFFER_PTS (buf);
   }
 
+  if (mux->packetize_threads > 0) {
+    PacketizeJobData *job_data = g_slice_new (PacketizeJobData);
+
+    job_data->is_delta = delta;
+    job_data->is_header = header;
+
+    /* mux->last_ts is also set when earlier jobs are written out, so keep
+     * track of the input side timestamp separately */
+    if (prog->pcr_stream == best->stream)
+      mux->packetize_last_ts = mux->last_ts;
+    job_data->last_ts = mux->packetize_last_ts;
+
+    /* Prepared in the background, written out once all previous buffers
+     * are */
+    if (!tsmux_submit_stream_packets (mux->tsmux, best->stream, job_data,
+            (GDestroyNotify) packetize_job_data_free)) {
+      GST_DEBUG_OBJECT (mux, "Failed to write data packets");
+      GST_ELEMENT_ERROR (mux, STREAM, MUX,
+          ("Failed writing output data to stream %04x", best->stream->id),
+          (NULL));
+      goto write_fail;
+    }
+    return mpegtsmux_push_packets (mux, FALSE);
+  }
+
   mux->is_delta = delta;
   mux->is_header = header;
   while (tsmux_stream_bytes_in_buffer (best->stream) > 0) {
@@ -1508,6 +1679,15 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
   return mpegtsmux_push_packets (mux, FALSE);
 
   /* ERRORS */
+flush_fail:
+  {
+    if (buf)
+      gst_buffer_unref (buf);
+    GST_DEBUG_OBJECT (mux, "Failed to write prepared packets");
+    GST_ELEMENT_ERROR (mux, STREAM, MUX, ("Failed writing output data"),
+        (NULL));
+    return mux->last_flow_ret;
+  }
 write_fail:
   {
     return mux->last_flow_ret;
@@ -1612,8 +1792,9 @@ new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
       GstBuffer *hbuf;
 
       if (!buf) {
+        /* @len includes any M2TS prefix in front of @data */
         hbuf = gst_buffer_new_and_alloc (len);
-        gst_buffer_fill (hbuf, 0, data, len);
+        gst_buffer_fill (hbuf, 0, data + NORMAL_TS_PACKET_LENGTH - len, len);
       } else {
         hbuf = gst_buffer_copy (buf);
       }
@@ -1642,6 +1823,33 @@ new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
   }
 }
 
+/* Fill @count null packets at @data, continuing M2TS headers from @header */
+static void
+mpegtsmux_write_null_packets (guint8 * data, gint count, gint packet_size,
+    guint32 header)
+{
+  for (; count > 0; count--) {
+    gint offset;
+
+    if (packet_size > NORMAL_TS_PACKET_LENGTH) {
+      GST_WRITE_UINT32_BE (data, header);
+      /* simply increase header a bit and never mind too much */
+      header++;
+      offset = 4;
+    } else {
+      offset = 0;
+    }
+    GST_WRITE_UINT8 (data + offset, TSMUX_SYNC_BYTE);
+    /* null packet PID */
+    GST_WRITE_UINT16_BE (data + offset + 1, 0x1FFF);
+    /* no adaptation field exists | continuity counter undefined */
+    GST_WRITE_UINT8 (data + offset + 3, 0x10);
+    /* payload */
+    memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
+    data += packet_size;
+  }
+}
+
 static GstFlowReturn
 mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
 {
@@ -1649,6 +1857,19 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
   gint align = mux->alignment;
   gint av, packet_size;
 
+  if (mux->batch_packets) {
+    /* chunks are already aligned, only complete ones are in the adapter */
+    if (force)
+      mpegtsmux_finish_chunks (mux);
+
+    av = gst_adapter_available (mux->out_adapter);
+    if (av == 0)
+      return GST_FLOW_OK;
+
+    buffer_list = gst_adapter_take_buffer_list (mux->out_adapter, av);
+    return gst_pad_push_list (mux->srcpad, buffer_list);
+  }
+
   if (mux->m2ts_mode) {
     packet_size = M2TS_PACKET_LENGTH;
     if (align < 0)
@@ -1719,26 +1940,7 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
     dummy = (map.size - av) / packet_size;
     GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
 
-    for (; dummy > 0; dummy--) {
-      gint offset;
-
-      if (packet_size > NORMAL_TS_PACKET_LENGTH) {
-        GST_WRITE_UINT32_BE (data, header);
-        /* simply increase header a bit and never mind too much */
-        header++;
-        offset = 4;
-      } else {
-        offset = 0;
-      }
-      GST_WRITE_UINT8 (data + offset, TSMUX_SYNC_BYTE);
-      /* null packet PID */
-      GST_WRITE_UINT16_BE (data + offset + 1, 0x1FFF);
-      /* no adaptation field exists | continuity counter undefined */
-      GST_WRITE_UINT8 (data + offset + 3, 0x10);
-      /* payload */
-      memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
-      data += packet_size;
-    }
+    mpegtsmux_write_null_packets (data, dummy, packet_size, header);
 
     gst_buffer_unmap (buf, &map);
     gst_buffer_list_add (buffer_list, buf);
@@ -1757,6 +1959,21 @@ mpegtsmux_collect_packet (MpegTsMux * mux, GstBuffer * buf)
   return GST_FLOW_OK;
 }
 
+/* interpolate the PCR of the packet @offset bytes after the first pending
+ * one, from the previous PCR and the current rate */
+static guint64
+mpegtsmux_interpolate_pcr (MpegTsMux * mux, gint64 offset)
+{
+  if (G_LIKELY (offset >= mux->previous_offset))
+    return mux->previous_pcr +
+        gst_util_uint64_scale (offset - mux->previous_offset,
+        mux->pcr_rate_num, mux->pcr_rate_den);
+  else
+    return mux->previous_pcr -
+        gst_util_uint64_scale (mux->previous_offset - offset,
+        mux->pcr_rate_num, mux->pcr_rate_den);
+}
+
 static gboolean
 new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
 {
@@ -1815,14 +2032,7 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
        * timestamp header and pushing */
 
       /* interpolate PCR */
-      if (G_LIKELY (offset >= mux->previous_offset))
-        cur_pcr = mux->previous_pcr +
-            gst_util_uint64_scale (offset - mux->previous_offset,
-            mux->pcr_rate_num, mux->pcr_rate_den);
-      else
-        cur_pcr = mux->previous_pcr -
-            gst_util_uint64_scale (mux->previous_offset - offset,
-            mux->pcr_rate_num, mux->pcr_rate_den);
+      cur_pcr = mpegtsmux_interpolate_pcr (mux, offset);
 
       /* FIXME: what about DTS here? */
       ts = gst_adapter_prev_pts (mux->adapter, NULL);
@@ -1910,7 +2120,8 @@ new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
   return TRUE;
 }
 
-/* called when TsMux needs new packet to write into */
+/* called when TsMux needs new packet to write into, also from the
+ * packetizing threads */
 static void
 alloc_packet_cb (GstBuffer ** _buf, void *user_data)
 {
@@ -1927,6 +2138,272 @@ alloc_packet_cb (GstBuffer ** _buf, void *user_data)
   *_buf = buf;
 }
 
+/* called before the packets prepared for an input buffer are written */
+static void
+packetize_job_cb (void *job_data, void *user_data)
+{
+  MpegTsMux *mux = (MpegTsMux *) user_data;
+  PacketizeJobData *data = job_data;
+
+  mux->is_delta = data->is_delta;
+  mux->is_header = data->is_header;
+  mux->last_ts = data->last_ts;
+}
+
+static void
+packetize_job_data_free (PacketizeJobData * data)
+{
+  g_slice_free (PacketizeJobData, data);
+}
+
+static void
+mpegtsmux_chunk_free (MpegTsMuxChunk * chunk)
+{
+  gst_buffer_unmap (chunk->buffer, &chunk->map);
+  gst_buffer_unref (chunk->buffer);
+  g_slice_free (MpegTsMuxChunk, chunk);
+}
+
+static void
+mpegtsmux_free_chunks (MpegTsMux * mux)
+{
+  MpegTsMuxChunk *chunk;
+
+  if (mux->out_chunk) {
+    mpegtsmux_chunk_free (mux->out_chunk);
+    mux->out_chunk = NULL;
+  }
+  while ((chunk = g_queue_pop_head (&mux->out_chunks)))
+    mpegtsmux_chunk_free (chunk);
+
+  if (mux->m2ts_pending)
+    g_array_set_size (mux->m2ts_pending, 0);
+
+  if (mux->chunk_pool) {
+    gst_buffer_pool_set_active (mux->chunk_pool, FALSE);
+    gst_object_unref (mux->chunk_pool);
+    mux->chunk_pool = NULL;
+  }
+}
+
+static MpegTsMuxChunk *
+mpegtsmux_acquire_chunk (MpegTsMux * mux)
+{
+  MpegTsMuxChunk *chunk;
+  GstBuffer *buf = NULL;
+
+  if (G_UNLIKELY (mux->chunk_pool == NULL)) {
+    GstStructure *config;
+    gint packets = mux->alignment;
+
+    if (packets <= 0)
+      packets = MPEGTSMUX_DEFAULT_CHUNK_PACKETS;
+
+    mux->chunk_size = packets *
+        (mux->m2ts_mode ? M2TS_PACKET_LENGTH : NORMAL_TS_PACKET_LENGTH);
+
+    mux->chunk_pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (mux->chunk_pool);
+    gst_buffer_pool_config_set_params (config, NULL, mux->chunk_size, 0, 0);
+    if (!gst_buffer_pool_set_config (mux->chunk_pool, config) ||
+        !gst_buffer_pool_set_active (mux->chunk_pool, TRUE)) {
+      GST_ERROR_OBJECT (mux, "failed to configure output buffer pool");
+      gst_object_unref (mux->chunk_pool);
+      mux->chunk_pool = NULL;
+      return NULL;
+    }
+
+    GST_DEBUG_OBJECT (mux, "writing %d packets per buffer", packets);
+  }
+
+  if (gst_buffer_pool_acquire_buffer (mux->chunk_pool, &buf,
+          NULL) != GST_FLOW_OK)
+    return NULL;
+
+  chunk = g_slice_new (MpegTsMuxChunk);
+  chunk->buffer = buf;
+  chunk->size = 0;
+  if (!gst_buffer_map (buf, &chunk->map, GST_MAP_WRITE)) {
+    gst_buffer_unref (buf);
+    g_slice_free (MpegTsMuxChunk, chunk);
+    return NULL;
+  }
+
+  return chunk;
+}
+
+/* Hand over all full chunks once no M2TS header in them is pending */
+static void
+mpegtsmux_flush_chunks (MpegTsMux * mux)
+{
+  MpegTsMuxChunk *chunk;
+
+  if (mux->m2ts_pending->len > 0)
+    return;
+
+  while ((chunk = g_queue_pop_head (&mux->out_chunks))) {
+    GstBuffer *buf = chunk->buffer;
+
+    gst_buffer_unmap (buf, &chunk->map);
+    gst_buffer_set_size (buf, chunk->size);
+    g_slice_free (MpegTsMuxChunk, chunk);
+    mpegtsmux_collect_packet (mux, buf);
+  }
+}
+
+/* Same as new_packet_m2ts(), but patches the 4 byte headers in place
+ * inside the mapped chunks instead of going through an adapter */
+static void
+new_chunk_packet_m2ts (MpegTsMux * mux, guint8 * header, gint64 new_pcr)
+{
+  gint64 chunk_bytes = mux->m2ts_pending->len * M2TS_PACKET_LENGTH;
+
+  if (G_LIKELY (header)) {
+    if (new_pcr < 0) {
+      g_array_append_val (mux->m2ts_pending, header);
+      return;
+    }
+
+    /* no first interpolation point yet, then this is the one,
+     * otherwise it is the second interpolation point */
+    if (mux->previous_pcr < 0 && chunk_bytes) {
+      mux->previous_pcr = new_pcr;
+      mux->previous_offset = chunk_bytes;
+      g_array_append_val (mux->m2ts_pending, header);
+      return;
+    }
+  } else {
+    g_assert (new_pcr == -1);
+  }
+
+  /* interpolate if needed, and 2 points available */
+  if (chunk_bytes && (new_pcr != mux->previous_pcr)) {
+    guint i;
+
+    g_assert (chunk_bytes > mux->previous_offset);
+    /* if draining, use previous rate */
+    if (G_LIKELY (new_pcr > 0)) {
+      mux->pcr_rate_num = new_pcr - mux->previous_pcr;
+      mux->pcr_rate_den = chunk_bytes - mux->previous_offset;
+    }
+
+    for (i = 0; i < mux->m2ts_pending->len; i++) {
+      guint64 cur_pcr;
+
+      cur_pcr = mpegtsmux_interpolate_pcr (mux, i * M2TS_PACKET_LENGTH);
+      GST_WRITE_UINT32_BE (g_array_index (mux->m2ts_pending, guint8 *, i),
+          cur_pcr & 0x3FFFFFFF);
+    }
+    g_array_set_size (mux->m2ts_pending, 0);
+  }
+
+  if (G_UNLIKELY (!header))
+    return;
+
+  /* Only write the bottom 30 bits of the PCR */
+  GST_WRITE_UINT32_BE (header, new_pcr & 0x3FFFFFFF);
+
+  if (new_pcr != mux->previous_pcr) {
+    mux->previous_pcr = new_pcr;
+    mux->previous_offset = -M2TS_PACKET_LENGTH;
+  }
+}
+
+/* called when TsMux needs room for the next packet in batch mode */
+static guint8 *
+alloc_chunk_packet_cb (void *user_data)
+{
+  MpegTsMux *mux = (MpegTsMux *) user_data;
+  MpegTsMuxChunk *chunk = mux->out_chunk;
+
+  if (G_UNLIKELY (chunk == NULL)) {
+    chunk = mux->out_chunk = mpegtsmux_acquire_chunk (mux);
+    if (chunk == NULL)
+      return NULL;
+  }
+
+  return chunk->map.data + chunk->size + (mux->m2ts_mode ? 4 : 0);
+}
+
+/* Called when the TsMux has written a packet into the current chunk */
+static gboolean
+new_chunk_packet_cb (guint8 * packet, void *user_data, gint64 new_pcr)
+{
+  MpegTsMux *mux = (MpegTsMux *) user_data;
+  MpegTsMuxChunk *chunk = mux->out_chunk;
+
+  g_assert (chunk != NULL);
+
+  /* only the packet itself goes into the streamheader, the chunk is still
+   * being filled */
+  new_packet_common_init (mux, NULL, packet,
+      mux->m2ts_mode ? M2TS_PACKET_LENGTH : NORMAL_TS_PACKET_LENGTH);
+
+  if (chunk->size == 0) {
+    GST_BUFFER_PTS (chunk->buffer) = mux->last_ts;
+    if (mux->is_delta)
+      GST_BUFFER_FLAG_SET (chunk->buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+  /* the chunk carries the start of a key unit */
+  if (!mux->is_delta) {
+    GST_DEBUG_OBJECT (mux, "marking as non-delta unit");
+    GST_BUFFER_FLAG_UNSET (chunk->buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    mux->is_delta = TRUE;
+  }
+  if (mux->is_header)
+    GST_BUFFER_FLAG_SET (chunk->buffer, GST_BUFFER_FLAG_HEADER);
+
+  if (mux->m2ts_mode) {
+    new_chunk_packet_m2ts (mux, packet - 4, new_pcr);
+    chunk->size += M2TS_PACKET_LENGTH;
+  } else {
+    chunk->size += NORMAL_TS_PACKET_LENGTH;
+  }
+
+  if (chunk->size >= mux->chunk_size) {
+    g_queue_push_tail (&mux->out_chunks, chunk);
+    mux->out_chunk = NULL;
+  }
+
+  mpegtsmux_flush_chunks (mux);
+
+  return TRUE;
+}
+
+/* Drain pending M2TS headers and hand over the partially filled chunk,
+ * padded with null packets if an alignment was requested */
+static void
+mpegtsmux_finish_chunks (MpegTsMux * mux)
+{
+  MpegTsMuxChunk *chunk = mux->out_chunk;
+
+  if (mux->m2ts_mode)
+    new_chunk_packet_m2ts (mux, NULL, -1);
+
+  if (chunk) {
+    mux->out_chunk = NULL;
+
+    if (chunk->size == 0) {
+      mpegtsmux_chunk_free (chunk);
+    } else {
+      if (mux->alignment > 0) {
+        gint packet_size = mux->m2ts_mode ? M2TS_PACKET_LENGTH :
+            NORMAL_TS_PACKET_LENGTH;
+        guint8 *data = chunk->map.data + chunk->size;
+        gint dummy = (mux->chunk_size - chunk->size) / packet_size;
+
+        GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
+        mpegtsmux_write_null_packets (data, dummy, packet_size,
+            GST_READ_UINT32_BE (data - packet_size));
+        chunk->size += dummy * packet_size;
+      }
+      g_queue_push_tail (&mux->out_chunks, chunk);
+    }
+  }
+
+  mpegtsmux_flush_chunks (mux);
+}
+
 static void
 mpegtsmux_set_header_on_caps (MpegTsMux * mux)
 {
@@ -1981,6 +2458,10 @@ mpegtsmux_prepare_srcpad (MpegTsMux * mux)
   gst_pad_set_caps (mux->srcpad, caps);
   gst_caps_unref (caps);
 
+  if (mux->batch_packets)
+    tsmux_set_packet_funcs (mux->tsmux, alloc_chunk_packet_cb,
+        new_chunk_packet_cb, mux);
+
   if (!gst_pad_push_event (mux->srcpad, new_seg)) {
     GST_WARNING_OBJECT (mux, "New segment event was not handled downstream");
   }
@@ -116,6 +116,7 @@ G_BEGIN_DECLS
 typedef struct MpegTsMux MpegTsMux;
 typedef struct MpegTsMuxClass MpegTsMuxClass;
 typedef struct MpegTsPadData MpegTsPadData;
+typedef struct MpegTsMuxChunk MpegTsMuxChunk;
 
 typedef GstBuffer * (*MpegTsPadDataPrepareFunction) (GstBuffer * buf,
     MpegTsPadData * data, MpegTsMux * mux);
@@ -139,6 +140,10 @@ struct MpegTsMux {
   guint pmt_interval;
   gint alignment;
   guint si_interval;
+  gboolean batch_packets;
+  guint64 bitrate;
+  guint pcr_interval;
+  guint packetize_threads;
 
   /* state */
   gboolean first;
@@ -152,6 +157,8 @@ struct MpegTsMux {
   gboolean is_delta;
   gboolean is_header;
   GstClockTime last_ts;
+  /* last_ts of the most recently submitted packetizing job */
+  GstClockTime packetize_last_ts;
 
   /* m2ts specific */
   gint64 previous_pcr;
@@ -164,6 +171,15 @@ struct MpegTsMux {
   GstAdapter *out_adapter;
   GstBuffer *out_buffer;
 
+  /* batched output: packets are written straight into pooled chunks */
+  GstBufferPool *chunk_pool;
+  guint chunk_size;
+  MpegTsMuxChunk *out_chunk;
+  /* full chunks kept mapped while M2TS headers are pending */
+  GQueue out_chunks;
+  /* guint8 * to M2TS headers waiting for the next PCR */
+  GArray *m2ts_pending;
+
 #if 0
   /* SPN/PTS index handling */
   GstIndex *element_index;
@@ -171,6 +187,14 @@ struct MpegTsMux {
 #endif
 };
 
+/* A pooled output buffer that TS packets are written into */
+struct MpegTsMuxChunk {
+  GstBuffer *buffer;
+  GstMapInfo map;
+  /* bytes written so far */
+  gsize size;
+};
+
 struct MpegTsMuxClass {
   GstElementClass parent_class;
 };
@@ -106,13 +106,51 @@
  * 1/8 second atm */
 #define TSMUX_PCR_OFFSET (TSMUX_CLOCK_FREQ / 8)
 
-/* Times per second to write PCR */
-#define TSMUX_DEFAULT_PCR_FREQ (25)
+/* Byte offset of the end of the PCR base within a packet carrying a PCR */
+#define TSMUX_PCR_BYTE_OFFSET 11
+
+/* In constant rate mode, the output clock is resynced instead of stuffing
+ * when the next PES is due more than this far in the future */
+#define TSMUX_MAX_STUFFING_GAP TSMUX_CLOCK_FREQ
 
 /* Base for all written PCR and DTS/PTS,
  * so we have some slack to go backwards */
 #define CLOCK_BASE (TSMUX_CLOCK_FREQ * 10 * 360)
 
+/* Jobs in flight per packetizing thread */
+#define TSMUX_JOBS_PER_THREAD 4
+
+/* A packet prepared by a packetizing thread */
+typedef struct
+{
+  /* PCR written in the packet, or -1 */
+  gint64 pcr;
+  /* whether the tables are due to be checked at @tables_ts before writing
+   * the packet, as done for every packet of a PCR stream */
+  gboolean write_tables;
+  gint64 tables_ts;
+  /* the packet, if the alloc/write functions are used */
+  GstBuffer *buf;
+} TsMuxJobPacket;
+
+/* All packets of the data queued in a stream at submission time */
+typedef struct
+{
+  TsMuxStream *stream;
+
+  void *job_data;
+  GDestroyNotify notify;
+
+  /* TsMuxJobPacket */
+  GArray *packets;
+  /* the packets, if the packet functions are used */
+  GByteArray *data;
+
+  /* protected by the job lock */
+  gboolean done;
+  gboolean failed;
+} TsMuxJob;
+
 static gboolean tsmux_write_pat (TsMux * mux);
 static gboolean tsmux_write_pmt (TsMux * mux, TsMuxProgram * program);
 static void
@@ -150,9 +188,20 @@ tsmux_new (void)
   mux->last_si_ts = G_MININT64;
   mux->si_interval = TSMUX_DEFAULT_SI_INTERVAL;
 
+  mux->pcr_interval = TSMUX_DEFAULT_PCR_INTERVAL;
+
+  mux->bitrate = 0;
+  mux->packet_size = TSMUX_PACKET_LENGTH;
+  mux->n_bytes = 0;
+  mux->first_pcr = -1;
+
   mux->si_sections = g_hash_table_new_full (g_direct_hash, g_direct_equal,
       NULL, (GDestroyNotify) tsmux_section_free);
 
+  g_queue_init (&mux->jobs);
+  g_mutex_init (&mux->job_lock);
+  g_cond_init (&mux->job_cond);
+
   return mux;
 }
 
@@ -193,6 +242,35 @@ tsmux_set_alloc_func (TsMux * mux, TsMuxAllocFunc func, void *user_data)
   mux->alloc_func_data = user_data;
 }
 
+/**
+ * tsmux_set_packet_funcs:
+ * @mux: a #TsMux
+ * @alloc_func: a user callback returning room for the next packet
+ * @write_func: a user callback called once a packet has been written
+ * @user_data: user data passed to @alloc_func and @write_func
+ *
+ * Make @mux write packets directly into memory provided by @alloc_func
+ * instead of allocating a #GstBuffer per packet. @alloc_func must return
+ * at least %TSMUX_PACKET_LENGTH writable bytes, which stay owned by the
+ * caller. Once the packet has been filled in, @write_func is called with
+ * the same pointer. If @write_func is not called, the memory was not used
+ * and may be handed out again.
+ *
+ * Passing %NULL functions reverts to the #TsMuxAllocFunc/#TsMuxWriteFunc
+ * path.
+ */
+void
+tsmux_set_packet_funcs (TsMux * mux, TsMuxPacketAllocFunc alloc_func,
+    TsMuxPacketWriteFunc write_func, void *user_data)
+{
+  g_return_if_fail (mux != NULL);
+  g_return_if_fail ((alloc_func == NULL) == (write_func == NULL));
+
+  mux->packet_alloc_func = alloc_func;
+  mux->packet_write_func = write_func;
+  mux->packet_func_data = user_data;
+}
+
 /**
  * tsmux_set_pat_interval:
  * @mux: a #TsMux
@@ -242,6 +320,91 @@ tsmux_resend_pat (TsMux * mux)
   mux->last_pat_ts = G_MININT64;
 }
 
+/**
+ * tsmux_set_pcr_interval:
+ * @mux: a #TsMux
+ * @freq: a new PCR interval
+ *
+ * Set the maximum interval (in cycles of the 90kHz clock) between two PCR
+ * values written for a program.
+ */
+void
+tsmux_set_pcr_interval (TsMux * mux, guint freq)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->pcr_interval = freq;
+}
+
+/**
+ * tsmux_get_pcr_interval:
+ * @mux: a #TsMux
+ *
+ * Get the configured PCR interval. See also tsmux_set_pcr_interval().
+ *
+ * Returns: the configured PCR interval
+ */
+guint
+tsmux_get_pcr_interval (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->pcr_interval;
+}
+
+/**
+ * tsmux_set_bitrate:
+ * @mux: a #TsMux
+ * @bitrate: the mux rate in bits per second, or 0
+ *
+ * Set a constant output rate for @mux. The PCR is then derived from the
+ * number of bytes written, and before each PES packet the output is filled
+ * up with null packets, PCR-only packets and PAT/PMT/SI tables until the
+ * packet is due. 0 selects the default variable rate output.
+ */
+void
+tsmux_set_bitrate (TsMux * mux, guint64 bitrate)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->bitrate = bitrate;
+}
+
+/**
+ * tsmux_set_packet_size:
+ * @mux: a #TsMux
+ * @packet_size: size of an output packet in bytes
+ *
+ * Set the size of the packets as they are output, including any prefix
+ * the caller adds in front of each packet such as the 4 byte M2TS
+ * timestamp. The constant rate output accounts for this many bytes per
+ * packet.
+ */
+void
+tsmux_set_packet_size (TsMux * mux, guint packet_size)
+{
+  g_return_if_fail (mux != NULL);
+  g_return_if_fail (packet_size >= TSMUX_PACKET_LENGTH);
+
+  mux->packet_size = packet_size;
+}
+
+/**
+ * tsmux_get_bitrate:
+ * @mux: a #TsMux
+ *
+ * Get the configured constant mux rate. See also tsmux_set_bitrate().
+ *
+ * Returns: the configured mux rate in bits per second, or 0
+ */
+guint64
+tsmux_get_bitrate (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->bitrate;
+}
+
 /**
  * tsmux_set_si_interval:
  * @mux: a #TsMux
@@ -337,6 +500,13 @@ tsmux_free (TsMux * mux)
 
   g_return_if_fail (mux != NULL);
 
+  /* Wait for the packetizing threads, streams are freed below */
+  tsmux_drop_jobs (mux);
+  if (mux->job_pool)
+    g_thread_pool_free (mux->job_pool, FALSE, TRUE);
+  g_mutex_clear (&mux->job_lock);
+  g_cond_clear (&mux->job_cond);
+
   /* Free PAT section */
   if (mux->pat.section)
     gst_mpegts_section_unref (mux->pat.section);
@@ -628,6 +798,8 @@ tsmux_get_buffer (TsMux * mux, GstBuffer ** buf)
 static gboolean
 tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
 {
+  mux->n_bytes += mux->packet_size;
+
   if (G_UNLIKELY (mux->write_func == NULL)) {
     if (buf)
       gst_buffer_unref (buf);
@@ -637,6 +809,55 @@ tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
   return mux->write_func (buf, mux->write_func_data, pcr);
 }
 
+static inline gboolean
+tsmux_use_packet_funcs (TsMux * mux)
+{
+  return mux->packet_alloc_func != NULL;
+}
+
+static guint8 *
+tsmux_get_packet (TsMux * mux)
+{
+  return mux->packet_alloc_func (mux->packet_func_data);
+}
+
+static gboolean
+tsmux_packet_write (TsMux * mux, guint8 * packet, gint64 pcr)
+{
+  mux->n_bytes += mux->packet_size;
+
+  return mux->packet_write_func (packet, mux->packet_func_data, pcr);
+}
+
+/* Obtain room for a single packet from whichever output path is in use */
+static guint8 *
+tsmux_packet_begin (TsMux * mux, GstBuffer ** buf, GstMapInfo * map)
+{
+  *buf = NULL;
+
+  if (tsmux_use_packet_funcs (mux))
+    return tsmux_get_packet (mux);
+
+  if (!tsmux_get_buffer (mux, buf))
+    return NULL;
+
+  gst_buffer_map (*buf, map, GST_MAP_WRITE);
+
+  return map->data;
+}
+
+static gboolean
+tsmux_packet_finish (TsMux * mux, GstBuffer * buf, GstMapInfo * map,
+    guint8 * packet, gint64 pcr)
+{
+  if (buf == NULL)
+    return tsmux_packet_write (mux, packet, pcr);
+
+  gst_buffer_unmap (buf, map);
+
+  return tsmux_packet_out (mux, buf, pcr);
+}
+
 /*
  * adaptation_field() {
  *   adaptation_field_length                              8 uimsbf
@@ -884,6 +1105,55 @@ tsmux_write_ts_header (guint8 * buf, TsMuxPacketInfo * pi,
   return TRUE;
 }
 
+/* Write all packets of @section straight into the memory provided by the
+ * packet functions. The section data is small, so copying it is cheaper
+ * than wrapping every packet payload in its own buffer. */
+static gboolean
+tsmux_section_write_packet_direct (TsMuxSection * section, TsMux * mux,
+    const guint8 * data)
+{
+  guint len = 0, offset = 0, payload_len;
+  gsize payload_written = 0;
+  guint8 *packet;
+
+  while (section->pi.stream_avail > 0) {
+    packet = tsmux_get_packet (mux);
+    if (G_UNLIKELY (packet == NULL))
+      return FALSE;
+
+    if (section->pi.packet_start_unit_indicator) {
+      /* We need room for a pointer byte */
+      section->pi.stream_avail++;
+
+      if (!tsmux_write_ts_header (packet, &section->pi, &len, &offset))
+        return FALSE;
+
+      /* Write the pointer byte */
+      packet[offset++] = 0x00;
+      payload_len = len - 1;
+    } else {
+      if (!tsmux_write_ts_header (packet, &section->pi, &len, &offset))
+        return FALSE;
+      payload_len = len;
+    }
+
+    memcpy (packet + offset, data + payload_written, payload_len);
+
+    TS_DEBUG ("Writing %d bytes to section. %d bytes remaining",
+        len, section->pi.stream_avail - len);
+
+    /* Push the packet without PCR */
+    if (G_UNLIKELY (!tsmux_packet_write (mux, packet, -1)))
+      return FALSE;
+
+    section->pi.stream_avail -= len;
+    payload_written += payload_len;
+    section->pi.packet_start_unit_indicator = FALSE;
+  }
+
+  return TRUE;
+}
+
 static gboolean
 tsmux_section_write_packet (GstMpegtsSectionType * type,
     TsMuxSection * section, TsMux * mux)
@@ -915,6 +1185,9 @@ tsmux_section_write_packet (GstMpegtsSectionType * type,
   section->pi.stream_avail = data_size;
   payload_written = 0;
 
+  if (tsmux_use_packet_funcs (mux))
+    return tsmux_section_write_packet_direct (section, mux, data);
+
   /* Wrap section data in a buffer without free function.
      The data will be freed when the GstMpegtsSection is destroyed. */
   section_buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
@@ -1019,6 +1292,315 @@ tsmux_write_si (TsMux * mux)
 
 }
 
+/* Write out PAT, SI and PMTs if they changed or their interval elapsed
+ * at @cur_ts */
+static gboolean
+tsmux_write_tables (TsMux * mux, gint64 cur_ts)
+{
+  gboolean write_pat;
+  gboolean write_si;
+  GList *cur;
+
+  /* check if we need to rewrite pat */
+  if (mux->last_pat_ts == G_MININT64 || mux->pat_changed)
+    write_pat = TRUE;
+  else if (cur_ts >= mux->last_pat_ts + mux->pat_interval)
+    write_pat = TRUE;
+  else
+    write_pat = FALSE;
+
+  if (write_pat) {
+    mux->last_pat_ts = cur_ts;
+    if (!tsmux_write_pat (mux))
+      return FALSE;
+  }
+
+  /* check if we need to rewrite sit */
+  if (mux->last_si_ts == G_MININT64 || mux->si_changed)
+    write_si = TRUE;
+  else if (cur_ts >= mux->last_si_ts + mux->si_interval)
+    write_si = TRUE;
+  else
+    write_si = FALSE;
+
+  if (write_si) {
+    mux->last_si_ts = cur_ts;
+    if (!tsmux_write_si (mux))
+      return FALSE;
+  }
+
+  /* check if we need to rewrite any of the current pmts */
+  for (cur = mux->programs; cur; cur = cur->next) {
+    TsMuxProgram *program = (TsMuxProgram *) cur->data;
+    gboolean write_pmt;
+
+    if (program->last_pmt_ts == G_MININT64 || program->pmt_changed)
+      write_pmt = TRUE;
+    else if (cur_ts >= program->last_pmt_ts + program->pmt_interval)
+      write_pmt = TRUE;
+    else
+      write_pmt = FALSE;
+
+    if (write_pmt) {
+      program->last_pmt_ts = cur_ts;
+      if (!tsmux_write_pmt (mux, program))
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Flag the next packet of @stream to carry @cur_pcr if a PCR is due.
+ * Returns the PCR to be written, or -1 */
+static gint64
+tsmux_stream_schedule_pcr (TsMux * mux, TsMuxStream * stream, gint64 cur_pcr)
+{
+  if (stream->last_pcr == -1 ||
+      (cur_pcr - stream->last_pcr >
+          (gint64) mux->pcr_interval * (TSMUX_SYS_CLOCK_FREQ /
+              TSMUX_CLOCK_FREQ))) {
+    stream->pi.flags |=
+        TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+    stream->pi.pcr = cur_pcr;
+    stream->last_pcr = cur_pcr;
+    return cur_pcr;
+  }
+
+  return -1;
+}
+
+/* PCR at byte @offset of the constant rate output */
+static inline gint64
+tsmux_get_cbr_pcr (TsMux * mux, guint64 offset)
+{
+  return mux->first_pcr + gst_util_uint64_scale (offset * 8,
+      TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+}
+
+/* PCR for the PCR field of the next packet of the constant rate output */
+static inline gint64
+tsmux_get_next_cbr_pcr (TsMux * mux)
+{
+  return tsmux_get_cbr_pcr (mux, mux->n_bytes + mux->packet_size -
+      TSMUX_PACKET_LENGTH + TSMUX_PCR_BYTE_OFFSET);
+}
+
+/* Current time of the constant rate output in MPEG PTS clock time */
+static inline gint64
+tsmux_get_cbr_ts (TsMux * mux)
+{
+  return tsmux_get_cbr_pcr (mux, mux->n_bytes) /
+      (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+}
+
+static gboolean
+tsmux_write_null_packet (TsMux * mux)
+{
+  TsMuxPacketInfo pi = { 0, };
+  guint payload_len, payload_offs;
+  GstBuffer *buf;
+  GstMapInfo map;
+  guint8 *packet;
+
+  pi.pid = TSMUX_NULL_PID;
+  pi.stream_avail = TSMUX_PAYLOAD_LENGTH;
+
+  packet = tsmux_packet_begin (mux, &buf, &map);
+  if (G_UNLIKELY (packet == NULL))
+    return FALSE;
+
+  tsmux_write_ts_header (packet, &pi, &payload_len, &payload_offs);
+  memset (packet + payload_offs, 0xff, payload_len);
+
+  return tsmux_packet_finish (mux, buf, &map, packet, -1);
+}
+
+/* Write a packet with only an adaptation field carrying @pcr on the PID
+ * of @stream. Without payload, it repeats the continuity counter of the
+ * previous packet on the PID. */
+static gboolean
+tsmux_write_pcr_packet (TsMux * mux, TsMuxStream * stream, gint64 pcr)
+{
+  TsMuxPacketInfo pi = { 0, };
+  guint payload_len, payload_offs;
+  GstBuffer *buf;
+  GstMapInfo map;
+  guint8 *packet;
+
+  pi.pid = stream->pi.pid;
+  pi.packet_count = (stream->pi.packet_count - 1) & 0x0f;
+  pi.flags = TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+  pi.pcr = pcr;
+  pi.stream_avail = 0;
+
+  packet = tsmux_packet_begin (mux, &buf, &map);
+  if (G_UNLIKELY (packet == NULL))
+    return FALSE;
+
+  if (!tsmux_write_ts_header (packet, &pi, &payload_len, &payload_offs)) {
+    if (buf) {
+      gst_buffer_unmap (buf, &map);
+      gst_buffer_unref (buf);
+    }
+    return FALSE;
+  }
+
+  stream->last_pcr = pcr;
+
+  return tsmux_packet_finish (mux, buf, &map, packet, pcr);
+}
+
+/* Write a PCR-only packet for the first program whose PCR is due, if any */
+static gboolean
+tsmux_write_due_pcr (TsMux * mux, gboolean * written)
+{
+  GList *cur;
+
+  *written = FALSE;
+
+  for (cur = mux->programs; cur; cur = cur->next) {
+    TsMuxProgram *program = (TsMuxProgram *) cur->data;
+    TsMuxStream *stream = program->pcr_stream;
+    gint64 pcr;
+
+    if (stream == NULL)
+      continue;
+
+    pcr = tsmux_get_next_cbr_pcr (mux);
+    if (stream->last_pcr != -1 && pcr - stream->last_pcr <=
+        (gint64) mux->pcr_interval * (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ))
+      continue;
+
+    *written = TRUE;
+    return tsmux_write_pcr_packet (mux, stream, pcr);
+  }
+
+  return TRUE;
+}
+
+/* In constant rate mode, fill the output with tables, PCR-only packets and
+ * null packets until the output clock reaches the time a PES starting at
+ * @ts is due */
+static gboolean
+tsmux_pad_stream (TsMux * mux, gint64 ts)
+{
+  gint64 target = (ts - TSMUX_PCR_OFFSET) *
+      (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+  gint64 cur_pcr;
+
+  if (G_UNLIKELY (mux->first_pcr == -1)) {
+    /* start the output clock at the first PES */
+    mux->first_pcr = target - gst_util_uint64_scale (mux->n_bytes * 8,
+        TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+    TS_DEBUG ("First PCR is %" G_GINT64_FORMAT, mux->first_pcr);
+    return TRUE;
+  }
+
+  cur_pcr = tsmux_get_cbr_pcr (mux, mux->n_bytes);
+
+  if (target - cur_pcr > TSMUX_MAX_STUFFING_GAP *
+      (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ)) {
+    TS_DEBUG ("Next PES is due %" G_GINT64_FORMAT " ticks ahead, "
+        "resyncing output clock", target - cur_pcr);
+    mux->first_pcr += target - cur_pcr;
+    return TRUE;
+  }
+
+  if (cur_pcr > target) {
+    TS_DEBUG ("Output is %" G_GINT64_FORMAT " ticks late, mux rate too low?",
+        cur_pcr - target);
+    return TRUE;
+  }
+
+  while (tsmux_get_cbr_pcr (mux, mux->n_bytes) < target) {
+    guint64 n_bytes = mux->n_bytes;
+    gboolean written;
+
+    if (!tsmux_write_tables (mux, tsmux_get_cbr_ts (mux)))
+      return FALSE;
+    if (mux->n_bytes != n_bytes)
+      continue;
+
+    if (!tsmux_write_due_pcr (mux, &written))
+      return FALSE;
+    if (written)
+      continue;
+
+    if (!tsmux_write_null_packet (mux))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Set up the packet info of @stream for its next packet, starting a new
+ * PES packet if needed */
+static void
+tsmux_stream_begin_packet (TsMuxStream * stream)
+{
+  TsMuxPacketInfo *pi = &stream->pi;
+
+  pi->packet_start_unit_indicator = tsmux_stream_at_pes_start (stream);
+  if (pi->packet_start_unit_indicator) {
+    tsmux_stream_initialize_pes_packet (stream);
+    if (stream->dts != G_MININT64)
+      stream->dts += CLOCK_BASE;
+    if (stream->pts != G_MININT64)
+      stream->pts += CLOCK_BASE;
+  }
+}
+
+/* In variable rate mode, the PCR follows the timestamps of the PCR stream
+ * @stream. Returns the PCR for its next packet or -1, and in @tables_ts the
+ * time at which the tables are checked before that packet */
+static gint64
+tsmux_stream_get_vbr_pcr (TsMux * mux, TsMuxStream * stream,
+    gint64 * tables_ts)
+{
+  gint64 cur_pts = tsmux_stream_get_pts (stream);
+  gint64 cur_pcr = 0;
+
+  if (cur_pts != G_MININT64) {
+    TS_DEBUG ("TS for PCR stream is %" G_GINT64_FORMAT, cur_pts);
+  }
+
+  /* FIXME: The current PCR needs more careful calculation than just
+   * writing a fixed offset */
+  if (cur_pts != G_MININT64) {
+    /* CLOCK_BASE >= TSMUX_PCR_OFFSET */
+    cur_pts += CLOCK_BASE;
+    cur_pcr = (cur_pts - TSMUX_PCR_OFFSET) *
+        (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+  }
+
+  *tables_ts = cur_pts;
+
+  /* Need to decide whether to write a new PCR in this packet */
+  return tsmux_stream_schedule_pcr (mux, stream, cur_pcr);
+}
+
+/* Write header and payload of the next packet of @stream to @packet */
+static gboolean
+tsmux_stream_fill_packet (TsMuxStream * stream, guint8 * packet)
+{
+  guint payload_len, payload_offs;
+  TsMuxPacketInfo *pi = &stream->pi;
+
+  pi->stream_avail = tsmux_stream_bytes_avail (stream);
+
+  if (!tsmux_write_ts_header (packet, pi, &payload_len, &payload_offs))
+    return FALSE;
+
+  if (!tsmux_stream_get_data (stream, packet + payload_offs, payload_len))
+    return FALSE;
+
+  /* Reset all dynamic flags */
+  pi->flags &= TSMUX_PACKET_FLAG_PES_FULL_HEADER;
+
+  return TRUE;
+}
+
 /**
  * tsmux_write_stream_packet:
  * @mux: a #TsMux
@@ -1031,9 +1613,7 @@ tsmux_write_si (TsMux * mux)
 gboolean
 tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
 {
-  guint payload_len, payload_offs;
   TsMuxPacketInfo *pi = &stream->pi;
-  gboolean res;
   gint64 cur_pcr = -1;
   GstBuffer *buf = NULL;
   GstMapInfo map;
@@ -1041,96 +1621,49 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   g_return_val_if_fail (mux != NULL, FALSE);
   g_return_val_if_fail (stream != NULL, FALSE);
 
-  if (tsmux_stream_is_pcr (stream)) {
-    gint64 cur_pts = tsmux_stream_get_pts (stream);
-    gboolean write_pat;
-    gboolean write_si;
-    GList *cur;
+  tsmux_stream_begin_packet (stream);
 
-    cur_pcr = 0;
-    if (cur_pts != G_MININT64) {
-      TS_DEBUG ("TS for PCR stream is %" G_GINT64_FORMAT, cur_pts);
-    }
+  if (pi->packet_start_unit_indicator && mux->bitrate) {
+    gint64 ts = stream->dts != G_MININT64 ? stream->dts : stream->pts;
 
-    /* FIXME: The current PCR needs more careful calculation than just
-     * writing a fixed offset */
-    if (cur_pts != G_MININT64) {
-      /* CLOCK_BASE >= TSMUX_PCR_OFFSET */
-      cur_pts += CLOCK_BASE;
-      cur_pcr = (cur_pts - TSMUX_PCR_OFFSET) *
+    if (ts != G_MININT64 && !tsmux_pad_stream (mux, ts))
+      return FALSE;
+  }
+
+  if (mux->bitrate) {
+    /* timestamp-less streams only, start the clock at the base */
+    if (G_UNLIKELY (mux->first_pcr == -1))
+      mux->first_pcr = (CLOCK_BASE - TSMUX_PCR_OFFSET) *
           (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
-    }
 
-    /* Need to decide whether to write a new PCR in this packet */
-    if (stream->last_pcr == -1 ||
-        (cur_pcr - stream->last_pcr >
-            (TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ))) {
+    /* tables follow the output clock, whichever stream is written */
+    if (!tsmux_write_tables (mux, tsmux_get_cbr_ts (mux)))
+      return FALSE;
 
-      stream->pi.flags |=
-          TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
-      stream->pi.pcr = cur_pcr;
-      stream->last_pcr = cur_pcr;
-    } else {
-      cur_pcr = -1;
-    }
+    if (tsmux_stream_is_pcr (stream))
+      cur_pcr = tsmux_stream_schedule_pcr (mux, stream,
+          tsmux_get_next_cbr_pcr (mux));
+  } else if (tsmux_stream_is_pcr (stream)) {
+    gint64 tables_ts;
 
-    /* check if we need to rewrite pat */
-    if (mux->last_pat_ts == G_MININT64 || mux->pat_changed)
-      write_pat = TRUE;
-    else if (cur_pts >= mux->last_pat_ts + mux->pat_interval)
-      write_pat = TRUE;
-    else
-      write_pat = FALSE;
+    cur_pcr = tsmux_stream_get_vbr_pcr (mux, stream, &tables_ts);
 
-    if (write_pat) {
-      mux->last_pat_ts = cur_pts;
-      if (!tsmux_write_pat (mux))
-        return FALSE;
-    }
+    if (!tsmux_write_tables (mux, tables_ts))
+      return FALSE;
+  }
 
-    /* check if we need to rewrite sit */
-    if (mux->last_si_ts == G_MININT64 || mux->si_changed)
-      write_si = TRUE;
-    else if (cur_pts >= mux->last_si_ts + mux->si_interval)
-      write_si = TRUE;
-    else
-      write_si = FALSE;
+  if (tsmux_use_packet_funcs (mux)) {
+    guint8 *packet;
 
-    if (write_si) {
-      mux->last_si_ts = cur_pts;
-      if (!tsmux_write_si (mux))
-        return FALSE;
-    }
+    packet = tsmux_get_packet (mux);
+    if (G_UNLIKELY (packet == NULL))
+      return FALSE;
 
-    /* check if we need to rewrite any of the current pmts */
-    for (cur = mux->programs; cur; cur = cur->next) {
-      TsMuxProgram *program = (TsMuxProgram *) cur->data;
-      gboolean write_pmt;
-
-      if (program->last_pmt_ts == G_MININT64 || program->pmt_changed)
-        write_pmt = TRUE;
-      else if (cur_pts >= program->last_pmt_ts + program->pmt_interval)
-        write_pmt = TRUE;
-      else
-        write_pmt = FALSE;
-
-      if (write_pmt) {
-        program->last_pmt_ts = cur_pts;
-        if (!tsmux_write_pmt (mux, program))
-          return FALSE;
-      }
-    }
-  }
+    if (!tsmux_stream_fill_packet (stream, packet))
+      return FALSE;
 
-  pi->packet_start_unit_indicator = tsmux_stream_at_pes_start (stream);
-  if (pi->packet_start_unit_indicator) {
-    tsmux_stream_initialize_pes_packet (stream);
-    if (stream->dts != G_MININT64)
-      stream->dts += CLOCK_BASE;
-    if (stream->pts != G_MININT64)
-      stream->pts += CLOCK_BASE;
+    return tsmux_packet_write (mux, packet, cur_pcr);
   }
-  pi->stream_avail = tsmux_stream_bytes_avail (stream);
 
   /* obtain buffer */
   if (!tsmux_get_buffer (mux, &buf))
@@ -1138,22 +1671,13 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
 
   gst_buffer_map (buf, &map, GST_MAP_READ);
 
-  if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs))
-    goto fail;
-
-
-  if (!tsmux_stream_get_data (stream, map.data + payload_offs, payload_len))
+  if (!tsmux_stream_fill_packet (stream, map.data))
     goto fail;
 
   gst_buffer_unmap (buf, &map);
 
   GST_DEBUG ("Writing PES of size %d", (int) gst_buffer_get_size (buf));
-  res = tsmux_packet_out (mux, buf, cur_pcr);
-
-  /* Reset all dynamic flags */
-  stream->pi.flags &= TSMUX_PACKET_FLAG_PES_FULL_HEADER;
-
-  return res;
+  return tsmux_packet_out (mux, buf, cur_pcr);
 
   /* ERRORS */
 fail:
@@ -1165,6 +1689,356 @@ fail:
   }
 }
 
+/* Parallel packetization
+ *
+ * In variable rate mode, the packets of a stream only depend on the state of
+ * that stream: continuity counter, PES headers and PCR are all derived from
+ * its own data and timestamps. The only thing that depends on the other
+ * streams are the tables, which are written in between the packets of PCR
+ * streams. A job thus prepares all packets of a stream on a pool thread,
+ * remembering where the tables were due, and the writing thread outputs the
+ * jobs in the order they were submitted, inserting the tables at the same
+ * places the serial path does. The output is identical to the one of
+ * tsmux_write_stream_packet(). */
+
+static gboolean
+tsmux_job_write_packet (TsMux * mux, TsMuxJob * job)
+{
+  TsMuxStream *stream = job->stream;
+  TsMuxJobPacket p = { -1, FALSE, 0, NULL };
+  gboolean res;
+
+  tsmux_stream_begin_packet (stream);
+
+  if (tsmux_stream_is_pcr (stream)) {
+    p.pcr = tsmux_stream_get_vbr_pcr (mux, stream, &p.tables_ts);
+    p.write_tables = TRUE;
+  }
+
+  if (tsmux_use_packet_funcs (mux)) {
+    g_byte_array_set_size (job->data, job->data->len + TSMUX_PACKET_LENGTH);
+    res = tsmux_stream_fill_packet (stream,
+        job->data->data + job->data->len - TSMUX_PACKET_LENGTH);
+  } else {
+    GstMapInfo map;
+
+    if (!tsmux_get_buffer (mux, &p.buf))
+      return FALSE;
+
+    gst_buffer_map (p.buf, &map, GST_MAP_WRITE);
+    res = tsmux_stream_fill_packet (stream, map.data);
+    gst_buffer_unmap (p.buf, &map);
+
+    if (!res)
+      gst_buffer_unref (p.buf);
+  }
+
+  if (res)
+    g_array_append_val (job->packets, p);
+
+  return res;
+}
+
+/* Runs in a thread of the pool */
+static void
+tsmux_job_run (TsMuxJob * job, TsMux * mux)
+{
+  gboolean failed = FALSE;
+
+  while (!failed && tsmux_stream_bytes_in_buffer (job->stream) > 0)
+    failed = !tsmux_job_write_packet (mux, job);
+
+  g_mutex_lock (&mux->job_lock);
+  job->failed = failed;
+  job->done = TRUE;
+  g_cond_broadcast (&mux->job_cond);
+  g_mutex_unlock (&mux->job_lock);
+}
+
+static void
+tsmux_job_free (TsMuxJob * job)
+{
+  guint i;
+
+  for (i = 0; i < job->packets->len; i++) {
+    TsMuxJobPacket *p = &g_array_index (job->packets, TsMuxJobPacket, i);
+
+    if (p->buf)
+      gst_buffer_unref (p->buf);
+  }
+  g_array_free (job->packets, TRUE);
+  if (job->data)
+    g_byte_array_unref (job->data);
+  if (job->notify)
+    job->notify (job->job_data);
+
+  g_slice_free (TsMuxJob, job);
+}
+
+/* Write out the prepared packets of @job, with the tables as they are due */
+static gboolean
+tsmux_job_write (TsMux * mux, TsMuxJob * job)
+{
+  guint i;
+
+  if (mux->job_func)
+    mux->job_func (job->job_data, mux->job_func_data);
+
+  if (job->failed)
+    return FALSE;
+
+  for (i = 0; i < job->packets->len; i++) {
+    TsMuxJobPacket *p = &g_array_index (job->packets, TsMuxJobPacket, i);
+
+    if (p->write_tables && !tsmux_write_tables (mux, p->tables_ts))
+      return FALSE;
+
+    if (p->buf) {
+      GstBuffer *buf = p->buf;
+
+      p->buf = NULL;
+      if (!tsmux_packet_out (mux, buf, p->pcr))
+        return FALSE;
+    } else {
+      guint8 *packet = tsmux_get_packet (mux);
+
+      if (G_UNLIKELY (packet == NULL))
+        return FALSE;
+
+      memcpy (packet, job->data->data + i * TSMUX_PACKET_LENGTH,
+          TSMUX_PACKET_LENGTH);
+      if (!tsmux_packet_write (mux, packet, p->pcr))
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+tsmux_job_wait (TsMux * mux, TsMuxJob * job)
+{
+  g_mutex_lock (&mux->job_lock);
+  while (!job->done)
+    g_cond_wait (&mux->job_cond, &mux->job_lock);
+  g_mutex_unlock (&mux->job_lock);
+}
+
+/**
+ * tsmux_drop_jobs:
+ * @mux: a #TsMux
+ *
+ * Wait for all submitted jobs and discard their packets, e.g. after a
+ * flush.
+ */
+void
+tsmux_drop_jobs (TsMux * mux)
+{
+  TsMuxJob *job;
+
+  while ((job = g_queue_pop_head (&mux->jobs))) {
+    tsmux_job_wait (mux, job);
+    tsmux_job_free (job);
+  }
+}
+
+/* Write out the oldest job, waiting for it to be done */
+static gboolean
+tsmux_write_next_job (TsMux * mux)
+{
+  TsMuxJob *job = g_queue_pop_head (&mux->jobs);
+  gboolean ret;
+
+  tsmux_job_wait (mux, job);
+  ret = tsmux_job_write (mux, job);
+  tsmux_job_free (job);
+
+  /* Output would have a hole, the following jobs are useless */
+  if (G_UNLIKELY (!ret))
+    tsmux_drop_jobs (mux);
+
+  return ret;
+}
+
+/**
+ * tsmux_set_packetize_threads:
+ * @mux: a #TsMux
+ * @n_threads: number of threads, 0 to disable parallel packetization
+ *
+ * Set the number of threads preparing stream packets for
+ * tsmux_submit_stream_packets(). If the alloc/write functions are used
+ * instead of the packet functions, the alloc function will be called from
+ * these threads. Must be called before submitting any job.
+ */
+void
+tsmux_set_packetize_threads (TsMux * mux, guint n_threads)
+{
+  g_return_if_fail (mux != NULL);
+  g_return_if_fail (g_queue_is_empty (&mux->jobs));
+
+  if (mux->job_pool) {
+    g_thread_pool_free (mux->job_pool, FALSE, TRUE);
+    mux->job_pool = NULL;
+  }
+
+  if (n_threads > 0) {
+    mux->job_pool = g_thread_pool_new ((GFunc) tsmux_job_run, mux, n_threads,
+        FALSE, NULL);
+    mux->max_jobs = n_threads * TSMUX_JOBS_PER_THREAD;
+  }
+}
+
+/**
+ * tsmux_set_job_func:
+ * @mux: a #TsMux
+ * @func: a user callback function
+ * @user_data: user data passed to @func
+ *
+ * Set the callback function called with the job data passed to
+ * tsmux_submit_stream_packets() right before the packets of that job are
+ * written out, so the user can restore the state the packets belong to.
+ */
+void
+tsmux_set_job_func (TsMux * mux, TsMuxJobFunc func, void *user_data)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->job_func = func;
+  mux->job_func_data = user_data;
+}
+
+/**
+ * tsmux_submit_stream_packets:
+ * @mux: a #TsMux
+ * @stream: a #TsMuxStream
+ * @job_data: data passed to the job function
+ * @notify: function to free @job_data
+ *
+ * Prepare packets for all the data currently queued in @stream on one of the
+ * packetizing threads. The packets are written out, in submission order,
+ * by this or a later call to tsmux_submit_stream_packets(),
+ * tsmux_wait_stream() or tsmux_flush_jobs(). No data may be added to @stream
+ * before its packets were written, see tsmux_wait_stream().
+ *
+ * In constant bitrate mode, or without packetizing threads, the packets are
+ * written right away.
+ *
+ * Returns: FALSE if writing out packets failed.
+ */
+gboolean
+tsmux_submit_stream_packets (TsMux * mux, TsMuxStream * stream,
+    void *job_data, GDestroyNotify notify)
+{
+  TsMuxJob *job;
+
+  g_return_val_if_fail (mux != NULL, FALSE);
+  g_return_val_if_fail (stream != NULL, FALSE);
+
+  if (mux->job_pool == NULL || mux->bitrate) {
+    gboolean ret = tsmux_flush_jobs (mux, TRUE);
+
+    /* Constant rate output depends on the position of every packet */
+    if (ret && mux->job_func)
+      mux->job_func (job_data, mux->job_func_data);
+    while (ret && tsmux_stream_bytes_in_buffer (stream) > 0)
+      ret = tsmux_write_stream_packet (mux, stream);
+
+    if (notify)
+      notify (job_data);
+    return ret;
+  }
+
+  /* Bound the amount of prepared data */
+  while (g_queue_get_length (&mux->jobs) >= mux->max_jobs) {
+    if (!tsmux_write_next_job (mux)) {
+      if (notify)
+        notify (job_data);
+      return FALSE;
+    }
+  }
+
+  job = g_slice_new0 (TsMuxJob);
+  job->stream = stream;
+  job->job_data = job_data;
+  job->notify = notify;
+  job->packets = g_array_new (FALSE, FALSE, sizeof (TsMuxJobPacket));
+  if (tsmux_use_packet_funcs (mux))
+    job->data = g_byte_array_new ();
+
+  g_queue_push_tail (&mux->jobs, job);
+  g_thread_pool_push (mux->job_pool, job, NULL);
+
+  /* Write out what is already done */
+  return tsmux_flush_jobs (mux, FALSE);
+}
+
+/**
+ * tsmux_wait_stream:
+ * @mux: a #TsMux
+ * @stream: a #TsMuxStream
+ *
+ * Write out all jobs up to the last one of @stream, after which data can be
+ * added to @stream again.
+ *
+ * Returns: FALSE if writing out packets failed.
+ */
+gboolean
+tsmux_wait_stream (TsMux * mux, TsMuxStream * stream)
+{
+  GList *cur;
+  guint i, n = 0;
+
+  g_return_val_if_fail (mux != NULL, FALSE);
+
+  for (cur = mux->jobs.head, i = 1; cur; cur = cur->next, i++) {
+    if (((TsMuxJob *) cur->data)->stream == stream)
+      n = i;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (!tsmux_write_next_job (mux))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * tsmux_flush_jobs:
+ * @mux: a #TsMux
+ * @wait: whether to wait for the jobs still in progress
+ *
+ * Write out the packets of all finished jobs, or of all jobs if @wait is
+ * TRUE, in submission order.
+ *
+ * Returns: FALSE if writing out packets failed.
+ */
+gboolean
+tsmux_flush_jobs (TsMux * mux, gboolean wait)
+{
+  TsMuxJob *job;
+
+  g_return_val_if_fail (mux != NULL, FALSE);
+
+  while ((job = g_queue_peek_head (&mux->jobs))) {
+    if (!wait) {
+      gboolean done;
+
+      g_mutex_lock (&mux->job_lock);
+      done = job->done;
+      g_mutex_unlock (&mux->job_lock);
+
+      if (!done)
+        break;
+    }
+
+    if (!tsmux_write_next_job (mux))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
 /**
  * tsmux_program_free:
  * @program: a #TsMuxProgram
@@ -97,11 +97,16 @@ G_BEGIN_DECLS
 #define TSMUX_START_PMT_PID 0x0020
 #define TSMUX_START_ES_PID 0x0040
 
+#define TSMUX_NULL_PID 0x1FFF
+
 typedef struct TsMuxSection TsMuxSection;
 typedef struct TsMux TsMux;
 
 typedef gboolean (*TsMuxWriteFunc) (GstBuffer * buf, void *user_data, gint64 new_pcr);
 typedef void (*TsMuxAllocFunc) (GstBuffer ** buf, void *user_data);
+typedef guint8 * (*TsMuxPacketAllocFunc) (void *user_data);
+typedef gboolean (*TsMuxPacketWriteFunc) (guint8 * packet, void *user_data, gint64 new_pcr);
+typedef void (*TsMuxJobFunc) (void *job_data, void *user_data);
 
 struct TsMuxSection {
   TsMuxPacketInfo pi;
@@ -169,6 +174,18 @@ struct TsMux {
   /* last time SIT written in MPEG PTS clock time */
   gint64   last_si_ts;
 
+  /* interval between PCR in MPEG PTS clock time */
+  guint    pcr_interval;
+
+  /* constant mux rate in bits per second, 0 for variable rate */
+  guint64  bitrate;
+  /* size of an output packet including any M2TS prefix */
+  guint    packet_size;
+  /* bytes written so far, drives the PCR in constant rate mode */
+  guint64  n_bytes;
+  /* PCR of the first byte written in constant rate mode */
+  gint64   first_pcr;
+
   /* callback to write finished packet */
   TsMuxWriteFunc write_func;
   void *write_func_data;
@@ -176,6 +193,25 @@ struct TsMux {
   TsMuxAllocFunc alloc_func;
   void *alloc_func_data;
 
+  /* optional callbacks to write packets straight into caller memory,
+   * used instead of the alloc/write functions above when set */
+  TsMuxPacketAllocFunc packet_alloc_func;
+  TsMuxPacketWriteFunc packet_write_func;
+  void *packet_func_data;
+
+  /* parallel packetization: stream packets are prepared by the threads
+   * of @job_pool and written out in submission order */
+  GThreadPool *job_pool;
+  guint max_jobs;
+  /* TsMuxJob, oldest first. Only accessed from the writing thread */
+  GQueue jobs;
+  /* protects the state of the jobs shared with the pool threads */
+  GMutex job_lock;
+  GCond job_cond;
+  /* called before the packets of a job are written */
+  TsMuxJobFunc job_func;
+  void *job_func_data;
+
   /* scratch space for writing ES_info descriptors */
   guint8 es_info_buf[TSMUX_MAX_ES_INFO_LENGTH];
 };
@@ -187,9 +223,16 @@ void 		tsmux_free 			(TsMux *mux);
 /* Setting muxing session properties */
 void 		tsmux_set_write_func 		(TsMux *mux, TsMuxWriteFunc func, void *user_data);
 void 		tsmux_set_alloc_func 		(TsMux *mux, TsMuxAllocFunc func, void *user_data);
+void 		tsmux_set_packet_funcs 		(TsMux *mux, TsMuxPacketAllocFunc alloc_func,
+						 TsMuxPacketWriteFunc write_func, void *user_data);
 void 		tsmux_set_pat_interval          (TsMux *mux, guint interval);
 guint 		tsmux_get_pat_interval          (TsMux *mux);
 void 		tsmux_resend_pat                (TsMux *mux);
+void 		tsmux_set_pcr_interval          (TsMux *mux, guint interval);
+guint 		tsmux_get_pcr_interval          (TsMux *mux);
+void 		tsmux_set_bitrate               (TsMux *mux, guint64 bitrate);
+guint64		tsmux_get_bitrate               (TsMux *mux);
+void 		tsmux_set_packet_size           (TsMux *mux, guint packet_size);
 guint16		tsmux_get_new_pid 		(TsMux *mux);
 
 /* pid/program management */
@@ -215,6 +258,15 @@ void 		tsmux_program_set_pcr_stream 	(TsMuxProgram *program, TsMuxStream *stream
 /* writing stuff */
 gboolean 	tsmux_write_stream_packet 	(TsMux *mux, TsMuxStream *stream);
 
+/* parallel packetization */
+void 		tsmux_set_packetize_threads 	(TsMux *mux, guint n_threads);
+void 		tsmux_set_job_func 		(TsMux *mux, TsMuxJobFunc func, void *user_data);
+gboolean 	tsmux_submit_stream_packets 	(TsMux *mux, TsMuxStream *stream,
+						 void *job_data, GDestroyNotify notify);
+gboolean 	tsmux_wait_stream 		(TsMux *mux, TsMuxStream *stream);
+gboolean 	tsmux_flush_jobs 		(TsMux *mux, gboolean wait);
+void 		tsmux_drop_jobs 		(TsMux *mux);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,932 @@
+/* GStreamer
+ *
+ * gstav1parse.c: AV1 video parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-av1parse
+ * @title: av1parse
+ *
+ * Parses AV1 streams into temporal units, one per output buffer, and marks
+ * the ones starting with a shown key frame as such. Both the low overhead
+ * bitstream format of section 5 of the AV1 specification ("obu-stream") and
+ * the length delimited format of its Annex B ("annexb") are accepted and
+ * can be converted into each other, depending on what downstream accepts.
+ *
+ * In the obu-stream format the sequence header is also put into the caps as
+ * an AV1CodecConfigurationRecord (codec_data), as needed by the ISOBMFF and
+ * Matroska muxers.
+ *
+ * ## Example launch line
+ * |[
+ * gst-launch-1.0 filesrc location=video.ivf ! ivfparse ! av1parse ! matroskamux ! filesink location=video.mkv
+ * ]|
+ *
+ * Since: 1.18
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/base/base.h>
+#include <gst/pbutils/pbutils.h>
+#include "gstav1parse.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (av1_parse_debug);
+#define GST_CAT_DEFAULT av1_parse_debug
+
+enum
+{
+  GST_AV1_PARSE_FORMAT_NONE,
+  GST_AV1_PARSE_FORMAT_OBU,
+  GST_AV1_PARSE_FORMAT_ANNEXB
+};
+
+/* an OBU of the temporal unit being parsed */
+typedef struct
+{
+  GstAV1OBU obu;
+  /* offset of the OBU header in the input buffer */
+  guint offset;
+  /* size of the OBU including its header, the obu_length in Annex B */
+  guint size;
+} GstAV1ParseOBU;
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-av1, parsed = (boolean) true, "
+        "stream-format = (string) { obu-stream, annexb }, "
+        "alignment = (string) tu"));
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-av1"));
+
+#define parent_class gst_av1_parse_parent_class
+G_DEFINE_TYPE (GstAV1Parse, gst_av1_parse, GST_TYPE_BASE_PARSE);
+
+static void gst_av1_parse_finalize (GObject * object);
+
+static gboolean gst_av1_parse_start (GstBaseParse * parse);
+static gboolean gst_av1_parse_stop (GstBaseParse * parse);
+static GstFlowReturn gst_av1_parse_handle_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame, gint * skipsize);
+static GstFlowReturn gst_av1_parse_pre_push_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame);
+static gboolean gst_av1_parse_set_caps (GstBaseParse * parse, GstCaps * caps);
+
+static void
+gst_av1_parse_class_init (GstAV1ParseClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseParseClass *parse_class = GST_BASE_PARSE_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (av1_parse_debug, "av1parse", 0, "av1 parser");
+
+  gobject_class->finalize = gst_av1_parse_finalize;
+
+  /* Override BaseParse vfuncs */
+  parse_class->start = GST_DEBUG_FUNCPTR (gst_av1_parse_start);
+  parse_class->stop = GST_DEBUG_FUNCPTR (gst_av1_parse_stop);
+  parse_class->handle_frame = GST_DEBUG_FUNCPTR (gst_av1_parse_handle_frame);
+  parse_class->pre_push_frame =
+      GST_DEBUG_FUNCPTR (gst_av1_parse_pre_push_frame);
+  parse_class->set_sink_caps = GST_DEBUG_FUNCPTR (gst_av1_parse_set_caps);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &srctemplate);
+  gst_element_class_add_static_pad_template (gstelement_class, &sinktemplate);
+
+  gst_element_class_set_static_metadata (gstelement_class, "AV1 parser",
+      "Codec/Parser/Converter/Video",
+      "Parses AV1 streams", "GStreamer maintainers "
+      "<gstreamer-devel@lists.freedesktop.org>");
+}
+
+static void
+gst_av1_parse_init (GstAV1Parse * av1parse)
+{
+  av1parse->parser = gst_av1_parser_new ();
+  av1parse->obus = g_array_new (FALSE, FALSE, sizeof (GstAV1ParseOBU));
+
+  gst_base_parse_set_pts_interpolation (GST_BASE_PARSE (av1parse), FALSE);
+  GST_PAD_SET_ACCEPT_INTERSECT (GST_BASE_PARSE_SINK_PAD (av1parse));
+  GST_PAD_SET_ACCEPT_TEMPLATE (GST_BASE_PARSE_SINK_PAD (av1parse));
+}
+
+static void
+gst_av1_parse_finalize (GObject * object)
+{
+  GstAV1Parse *av1parse = GST_AV1_PARSE (object);
+
+  gst_av1_parser_free (av1parse->parser);
+  g_array_free (av1parse->obus, TRUE);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_av1_parse_reset (GstAV1Parse * av1parse)
+{
+  gst_av1_parser_reset (av1parse->parser);
+  g_array_set_size (av1parse->obus, 0);
+
+  av1parse->in_format = GST_AV1_PARSE_FORMAT_OBU;
+  av1parse->format = GST_AV1_PARSE_FORMAT_NONE;
+  av1parse->packetized = FALSE;
+
+  gst_buffer_replace (&av1parse->seq_header_obu, NULL);
+  av1parse->update_caps = FALSE;
+  av1parse->sent_codec_tag = FALSE;
+}
+
+static gboolean
+gst_av1_parse_start (GstBaseParse * parse)
+{
+  GstAV1Parse *av1parse = GST_AV1_PARSE (parse);
+
+  GST_DEBUG_OBJECT (parse, "start");
+
+  gst_av1_parse_reset (av1parse);
+
+  /* a temporal delimiter OBU */
+  gst_base_parse_set_min_frame_size (parse, 2);
+
+  return TRUE;
+}
+
+static gboolean
+gst_av1_parse_stop (GstBaseParse * parse)
+{
+  GstAV1Parse *av1parse = GST_AV1_PARSE (parse);
+
+  GST_DEBUG_OBJECT (parse, "stop");
+
+  gst_av1_parse_reset (av1parse);
+
+  return TRUE;
+}
+
+static const gchar *
+gst_av1_parse_get_format_string (guint format)
+{
+  switch (format) {
+    case GST_AV1_PARSE_FORMAT_OBU:
+      return "obu-stream";
+    case GST_AV1_PARSE_FORMAT_ANNEXB:
+      return "annexb";
+    default:
+      return "none";
+  }
+}
+
+static guint
+gst_av1_parse_format_from_caps (GstCaps * caps)
+{
+  GstStructure *s;
+  const gchar *str;
+
+  if (!caps || gst_caps_get_size (caps) == 0)
+    return GST_AV1_PARSE_FORMAT_NONE;
+
+  s = gst_caps_get_structure (caps, 0);
+  if ((str = gst_structure_get_string (s, "stream-format"))) {
+    if (strcmp (str, "obu-stream") == 0)
+      return GST_AV1_PARSE_FORMAT_OBU;
+    else if (strcmp (str, "annexb") == 0)
+      return GST_AV1_PARSE_FORMAT_ANNEXB;
+  }
+
+  return GST_AV1_PARSE_FORMAT_NONE;
+}
+
+/* check downstream caps to configure the output format */
+static void
+gst_av1_parse_negotiate (GstAV1Parse * av1parse, GstCaps * in_caps)
+{
+  GstCaps *caps;
+  guint format = GST_AV1_PARSE_FORMAT_NONE;
+
+  caps = gst_pad_get_allowed_caps (GST_BASE_PARSE_SRC_PAD (av1parse));
+  GST_DEBUG_OBJECT (av1parse, "allowed caps: %" GST_PTR_FORMAT, caps);
+
+  /* concentrate on leading structure, since decodebin parser
+   * capsfilter always includes parser template caps */
+  if (caps)
+    caps = gst_caps_truncate (caps);
+
+  if (caps && !gst_caps_is_empty (caps)) {
+    GstCaps *in_format_caps;
+
+    /* keep the input format if downstream accepts it, no conversion needed */
+    in_format_caps = gst_caps_new_simple ("video/x-av1",
+        "stream-format", G_TYPE_STRING,
+        gst_av1_parse_get_format_string (av1parse->in_format), NULL);
+    if (gst_caps_can_intersect (in_format_caps, caps)) {
+      format = av1parse->in_format;
+    } else {
+      /* fixate to avoid ambiguity with lists when parsing */
+      caps = gst_caps_fixate (caps);
+      format = gst_av1_parse_format_from_caps (caps);
+    }
+    gst_caps_unref (in_format_caps);
+  }
+
+  /* default */
+  if (!format)
+    format = av1parse->in_format;
+
+  GST_DEBUG_OBJECT (av1parse, "selected format %s, input format %s",
+      gst_av1_parse_get_format_string (format),
+      gst_av1_parse_get_format_string (av1parse->in_format));
+
+  if (format != av1parse->format)
+    av1parse->update_caps = TRUE;
+  av1parse->format = format;
+
+  if (caps)
+    gst_caps_unref (caps);
+}
+
+static guint
+gst_av1_parse_leb128_size (guint32 value)
+{
+  guint size = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+
+  return size;
+}
+
+static gboolean
+gst_av1_parse_write_leb128 (GstByteWriter * bw, guint32 value)
+{
+  gboolean ok = TRUE;
+
+  do {
+    guint8 byte = value & 0x7f;
+
+    value >>= 7;
+    if (value)
+      byte |= 0x80;
+    ok &= gst_byte_writer_put_uint8 (bw, byte);
+  } while (value);
+
+  return ok;
+}
+
+/* writes the OBU at @data with an obu_size field, as required by the
+ * obu-stream format and the codec_data */
+static gboolean
+gst_av1_parse_write_obu (GstByteWriter * bw, const guint8 * data,
+    const GstAV1OBU * obu)
+{
+  guint ext_size = obu->header.obu_extention_flag ? 1 : 0;
+  gboolean ok = TRUE;
+
+  if (obu->header.obu_has_size_field)
+    return gst_byte_writer_put_data (bw, data, obu->header_size +
+        obu->obu_size);
+
+  ok &= gst_byte_writer_put_uint8 (bw, data[0] | 0x02);
+  if (ext_size)
+    ok &= gst_byte_writer_put_uint8 (bw, data[1]);
+  ok &= gst_av1_parse_write_leb128 (bw, obu->obu_size);
+  ok &= gst_byte_writer_put_data (bw, obu->data, obu->obu_size);
+
+  return ok;
+}
+
+static gboolean
+gst_av1_parse_handle_sequence_header (GstAV1Parse * av1parse,
+    const guint8 * data, const GstAV1OBU * obu)
+{
+  GstAV1SequenceHeaderOBU seq_header;
+  GstByteWriter bw;
+  GstBuffer *buf;
+  gsize size;
+
+  if (gst_av1_parser_parse_sequence_header_obu (av1parse->parser, obu,
+          &seq_header) != GST_AV1_PARSER_OK) {
+    GST_WARNING_OBJECT (av1parse, "failed to parse sequence header");
+    return FALSE;
+  }
+
+  gst_byte_writer_init_with_size (&bw, obu->header_size + obu->obu_size + 4,
+      FALSE);
+  if (!gst_av1_parse_write_obu (&bw, data, obu)) {
+    gst_byte_writer_reset (&bw);
+    return FALSE;
+  }
+  buf = gst_byte_writer_reset_and_get_buffer (&bw);
+
+  /* repeated sequence headers are the norm, only update caps on changes */
+  size = gst_buffer_get_size (buf);
+  if (av1parse->seq_header_obu &&
+      gst_buffer_get_size (av1parse->seq_header_obu) == size) {
+    GstMapInfo map;
+    gboolean equal;
+
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    equal = gst_buffer_memcmp (av1parse->seq_header_obu, 0, map.data,
+        map.size) == 0;
+    gst_buffer_unmap (buf, &map);
+
+    if (equal) {
+      gst_buffer_unref (buf);
+      return TRUE;
+    }
+  }
+
+  GST_DEBUG_OBJECT (av1parse, "new sequence header");
+  gst_buffer_replace (&av1parse->seq_header_obu, buf);
+  gst_buffer_unref (buf);
+  av1parse->update_caps = TRUE;
+
+  return TRUE;
+}
+
+/* parses the AV1CodecConfigurationRecord of the ISOBMFF and Matroska
+ * mappings, which carries the sequence header in its configOBUs */
+static gboolean
+gst_av1_parse_handle_codec_data (GstAV1Parse * av1parse, GstBuffer * buffer)
+{
+  GstMapInfo map;
+  GstAV1OBU obu;
+  gsize offset;
+  gboolean ret = FALSE;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+
+  /* marker and version */
+  if (map.size < 4 || map.data[0] != 0x81) {
+    GST_WARNING_OBJECT (av1parse, "invalid codec_data");
+    goto done;
+  }
+
+  offset = 4;
+  while (offset < map.size) {
+    if (gst_av1_parser_identify_obu (av1parse->parser, map.data + offset,
+            map.size - offset, &obu) != GST_AV1_PARSER_OK) {
+      GST_WARNING_OBJECT (av1parse, "invalid OBU in codec_data");
+      break;
+    }
+
+    if (obu.header.obu_type == GST_AV1_OBU_SEQUENCE_HEADER)
+      ret = gst_av1_parse_handle_sequence_header (av1parse,
+          map.data + offset, &obu);
+
+    offset += obu.header_size + obu.obu_size;
+  }
+
+done:
+  gst_buffer_unmap (buffer, &map);
+
+  return ret;
+}
+
+static GstBuffer *
+gst_av1_parse_make_codec_data (GstAV1Parse * av1parse)
+{
+  const GstAV1SequenceHeaderOBU *seq_header = &av1parse->parser->seq_header;
+  const GstAV1ColorConfig *cc = &seq_header->color_config;
+  GstBuffer *buf;
+  guint8 *data;
+
+  if (!av1parse->seq_header_obu)
+    return NULL;
+
+  data = g_malloc (4);
+  /* marker and version 1 */
+  data[0] = 0x81;
+  data[1] = (seq_header->seq_profile << 5) |
+      seq_header->operating_points[0].seq_level_idx;
+  data[2] = (seq_header->operating_points[0].seq_tier << 7) |
+      (cc->high_bitdepth << 6) | (cc->twelve_bit << 5) |
+      (cc->mono_chrome << 4) | (cc->subsampling_x << 3) |
+      (cc->subsampling_y << 2) | cc->chroma_sample_position;
+  /* no initial_presentation_delay */
+  data[3] = 0;
+
+  buf = gst_buffer_new_wrapped (data, 4);
+
+  return gst_buffer_append (buf, gst_buffer_ref (av1parse->seq_header_obu));
+}
+
+static void
+gst_av1_parse_update_src_caps (GstAV1Parse * av1parse, GstCaps * caps)
+{
+  GstCaps *sink_caps, *src_caps;
+  GstStructure *s;
+  GstBuffer *codec_data = NULL;
+
+  if (G_UNLIKELY (!av1parse->update_caps &&
+          gst_pad_has_current_caps (GST_BASE_PARSE_SRC_PAD (av1parse))))
+    return;
+
+  /* if this is being called from the first _setcaps call, caps on the sinkpad
+   * aren't set yet and so they need to be passed as an argument */
+  if (caps)
+    sink_caps = gst_caps_ref (caps);
+  else
+    sink_caps = gst_pad_get_current_caps (GST_BASE_PARSE_SINK_PAD (av1parse));
+
+  /* carry over input caps as much as possible; override with our own stuff */
+  if (!sink_caps)
+    sink_caps = gst_caps_new_empty_simple ("video/x-av1");
+
+  caps = gst_caps_copy (sink_caps);
+  s = gst_caps_get_structure (caps, 0);
+  gst_structure_remove_field (s, "codec_data");
+
+  if (av1parse->parser->have_seq_header) {
+    const GstAV1SequenceHeaderOBU *seq_header = &av1parse->parser->seq_header;
+    const GstAV1ColorConfig *cc = &seq_header->color_config;
+    const gchar *profile = NULL, *chroma_format;
+    gint fps_num, fps_den;
+
+    switch (seq_header->seq_profile) {
+      case GST_AV1_PROFILE_0:
+        profile = "main";
+        break;
+      case GST_AV1_PROFILE_1:
+        profile = "high";
+        break;
+      case GST_AV1_PROFILE_2:
+        profile = "professional";
+        break;
+      default:
+        break;
+    }
+
+    if (cc->mono_chrome)
+      chroma_format = "4:0:0";
+    else if (cc->subsampling_x && cc->subsampling_y)
+      chroma_format = "4:2:0";
+    else if (cc->subsampling_x)
+      chroma_format = "4:2:2";
+    else
+      chroma_format = "4:4:4";
+
+    gst_caps_set_simple (caps,
+        "width", G_TYPE_INT, seq_header->max_frame_width_minus_1 + 1,
+        "height", G_TYPE_INT, seq_header->max_frame_height_minus_1 + 1,
+        "chroma-format", G_TYPE_STRING, chroma_format,
+        "bit-depth-luma", G_TYPE_UINT, cc->bit_depth,
+        "bit-depth-chroma", G_TYPE_UINT, cc->bit_depth, NULL);
+    if (profile)
+      gst_caps_set_simple (caps, "profile", G_TYPE_STRING, profile, NULL);
+
+    /* upstream framerate takes precedence over the timing info */
+    if (!gst_structure_get_fraction (s, "framerate", &fps_num, &fps_den) &&
+        seq_header->timing_info_present_flag &&
+        seq_header->timing_info.equal_picture_interval) {
+      const GstAV1TimingInfo *ti = &seq_header->timing_info;
+      guint64 den = (guint64) ti->num_units_in_display_tick *
+          ((guint64) ti->num_ticks_per_picture_minus_1 + 1);
+
+      if (den <= G_MAXINT && ti->time_scale <= G_MAXINT) {
+        fps_num = ti->time_scale;
+        fps_den = den;
+        gst_caps_set_simple (caps, "framerate", GST_TYPE_FRACTION, fps_num,
+            fps_den, NULL);
+      } else {
+        fps_num = 0;
+      }
+    }
+
+    if (fps_num > 0 && fps_den > 0)
+      gst_base_parse_set_frame_rate (GST_BASE_PARSE (av1parse), fps_num,
+          fps_den, 0, 0);
+  }
+
+  gst_caps_set_simple (caps, "parsed", G_TYPE_BOOLEAN, TRUE,
+      "stream-format", G_TYPE_STRING,
+      gst_av1_parse_get_format_string (av1parse->format),
+      "alignment", G_TYPE_STRING, "tu", NULL);
+
+  /* only the obu-stream format carries codec_data */
+  if (av1parse->format == GST_AV1_PARSE_FORMAT_OBU &&
+      (codec_data = gst_av1_parse_make_codec_data (av1parse))) {
+    gst_caps_set_simple (caps, "codec_data", GST_TYPE_BUFFER, codec_data,
+        NULL);
+    gst_buffer_unref (codec_data);
+  }
+
+  src_caps = gst_pad_get_current_caps (GST_BASE_PARSE_SRC_PAD (av1parse));
+  if (!(src_caps && gst_caps_is_strictly_equal (src_caps, caps))) {
+    GST_DEBUG_OBJECT (av1parse, "new src caps %" GST_PTR_FORMAT, caps);
+    gst_pad_set_caps (GST_BASE_PARSE_SRC_PAD (av1parse), caps);
+  }
+
+  av1parse->update_caps = FALSE;
+
+  if (src_caps)
+    gst_caps_unref (src_caps);
+  gst_caps_unref (caps);
+  gst_caps_unref (sink_caps);
+}
+
+static gboolean
+gst_av1_parse_set_caps (GstBaseParse * parse, GstCaps * caps)
+{
+  GstAV1Parse *av1parse = GST_AV1_PARSE (parse);
+  GstStructure *s;
+  const GValue *value;
+  const gchar *alignment;
+
+  s = gst_caps_get_structure (caps, 0);
+
+  av1parse->in_format = gst_av1_parse_format_from_caps (caps);
+  if (av1parse->in_format == GST_AV1_PARSE_FORMAT_NONE)
+    av1parse->in_format = GST_AV1_PARSE_FORMAT_OBU;
+
+  /* the temporal units are only delimited by temporal delimiter OBUs in
+   * the obu-stream format, unless upstream says buffers are temporal units */
+  alignment = gst_structure_get_string (s, "alignment");
+  av1parse->packetized = alignment && strcmp (alignment, "tu") == 0;
+
+  /* the ISOBMFF and Matroska mappings store temporal units without
+   * temporal delimiters */
+  if ((value = gst_structure_get_value (s, "codec_data"))) {
+    GstBuffer *codec_data = gst_value_get_buffer (value);
+
+    av1parse->packetized = TRUE;
+    if (codec_data)
+      gst_av1_parse_handle_codec_data (av1parse, codec_data);
+  }
+
+  GST_DEBUG_OBJECT (av1parse, "input format %s, packetized %d",
+      gst_av1_parse_get_format_string (av1parse->in_format),
+      av1parse->packetized);
+
+  gst_av1_parse_negotiate (av1parse, caps);
+  av1parse->update_caps = TRUE;
+  gst_av1_parse_update_src_caps (av1parse, caps);
+
+  return TRUE;
+}
+
+static void
+gst_av1_parse_add_obu (GstAV1Parse * av1parse, const GstAV1OBU * obu,
+    guint offset, guint size)
+{
+  GstAV1ParseOBU parse_obu;
+
+  parse_obu.obu = *obu;
+  parse_obu.offset = offset;
+  parse_obu.size = size;
+  g_array_append_val (av1parse->obus, parse_obu);
+}
+
+/* collects the OBUs of the temporal unit at the start of @data, which ends
+ * at the next temporal delimiter unless @complete */
+static GstAV1ParserResult
+gst_av1_parse_split_obu_stream (GstAV1Parse * av1parse, const guint8 * data,
+    gsize size, gboolean complete, guint * framesize)
+{
+  GstAV1ParserResult res;
+  GstAV1OBU obu;
+  guint offset = 0, obu_size;
+
+  while (offset < size) {
+    res = gst_av1_parser_identify_obu (av1parse->parser, data + offset,
+        size - offset, &obu);
+    if (res == GST_AV1_PARSER_NO_MORE_DATA && complete)
+      res = GST_AV1_PARSER_BROKEN_DATA;
+    if (res != GST_AV1_PARSER_OK)
+      goto done;
+
+    if (!obu.header.obu_has_size_field && !av1parse->packetized) {
+      GST_WARNING_OBJECT (av1parse, "OBU without size in obu-stream");
+      res = GST_AV1_PARSER_BROKEN_DATA;
+      goto done;
+    }
+
+    if (obu.header.obu_type == GST_AV1_OBU_TEMPORAL_DELIMITER && offset > 0 &&
+        !av1parse->packetized)
+      break;
+
+    obu_size = obu.header_size + obu.obu_size;
+    gst_av1_parse_add_obu (av1parse, &obu, offset, obu_size);
+    offset += obu_size;
+  }
+
+  /* the temporal unit might continue in the next buffer */
+  if (offset == size && !complete)
+    return GST_AV1_PARSER_NO_MORE_DATA;
+
+  res = GST_AV1_PARSER_OK;
+
+done:
+  *framesize = offset;
+  return res;
+}
+
+/* collects the OBUs of the Annex B temporal_unit() at the start of @data */
+static GstAV1ParserResult
+gst_av1_parse_split_annexb (GstAV1Parse * av1parse, const guint8 * data,
+    gsize size, guint * framesize)
+{
+  GstAV1ParserResult res;
+  GstAV1OBU obu;
+  guint32 tu_size, fu_size, obu_length;
+  guint pos, len, tu_end, fu_end;
+
+  *framesize = 0;
+
+  res = gst_av1_read_leb128 (data, size, &tu_size, &len);
+  if (res != GST_AV1_PARSER_OK)
+    return res;
+
+  if (tu_size > size - len)
+    return GST_AV1_PARSER_NO_MORE_DATA;
+
+  pos = len;
+  tu_end = *framesize = len + tu_size;
+
+  while (pos < tu_end) {
+    if (gst_av1_read_leb128 (data + pos, tu_end - pos, &fu_size,
+            &len) != GST_AV1_PARSER_OK)
+      goto broken;
+    pos += len;
+    if (fu_size > tu_end - pos)
+      goto broken;
+    fu_end = pos + fu_size;
+
+    while (pos < fu_end) {
+      if (gst_av1_read_leb128 (data + pos, fu_end - pos, &obu_length,
+              &len) != GST_AV1_PARSER_OK)
+        goto broken;
+      pos += len;
+      if (obu_length > fu_end - pos)
+        goto broken;
+
+      if (gst_av1_parser_identify_obu (av1parse->parser, data + pos,
+              obu_length, &obu) != GST_AV1_PARSER_OK)
+        goto broken;
+
+      gst_av1_parse_add_obu (av1parse, &obu, pos, obu_length);
+      pos += obu_length;
+    }
+  }
+
+  return GST_AV1_PARSER_OK;
+
+broken:
+  GST_WARNING_OBJECT (av1parse, "invalid temporal unit");
+  return GST_AV1_PARSER_BROKEN_DATA;
+}
+
+/* converts the collected OBUs to @format, returns NULL if nothing needs to
+ * be done */
+static GstBuffer *
+gst_av1_parse_convert (GstAV1Parse * av1parse, const guint8 * data,
+    guint size)
+{
+  GstByteWriter bw;
+  GstAV1ParseOBU *parse_obu;
+  gboolean ok = TRUE;
+  guint i;
+
+  if (av1parse->format == av1parse->in_format)
+    return NULL;
+
+  gst_byte_writer_init_with_size (&bw, size + 16, FALSE);
+
+  if (av1parse->format == GST_AV1_PARSE_FORMAT_ANNEXB) {
+    guint n_obus = av1parse->obus->len;
+    guint *fu_sizes = g_new0 (guint, n_obus);
+    guint fu = 0, tu_size = 0;
+    gboolean have_frame = FALSE;
+
+    /* a frame unit holds one frame header and its tile groups, the OBUs in
+     * front of the first frame header belong to the first one */
+    for (i = 0; i < n_obus; i++) {
+      gboolean is_frame;
+
+      parse_obu = &g_array_index (av1parse->obus, GstAV1ParseOBU, i);
+      is_frame = parse_obu->obu.header.obu_type == GST_AV1_OBU_FRAME_HEADER ||
+          parse_obu->obu.header.obu_type == GST_AV1_OBU_FRAME;
+      if (is_frame && have_frame) {
+        fu = i;
+        have_frame = FALSE;
+      }
+      if (is_frame)
+        have_frame = TRUE;
+
+      fu_sizes[fu] += gst_av1_parse_leb128_size (parse_obu->size) +
+          parse_obu->size;
+    }
+
+    for (i = 0; i < n_obus; i++) {
+      if (fu_sizes[i])
+        tu_size += gst_av1_parse_leb128_size (fu_sizes[i]) + fu_sizes[i];
+    }
+
+    ok &= gst_av1_parse_write_leb128 (&bw, tu_size);
+    for (i = 0; i < n_obus; i++) {
+      parse_obu = &g_array_index (av1parse->obus, GstAV1ParseOBU, i);
+
+      if (fu_sizes[i])
+        ok &= gst_av1_parse_write_leb128 (&bw, fu_sizes[i]);
+      ok &= gst_av1_parse_write_leb128 (&bw, parse_obu->size);
+      ok &= gst_byte_writer_put_data (&bw, data + parse_obu->offset,
+          parse_obu->size);
+    }
+
+    g_free (fu_sizes);
+  } else {
+    for (i = 0; i < av1parse->obus->len; i++) {
+      parse_obu = &g_array_index (av1parse->obus, GstAV1ParseOBU, i);
+      ok &= gst_av1_parse_write_obu (&bw, data + parse_obu->offset,
+          &parse_obu->obu);
+    }
+  }
+
+  if (!ok) {
+    GST_WARNING_OBJECT (av1parse, "failed to convert temporal unit");
+    gst_byte_writer_reset (&bw);
+    return NULL;
+  }
+
+  return gst_byte_writer_reset_and_get_buffer (&bw);
+}
+
+static GstFlowReturn
+gst_av1_parse_handle_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame, gint * skipsize)
+{
+  GstAV1Parse *av1parse = GST_AV1_PARSE (parse);
+  GstBuffer *buffer = frame->buffer;
+  GstBuffer *out_buf;
+  GstMapInfo map;
+  GstAV1ParserResult res;
+  GstAV1FrameHeaderOBU frame_header;
+  gboolean keyframe = FALSE, header = FALSE;
+  guint framesize = 0, i;
+
+  if (G_UNLIKELY (av1parse->format == GST_AV1_PARSE_FORMAT_NONE))
+    gst_av1_parse_negotiate (av1parse, NULL);
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (parse, "Couldn't map incoming buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  g_array_set_size (av1parse->obus, 0);
+
+  if (av1parse->in_format == GST_AV1_PARSE_FORMAT_ANNEXB)
+    res = gst_av1_parse_split_annexb (av1parse, map.data, map.size,
+        &framesize);
+  else
+    res = gst_av1_parse_split_obu_stream (av1parse, map.data, map.size,
+        av1parse->packetized || GST_BASE_PARSE_DRAINING (parse), &framesize);
+
+  switch (res) {
+    case GST_AV1_PARSER_OK:
+      break;
+    case GST_AV1_PARSER_NO_MORE_DATA:
+      if (GST_BASE_PARSE_DRAINING (parse)) {
+        GST_WARNING_OBJECT (parse, "dropping incomplete temporal unit");
+        *skipsize = map.size;
+      }
+      goto out;
+    default:
+      if (framesize > 0 && av1parse->in_format == GST_AV1_PARSE_FORMAT_OBU) {
+        /* push what was found so far, the broken OBU will be skipped */
+        break;
+      }
+
+      if (framesize == 0 && av1parse->in_format == GST_AV1_PARSE_FORMAT_OBU) {
+        /* resync on the next temporal delimiter */
+        for (framesize = 1; framesize + 1 < map.size; framesize++) {
+          if (map.data[framesize] ==
+              (GST_AV1_OBU_TEMPORAL_DELIMITER << 3 | 0x02) &&
+              map.data[framesize + 1] == 0)
+            break;
+        }
+        if (framesize + 1 >= map.size)
+          framesize = map.size;
+      }
+
+      GST_WARNING_OBJECT (parse, "skipping %u bytes of invalid data",
+          framesize);
+      *skipsize = MAX (framesize, 1);
+      goto out;
+  }
+
+  for (i = 0; i < av1parse->obus->len; i++) {
+    GstAV1ParseOBU *parse_obu =
+        &g_array_index (av1parse->obus, GstAV1ParseOBU, i);
+
+    switch (parse_obu->obu.header.obu_type) {
+      case GST_AV1_OBU_SEQUENCE_HEADER:
+        if (gst_av1_parse_handle_sequence_header (av1parse,
+                map.data + parse_obu->offset, &parse_obu->obu))
+          header = TRUE;
+        break;
+      case GST_AV1_OBU_FRAME_HEADER:
+      case GST_AV1_OBU_FRAME:
+        if (gst_av1_parser_parse_frame_header_obu (av1parse->parser,
+                &parse_obu->obu, &frame_header) != GST_AV1_PARSER_OK)
+          break;
+
+        if (frame_header.frame_type == GST_AV1_KEY_FRAME &&
+            frame_header.show_frame && !frame_header.show_existing_frame)
+          keyframe = TRUE;
+        break;
+      default:
+        break;
+    }
+  }
+
+  GST_LOG_OBJECT (parse, "temporal unit of %u bytes, %u OBUs, keyframe %d",
+      framesize, av1parse->obus->len, keyframe);
+
+  gst_av1_parse_update_src_caps (av1parse, NULL);
+
+  if (keyframe)
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  else
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if (header)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_HEADER);
+  else
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_HEADER);
+
+  if ((out_buf = gst_av1_parse_convert (av1parse, map.data, framesize))) {
+    gst_buffer_copy_into (out_buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+    gst_buffer_replace (&frame->out_buffer, out_buf);
+    gst_buffer_unref (out_buf);
+  }
+
+  gst_buffer_unmap (buffer, &map);
+
+  return gst_base_parse_finish_frame (parse, frame, framesize);
+
+out:
+  gst_buffer_unmap (buffer, &map);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_av1_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
+{
+  GstAV1Parse *av1parse = GST_AV1_PARSE (parse);
+
+  if (!av1parse->sent_codec_tag) {
+    GstTagList *taglist;
+    GstCaps *caps;
+
+    /* codec tag */
+    caps = gst_pad_get_current_caps (GST_BASE_PARSE_SRC_PAD (parse));
+    if (G_UNLIKELY (caps == NULL)) {
+      if (GST_PAD_IS_FLUSHING (GST_BASE_PARSE_SRC_PAD (parse))) {
+        GST_INFO_OBJECT (parse, "Src pad is flushing");
+        return GST_FLOW_FLUSHING;
+      } else {
+        GST_INFO_OBJECT (parse, "Src pad is not negotiated!");
+        return GST_FLOW_NOT_NEGOTIATED;
+      }
+    }
+
+    taglist = gst_tag_list_new_empty ();
+    gst_pb_utils_add_codec_description_to_tag_list (taglist,
+        GST_TAG_VIDEO_CODEC, caps);
+    gst_caps_unref (caps);
+
+    gst_base_parse_merge_tags (parse, taglist, GST_TAG_MERGE_REPLACE);
+    gst_tag_list_unref (taglist);
+
+    /* also signals the end of first-frame processing */
+    av1parse->sent_codec_tag = TRUE;
+  }
+
+  return GST_FLOW_OK;
+}
@@ -29,6 +29,7 @@
 #include <gst/base/base.h>
 #include <gst/pbutils/pbutils.h>
 #include <gst/video/video.h>
+#include <gst/crc-private.h>
 #include "gsth264parse.h"
 
 #include <string.h>
@@ -37,11 +38,16 @@ GST_DEBUG_CATEGORY (h264_parse_debug);
 #define GST_CAT_DEFAULT h264_parse_debug
 
 #define DEFAULT_CONFIG_INTERVAL      (0)
+#define DEFAULT_GOP_CACHE            FALSE
+
+/* GOPs larger than this are not cached */
+#define GOP_CACHE_MAX_SIZE (64 * 1024 * 1024)
 
 enum
 {
   PROP_0,
-  PROP_CONFIG_INTERVAL
+  PROP_CONFIG_INTERVAL,
+  PROP_GOP_CACHE
 };
 
 enum
@@ -114,6 +120,7 @@ static gboolean gst_h264_parse_src_event (GstBaseParse * parse,
     GstEvent * event);
 static void gst_h264_parse_update_src_caps (GstH264Parse * h264parse,
     GstCaps * caps);
+static void gst_h264_parse_clear_gop (GstH264Parse * h264parse);
 
 static void
 gst_h264_parse_class_init (GstH264ParseClass * klass)
@@ -137,6 +144,27 @@ gst_h264_parse_class_init (GstH264ParseClass * klass)
           -1, 3600, DEFAULT_CONFIG_INTERVAL,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstH264Parse:gop-cache:
+   *
+   * Keep the AUs since the last keyframe, and push them again when
+   * a new consumer asks for a key unit as soon as possible, i.e. without a
+   * running time. A consumer is new when it was linked, i.e. sent a
+   * reconfigure event, since the last keyframe, e.g. a new branch added
+   * after a tee. It can then start decoding right away instead of waiting
+   * for the next keyframe, and the request is not forwarded to the encoder.
+   * Other requests are passed upstream as usual, so that the branches that
+   * are already running don't receive AUs they already got. GOPs of more
+   * than 64 MiB are not cached.
+   *
+   * Since: 1.18
+   */
+  g_object_class_install_property (gobject_class, PROP_GOP_CACHE,
+      g_param_spec_boolean ("gop-cache", "GOP cache",
+          "Push the AUs since the last keyframe again on key unit requests "
+          "from downstream", DEFAULT_GOP_CACHE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* Override BaseParse vfuncs */
   parse_class->start = GST_DEBUG_FUNCPTR (gst_h264_parse_start);
   parse_class->stop = GST_DEBUG_FUNCPTR (gst_h264_parse_stop);
@@ -161,12 +189,14 @@ static void
 gst_h264_parse_init (GstH264Parse * h264parse)
 {
   h264parse->frame_out = gst_adapter_new ();
+  h264parse->au_nals = g_array_new (FALSE, FALSE, sizeof (GstH26xAUNal));
   gst_base_parse_set_pts_interpolation (GST_BASE_PARSE (h264parse), FALSE);
   GST_PAD_SET_ACCEPT_INTERSECT (GST_BASE_PARSE_SINK_PAD (h264parse));
   GST_PAD_SET_ACCEPT_TEMPLATE (GST_BASE_PARSE_SINK_PAD (h264parse));
 
   h264parse->aud_needed = TRUE;
   h264parse->aud_insert = TRUE;
+  h264parse->gop_cache = DEFAULT_GOP_CACHE;
 }
 
 
@@ -176,6 +206,8 @@ gst_h264_parse_finalize (GObject * object)
   GstH264Parse *h264parse = GST_H264_PARSE (object);
 
   g_object_unref (h264parse->frame_out);
+  g_array_unref (h264parse->au_nals);
+  gst_h264_parse_clear_gop (h264parse);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -199,6 +231,41 @@ gst_h264_parse_reset_frame (GstH264Parse * h264parse)
   h264parse->have_sps_in_frame = FALSE;
   h264parse->have_pps_in_frame = FALSE;
   gst_adapter_clear (h264parse->frame_out);
+  h264parse->frame_out_n_mem = 0;
+  gst_buffer_replace (&h264parse->frame_out_src, NULL);
+  h264parse->frame_out_size = 0;
+
+  g_array_set_size (h264parse->au_nals, 0);
+  h264parse->au_flags = GST_H26X_AU_META_FLAG_NONE;
+  h264parse->au_slice_types = 0;
+  h264parse->au_have_picture = FALSE;
+  h264parse->au_frame_num = 0;
+  h264parse->au_recovery_cnt = -1;
+  h264parse->au_sps_id = -1;
+  h264parse->au_pps_id = -1;
+}
+
+/* Forgets which NALUs don't need to be parsed again when repeated. PPS and
+ * SEI are parsed using the SPS, so this is needed whenever an SPS changes */
+static void
+gst_h264_parse_clear_parsed_nals (GstH264Parse * h264parse, gboolean sps)
+{
+  gint i;
+
+  if (sps) {
+    for (i = 0; i < GST_H264_MAX_SPS_COUNT; i++)
+      h264parse->sps_crc[i] = -1;
+  }
+  for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++)
+    h264parse->pps_crc[i] = -1;
+
+  for (i = 0; i < GST_H264_PARSE_SEI_CACHE_SIZE; i++) {
+    GstH264ParseSEICache *entry = &h264parse->sei_cache[i];
+
+    g_clear_pointer (&entry->nal, g_bytes_unref);
+    g_clear_pointer (&entry->messages, g_array_unref);
+    entry->sps = NULL;
+  }
 }
 
 static void
@@ -229,6 +296,12 @@ gst_h264_parse_reset_stream_info (GstH264Parse * h264parse)
   h264parse->packetized = FALSE;
   h264parse->push_codec = FALSE;
 
+  h264parse->poc = 0;
+  h264parse->prev_poc_msb = 0;
+  h264parse->prev_poc_lsb = 0;
+  h264parse->prev_frame_num = 0;
+  h264parse->prev_frame_num_offset = 0;
+
   gst_buffer_replace (&h264parse->codec_data, NULL);
   gst_buffer_replace (&h264parse->codec_data_in, NULL);
 
@@ -238,6 +311,7 @@ gst_h264_parse_reset_stream_info (GstH264Parse * h264parse)
     gst_buffer_replace (&h264parse->sps_nals[i], NULL);
   for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++)
     gst_buffer_replace (&h264parse->pps_nals[i], NULL);
+  gst_h264_parse_clear_parsed_nals (h264parse, TRUE);
 }
 
 static void
@@ -256,6 +330,7 @@ gst_h264_parse_reset (GstH264Parse * h264parse)
 
   h264parse->discont = FALSE;
 
+  gst_h264_parse_clear_gop (h264parse);
   gst_h264_parse_reset_stream_info (h264parse);
 }
 
@@ -420,49 +495,162 @@ gst_h264_parse_negotiate (GstH264Parse * h264parse, gint in_format,
     gst_caps_unref (caps);
 }
 
-static GstBuffer *
-gst_h264_parse_wrap_nal (GstH264Parse * h264parse, guint format, guint8 * data,
-    guint size)
+/* Writes the length or start code prefix of a NALU of @size bytes in
+ * @format to @prefix and returns its size */
+static guint
+gst_h264_parse_get_nal_prefix (GstH264Parse * h264parse, guint format,
+    guint size, guint8 prefix[4])
 {
-  GstBuffer *buf;
   guint nl = h264parse->nal_length_size;
-  guint32 tmp;
 
-  GST_DEBUG_OBJECT (h264parse, "nal length %d", size);
-
-  buf = gst_buffer_new_allocate (NULL, 4 + size, NULL);
   if (format == GST_H264_PARSE_FORMAT_AVC
       || format == GST_H264_PARSE_FORMAT_AVC3) {
-    tmp = GUINT32_TO_BE (size << (32 - 8 * nl));
+    GST_WRITE_UINT32_BE (prefix, size << (32 - 8 * nl));
   } else {
     /* HACK: nl should always be 4 here, otherwise this won't work. 
      * There are legit cases where nl in avc stream is 2, but byte-stream
      * SC is still always 4 bytes. */
     nl = 4;
-    tmp = GUINT32_TO_BE (1);
+    GST_WRITE_UINT32_BE (prefix, 1);
   }
 
-  gst_buffer_fill (buf, 0, &tmp, sizeof (guint32));
+  return nl;
+}
+
+static GstBuffer *
+gst_h264_parse_wrap_nal (GstH264Parse * h264parse, guint format, guint8 * data,
+    guint size)
+{
+  GstBuffer *buf;
+  guint8 prefix[4];
+  guint nl;
+
+  GST_DEBUG_OBJECT (h264parse, "nal length %d", size);
+
+  nl = gst_h264_parse_get_nal_prefix (h264parse, format, size, prefix);
+
+  buf = gst_buffer_new_allocate (NULL, nl + size, NULL);
+  gst_buffer_fill (buf, 0, prefix, nl);
   gst_buffer_fill (buf, nl, data, size);
-  gst_buffer_set_size (buf, size + nl);
 
   return buf;
 }
 
+/* Like gst_h264_parse_wrap_nal(), but only the prefix is allocated and the
+ * returned buffer refers to the memory of @nal */
+static GstBuffer *
+gst_h264_parse_wrap_nal_buffer (GstH264Parse * h264parse, guint format,
+    GstBuffer * nal)
+{
+  GstBuffer *buf;
+  guint8 prefix[4];
+  guint nl;
+
+  nl = gst_h264_parse_get_nal_prefix (h264parse, format,
+      gst_buffer_get_size (nal), prefix);
+
+  buf = gst_buffer_new_allocate (NULL, nl, NULL);
+  gst_buffer_fill (buf, 0, prefix, nl);
+
+  return gst_buffer_append (buf,
+      gst_buffer_copy_region (nal, GST_BUFFER_COPY_MEMORY, 0, -1));
+}
+
+/* Queues @buf for the output AU */
+static void
+gst_h264_parse_push_frame_out (GstH264Parse * h264parse, GstBuffer * buf)
+{
+  h264parse->frame_out_n_mem += gst_buffer_n_memory (buf);
+  gst_adapter_push (h264parse->frame_out, buf);
+}
+
+/* Collects the pending region of the input in frame_out */
+static void
+gst_h264_parse_flush_frame_out (GstH264Parse * h264parse)
+{
+  if (!h264parse->frame_out_src)
+    return;
+
+  gst_h264_parse_push_frame_out (h264parse,
+      gst_buffer_copy_region (h264parse->frame_out_src, GST_BUFFER_COPY_MEMORY,
+          h264parse->frame_out_offset, h264parse->frame_out_size));
+  gst_buffer_replace (&h264parse->frame_out_src, NULL);
+  h264parse->frame_out_size = 0;
+}
+
+/* size of the output AU collected so far */
+static guint
+gst_h264_parse_frame_out_size (GstH264Parse * h264parse)
+{
+  return gst_adapter_available (h264parse->frame_out) +
+      h264parse->frame_out_size;
+}
+
+/* Collects @nalu with the prefix of the output format. NALUs of the input
+ * buffer are not copied: the output refers to the input memory, consecutive
+ * NALUs become a single region, and only prefixes that differ from the
+ * input ones are newly allocated. */
+static void
+gst_h264_parse_collect_out_nal (GstH264Parse * h264parse,
+    GstH264NalUnit * nalu)
+{
+  GstBuffer *src = h264parse->nal_src;
+  guint8 prefix[4];
+  guint nl, offset = nalu->offset;
+
+  if (!src) {
+    gst_h264_parse_flush_frame_out (h264parse);
+    gst_h264_parse_push_frame_out (h264parse,
+        gst_h264_parse_wrap_nal (h264parse, h264parse->format,
+            nalu->data + nalu->offset, nalu->size));
+    return;
+  }
+
+  nl = gst_h264_parse_get_nal_prefix (h264parse, h264parse->format,
+      nalu->size, prefix);
+
+  if (nalu->offset - nalu->sc_offset >= nl &&
+      memcmp (nalu->data + nalu->offset - nl, prefix, nl) == 0) {
+    /* the input prefix can be used as is */
+    offset -= nl;
+  } else {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, nl, NULL);
+
+    gst_buffer_fill (buf, 0, prefix, nl);
+    gst_h264_parse_flush_frame_out (h264parse);
+    gst_h264_parse_push_frame_out (h264parse, buf);
+  }
+
+  if (h264parse->frame_out_src == src &&
+      h264parse->frame_out_offset + h264parse->frame_out_size == offset) {
+    h264parse->frame_out_size = nalu->offset + nalu->size -
+        h264parse->frame_out_offset;
+    return;
+  }
+
+  gst_h264_parse_flush_frame_out (h264parse);
+  h264parse->frame_out_src = gst_buffer_ref (src);
+  h264parse->frame_out_offset = offset;
+  h264parse->frame_out_size = nalu->offset + nalu->size - offset;
+}
+
 static void
 gst_h264_parser_store_nal (GstH264Parse * h264parse, guint id,
-    GstH264NalUnitType naltype, GstH264NalUnit * nalu)
+    GstH264NalUnitType naltype, GstH264NalUnit * nalu, gint64 crc)
 {
   GstBuffer *buf, **store;
+  gint64 *crcs;
   guint size = nalu->size, store_size;
 
   if (naltype == GST_H264_NAL_SPS || naltype == GST_H264_NAL_SUBSET_SPS) {
     store_size = GST_H264_MAX_SPS_COUNT;
     store = h264parse->sps_nals;
+    crcs = h264parse->sps_crc;
     GST_DEBUG_OBJECT (h264parse, "storing sps %u", id);
   } else if (naltype == GST_H264_NAL_PPS) {
     store_size = GST_H264_MAX_PPS_COUNT;
     store = h264parse->pps_nals;
+    crcs = h264parse->pps_crc;
     GST_DEBUG_OBJECT (h264parse, "storing pps %u", id);
   } else
     return;
@@ -483,6 +671,50 @@ gst_h264_parser_store_nal (GstH264Parse * h264parse, guint id,
     gst_buffer_unref (store[id]);
 
   store[id] = buf;
+  crcs[id] = crc;
+}
+
+/* Parameter sets are often repeated unchanged with every keyframe or even
+ * every frame. Returns TRUE if @nalu is the same as a stored one that was
+ * parsed successfully, which then doesn't need to be parsed again. */
+static gboolean
+gst_h264_parse_find_stored_nal (GstH264Parse * h264parse,
+    GstH264NalUnitType naltype, GstH264NalUnit * nalu, guint32 crc,
+    guint * id)
+{
+  GstH264NalParser *nalparser = h264parse->nalparser;
+  GstBuffer **store;
+  gint64 *crcs;
+  guint i, store_size;
+
+  if (naltype == GST_H264_NAL_SPS || naltype == GST_H264_NAL_SUBSET_SPS) {
+    store_size = GST_H264_MAX_SPS_COUNT;
+    store = h264parse->sps_nals;
+    crcs = h264parse->sps_crc;
+  } else {
+    store_size = GST_H264_MAX_PPS_COUNT;
+    store = h264parse->pps_nals;
+    crcs = h264parse->pps_crc;
+  }
+
+  for (i = 0; i < store_size; i++) {
+    if (crcs[i] != crc || !store[i])
+      continue;
+
+    if (gst_buffer_get_size (store[i]) != nalu->size ||
+        gst_buffer_memcmp (store[i], 0, nalu->data + nalu->offset,
+            nalu->size) != 0)
+      continue;
+
+    if (store == h264parse->sps_nals ? !nalparser->sps[i].valid :
+        !nalparser->pps[i].valid)
+      return FALSE;
+
+    *id = i;
+    return TRUE;
+  }
+
+  return FALSE;
 }
 
 #ifndef GST_DISABLE_GST_DEBUG
@@ -608,6 +840,72 @@ gst_h264_parse_process_sei_user_data (GstH264Parse * h264parse,
   }
 }
 
+/* Returns the messages of a recently parsed SEI that is the same as @nalu
+ * and was parsed with the current SPS, or NULL */
+static GArray *
+gst_h264_parse_lookup_sei (GstH264Parse * h264parse, GstH264NalUnit * nalu)
+{
+  const guint8 *data = nalu->data + nalu->offset;
+  guint i;
+
+  for (i = 0; i < GST_H264_PARSE_SEI_CACHE_SIZE; i++) {
+    GstH264ParseSEICache *entry = &h264parse->sei_cache[i];
+    gconstpointer nal;
+    gsize size;
+
+    if (!entry->nal || entry->sps != h264parse->nalparser->last_sps)
+      continue;
+
+    nal = g_bytes_get_data (entry->nal, &size);
+    if (size == nalu->size && memcmp (nal, data, size) == 0)
+      return g_array_ref (entry->messages);
+  }
+
+  return NULL;
+}
+
+/* Keeps the messages of @nalu for the current SPS. An entry with the same
+ * SEI parsed with another SPS is updated in place instead of copying the
+ * NALU once more. */
+static void
+gst_h264_parse_store_sei (GstH264Parse * h264parse, GstH264NalUnit * nalu,
+    GArray * messages)
+{
+  const guint8 *data = nalu->data + nalu->offset;
+  GstH264ParseSEICache *entry = NULL;
+  guint i;
+
+  for (i = 0; i < GST_H264_PARSE_SEI_CACHE_SIZE; i++) {
+    GstH264ParseSEICache *e = &h264parse->sei_cache[i];
+    gconstpointer nal;
+    gsize size;
+
+    if (!e->nal)
+      continue;
+
+    nal = g_bytes_get_data (e->nal, &size);
+    if (size == nalu->size && memcmp (nal, data, size) == 0) {
+      entry = e;
+      break;
+    }
+  }
+
+  if (!entry) {
+    entry = &h264parse->sei_cache[h264parse->sei_cache_pos];
+    h264parse->sei_cache_pos =
+        (h264parse->sei_cache_pos + 1) % GST_H264_PARSE_SEI_CACHE_SIZE;
+
+    if (entry->nal)
+      g_bytes_unref (entry->nal);
+    entry->nal = g_bytes_new (data, nalu->size);
+  }
+
+  if (entry->messages)
+    g_array_unref (entry->messages);
+  entry->messages = g_array_ref (messages);
+  entry->sps = h264parse->nalparser->last_sps;
+}
+
 static void
 gst_h264_parse_process_sei (GstH264Parse * h264parse, GstH264NalUnit * nalu)
 {
@@ -617,9 +915,17 @@ gst_h264_parse_process_sei (GstH264Parse * h264parse, GstH264NalUnit * nalu)
   GArray *messages;
   guint i;
 
-  pres = gst_h264_parser_parse_sei (nalparser, nalu, &messages);
-  if (pres != GST_H264_PARSER_OK)
-    GST_WARNING_OBJECT (h264parse, "failed to parse one or more SEI message");
+  messages = gst_h264_parse_lookup_sei (h264parse, nalu);
+  if (messages) {
+    GST_LOG_OBJECT (h264parse, "SEI repeated, not parsing it again");
+  } else {
+    pres = gst_h264_parser_parse_sei (nalparser, nalu, &messages);
+    if (pres != GST_H264_PARSER_OK)
+      GST_WARNING_OBJECT (h264parse,
+          "failed to parse one or more SEI message");
+    else
+      gst_h264_parse_store_sei (h264parse, nalu, messages);
+  }
 
   /* Even if pres != GST_H264_PARSER_OK, some message could have been parsed and
    * stored in messages.
@@ -677,6 +983,9 @@ gst_h264_parse_process_sei (GstH264Parse * h264parse, GstH264NalUnit * nalu)
             sei.payload.recovery_point.broken_link_flag,
             sei.payload.recovery_point.changing_slice_group_idc);
         h264parse->keyframe = TRUE;
+        h264parse->au_flags |= GST_H26X_AU_META_FLAG_RECOVERY_POINT;
+        h264parse->au_recovery_cnt =
+            sei.payload.recovery_point.recovery_frame_cnt;
         break;
 
         /* Additional messages that are not innerly useful to the
@@ -808,7 +1117,117 @@ gst_h264_parse_process_sei (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       }
     }
   }
-  g_array_free (messages, TRUE);
+  g_array_unref (messages);
+}
+
+/* derives the picture order count of the picture @slice belongs to, as in
+ * 8.2.1, and updates the state needed for the next one */
+static gint32
+gst_h264_parse_compute_poc (GstH264Parse * h264parse, GstH264NalUnit * nalu,
+    GstH264SliceHdr * slice)
+{
+  GstH264SPS *sps = slice->pps->sequence;
+  GstH264DecRefPicMarking *marking = &slice->dec_ref_pic_marking;
+  guint32 max_frame_num = 1 << (sps->log2_max_frame_num_minus4 + 4);
+  guint32 frame_num_offset = 0;
+  gint32 top = 0, bottom = 0;
+  gboolean mmco5 = FALSE;
+  guint i;
+
+  if (nalu->ref_idc != 0 && !nalu->idr_pic_flag &&
+      marking->adaptive_ref_pic_marking_mode_flag) {
+    for (i = 0; i < marking->n_ref_pic_marking; i++) {
+      if (marking->ref_pic_marking[i].memory_management_control_operation == 5)
+        mmco5 = TRUE;
+    }
+  }
+
+  if (sps->pic_order_cnt_type != 0 && !nalu->idr_pic_flag) {
+    frame_num_offset = h264parse->prev_frame_num_offset;
+    if (h264parse->prev_frame_num > slice->frame_num)
+      frame_num_offset += max_frame_num;
+  }
+
+  switch (sps->pic_order_cnt_type) {
+    case 0:{
+      gint32 max_lsb = 1 << (sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+      gint32 lsb = slice->pic_order_cnt_lsb;
+      gint32 prev_lsb, msb;
+
+      if (nalu->idr_pic_flag) {
+        h264parse->prev_poc_msb = 0;
+        h264parse->prev_poc_lsb = 0;
+      }
+      prev_lsb = h264parse->prev_poc_lsb;
+
+      msb = h264parse->prev_poc_msb;
+      if (lsb < prev_lsb && prev_lsb - lsb >= max_lsb / 2)
+        msb += max_lsb;
+      else if (lsb > prev_lsb && lsb - prev_lsb > max_lsb / 2)
+        msb -= max_lsb;
+
+      top = bottom = msb + lsb;
+      if (!slice->field_pic_flag)
+        bottom += slice->delta_pic_order_cnt_bottom;
+
+      if (nalu->ref_idc != 0) {
+        /* after mmco5 the picture counts as having the lowest POC */
+        h264parse->prev_poc_msb = mmco5 ? 0 : msb;
+        h264parse->prev_poc_lsb = mmco5 ? top - MIN (top, bottom) : lsb;
+      }
+      break;
+    }
+    case 1:{
+      guint32 n_cycle = sps->num_ref_frames_in_pic_order_cnt_cycle;
+      guint32 abs_frame_num = 0;
+      gint32 expected = 0;
+
+      if (n_cycle != 0)
+        abs_frame_num = frame_num_offset + slice->frame_num;
+      if (nalu->ref_idc == 0 && abs_frame_num > 0)
+        abs_frame_num--;
+
+      if (abs_frame_num > 0) {
+        guint32 cycle_cnt = (abs_frame_num - 1) / n_cycle;
+        guint32 in_cycle = (abs_frame_num - 1) % n_cycle;
+        gint32 delta_per_cycle = 0;
+
+        for (i = 0; i < n_cycle; i++)
+          delta_per_cycle += sps->offset_for_ref_frame[i];
+        expected = cycle_cnt * delta_per_cycle;
+        for (i = 0; i <= in_cycle; i++)
+          expected += sps->offset_for_ref_frame[i];
+      }
+      if (nalu->ref_idc == 0)
+        expected += sps->offset_for_non_ref_pic;
+
+      if (!slice->field_pic_flag) {
+        top = expected + slice->delta_pic_order_cnt[0];
+        bottom = top + sps->offset_for_top_to_bottom_field +
+            slice->delta_pic_order_cnt[1];
+      } else if (!slice->bottom_field_flag) {
+        top = bottom = expected + slice->delta_pic_order_cnt[0];
+      } else {
+        top = bottom = expected + sps->offset_for_top_to_bottom_field +
+            slice->delta_pic_order_cnt[0];
+      }
+      break;
+    }
+    case 2:
+      if (!nalu->idr_pic_flag) {
+        top = bottom = 2 * (frame_num_offset + slice->frame_num);
+        if (nalu->ref_idc == 0)
+          top = bottom = top - 1;
+      }
+      break;
+    default:
+      break;
+  }
+
+  h264parse->prev_frame_num = mmco5 ? 0 : slice->frame_num;
+  h264parse->prev_frame_num_offset = mmco5 ? 0 : frame_num_offset;
+
+  return MIN (top, bottom);
 }
 
 /* caller guarantees 2 bytes of nal payload */
@@ -819,7 +1238,12 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
   GstH264PPS pps = { 0, };
   GstH264SPS sps = { 0, };
   GstH264NalParser *nalparser = h264parse->nalparser;
-  GstH264ParserResult pres;
+  GstH264ParserResult pres = GST_H264_PARSER_OK;
+  gboolean repeated = FALSE;
+  guint32 crc = 0;
+  guint id = 0;
+  gint slice_type = -1;
+  GstH26xAUNal au_nal;
 
   /* nothing to do for broken input */
   if (G_UNLIKELY (nalu->size < 2)) {
@@ -833,27 +1257,50 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
   GST_DEBUG_OBJECT (h264parse, "processing nal of type %u %s, size %u",
       nal_type, _nal_name (nal_type), nalu->size);
 
+  if (nal_type == GST_H264_NAL_SPS || nal_type == GST_H264_NAL_SUBSET_SPS
+      || nal_type == GST_H264_NAL_PPS) {
+    crc = gst_crc32_mpeg2 (nalu->data + nalu->offset, nalu->size);
+    repeated = gst_h264_parse_find_stored_nal (h264parse, nal_type, nalu, crc,
+        &id);
+  }
+
   switch (nal_type) {
     case GST_H264_NAL_SUBSET_SPS:
       if (!GST_H264_PARSE_STATE_VALID (h264parse, GST_H264_PARSE_STATE_GOT_SPS))
         return FALSE;
-      pres = gst_h264_parser_parse_subset_sps (nalparser, nalu, &sps, TRUE);
+      if (!repeated)
+        pres = gst_h264_parser_parse_subset_sps (nalparser, nalu, &sps, TRUE);
       goto process_sps;
 
     case GST_H264_NAL_SPS:
       /* reset state, everything else is obsolete */
       h264parse->state = 0;
-      pres = gst_h264_parser_parse_sps (nalparser, nalu, &sps, TRUE);
+      if (!repeated)
+        pres = gst_h264_parser_parse_sps (nalparser, nalu, &sps, TRUE);
 
     process_sps:
-      /* arranged for a fallback sps.id, so use that one and only warn */
-      if (pres != GST_H264_PARSER_OK) {
-        GST_WARNING_OBJECT (h264parse, "failed to parse SPS:");
-        return FALSE;
+      if (repeated) {
+        /* same as the stored one, but it might be a different SPS than the
+         * last one */
+        GST_LOG_OBJECT (h264parse, "SPS %u repeated, not parsing it again", id);
+        if (nalparser->last_sps != &nalparser->sps[id]) {
+          GST_DEBUG_OBJECT (h264parse, "triggering src caps check");
+          nalparser->last_sps = &nalparser->sps[id];
+          h264parse->update_caps = TRUE;
+        }
+      } else {
+        gst_h264_parse_clear_parsed_nals (h264parse, FALSE);
+
+        /* arranged for a fallback sps.id, so use that one and only warn */
+        if (pres != GST_H264_PARSER_OK) {
+          GST_WARNING_OBJECT (h264parse, "failed to parse SPS:");
+          return FALSE;
+        }
+
+        GST_DEBUG_OBJECT (h264parse, "triggering src caps check");
+        h264parse->update_caps = TRUE;
       }
 
-      GST_DEBUG_OBJECT (h264parse, "triggering src caps check");
-      h264parse->update_caps = TRUE;
       h264parse->have_sps = TRUE;
       h264parse->have_sps_in_frame = TRUE;
       if (h264parse->push_codec && h264parse->have_pps) {
@@ -865,8 +1312,10 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
         h264parse->have_pps = FALSE;
       }
 
-      gst_h264_parser_store_nal (h264parse, sps.id, nal_type, nalu);
-      gst_h264_sps_clear (&sps);
+      if (!repeated) {
+        gst_h264_parser_store_nal (h264parse, sps.id, nal_type, nalu, crc);
+        gst_h264_sps_clear (&sps);
+      }
       h264parse->state |= GST_H264_PARSE_STATE_GOT_SPS;
       h264parse->header |= TRUE;
       break;
@@ -876,12 +1325,17 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       if (!GST_H264_PARSE_STATE_VALID (h264parse, GST_H264_PARSE_STATE_GOT_SPS))
         return FALSE;
 
-      pres = gst_h264_parser_parse_pps (nalparser, nalu, &pps);
-      /* arranged for a fallback pps.id, so use that one and only warn */
-      if (pres != GST_H264_PARSER_OK) {
-        GST_WARNING_OBJECT (h264parse, "failed to parse PPS:");
-        if (pres != GST_H264_PARSER_BROKEN_LINK)
-          return FALSE;
+      if (repeated) {
+        GST_LOG_OBJECT (h264parse, "PPS %u repeated, not parsing it again", id);
+        nalparser->last_pps = &nalparser->pps[id];
+      } else {
+        pres = gst_h264_parser_parse_pps (nalparser, nalu, &pps);
+        /* arranged for a fallback pps.id, so use that one and only warn */
+        if (pres != GST_H264_PARSER_OK) {
+          GST_WARNING_OBJECT (h264parse, "failed to parse PPS:");
+          if (pres != GST_H264_PARSER_BROKEN_LINK)
+            return FALSE;
+        }
       }
 
       /* parameters might have changed, force caps check */
@@ -900,8 +1354,12 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
         h264parse->have_pps = FALSE;
       }
 
-      gst_h264_parser_store_nal (h264parse, pps.id, nal_type, nalu);
-      gst_h264_pps_clear (&pps);
+      if (!repeated) {
+        /* a PPS referring to an unknown SPS must be parsed again */
+        gst_h264_parser_store_nal (h264parse, pps.id, nal_type, nalu,
+            pres == GST_H264_PARSER_OK ? crc : -1);
+        gst_h264_pps_clear (&pps);
+      }
       h264parse->state |= GST_H264_PARSE_STATE_GOT_PPS;
       h264parse->header |= TRUE;
       break;
@@ -915,7 +1373,7 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       /* mark SEI pos */
       if (h264parse->sei_pos == -1) {
         if (h264parse->transform)
-          h264parse->sei_pos = gst_adapter_available (h264parse->frame_out);
+          h264parse->sei_pos = gst_h264_parse_frame_out_size (h264parse);
         else
           h264parse->sei_pos = nalu->sc_offset;
         GST_DEBUG_OBJECT (h264parse, "marking SEI in frame at offset %d",
@@ -959,6 +1417,23 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
 
           h264parse->state |= GST_H264_PARSE_STATE_GOT_SLICE;
           h264parse->field_pic_flag = slice.field_pic_flag;
+
+          slice_type = slice.type % 5;
+          h264parse->au_slice_types |= 1 << slice_type;
+          /* the first slice of the base view has the picture values */
+          if (!h264parse->au_have_picture &&
+              nal_type != GST_H264_NAL_SLICE_EXT) {
+            h264parse->au_have_picture = TRUE;
+            if (nalu->idr_pic_flag)
+              h264parse->au_flags |= GST_H26X_AU_META_FLAG_IDR;
+            h264parse->au_frame_num = slice.frame_num;
+            /* once per picture, also when it is output a slice at a time */
+            if (slice.first_mb_in_slice == 0)
+              h264parse->poc = gst_h264_parse_compute_poc (h264parse, nalu,
+                  &slice);
+            h264parse->au_pps_id = slice.pps->id;
+            h264parse->au_sps_id = slice.pps->sequence->id;
+          }
         }
       }
       if (G_LIKELY (nal_type != GST_H264_NAL_SLICE_IDR &&
@@ -971,7 +1446,7 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       /* mind replacement buffer if applicable */
       if (h264parse->idr_pos == -1) {
         if (h264parse->transform)
-          h264parse->idr_pos = gst_adapter_available (h264parse->frame_out);
+          h264parse->idr_pos = gst_h264_parse_frame_out_size (h264parse);
         else
           h264parse->idr_pos = nalu->sc_offset;
         GST_DEBUG_OBJECT (h264parse, "marking IDR in frame at offset %d",
@@ -1005,13 +1480,19 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
   /* if AVC output needed, collect properly prefixed nal in adapter,
    * and use that to replace outgoing buffer data later on */
   if (h264parse->transform) {
-    GstBuffer *buf;
-
     GST_LOG_OBJECT (h264parse, "collecting NAL in AVC frame");
-    buf = gst_h264_parse_wrap_nal (h264parse, h264parse->format,
-        nalu->data + nalu->offset, nalu->size);
-    gst_adapter_push (h264parse->frame_out, buf);
+    au_nal.offset = gst_h264_parse_frame_out_size (h264parse);
+    gst_h264_parse_collect_out_nal (h264parse, nalu);
+    au_nal.size = gst_h264_parse_frame_out_size (h264parse) - au_nal.offset;
+  } else {
+    /* split packetized input goes out one NAL per frame */
+    au_nal.offset = h264parse->split_packetized ? 0 : nalu->sc_offset;
+    au_nal.size = nalu->offset + nalu->size - nalu->sc_offset;
   }
+  au_nal.type = nal_type;
+  au_nal.slice_type = slice_type;
+  g_array_append_val (h264parse->au_nals, au_nal);
+
   return TRUE;
 }
 
@@ -1107,7 +1588,9 @@ gst_h264_parse_handle_frame_packetized (GstBaseParse * parse,
     GST_DEBUG_OBJECT (h264parse, "AVC nal offset %d", nalu.offset + nalu.size);
 
     /* either way, have a look at it */
+    h264parse->nal_src = buffer;
     gst_h264_parse_process_nal (h264parse, &nalu);
+    h264parse->nal_src = NULL;
 
     /* dispatch per NALU if needed */
     if (h264parse->split_packetized) {
@@ -1345,7 +1828,9 @@ gst_h264_parse_handle_frame (GstBaseParse * parse,
       }
     }
 
+    h264parse->nal_src = buffer;
     if (!gst_h264_parse_process_nal (h264parse, &nalu)) {
+      h264parse->nal_src = NULL;
       GST_WARNING_OBJECT (h264parse,
           "broken/invalid nal Type: %d %s, Size: %u will be dropped",
           nalu.type, _nal_name (nalu.type), nalu.size);
@@ -1353,6 +1838,7 @@ gst_h264_parse_handle_frame (GstBaseParse * parse,
       h264parse->aud_needed = TRUE;
       goto skip;
     }
+    h264parse->nal_src = NULL;
 
     /* Judge whether or not to insert AU Delimiter in case of byte-stream
      * If we're in the middle of au, we don't need to insert aud.
@@ -1414,6 +1900,9 @@ skip:
       !(h264parse->state & GST_H264_PARSE_STATE_VALID_PICTURE_HEADERS) ||
       (h264parse->state & GST_H264_PARSE_STATE_GOT_SLICE))
     gst_h264_parse_reset_frame (h264parse);
+  else if (!h264parse->transform)
+    /* the NALs kept so far are skipped along */
+    g_array_set_size (h264parse->au_nals, 0);
   goto out;
 
 invalid_stream:
@@ -2296,12 +2785,20 @@ gst_h264_parse_parse_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     h264parse->discont = FALSE;
   }
 
-  /* replace with transformed AVC output if applicable */
+  /* replace with transformed AVC output if applicable, which refers to the
+   * input memory as much as possible */
+  gst_h264_parse_flush_frame_out (h264parse);
   av = gst_adapter_available (h264parse->frame_out);
   if (av) {
     GstBuffer *buf;
 
-    buf = gst_adapter_take_buffer (h264parse->frame_out, av);
+    /* Past the memory limit of a buffer, appending merges all memories
+     * every time, so make a single copy instead */
+    if (h264parse->frame_out_n_mem <= gst_buffer_get_max_memory ())
+      buf = gst_adapter_take_buffer_fast (h264parse->frame_out, av);
+    else
+      buf = gst_adapter_take_buffer (h264parse->frame_out, av);
+    h264parse->frame_out_n_mem = 0;
     gst_buffer_copy_into (buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
     gst_buffer_replace (&frame->out_buffer, buf);
     gst_buffer_unref (buf);
@@ -2316,12 +2813,7 @@ static GstFlowReturn
 gst_h264_parse_push_codec_buffer (GstH264Parse * h264parse,
     GstBuffer * nal, GstClockTime ts)
 {
-  GstMapInfo map;
-
-  gst_buffer_map (nal, &map, GST_MAP_READ);
-  nal = gst_h264_parse_wrap_nal (h264parse, h264parse->format,
-      map.data, map.size);
-  gst_buffer_unmap (nal, &map);
+  nal = gst_h264_parse_wrap_nal_buffer (h264parse, h264parse->format, nal);
 
   GST_BUFFER_TIMESTAMP (nal) = ts;
   GST_BUFFER_DURATION (nal) = 0;
@@ -2424,14 +2916,116 @@ gst_h264_parse_prepare_key_unit (GstH264Parse * parse, GstEvent * event)
   parse->push_codec = TRUE;
 }
 
+/* sends the config NALs as separate buffers, returns FALSE if none are
+ * known */
 static gboolean
-gst_h264_parse_handle_sps_pps_nals (GstH264Parse * h264parse,
-    GstBuffer * buffer, GstBaseParseFrame * frame)
+gst_h264_parse_push_codec_nals (GstH264Parse * h264parse,
+    GstClockTime timestamp)
 {
   GstBuffer *codec_nal;
   gint i;
   gboolean send_done = FALSE;
-  GstClockTime timestamp = GST_BUFFER_TIMESTAMP (buffer);
+
+  GST_DEBUG_OBJECT (h264parse, "- sending SPS/PPS");
+  for (i = 0; i < GST_H264_MAX_SPS_COUNT; i++) {
+    if ((codec_nal = h264parse->sps_nals[i])) {
+      GST_DEBUG_OBJECT (h264parse, "sending SPS nal");
+      gst_h264_parse_push_codec_buffer (h264parse, codec_nal, timestamp);
+      send_done = TRUE;
+    }
+  }
+  for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++) {
+    if ((codec_nal = h264parse->pps_nals[i])) {
+      GST_DEBUG_OBJECT (h264parse, "sending PPS nal");
+      gst_h264_parse_push_codec_buffer (h264parse, codec_nal, timestamp);
+      send_done = TRUE;
+    }
+  }
+
+  return send_done;
+}
+
+/* appends config NAL @nal to @buffer, keeping the parse results in @meta
+ * up to date */
+static GstBuffer *
+gst_h264_parse_append_codec_nal (GstH264Parse * h264parse, GstBuffer * buffer,
+    GstH26xAUMeta * meta, GstBuffer * nal)
+{
+  GstBuffer *wrapped;
+  guint8 header = 0;
+
+  wrapped = gst_h264_parse_wrap_nal_buffer (h264parse, h264parse->format, nal);
+  if (meta) {
+    gst_buffer_extract (nal, 0, &header, 1);
+    gst_h26x_au_meta_insert_nal (meta, gst_buffer_get_size (buffer),
+        gst_buffer_get_size (wrapped), header & 0x1f);
+  }
+
+  return gst_buffer_append (buffer, wrapped);
+}
+
+/* returns a new AU with the config NALs inserted at @idr_pos, without
+ * copying the AU itself, or NULL if none are known */
+static GstBuffer *
+gst_h264_parse_insert_codec_nals (GstH264Parse * h264parse,
+    GstBuffer * buffer, gint idr_pos)
+{
+  GstBuffer *codec_nal, *new_buf;
+  GstH26xAUMeta *meta;
+  gint i;
+  gboolean send_done = FALSE;
+
+  new_buf = gst_buffer_new ();
+  gst_buffer_copy_into (new_buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+  /* the AU meta depends on the memory and is not part of the metadata, but
+   * all of the memory of @buffer ends up in @new_buf */
+  if ((meta = gst_buffer_get_h26x_au_meta (buffer))) {
+    GstMetaTransformCopy copy = { FALSE, 0, -1 };
+
+    meta->meta.info->transform_func (new_buf, (GstMeta *) meta, buffer,
+        _gst_meta_transform_copy, &copy);
+  }
+  meta = gst_buffer_get_h26x_au_meta (new_buf);
+  if (idr_pos > 0)
+    new_buf = gst_buffer_append (new_buf, gst_buffer_copy_region (buffer,
+            GST_BUFFER_COPY_MEMORY, 0, idr_pos));
+  GST_DEBUG_OBJECT (h264parse, "- inserting SPS/PPS");
+  for (i = 0; i < GST_H264_MAX_SPS_COUNT; i++) {
+    if ((codec_nal = h264parse->sps_nals[i])) {
+      GST_DEBUG_OBJECT (h264parse, "inserting SPS nal");
+      new_buf = gst_h264_parse_append_codec_nal (h264parse, new_buf, meta,
+          codec_nal);
+      send_done = TRUE;
+    }
+  }
+  for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++) {
+    if ((codec_nal = h264parse->pps_nals[i])) {
+      GST_DEBUG_OBJECT (h264parse, "inserting PPS nal");
+      new_buf = gst_h264_parse_append_codec_nal (h264parse, new_buf, meta,
+          codec_nal);
+      send_done = TRUE;
+    }
+  }
+
+  if (!send_done) {
+    gst_buffer_unref (new_buf);
+    return NULL;
+  }
+
+  new_buf = gst_buffer_append (new_buf, gst_buffer_copy_region (buffer,
+          GST_BUFFER_COPY_MEMORY, MAX (idr_pos, 0), -1));
+  /* should already be keyframe/IDR, but it may not have been,
+   * so mark it as such to avoid being discarded by picky decoder */
+  GST_BUFFER_FLAG_UNSET (new_buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  return new_buf;
+}
+
+static gboolean
+gst_h264_parse_handle_sps_pps_nals (GstH264Parse * h264parse,
+    GstBuffer * buffer, GstBaseParseFrame * frame)
+{
+  GstBuffer *new_buf;
 
   if (h264parse->have_sps_in_frame && h264parse->have_pps_in_frame) {
     GST_DEBUG_OBJECT (h264parse, "SPS/PPS exist in frame, will not insert");
@@ -2440,79 +3034,147 @@ gst_h264_parse_handle_sps_pps_nals (GstH264Parse * h264parse,
 
   if (h264parse->align == GST_H264_PARSE_ALIGN_NAL) {
     /* send separate config NAL buffers */
-    GST_DEBUG_OBJECT (h264parse, "- sending SPS/PPS");
-    for (i = 0; i < GST_H264_MAX_SPS_COUNT; i++) {
-      if ((codec_nal = h264parse->sps_nals[i])) {
-        GST_DEBUG_OBJECT (h264parse, "sending SPS nal");
-        gst_h264_parse_push_codec_buffer (h264parse, codec_nal, timestamp);
-        send_done = TRUE;
-      }
-    }
-    for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++) {
-      if ((codec_nal = h264parse->pps_nals[i])) {
-        GST_DEBUG_OBJECT (h264parse, "sending PPS nal");
-        gst_h264_parse_push_codec_buffer (h264parse, codec_nal, timestamp);
-        send_done = TRUE;
-      }
-    }
-  } else {
-    /* insert config NALs into AU */
-    GstByteWriter bw;
-    GstBuffer *new_buf;
-    const gboolean bs = h264parse->format == GST_H264_PARSE_FORMAT_BYTE;
-    const gint nls = 4 - h264parse->nal_length_size;
-    gboolean ok;
-
-    gst_byte_writer_init_with_size (&bw, gst_buffer_get_size (buffer), FALSE);
-    ok = gst_byte_writer_put_buffer (&bw, buffer, 0, h264parse->idr_pos);
-    GST_DEBUG_OBJECT (h264parse, "- inserting SPS/PPS");
-    for (i = 0; i < GST_H264_MAX_SPS_COUNT; i++) {
-      if ((codec_nal = h264parse->sps_nals[i])) {
-        gsize nal_size = gst_buffer_get_size (codec_nal);
-        GST_DEBUG_OBJECT (h264parse, "inserting SPS nal");
-        if (bs) {
-          ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-        } else {
-          ok &= gst_byte_writer_put_uint32_be (&bw, (nal_size << (nls * 8)));
-          ok &= gst_byte_writer_set_pos (&bw,
-              gst_byte_writer_get_pos (&bw) - nls);
-        }
+    return gst_h264_parse_push_codec_nals (h264parse,
+        GST_BUFFER_TIMESTAMP (buffer));
+  }
 
-        ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
-        send_done = TRUE;
-      }
-    }
-    for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++) {
-      if ((codec_nal = h264parse->pps_nals[i])) {
-        gsize nal_size = gst_buffer_get_size (codec_nal);
-        GST_DEBUG_OBJECT (h264parse, "inserting PPS nal");
-        if (bs) {
-          ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-        } else {
-          ok &= gst_byte_writer_put_uint32_be (&bw, (nal_size << (nls * 8)));
-          ok &= gst_byte_writer_set_pos (&bw,
-              gst_byte_writer_get_pos (&bw) - nls);
-        }
-        ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
-        send_done = TRUE;
+  /* insert config NALs into AU */
+  new_buf = gst_h264_parse_insert_codec_nals (h264parse, buffer,
+      h264parse->idr_pos);
+  if (!new_buf)
+    return FALSE;
+
+  gst_buffer_replace (&frame->out_buffer, new_buf);
+  gst_buffer_unref (new_buf);
+
+  return TRUE;
+}
+
+static void
+gst_h264_parse_clear_gop (GstH264Parse * h264parse)
+{
+  GstBuffer *buffer;
+
+  GST_OBJECT_LOCK (h264parse);
+  while ((buffer = g_queue_pop_head (&h264parse->gop)))
+    gst_buffer_unref (buffer);
+  h264parse->gop_size = 0;
+  GST_OBJECT_UNLOCK (h264parse);
+
+  g_atomic_int_set (&h264parse->gop_replay, FALSE);
+  /* consumers linked before the next keyframe will get that one */
+  g_atomic_int_set (&h264parse->gop_new_consumer, FALSE);
+}
+
+/* keeps @buffer in the GOP cache if it is a keyframe or follows one */
+static void
+gst_h264_parse_cache_gop (GstH264Parse * h264parse, GstBuffer * buffer,
+    gboolean has_headers)
+{
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    gst_h264_parse_clear_gop (h264parse);
+    h264parse->gop_idr_pos = h264parse->idr_pos;
+    h264parse->gop_has_headers = has_headers;
+  } else if (g_queue_is_empty (&h264parse->gop)) {
+    return;
+  }
+
+  h264parse->gop_size += gst_buffer_get_size (buffer);
+  if (h264parse->gop_size > GOP_CACHE_MAX_SIZE) {
+    GST_DEBUG_OBJECT (h264parse, "GOP too large, not caching it");
+    gst_h264_parse_clear_gop (h264parse);
+    return;
+  }
+
+  GST_OBJECT_LOCK (h264parse);
+  g_queue_push_tail (&h264parse->gop, gst_buffer_ref (buffer));
+  GST_OBJECT_UNLOCK (h264parse);
+}
+
+/* pushes the cached GOP again, preceded by the config NALs if its keyframe
+ * doesn't contain them */
+static void
+gst_h264_parse_replay_gop (GstH264Parse * h264parse)
+{
+  GstPad *srcpad = GST_BASE_PARSE_SRC_PAD (h264parse);
+  GList *l;
+
+  GST_DEBUG_OBJECT (h264parse, "replaying %u cached AUs",
+      h264parse->gop.length);
+
+  for (l = h264parse->gop.head; l; l = l->next) {
+    GstBuffer *buffer = l->data;
+
+    if (l == h264parse->gop.head) {
+      GstBuffer *keyframe = NULL;
+
+      if (h264parse->gop_has_headers) {
+        /* nothing to add */
+      } else if (h264parse->align == GST_H264_PARSE_ALIGN_NAL) {
+        gst_h264_parse_push_codec_nals (h264parse,
+            GST_BUFFER_TIMESTAMP (buffer));
+      } else {
+        keyframe = gst_h264_parse_insert_codec_nals (h264parse, buffer,
+            CLAMP (h264parse->gop_idr_pos, 0,
+                (gint) gst_buffer_get_size (buffer)));
       }
+
+      buffer = keyframe ? keyframe : gst_buffer_copy (buffer);
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    } else {
+      gst_buffer_ref (buffer);
     }
-    ok &= gst_byte_writer_put_buffer (&bw, buffer, h264parse->idr_pos, -1);
-    /* collect result and push */
-    new_buf = gst_byte_writer_reset_and_get_buffer (&bw);
-    gst_buffer_copy_into (new_buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
-    /* should already be keyframe/IDR, but it may not have been,
-     * so mark it as such to avoid being discarded by picky decoder */
-    GST_BUFFER_FLAG_UNSET (new_buf, GST_BUFFER_FLAG_DELTA_UNIT);
-    gst_buffer_replace (&frame->out_buffer, new_buf);
-    gst_buffer_unref (new_buf);
-    /* some result checking seems to make some compilers happy */
-    if (G_UNLIKELY (!ok)) {
-      GST_ERROR_OBJECT (h264parse, "failed to insert SPS/PPS");
-    }
+
+    if (gst_pad_push (srcpad, buffer) != GST_FLOW_OK)
+      break;
   }
+}
 
-  return send_done;
+/* returns TRUE if a GOP will be replayed before the next AU, which is only
+ * done for a consumer that was linked after the keyframe of the GOP */
+static gboolean
+gst_h264_parse_request_gop_replay (GstH264Parse * h264parse)
+{
+  gboolean cached;
+
+  if (!g_atomic_int_compare_and_exchange (&h264parse->gop_new_consumer, TRUE,
+          FALSE))
+    return FALSE;
+
+  GST_OBJECT_LOCK (h264parse);
+  cached = h264parse->gop_cache && !g_queue_is_empty (&h264parse->gop);
+  GST_OBJECT_UNLOCK (h264parse);
+
+  if (cached)
+    g_atomic_int_set (&h264parse->gop_replay, TRUE);
+
+  return cached;
+}
+
+/* attaches the parse results of the AU to @buffer */
+static void
+gst_h264_parse_attach_au_meta (GstH264Parse * h264parse, GstBuffer * buffer)
+{
+  GstH26xAUMeta *meta;
+
+  if (h264parse->au_nals->len == 0)
+    return;
+
+  /* may have been carried over from the input */
+  if ((meta = gst_buffer_get_h26x_au_meta (buffer)))
+    gst_buffer_remove_meta (buffer, (GstMeta *) meta);
+
+  meta = gst_buffer_add_h26x_au_meta (buffer, GST_H26X_AU_META_CODEC_H264,
+      (GstH26xAUNal *) h264parse->au_nals->data, h264parse->au_nals->len);
+  meta->flags = h264parse->au_flags;
+  if (h264parse->keyframe)
+    meta->flags |= GST_H26X_AU_META_FLAG_KEYFRAME;
+  meta->slice_types = h264parse->au_slice_types;
+  meta->frame_num = h264parse->au_frame_num;
+  meta->poc = h264parse->poc;
+  meta->recovery_cnt = h264parse->au_recovery_cnt;
+  meta->sps_id = h264parse->au_sps_id;
+  meta->pps_id = h264parse->au_pps_id;
 }
 
 static GstFlowReturn
@@ -2521,6 +3183,7 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
   GstH264Parse *h264parse;
   GstBuffer *buffer;
   GstEvent *event;
+  gboolean sent_headers = FALSE;
 
   h264parse = GST_H264_PARSE (parse);
 
@@ -2552,6 +3215,14 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     h264parse->sent_codec_tag = TRUE;
   }
 
+  /* give new consumers the current GOP, unless this AU starts a new one */
+  if (g_atomic_int_compare_and_exchange (&h264parse->gop_replay, TRUE, FALSE)
+      && GST_BUFFER_FLAG_IS_SET (frame->buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    gst_h264_parse_replay_gop (h264parse);
+
+  gst_h264_parse_attach_au_meta (h264parse,
+      frame->out_buffer ? frame->out_buffer : frame->buffer);
+
   /* In case of byte-stream, insert au delimeter by default
    * if it doesn't exist */
   if (h264parse->aud_insert && h264parse->format == GST_H264_PARSE_FORMAT_BYTE) {
@@ -2559,11 +3230,15 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
       GstMemory *mem =
           gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, (guint8 *) au_delim,
           sizeof (au_delim), 0, sizeof (au_delim), NULL, NULL);
+      GstH26xAUMeta *meta;
 
       frame->out_buffer = gst_buffer_copy (frame->buffer);
       gst_buffer_prepend_memory (frame->out_buffer, mem);
       if (h264parse->idr_pos >= 0)
         h264parse->idr_pos += sizeof (au_delim);
+      if ((meta = gst_buffer_get_h26x_au_meta (frame->out_buffer)))
+        gst_h26x_au_meta_insert_nal (meta, 0, sizeof (au_delim),
+            GST_H264_NAL_AU_DELIMITER);
 
       buffer = frame->out_buffer;
     } else {
@@ -2632,6 +3307,7 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
 
         if (gst_h264_parse_handle_sps_pps_nals (h264parse, buffer, frame)) {
           h264parse->last_report = new_ts;
+          sent_headers = TRUE;
         }
       }
       /* we pushed whatever we had */
@@ -2644,7 +3320,8 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     if (h264parse->idr_pos >= 0) {
       GST_LOG_OBJECT (h264parse, "IDR nal at offset %d", h264parse->idr_pos);
 
-      gst_h264_parse_handle_sps_pps_nals (h264parse, buffer, frame);
+      sent_headers =
+          gst_h264_parse_handle_sps_pps_nals (h264parse, buffer, frame);
 
       /* we pushed whatever we had */
       h264parse->push_codec = FALSE;
@@ -2739,6 +3416,17 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     h264parse->num_clock_timestamp = 0;
   }
 
+  if (h264parse->gop_cache) {
+    gboolean has_headers = h264parse->align == GST_H264_PARSE_ALIGN_AU &&
+        (sent_headers || (h264parse->have_sps_in_frame
+            && h264parse->have_pps_in_frame));
+
+    gst_h264_parse_cache_gop (h264parse,
+        frame->out_buffer ? frame->out_buffer : frame->buffer, has_headers);
+  } else if (!g_queue_is_empty (&h264parse->gop)) {
+    gst_h264_parse_clear_gop (h264parse);
+  }
+
   gst_h264_parse_reset_frame (h264parse);
 
   return GST_FLOW_OK;
@@ -3093,6 +3781,7 @@ gst_h264_parse_event (GstBaseParse * parse, GstEvent * event)
       h264parse->dts = GST_CLOCK_TIME_NONE;
       h264parse->ts_trn_nb = GST_CLOCK_TIME_NONE;
       h264parse->push_codec = TRUE;
+      gst_h264_parse_clear_gop (h264parse);
 
       res = GST_BASE_PARSE_CLASS (parent_class)->sink_event (parse, event);
       break;
@@ -3141,6 +3830,15 @@ gst_h264_parse_src_event (GstBaseParse * parse, GstEvent * event)
             " all_headers %d count %d", gst_event_get_seqnum (event),
             GST_TIME_ARGS (running_time), all_headers, count);
 
+        /* Only an immediate request can be answered with the past */
+        if (!GST_CLOCK_TIME_IS_VALID (running_time)
+            && gst_h264_parse_request_gop_replay (h264parse)) {
+          GST_DEBUG_OBJECT (h264parse, "answering from the GOP cache");
+          gst_event_unref (event);
+          res = TRUE;
+          break;
+        }
+
         if (all_headers) {
           h264parse->pending_key_unit_ts = running_time;
           gst_event_replace (&h264parse->force_key_unit_event, event);
@@ -3149,6 +3847,11 @@ gst_h264_parse_src_event (GstBaseParse * parse, GstEvent * event)
       res = GST_BASE_PARSE_CLASS (parent_class)->src_event (parse, event);
       break;
     }
+    case GST_EVENT_RECONFIGURE:
+      /* e.g. a new branch after a tee, which may ask for a key unit next */
+      g_atomic_int_set (&h264parse->gop_new_consumer, TRUE);
+      res = GST_BASE_PARSE_CLASS (parent_class)->src_event (parse, event);
+      break;
     default:
       res = GST_BASE_PARSE_CLASS (parent_class)->src_event (parse, event);
       break;
@@ -3169,6 +3872,11 @@ gst_h264_parse_set_property (GObject * object, guint prop_id,
     case PROP_CONFIG_INTERVAL:
       parse->interval = g_value_get_int (value);
       break;
+    case PROP_GOP_CACHE:
+      GST_OBJECT_LOCK (parse);
+      parse->gop_cache = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (parse);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -3187,6 +3895,9 @@ gst_h264_parse_get_property (GObject * object, guint prop_id,
     case PROP_CONFIG_INTERVAL:
       g_value_set_int (value, parse->interval);
       break;
+    case PROP_GOP_CACHE:
+      g_value_set_boolean (value, parse->gop_cache);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
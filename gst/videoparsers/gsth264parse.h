@@ -28,12 +28,24 @@
 #include <gst/gst.h>
 #include <gst/base/gstbaseparse.h>
 #include <gst/codecparsers/gsth264parser.h>
+#include <gst/codecparsers/gsth26xaumeta.h>
 #include <gst/video/video.h>
 
 G_BEGIN_DECLS
 
 typedef struct _H264Params H264Params;
 
+#define GST_H264_PARSE_SEI_CACHE_SIZE 4
+
+/* A recently parsed SEI NALU and its messages */
+typedef struct
+{
+  GBytes *nal;
+  GArray *messages;
+  /* the SPS the messages were parsed with */
+  GstH264SPS *sps;
+} GstH264ParseSEICache;
+
 #define GST_TYPE_H264_PARSE \
   (gst_h264_parse_get_type())
 #define GST_H264_PARSE(obj) \
@@ -95,6 +107,13 @@ struct _GstH264Parse
   /* collected SPS and PPS NALUs */
   GstBuffer *sps_nals[GST_H264_MAX_SPS_COUNT];
   GstBuffer *pps_nals[GST_H264_MAX_PPS_COUNT];
+  /* their checksums, -1 if they must be parsed again when repeated */
+  gint64 sps_crc[GST_H264_MAX_SPS_COUNT];
+  gint64 pps_crc[GST_H264_MAX_PPS_COUNT];
+
+  /* recently parsed SEI NALUs, reused when repeated */
+  GstH264ParseSEICache sei_cache[GST_H264_PARSE_SEI_CACHE_SIZE];
+  guint sei_cache_pos;
 
   /* collected SEI timestamps */
   guint num_clock_timestamp;
@@ -121,18 +140,48 @@ struct _GstH264Parse
   gint idr_pos, sei_pos;
   gboolean update_caps;
   GstAdapter *frame_out;
+  /* input buffer the NALUs being processed point into, if any */
+  GstBuffer *nal_src;
+  /* region of an input buffer still to be collected in frame_out */
+  GstBuffer *frame_out_src;
+  gsize frame_out_offset, frame_out_size;
+  /* number of memories collected in frame_out */
+  guint frame_out_n_mem;
   gboolean keyframe;
   gboolean header;
   gboolean frame_start;
   /* AU state */
   gboolean picture_start;
 
+  /* parse results of the AU, attached to it as GstH26xAUMeta */
+  GArray *au_nals;
+  GstH26xAUMetaFlags au_flags;
+  guint au_slice_types;
+  gboolean au_have_picture;
+  guint32 au_frame_num;
+  gint au_recovery_cnt;
+  gint au_sps_id, au_pps_id;
+
+  /* picture order count of the current picture and derivation state, 8.2.1 */
+  gint32 poc;
+  gint32 prev_poc_msb, prev_poc_lsb;
+  guint32 prev_frame_num, prev_frame_num_offset;
+
   /* props */
   gint interval;
 
   GstClockTime pending_key_unit_ts;
   GstEvent *force_key_unit_event;
 
+  /* AUs since the last keyframe, pushed again for new consumers */
+  gboolean gop_cache;
+  GQueue gop;
+  gsize gop_size;
+  gint gop_idr_pos;
+  gboolean gop_has_headers;
+  gint gop_replay;
+  gint gop_new_consumer;
+
   /* Stereo / multiview info */
   GstVideoMultiviewMode multiview_mode;
   GstVideoMultiviewFlags multiview_flags;
@@ -24,6 +24,7 @@
 
 #include <gst/base/base.h>
 #include <gst/pbutils/pbutils.h>
+#include <gst/crc-private.h>
 #include "gsth265parse.h"
 
 #include <string.h>
@@ -32,11 +33,16 @@ GST_DEBUG_CATEGORY (h265_parse_debug);
 #define GST_CAT_DEFAULT h265_parse_debug
 
 #define DEFAULT_CONFIG_INTERVAL      (0)
+#define DEFAULT_GOP_CACHE            FALSE
+
+/* GOPs larger than this are not cached */
+#define GOP_CACHE_MAX_SIZE (64 * 1024 * 1024)
 
 enum
 {
   PROP_0,
-  PROP_CONFIG_INTERVAL
+  PROP_CONFIG_INTERVAL,
+  PROP_GOP_CACHE
 };
 
 enum
@@ -114,6 +120,7 @@ static GstCaps *gst_h265_parse_get_caps (GstBaseParse * parse,
 static gboolean gst_h265_parse_event (GstBaseParse * parse, GstEvent * event);
 static gboolean gst_h265_parse_src_event (GstBaseParse * parse,
     GstEvent * event);
+static void gst_h265_parse_clear_gop (GstH265Parse * h265parse);
 
 static void
 gst_h265_parse_class_init (GstH265ParseClass * klass)
@@ -136,6 +143,28 @@ gst_h265_parse_class_init (GstH265ParseClass * klass)
           "(0 = disabled, -1 = send with every IDR frame)",
           -1, 3600, DEFAULT_CONFIG_INTERVAL,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstH265Parse:gop-cache:
+   *
+   * Keep the AUs since the last keyframe, and push them again when
+   * a new consumer asks for a key unit as soon as possible, i.e. without a
+   * running time. A consumer is new when it was linked, i.e. sent a
+   * reconfigure event, since the last keyframe, e.g. a new branch added
+   * after a tee. It can then start decoding right away instead of waiting
+   * for the next keyframe, and the request is not forwarded to the encoder.
+   * Other requests are passed upstream as usual, so that the branches that
+   * are already running don't receive AUs they already got. GOPs of more
+   * than 64 MiB are not cached.
+   *
+   * Since: 1.18
+   */
+  g_object_class_install_property (gobject_class, PROP_GOP_CACHE,
+      g_param_spec_boolean ("gop-cache", "GOP cache",
+          "Push the AUs since the last keyframe again on key unit requests "
+          "from downstream", DEFAULT_GOP_CACHE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* Override BaseParse vfuncs */
   parse_class->start = GST_DEBUG_FUNCPTR (gst_h265_parse_start);
   parse_class->stop = GST_DEBUG_FUNCPTR (gst_h265_parse_stop);
@@ -160,9 +189,12 @@ static void
 gst_h265_parse_init (GstH265Parse * h265parse)
 {
   h265parse->frame_out = gst_adapter_new ();
+  h265parse->au_nals = g_array_new (FALSE, FALSE, sizeof (GstH26xAUNal));
   gst_base_parse_set_pts_interpolation (GST_BASE_PARSE (h265parse), FALSE);
   GST_PAD_SET_ACCEPT_INTERSECT (GST_BASE_PARSE_SINK_PAD (h265parse));
   GST_PAD_SET_ACCEPT_TEMPLATE (GST_BASE_PARSE_SINK_PAD (h265parse));
+
+  h265parse->gop_cache = DEFAULT_GOP_CACHE;
 }
 
 
@@ -172,6 +204,8 @@ gst_h265_parse_finalize (GObject * object)
   GstH265Parse *h265parse = GST_H265_PARSE (object);
 
   g_object_unref (h265parse->frame_out);
+  g_array_unref (h265parse->au_nals);
+  gst_h265_parse_clear_gop (h265parse);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -194,6 +228,47 @@ gst_h265_parse_reset_frame (GstH265Parse * h265parse)
   h265parse->have_sps_in_frame = FALSE;
   h265parse->have_pps_in_frame = FALSE;
   gst_adapter_clear (h265parse->frame_out);
+  h265parse->frame_out_n_mem = 0;
+  gst_buffer_replace (&h265parse->frame_out_src, NULL);
+  h265parse->frame_out_size = 0;
+
+  g_array_set_size (h265parse->au_nals, 0);
+  h265parse->au_flags = GST_H26X_AU_META_FLAG_NONE;
+  h265parse->au_slice_types = 0;
+  h265parse->au_have_picture = FALSE;
+  h265parse->au_recovery_cnt = -1;
+  h265parse->au_vps_id = -1;
+  h265parse->au_sps_id = -1;
+  h265parse->au_pps_id = -1;
+}
+
+/* Forgets which NALUs don't need to be parsed again when repeated. SPS are
+ * parsed using the VPS, and PPS and SEI using the SPS, so this is needed
+ * whenever one of those changes */
+static void
+gst_h265_parse_clear_parsed_nals (GstH265Parse * h265parse, gboolean vps,
+    gboolean sps)
+{
+  gint i;
+
+  if (vps) {
+    for (i = 0; i < GST_H265_MAX_VPS_COUNT; i++)
+      h265parse->vps_crc[i] = -1;
+  }
+  if (sps) {
+    for (i = 0; i < GST_H265_MAX_SPS_COUNT; i++)
+      h265parse->sps_crc[i] = -1;
+  }
+  for (i = 0; i < GST_H265_MAX_PPS_COUNT; i++)
+    h265parse->pps_crc[i] = -1;
+
+  for (i = 0; i < GST_H265_PARSE_SEI_CACHE_SIZE; i++) {
+    GstH265ParseSEICache *entry = &h265parse->sei_cache[i];
+
+    g_clear_pointer (&entry->nal, g_bytes_unref);
+    g_clear_pointer (&entry->messages, g_array_unref);
+    entry->sps = NULL;
+  }
 }
 
 static void
@@ -221,6 +296,11 @@ gst_h265_parse_reset_stream_info (GstH265Parse * h265parse)
   h265parse->packetized = FALSE;
   h265parse->push_codec = FALSE;
 
+  h265parse->poc = 0;
+  h265parse->prev_tid0_poc = 0;
+  h265parse->have_prev_tid0_pic = FALSE;
+  h265parse->slice_type = -1;
+
   gst_buffer_replace (&h265parse->codec_data, NULL);
   gst_buffer_replace (&h265parse->codec_data_in, NULL);
 
@@ -232,6 +312,7 @@ gst_h265_parse_reset_stream_info (GstH265Parse * h265parse)
     gst_buffer_replace (&h265parse->sps_nals[i], NULL);
   for (i = 0; i < GST_H265_MAX_PPS_COUNT; i++)
     gst_buffer_replace (&h265parse->pps_nals[i], NULL);
+  gst_h265_parse_clear_parsed_nals (h265parse, TRUE, TRUE);
 
   gst_video_mastering_display_info_init (&h265parse->mastering_display_info);
   h265parse->mastering_display_info_state = GST_H265_PARSE_SEI_EXPIRED;
@@ -252,6 +333,7 @@ gst_h265_parse_reset (GstH265Parse * h265parse)
 
   h265parse->discont = FALSE;
 
+  gst_h265_parse_clear_gop (h265parse);
   gst_h265_parse_reset_stream_info (h265parse);
 }
 
@@ -407,53 +489,167 @@ gst_h265_parse_negotiate (GstH265Parse * h265parse, gint in_format,
     gst_caps_unref (caps);
 }
 
-static GstBuffer *
-gst_h265_parse_wrap_nal (GstH265Parse * h265parse, guint format, guint8 * data,
-    guint size)
+/* Writes the length or start code prefix of a NALU of @size bytes in
+ * @format to @prefix and returns its size */
+static guint
+gst_h265_parse_get_nal_prefix (GstH265Parse * h265parse, guint format,
+    guint size, guint8 prefix[4])
 {
-  GstBuffer *buf;
   guint nl = h265parse->nal_length_size;
-  guint32 tmp;
-
-  GST_DEBUG_OBJECT (h265parse, "nal length %d", size);
 
-  buf = gst_buffer_new_allocate (NULL, 4 + size, NULL);
   if (format == GST_H265_PARSE_FORMAT_HVC1
       || format == GST_H265_PARSE_FORMAT_HEV1) {
-    tmp = GUINT32_TO_BE (size << (32 - 8 * nl));
+    GST_WRITE_UINT32_BE (prefix, size << (32 - 8 * nl));
   } else {
     /* HACK: nl should always be 4 here, otherwise this won't work.
      * There are legit cases where nl in hevc stream is 2, but byte-stream
      * SC is still always 4 bytes. */
     nl = 4;
-    tmp = GUINT32_TO_BE (1);
+    GST_WRITE_UINT32_BE (prefix, 1);
   }
 
-  gst_buffer_fill (buf, 0, &tmp, sizeof (guint32));
+  return nl;
+}
+
+static GstBuffer *
+gst_h265_parse_wrap_nal (GstH265Parse * h265parse, guint format, guint8 * data,
+    guint size)
+{
+  GstBuffer *buf;
+  guint8 prefix[4];
+  guint nl;
+
+  GST_DEBUG_OBJECT (h265parse, "nal length %d", size);
+
+  nl = gst_h265_parse_get_nal_prefix (h265parse, format, size, prefix);
+
+  buf = gst_buffer_new_allocate (NULL, nl + size, NULL);
+  gst_buffer_fill (buf, 0, prefix, nl);
   gst_buffer_fill (buf, nl, data, size);
-  gst_buffer_set_size (buf, size + nl);
 
   return buf;
 }
 
+/* Like gst_h265_parse_wrap_nal(), but only the prefix is allocated and the
+ * returned buffer refers to the memory of @nal */
+static GstBuffer *
+gst_h265_parse_wrap_nal_buffer (GstH265Parse * h265parse, guint format,
+    GstBuffer * nal)
+{
+  GstBuffer *buf;
+  guint8 prefix[4];
+  guint nl;
+
+  nl = gst_h265_parse_get_nal_prefix (h265parse, format,
+      gst_buffer_get_size (nal), prefix);
+
+  buf = gst_buffer_new_allocate (NULL, nl, NULL);
+  gst_buffer_fill (buf, 0, prefix, nl);
+
+  return gst_buffer_append (buf,
+      gst_buffer_copy_region (nal, GST_BUFFER_COPY_MEMORY, 0, -1));
+}
+
+/* Queues @buf for the output AU */
+static void
+gst_h265_parse_push_frame_out (GstH265Parse * h265parse, GstBuffer * buf)
+{
+  h265parse->frame_out_n_mem += gst_buffer_n_memory (buf);
+  gst_adapter_push (h265parse->frame_out, buf);
+}
+
+/* Collects the pending region of the input in frame_out */
+static void
+gst_h265_parse_flush_frame_out (GstH265Parse * h265parse)
+{
+  if (!h265parse->frame_out_src)
+    return;
+
+  gst_h265_parse_push_frame_out (h265parse,
+      gst_buffer_copy_region (h265parse->frame_out_src, GST_BUFFER_COPY_MEMORY,
+          h265parse->frame_out_offset, h265parse->frame_out_size));
+  gst_buffer_replace (&h265parse->frame_out_src, NULL);
+  h265parse->frame_out_size = 0;
+}
+
+/* size of the output AU collected so far */
+static guint
+gst_h265_parse_frame_out_size (GstH265Parse * h265parse)
+{
+  return gst_adapter_available (h265parse->frame_out) +
+      h265parse->frame_out_size;
+}
+
+/* Collects @nalu with the prefix of the output format. NALUs of the input
+ * buffer are not copied: the output refers to the input memory, consecutive
+ * NALUs become a single region, and only prefixes that differ from the
+ * input ones are newly allocated. */
+static void
+gst_h265_parse_collect_out_nal (GstH265Parse * h265parse,
+    GstH265NalUnit * nalu)
+{
+  GstBuffer *src = h265parse->nal_src;
+  guint8 prefix[4];
+  guint nl, offset = nalu->offset;
+
+  if (!src) {
+    gst_h265_parse_flush_frame_out (h265parse);
+    gst_h265_parse_push_frame_out (h265parse,
+        gst_h265_parse_wrap_nal (h265parse, h265parse->format,
+            nalu->data + nalu->offset, nalu->size));
+    return;
+  }
+
+  nl = gst_h265_parse_get_nal_prefix (h265parse, h265parse->format,
+      nalu->size, prefix);
+
+  if (nalu->offset - nalu->sc_offset >= nl &&
+      memcmp (nalu->data + nalu->offset - nl, prefix, nl) == 0) {
+    /* the input prefix can be used as is */
+    offset -= nl;
+  } else {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, nl, NULL);
+
+    gst_buffer_fill (buf, 0, prefix, nl);
+    gst_h265_parse_flush_frame_out (h265parse);
+    gst_h265_parse_push_frame_out (h265parse, buf);
+  }
+
+  if (h265parse->frame_out_src == src &&
+      h265parse->frame_out_offset + h265parse->frame_out_size == offset) {
+    h265parse->frame_out_size = nalu->offset + nalu->size -
+        h265parse->frame_out_offset;
+    return;
+  }
+
+  gst_h265_parse_flush_frame_out (h265parse);
+  h265parse->frame_out_src = gst_buffer_ref (src);
+  h265parse->frame_out_offset = offset;
+  h265parse->frame_out_size = nalu->offset + nalu->size - offset;
+}
+
 static void
 gst_h265_parser_store_nal (GstH265Parse * h265parse, guint id,
-    GstH265NalUnitType naltype, GstH265NalUnit * nalu)
+    GstH265NalUnitType naltype, GstH265NalUnit * nalu, gint64 crc)
 {
   GstBuffer *buf, **store;
+  gint64 *crcs;
   guint size = nalu->size, store_size;
 
   if (naltype == GST_H265_NAL_VPS) {
     store_size = GST_H265_MAX_VPS_COUNT;
     store = h265parse->vps_nals;
+    crcs = h265parse->vps_crc;
     GST_DEBUG_OBJECT (h265parse, "storing vps %u", id);
   } else if (naltype == GST_H265_NAL_SPS) {
     store_size = GST_H265_MAX_SPS_COUNT;
     store = h265parse->sps_nals;
+    crcs = h265parse->sps_crc;
     GST_DEBUG_OBJECT (h265parse, "storing sps %u", id);
   } else if (naltype == GST_H265_NAL_PPS) {
     store_size = GST_H265_MAX_PPS_COUNT;
     store = h265parse->pps_nals;
+    crcs = h265parse->pps_crc;
     GST_DEBUG_OBJECT (h265parse, "storing pps %u", id);
   } else
     return;
@@ -474,6 +670,62 @@ gst_h265_parser_store_nal (GstH265Parse * h265parse, guint id,
     gst_buffer_unref (store[id]);
 
   store[id] = buf;
+  crcs[id] = crc;
+}
+
+/* Parameter sets are often repeated unchanged with every keyframe or even
+ * every frame. Returns TRUE if @nalu is the same as a stored one that was
+ * parsed successfully, which then doesn't need to be parsed again. */
+static gboolean
+gst_h265_parse_find_stored_nal (GstH265Parse * h265parse,
+    GstH265NalUnitType naltype, GstH265NalUnit * nalu, guint32 crc,
+    guint * id)
+{
+  GstH265Parser *nalparser = h265parse->nalparser;
+  GstBuffer **store;
+  gint64 *crcs;
+  guint i, store_size;
+
+  if (naltype == GST_H265_NAL_VPS) {
+    store_size = GST_H265_MAX_VPS_COUNT;
+    store = h265parse->vps_nals;
+    crcs = h265parse->vps_crc;
+  } else if (naltype == GST_H265_NAL_SPS) {
+    store_size = GST_H265_MAX_SPS_COUNT;
+    store = h265parse->sps_nals;
+    crcs = h265parse->sps_crc;
+  } else {
+    store_size = GST_H265_MAX_PPS_COUNT;
+    store = h265parse->pps_nals;
+    crcs = h265parse->pps_crc;
+  }
+
+  for (i = 0; i < store_size; i++) {
+    gboolean valid;
+
+    if (crcs[i] != crc || !store[i])
+      continue;
+
+    if (gst_buffer_get_size (store[i]) != nalu->size ||
+        gst_buffer_memcmp (store[i], 0, nalu->data + nalu->offset,
+            nalu->size) != 0)
+      continue;
+
+    if (naltype == GST_H265_NAL_VPS)
+      valid = nalparser->vps[i].valid;
+    else if (naltype == GST_H265_NAL_SPS)
+      valid = nalparser->sps[i].valid;
+    else
+      valid = nalparser->pps[i].valid;
+
+    if (!valid)
+      return FALSE;
+
+    *id = i;
+    return TRUE;
+  }
+
+  return FALSE;
 }
 
 #ifndef GST_DISABLE_GST_DEBUG
@@ -530,6 +782,72 @@ _nal_name (GstH265NalUnitType nal_type)
 }
 #endif
 
+/* Returns the messages of a recently parsed SEI that is the same as @nalu
+ * and was parsed with the current SPS, or NULL */
+static GArray *
+gst_h265_parse_lookup_sei (GstH265Parse * h265parse, GstH265NalUnit * nalu)
+{
+  const guint8 *data = nalu->data + nalu->offset;
+  guint i;
+
+  for (i = 0; i < GST_H265_PARSE_SEI_CACHE_SIZE; i++) {
+    GstH265ParseSEICache *entry = &h265parse->sei_cache[i];
+    gconstpointer nal;
+    gsize size;
+
+    if (!entry->nal || entry->sps != h265parse->nalparser->last_sps)
+      continue;
+
+    nal = g_bytes_get_data (entry->nal, &size);
+    if (size == nalu->size && memcmp (nal, data, size) == 0)
+      return g_array_ref (entry->messages);
+  }
+
+  return NULL;
+}
+
+/* Keeps the messages of @nalu for the current SPS. An entry with the same
+ * SEI parsed with another SPS is updated in place instead of copying the
+ * NALU once more. */
+static void
+gst_h265_parse_store_sei (GstH265Parse * h265parse, GstH265NalUnit * nalu,
+    GArray * messages)
+{
+  const guint8 *data = nalu->data + nalu->offset;
+  GstH265ParseSEICache *entry = NULL;
+  guint i;
+
+  for (i = 0; i < GST_H265_PARSE_SEI_CACHE_SIZE; i++) {
+    GstH265ParseSEICache *e = &h265parse->sei_cache[i];
+    gconstpointer nal;
+    gsize size;
+
+    if (!e->nal)
+      continue;
+
+    nal = g_bytes_get_data (e->nal, &size);
+    if (size == nalu->size && memcmp (nal, data, size) == 0) {
+      entry = e;
+      break;
+    }
+  }
+
+  if (!entry) {
+    entry = &h265parse->sei_cache[h265parse->sei_cache_pos];
+    h265parse->sei_cache_pos =
+        (h265parse->sei_cache_pos + 1) % GST_H265_PARSE_SEI_CACHE_SIZE;
+
+    if (entry->nal)
+      g_bytes_unref (entry->nal);
+    entry->nal = g_bytes_new (data, nalu->size);
+  }
+
+  if (entry->messages)
+    g_array_unref (entry->messages);
+  entry->messages = g_array_ref (messages);
+  entry->sps = h265parse->nalparser->last_sps;
+}
+
 static void
 gst_h265_parse_process_sei (GstH265Parse * h265parse, GstH265NalUnit * nalu)
 {
@@ -539,9 +857,17 @@ gst_h265_parse_process_sei (GstH265Parse * h265parse, GstH265NalUnit * nalu)
   GArray *messages;
   guint i;
 
-  pres = gst_h265_parser_parse_sei (nalparser, nalu, &messages);
-  if (pres != GST_H265_PARSER_OK)
-    GST_WARNING_OBJECT (h265parse, "failed to parse one or more SEI message");
+  messages = gst_h265_parse_lookup_sei (h265parse, nalu);
+  if (messages) {
+    GST_LOG_OBJECT (h265parse, "SEI repeated, not parsing it again");
+  } else {
+    pres = gst_h265_parser_parse_sei (nalparser, nalu, &messages);
+    if (pres != GST_H265_PARSER_OK)
+      GST_WARNING_OBJECT (h265parse,
+          "failed to parse one or more SEI message");
+    else
+      gst_h265_parse_store_sei (h265parse, nalu, messages);
+  }
 
   /* Even if pres != GST_H265_PARSER_OK, some message could have been parsed and
    * stored in messages.
@@ -555,6 +881,9 @@ gst_h265_parse_process_sei (GstH265Parse * h265parse, GstH265NalUnit * nalu)
             sei.payload.recovery_point.exact_match_flag,
             sei.payload.recovery_point.broken_link_flag);
         h265parse->keyframe = TRUE;
+        h265parse->au_flags |= GST_H26X_AU_META_FLAG_RECOVERY_POINT;
+        h265parse->au_recovery_cnt =
+            sei.payload.recovery_point.recovery_poc_cnt;
         break;
       case GST_H265_SEI_TIME_CODE:
         memcpy (&h265parse->time_code, &sei.payload.time_code,
@@ -662,7 +991,52 @@ gst_h265_parse_process_sei (GstH265Parse * h265parse, GstH265NalUnit * nalu)
         break;
     }
   }
-  g_array_free (messages, TRUE);
+  g_array_unref (messages);
+}
+
+/* derives the picture order count of the picture @slice belongs to, as in
+ * 8.3.1, and updates the state needed for the next one */
+static gint32
+gst_h265_parse_compute_poc (GstH265Parse * h265parse, GstH265NalUnit * nalu,
+    GstH265SliceHdr * slice)
+{
+  GstH265SPS *sps = slice->pps->sps;
+  gint32 max_lsb = 1 << (sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+  gint32 lsb = slice->pic_order_cnt_lsb;
+  gint32 msb = 0, poc;
+  guint nal_type = nalu->type;
+  gboolean no_rasl_output_flag;
+
+  /* IDR and BLA pictures, and CRA pictures starting a coded video
+   * sequence, reset the count */
+  no_rasl_output_flag = (nal_type >= GST_H265_NAL_SLICE_BLA_W_LP &&
+      nal_type <= GST_H265_NAL_SLICE_IDR_N_LP) ||
+      (nal_type == GST_H265_NAL_SLICE_CRA_NUT &&
+      !h265parse->have_prev_tid0_pic);
+
+  if (!no_rasl_output_flag) {
+    gint32 prev_lsb = h265parse->prev_tid0_poc & (max_lsb - 1);
+    gint32 prev_msb = h265parse->prev_tid0_poc - prev_lsb;
+
+    msb = prev_msb;
+    if (lsb < prev_lsb && prev_lsb - lsb >= max_lsb / 2)
+      msb += max_lsb;
+    else if (lsb > prev_lsb && lsb - prev_lsb > max_lsb / 2)
+      msb -= max_lsb;
+  }
+  poc = msb + lsb;
+
+  /* RASL, RADL and sub-layer non-reference pictures are not used as
+   * prevTid0Pic */
+  if (nalu->temporal_id_plus1 == 1 &&
+      !(nal_type >= GST_H265_NAL_SLICE_RADL_N &&
+          nal_type <= GST_H265_NAL_SLICE_RASL_R) &&
+      !(nal_type <= GST_H265_NAL_SLICE_RASL_R && nal_type % 2 == 0)) {
+    h265parse->prev_tid0_poc = poc;
+    h265parse->have_prev_tid0_pic = TRUE;
+  }
+
+  return poc;
 }
 
 /* caller guarantees 2 bytes of nal payload */
@@ -675,6 +1049,11 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
   guint nal_type;
   GstH265Parser *nalparser = h265parse->nalparser;
   GstH265ParserResult pres = GST_H265_PARSER_ERROR;
+  gboolean repeated = FALSE;
+  guint32 crc = 0;
+  guint id = 0;
+  gint slice_type = -1;
+  GstH26xAUNal au_nal;
 
   /* nothing to do for broken input */
   if (G_UNLIKELY (nalu->size < 2)) {
@@ -687,18 +1066,37 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
 
   GST_DEBUG_OBJECT (h265parse, "processing nal of type %u %s, size %u",
       nal_type, _nal_name (nal_type), nalu->size);
+
+  if (nal_type == GST_H265_NAL_VPS || nal_type == GST_H265_NAL_SPS
+      || nal_type == GST_H265_NAL_PPS) {
+    crc = gst_crc32_mpeg2 (nalu->data + nalu->offset, nalu->size);
+    repeated = gst_h265_parse_find_stored_nal (h265parse, nal_type, nalu, crc,
+        &id);
+  }
+
   switch (nal_type) {
     case GST_H265_NAL_VPS:
-      /* It is not mandatory to have VPS in the stream. But it might
-       * be needed for other extensions like svc */
-      pres = gst_h265_parser_parse_vps (nalparser, nalu, &vps);
-      if (pres != GST_H265_PARSER_OK) {
-        GST_WARNING_OBJECT (h265parse, "failed to parse VPS");
-        return FALSE;
-      }
+      if (repeated) {
+        GST_LOG_OBJECT (h265parse, "VPS %u repeated, not parsing it again", id);
+        if (nalparser->last_vps != &nalparser->vps[id]) {
+          GST_DEBUG_OBJECT (h265parse, "triggering src caps check");
+          nalparser->last_vps = &nalparser->vps[id];
+          h265parse->update_caps = TRUE;
+        }
+      } else {
+        gst_h265_parse_clear_parsed_nals (h265parse, FALSE, TRUE);
+
+        /* It is not mandatory to have VPS in the stream. But it might
+         * be needed for other extensions like svc */
+        pres = gst_h265_parser_parse_vps (nalparser, nalu, &vps);
+        if (pres != GST_H265_PARSER_OK) {
+          GST_WARNING_OBJECT (h265parse, "failed to parse VPS");
+          return FALSE;
+        }
 
-      GST_DEBUG_OBJECT (h265parse, "triggering src caps check");
-      h265parse->update_caps = TRUE;
+        GST_DEBUG_OBJECT (h265parse, "triggering src caps check");
+        h265parse->update_caps = TRUE;
+      }
       h265parse->have_vps = TRUE;
       h265parse->have_vps_in_frame = TRUE;
       if (h265parse->push_codec && h265parse->have_pps) {
@@ -711,30 +1109,43 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
         h265parse->have_pps = FALSE;
       }
 
-      gst_h265_parser_store_nal (h265parse, vps.id, nal_type, nalu);
+      if (!repeated)
+        gst_h265_parser_store_nal (h265parse, vps.id, nal_type, nalu, crc);
       h265parse->header |= TRUE;
       break;
     case GST_H265_NAL_SPS:
       /* reset state, everything else is obsolete */
       h265parse->state = 0;
 
-      pres = gst_h265_parser_parse_sps (nalparser, nalu, &sps, TRUE);
+      if (repeated) {
+        /* same as the stored one, but it might be a different SPS than the
+         * last one */
+        GST_LOG_OBJECT (h265parse, "SPS %u repeated, not parsing it again", id);
+        if (nalparser->last_sps != &nalparser->sps[id]) {
+          GST_DEBUG_OBJECT (h265parse, "triggering src caps check");
+          nalparser->last_sps = &nalparser->sps[id];
+          h265parse->update_caps = TRUE;
+        }
+      } else {
+        gst_h265_parse_clear_parsed_nals (h265parse, FALSE, FALSE);
 
+        pres = gst_h265_parser_parse_sps (nalparser, nalu, &sps, TRUE);
 
-      /* arranged for a fallback sps.id, so use that one and only warn */
-      if (pres != GST_H265_PARSER_OK) {
-        /* try to not parse VUI */
-        pres = gst_h265_parser_parse_sps (nalparser, nalu, &sps, FALSE);
+        /* arranged for a fallback sps.id, so use that one and only warn */
         if (pres != GST_H265_PARSER_OK) {
-          GST_WARNING_OBJECT (h265parse, "failed to parse SPS:");
-          return FALSE;
+          /* try to not parse VUI */
+          pres = gst_h265_parser_parse_sps (nalparser, nalu, &sps, FALSE);
+          if (pres != GST_H265_PARSER_OK) {
+            GST_WARNING_OBJECT (h265parse, "failed to parse SPS:");
+            return FALSE;
+          }
+          GST_WARNING_OBJECT (h265parse,
+              "failed to parse VUI of SPS, ignore VUI");
         }
-        GST_WARNING_OBJECT (h265parse,
-            "failed to parse VUI of SPS, ignore VUI");
-      }
 
-      GST_DEBUG_OBJECT (h265parse, "triggering src caps check");
-      h265parse->update_caps = TRUE;
+        GST_DEBUG_OBJECT (h265parse, "triggering src caps check");
+        h265parse->update_caps = TRUE;
+      }
       h265parse->have_sps = TRUE;
       h265parse->have_sps_in_frame = TRUE;
       if (h265parse->push_codec && h265parse->have_pps) {
@@ -746,7 +1157,8 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
         h265parse->have_pps = FALSE;
       }
 
-      gst_h265_parser_store_nal (h265parse, sps.id, nal_type, nalu);
+      if (!repeated)
+        gst_h265_parser_store_nal (h265parse, sps.id, nal_type, nalu, crc);
       h265parse->header |= TRUE;
       h265parse->state |= GST_H265_PARSE_STATE_GOT_SPS;
       break;
@@ -756,14 +1168,18 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
       if (!GST_H265_PARSE_STATE_VALID (h265parse, GST_H265_PARSE_STATE_GOT_SPS))
         return FALSE;
 
-      pres = gst_h265_parser_parse_pps (nalparser, nalu, &pps);
-
+      if (repeated) {
+        GST_LOG_OBJECT (h265parse, "PPS %u repeated, not parsing it again", id);
+        nalparser->last_pps = &nalparser->pps[id];
+      } else {
+        pres = gst_h265_parser_parse_pps (nalparser, nalu, &pps);
 
-      /* arranged for a fallback pps.id, so use that one and only warn */
-      if (pres != GST_H265_PARSER_OK) {
-        GST_WARNING_OBJECT (h265parse, "failed to parse PPS:");
-        if (pres != GST_H265_PARSER_BROKEN_LINK)
-          return FALSE;
+        /* arranged for a fallback pps.id, so use that one and only warn */
+        if (pres != GST_H265_PARSER_OK) {
+          GST_WARNING_OBJECT (h265parse, "failed to parse PPS:");
+          if (pres != GST_H265_PARSER_BROKEN_LINK)
+            return FALSE;
+        }
       }
 
       /* parameters might have changed, force caps check */
@@ -782,7 +1198,11 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
         h265parse->have_pps = FALSE;
       }
 
-      gst_h265_parser_store_nal (h265parse, pps.id, nal_type, nalu);
+      if (!repeated) {
+        /* a PPS referring to an unknown SPS must be parsed again */
+        gst_h265_parser_store_nal (h265parse, pps.id, nal_type, nalu,
+            pres == GST_H265_PARSER_OK ? crc : -1);
+      }
       h265parse->header |= TRUE;
       h265parse->state |= GST_H265_PARSE_STATE_GOT_PPS;
       break;
@@ -799,7 +1219,7 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
       /* mark SEI pos */
       if (h265parse->sei_pos == -1) {
         if (h265parse->transform)
-          h265parse->sei_pos = gst_adapter_available (h265parse->frame_out);
+          h265parse->sei_pos = gst_h265_parse_frame_out_size (h265parse);
         else
           h265parse->sei_pos = nalu->sc_offset;
         GST_DEBUG_OBJECT (h265parse, "marking SEI in frame at offset %d",
@@ -841,6 +1261,29 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
           h265parse->keyframe |= TRUE;
 
         h265parse->state |= GST_H265_PARSE_STATE_GOT_SLICE;
+
+        /* dependent slice segments carry no slice type of their own */
+        if (!slice.dependent_slice_segment_flag)
+          h265parse->slice_type = slice.type;
+        slice_type = h265parse->slice_type;
+        if (slice_type >= 0)
+          h265parse->au_slice_types |= 1 << slice_type;
+
+        /* the base layer's first slice has the picture values */
+        if (!h265parse->au_have_picture && nalu->layer_id == 0) {
+          h265parse->au_have_picture = TRUE;
+          if (nal_type == GST_H265_NAL_SLICE_IDR_W_RADL ||
+              nal_type == GST_H265_NAL_SLICE_IDR_N_LP)
+            h265parse->au_flags |= GST_H26X_AU_META_FLAG_IDR;
+          /* once per picture, also when it is output a slice at a time */
+          if (slice.first_slice_segment_in_pic_flag)
+            h265parse->poc = gst_h265_parse_compute_poc (h265parse, nalu,
+                &slice);
+          h265parse->au_pps_id = slice.pps->id;
+          h265parse->au_sps_id = slice.pps->sps->id;
+          if (slice.pps->sps->vps)
+            h265parse->au_vps_id = slice.pps->sps->vps->id;
+        }
       }
       if (slice.first_slice_segment_in_pic_flag == 1)
         GST_DEBUG_OBJECT (h265parse,
@@ -888,7 +1331,7 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
       /* mind replacement buffer if applicable */
       if (h265parse->idr_pos == -1) {
         if (h265parse->transform)
-          h265parse->idr_pos = gst_adapter_available (h265parse->frame_out);
+          h265parse->idr_pos = gst_h265_parse_frame_out_size (h265parse);
         else
           h265parse->idr_pos = nalu->sc_offset;
         GST_DEBUG_OBJECT (h265parse, "marking IDR in frame at offset %d",
@@ -916,19 +1359,28 @@ gst_h265_parse_process_nal (GstH265Parse * h265parse, GstH265NalUnit * nalu)
       pres = gst_h265_parser_parse_nal (nalparser, nalu);
       if (pres != GST_H265_PARSER_OK)
         return FALSE;
+
+      /* the next picture starts a new coded video sequence */
+      if (nal_type == GST_H265_NAL_EOS || nal_type == GST_H265_NAL_EOB)
+        h265parse->have_prev_tid0_pic = FALSE;
       break;
   }
 
   /* if HEVC output needed, collect properly prefixed nal in adapter,
    * and use that to replace outgoing buffer data later on */
   if (h265parse->transform) {
-    GstBuffer *buf;
-
     GST_LOG_OBJECT (h265parse, "collecting NAL in HEVC frame");
-    buf = gst_h265_parse_wrap_nal (h265parse, h265parse->format,
-        nalu->data + nalu->offset, nalu->size);
-    gst_adapter_push (h265parse->frame_out, buf);
+    au_nal.offset = gst_h265_parse_frame_out_size (h265parse);
+    gst_h265_parse_collect_out_nal (h265parse, nalu);
+    au_nal.size = gst_h265_parse_frame_out_size (h265parse) - au_nal.offset;
+  } else {
+    /* split packetized input goes out one NAL per frame */
+    au_nal.offset = h265parse->split_packetized ? 0 : nalu->sc_offset;
+    au_nal.size = nalu->offset + nalu->size - nalu->sc_offset;
   }
+  au_nal.type = nal_type;
+  au_nal.slice_type = slice_type;
+  g_array_append_val (h265parse->au_nals, au_nal);
 
   return TRUE;
 }
@@ -1019,7 +1471,9 @@ gst_h265_parse_handle_frame_packetized (GstBaseParse * parse,
     GST_DEBUG_OBJECT (h265parse, "HEVC nal offset %d", nalu.offset + nalu.size);
 
     /* either way, have a look at it */
+    h265parse->nal_src = buffer;
     gst_h265_parse_process_nal (h265parse, &nalu);
+    h265parse->nal_src = NULL;
 
     /* dispatch per NALU if needed */
     if (h265parse->split_packetized) {
@@ -1237,13 +1691,16 @@ gst_h265_parse_handle_frame (GstBaseParse * parse,
       }
     }
 
+    h265parse->nal_src = buffer;
     if (!gst_h265_parse_process_nal (h265parse, &nalu)) {
+      h265parse->nal_src = NULL;
       GST_WARNING_OBJECT (h265parse,
           "broken/invalid nal Type: %d %s, Size: %u will be dropped",
           nalu.type, _nal_name (nalu.type), nalu.size);
       *skipsize = nalu.size;
       goto skip;
     }
+    h265parse->nal_src = NULL;
 
     if (nonext)
       break;
@@ -1286,6 +1743,9 @@ skip:
       !(h265parse->state & GST_H265_PARSE_STATE_VALID_PICTURE_HEADERS) ||
       (h265parse->state & GST_H265_PARSE_STATE_GOT_SLICE))
     gst_h265_parse_reset_frame (h265parse);
+  else if (!h265parse->transform)
+    /* the NALs kept so far are skipped along */
+    g_array_set_size (h265parse->au_nals, 0);
   goto out;
 
 invalid_stream:
@@ -2024,12 +2484,20 @@ gst_h265_parse_parse_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     h265parse->discont = FALSE;
   }
 
-  /* replace with transformed HEVC output if applicable */
+  /* replace with transformed HEVC output if applicable, which refers to the
+   * input memory as much as possible */
+  gst_h265_parse_flush_frame_out (h265parse);
   av = gst_adapter_available (h265parse->frame_out);
   if (av) {
     GstBuffer *buf;
 
-    buf = gst_adapter_take_buffer (h265parse->frame_out, av);
+    /* Past the memory limit of a buffer, appending merges all memories
+     * every time, so make a single copy instead */
+    if (h265parse->frame_out_n_mem <= gst_buffer_get_max_memory ())
+      buf = gst_adapter_take_buffer_fast (h265parse->frame_out, av);
+    else
+      buf = gst_adapter_take_buffer (h265parse->frame_out, av);
+    h265parse->frame_out_n_mem = 0;
     gst_buffer_copy_into (buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
     gst_buffer_replace (&frame->out_buffer, buf);
     gst_buffer_unref (buf);
@@ -2044,12 +2512,7 @@ static GstFlowReturn
 gst_h265_parse_push_codec_buffer (GstH265Parse * h265parse, GstBuffer * nal,
     GstClockTime ts)
 {
-  GstMapInfo map;
-
-  gst_buffer_map (nal, &map, GST_MAP_READ);
-  nal = gst_h265_parse_wrap_nal (h265parse, h265parse->format,
-      map.data, map.size);
-  gst_buffer_unmap (nal, &map);
+  nal = gst_h265_parse_wrap_nal_buffer (h265parse, h265parse->format, nal);
 
   GST_BUFFER_TIMESTAMP (nal) = ts;
   GST_BUFFER_DURATION (nal) = 0;
@@ -2158,14 +2621,131 @@ gst_h265_parse_prepare_key_unit (GstH265Parse * parse, GstEvent * event)
   parse->push_codec = TRUE;
 }
 
+/* sends the config NALs as separate buffers, returns FALSE if none are
+ * known */
 static gboolean
-gst_h265_parse_handle_vps_sps_pps_nals (GstH265Parse * h265parse,
-    GstBuffer * buffer, GstBaseParseFrame * frame)
+gst_h265_parse_push_codec_nals (GstH265Parse * h265parse,
+    GstClockTime timestamp)
 {
   GstBuffer *codec_nal;
   gint i;
   gboolean send_done = FALSE;
-  GstClockTime timestamp = GST_BUFFER_TIMESTAMP (buffer);
+
+  GST_DEBUG_OBJECT (h265parse, "- sending VPS/SPS/PPS");
+  for (i = 0; i < GST_H265_MAX_VPS_COUNT; i++) {
+    if ((codec_nal = h265parse->vps_nals[i])) {
+      GST_DEBUG_OBJECT (h265parse, "sending VPS nal");
+      gst_h265_parse_push_codec_buffer (h265parse, codec_nal, timestamp);
+      send_done = TRUE;
+    }
+  }
+  for (i = 0; i < GST_H265_MAX_SPS_COUNT; i++) {
+    if ((codec_nal = h265parse->sps_nals[i])) {
+      GST_DEBUG_OBJECT (h265parse, "sending SPS nal");
+      gst_h265_parse_push_codec_buffer (h265parse, codec_nal, timestamp);
+      send_done = TRUE;
+    }
+  }
+  for (i = 0; i < GST_H265_MAX_PPS_COUNT; i++) {
+    if ((codec_nal = h265parse->pps_nals[i])) {
+      GST_DEBUG_OBJECT (h265parse, "sending PPS nal");
+      gst_h265_parse_push_codec_buffer (h265parse, codec_nal, timestamp);
+      send_done = TRUE;
+    }
+  }
+
+  return send_done;
+}
+
+/* appends config NAL @nal to @buffer, keeping the parse results in @meta
+ * up to date */
+static GstBuffer *
+gst_h265_parse_append_codec_nal (GstH265Parse * h265parse, GstBuffer * buffer,
+    GstH26xAUMeta * meta, GstBuffer * nal)
+{
+  GstBuffer *wrapped;
+  guint8 header = 0;
+
+  wrapped = gst_h265_parse_wrap_nal_buffer (h265parse, h265parse->format, nal);
+  if (meta) {
+    gst_buffer_extract (nal, 0, &header, 1);
+    gst_h26x_au_meta_insert_nal (meta, gst_buffer_get_size (buffer),
+        gst_buffer_get_size (wrapped), (header >> 1) & 0x3f);
+  }
+
+  return gst_buffer_append (buffer, wrapped);
+}
+
+/* returns a new AU with the config NALs inserted at @idr_pos, without
+ * copying the AU itself, or NULL if none are known */
+static GstBuffer *
+gst_h265_parse_insert_codec_nals (GstH265Parse * h265parse,
+    GstBuffer * buffer, gint idr_pos)
+{
+  GstBuffer *codec_nal, *new_buf;
+  GstH26xAUMeta *meta;
+  gint i;
+  gboolean send_done = FALSE;
+
+  new_buf = gst_buffer_new ();
+  gst_buffer_copy_into (new_buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+  /* the AU meta depends on the memory and is not part of the metadata, but
+   * all of the memory of @buffer ends up in @new_buf */
+  if ((meta = gst_buffer_get_h26x_au_meta (buffer))) {
+    GstMetaTransformCopy copy = { FALSE, 0, -1 };
+
+    meta->meta.info->transform_func (new_buf, (GstMeta *) meta, buffer,
+        _gst_meta_transform_copy, &copy);
+  }
+  meta = gst_buffer_get_h26x_au_meta (new_buf);
+  if (idr_pos > 0)
+    new_buf = gst_buffer_append (new_buf, gst_buffer_copy_region (buffer,
+            GST_BUFFER_COPY_MEMORY, 0, idr_pos));
+  GST_DEBUG_OBJECT (h265parse, "- inserting VPS/SPS/PPS");
+  for (i = 0; i < GST_H265_MAX_VPS_COUNT; i++) {
+    if ((codec_nal = h265parse->vps_nals[i])) {
+      GST_DEBUG_OBJECT (h265parse, "inserting VPS nal");
+      new_buf = gst_h265_parse_append_codec_nal (h265parse, new_buf, meta,
+          codec_nal);
+      send_done = TRUE;
+    }
+  }
+  for (i = 0; i < GST_H265_MAX_SPS_COUNT; i++) {
+    if ((codec_nal = h265parse->sps_nals[i])) {
+      GST_DEBUG_OBJECT (h265parse, "inserting SPS nal");
+      new_buf = gst_h265_parse_append_codec_nal (h265parse, new_buf, meta,
+          codec_nal);
+      send_done = TRUE;
+    }
+  }
+  for (i = 0; i < GST_H265_MAX_PPS_COUNT; i++) {
+    if ((codec_nal = h265parse->pps_nals[i])) {
+      GST_DEBUG_OBJECT (h265parse, "inserting PPS nal");
+      new_buf = gst_h265_parse_append_codec_nal (h265parse, new_buf, meta,
+          codec_nal);
+      send_done = TRUE;
+    }
+  }
+
+  if (!send_done) {
+    gst_buffer_unref (new_buf);
+    return NULL;
+  }
+
+  new_buf = gst_buffer_append (new_buf, gst_buffer_copy_region (buffer,
+          GST_BUFFER_COPY_MEMORY, MAX (idr_pos, 0), -1));
+  /* should already be keyframe/IDR, but it may not have been,
+   * so mark it as such to avoid being discarded by picky decoder */
+  GST_BUFFER_FLAG_UNSET (new_buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  return new_buf;
+}
+
+static gboolean
+gst_h265_parse_handle_vps_sps_pps_nals (GstH265Parse * h265parse,
+    GstBuffer * buffer, GstBaseParseFrame * frame)
+{
+  GstBuffer *new_buf;
 
   if (h265parse->have_vps_in_frame && h265parse->have_sps_in_frame
       && h265parse->have_pps_in_frame) {
@@ -2175,102 +2755,147 @@ gst_h265_parse_handle_vps_sps_pps_nals (GstH265Parse * h265parse,
 
   if (h265parse->align == GST_H265_PARSE_ALIGN_NAL) {
     /* send separate config NAL buffers */
-    GST_DEBUG_OBJECT (h265parse, "- sending VPS/SPS/PPS");
-    for (i = 0; i < GST_H265_MAX_VPS_COUNT; i++) {
-      if ((codec_nal = h265parse->vps_nals[i])) {
-        GST_DEBUG_OBJECT (h265parse, "sending VPS nal");
-        gst_h265_parse_push_codec_buffer (h265parse, codec_nal, timestamp);
-        send_done = TRUE;
-      }
-    }
-    for (i = 0; i < GST_H265_MAX_SPS_COUNT; i++) {
-      if ((codec_nal = h265parse->sps_nals[i])) {
-        GST_DEBUG_OBJECT (h265parse, "sending SPS nal");
-        gst_h265_parse_push_codec_buffer (h265parse, codec_nal, timestamp);
-        send_done = TRUE;
-      }
-    }
-    for (i = 0; i < GST_H265_MAX_PPS_COUNT; i++) {
-      if ((codec_nal = h265parse->pps_nals[i])) {
-        GST_DEBUG_OBJECT (h265parse, "sending PPS nal");
-        gst_h265_parse_push_codec_buffer (h265parse, codec_nal, timestamp);
-        send_done = TRUE;
-      }
-    }
-  } else {
-    /* insert config NALs into AU */
-    GstByteWriter bw;
-    GstBuffer *new_buf;
-    const gboolean bs = h265parse->format == GST_H265_PARSE_FORMAT_BYTE;
-    const gint nls = 4 - h265parse->nal_length_size;
-    gboolean ok;
-
-    gst_byte_writer_init_with_size (&bw, gst_buffer_get_size (buffer), FALSE);
-    ok = gst_byte_writer_put_buffer (&bw, buffer, 0, h265parse->idr_pos);
-    GST_DEBUG_OBJECT (h265parse, "- inserting VPS/SPS/PPS");
-    for (i = 0; i < GST_H265_MAX_VPS_COUNT; i++) {
-      if ((codec_nal = h265parse->vps_nals[i])) {
-        gsize nal_size = gst_buffer_get_size (codec_nal);
-        GST_DEBUG_OBJECT (h265parse, "inserting VPS nal");
-        if (bs) {
-          ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-        } else {
-          ok &= gst_byte_writer_put_uint32_be (&bw, (nal_size << (nls * 8)));
-          ok &= gst_byte_writer_set_pos (&bw,
-              gst_byte_writer_get_pos (&bw) - nls);
-        }
+    return gst_h265_parse_push_codec_nals (h265parse,
+        GST_BUFFER_TIMESTAMP (buffer));
+  }
 
-        ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
-        send_done = TRUE;
-      }
-    }
-    for (i = 0; i < GST_H265_MAX_SPS_COUNT; i++) {
-      if ((codec_nal = h265parse->sps_nals[i])) {
-        gsize nal_size = gst_buffer_get_size (codec_nal);
-        GST_DEBUG_OBJECT (h265parse, "inserting SPS nal");
-        if (bs) {
-          ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-        } else {
-          ok &= gst_byte_writer_put_uint32_be (&bw, (nal_size << (nls * 8)));
-          ok &= gst_byte_writer_set_pos (&bw,
-              gst_byte_writer_get_pos (&bw) - nls);
-        }
+  /* insert config NALs into AU */
+  new_buf = gst_h265_parse_insert_codec_nals (h265parse, buffer,
+      h265parse->idr_pos);
+  if (!new_buf)
+    return FALSE;
 
-        ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
-        send_done = TRUE;
-      }
-    }
-    for (i = 0; i < GST_H265_MAX_PPS_COUNT; i++) {
-      if ((codec_nal = h265parse->pps_nals[i])) {
-        gsize nal_size = gst_buffer_get_size (codec_nal);
-        GST_DEBUG_OBJECT (h265parse, "inserting PPS nal");
-        if (bs) {
-          ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-        } else {
-          ok &= gst_byte_writer_put_uint32_be (&bw, (nal_size << (nls * 8)));
-          ok &= gst_byte_writer_set_pos (&bw,
-              gst_byte_writer_get_pos (&bw) - nls);
-        }
-        ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
-        send_done = TRUE;
+  gst_buffer_replace (&frame->out_buffer, new_buf);
+  gst_buffer_unref (new_buf);
+
+  return TRUE;
+}
+
+static void
+gst_h265_parse_clear_gop (GstH265Parse * h265parse)
+{
+  GstBuffer *buffer;
+
+  GST_OBJECT_LOCK (h265parse);
+  while ((buffer = g_queue_pop_head (&h265parse->gop)))
+    gst_buffer_unref (buffer);
+  h265parse->gop_size = 0;
+  GST_OBJECT_UNLOCK (h265parse);
+
+  g_atomic_int_set (&h265parse->gop_replay, FALSE);
+  /* consumers linked before the next keyframe will get that one */
+  g_atomic_int_set (&h265parse->gop_new_consumer, FALSE);
+}
+
+/* keeps @buffer in the GOP cache if it is a keyframe or follows one */
+static void
+gst_h265_parse_cache_gop (GstH265Parse * h265parse, GstBuffer * buffer,
+    gboolean has_headers)
+{
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    gst_h265_parse_clear_gop (h265parse);
+    h265parse->gop_idr_pos = h265parse->idr_pos;
+    h265parse->gop_has_headers = has_headers;
+  } else if (g_queue_is_empty (&h265parse->gop)) {
+    return;
+  }
+
+  h265parse->gop_size += gst_buffer_get_size (buffer);
+  if (h265parse->gop_size > GOP_CACHE_MAX_SIZE) {
+    GST_DEBUG_OBJECT (h265parse, "GOP too large, not caching it");
+    gst_h265_parse_clear_gop (h265parse);
+    return;
+  }
+
+  GST_OBJECT_LOCK (h265parse);
+  g_queue_push_tail (&h265parse->gop, gst_buffer_ref (buffer));
+  GST_OBJECT_UNLOCK (h265parse);
+}
+
+/* pushes the cached GOP again, preceded by the config NALs if its keyframe
+ * doesn't contain them */
+static void
+gst_h265_parse_replay_gop (GstH265Parse * h265parse)
+{
+  GstPad *srcpad = GST_BASE_PARSE_SRC_PAD (h265parse);
+  GList *l;
+
+  GST_DEBUG_OBJECT (h265parse, "replaying %u cached AUs",
+      h265parse->gop.length);
+
+  for (l = h265parse->gop.head; l; l = l->next) {
+    GstBuffer *buffer = l->data;
+
+    if (l == h265parse->gop.head) {
+      GstBuffer *keyframe = NULL;
+
+      if (h265parse->gop_has_headers) {
+        /* nothing to add */
+      } else if (h265parse->align == GST_H265_PARSE_ALIGN_NAL) {
+        gst_h265_parse_push_codec_nals (h265parse,
+            GST_BUFFER_TIMESTAMP (buffer));
+      } else {
+        keyframe = gst_h265_parse_insert_codec_nals (h265parse, buffer,
+            CLAMP (h265parse->gop_idr_pos, 0,
+                (gint) gst_buffer_get_size (buffer)));
       }
+
+      buffer = keyframe ? keyframe : gst_buffer_copy (buffer);
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    } else {
+      gst_buffer_ref (buffer);
     }
-    ok &= gst_byte_writer_put_buffer (&bw, buffer, h265parse->idr_pos, -1);
-    /* collect result and push */
-    new_buf = gst_byte_writer_reset_and_get_buffer (&bw);
-    gst_buffer_copy_into (new_buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
-    /* should already be keyframe/IDR, but it may not have been,
-     * so mark it as such to avoid being discarded by picky decoder */
-    GST_BUFFER_FLAG_UNSET (new_buf, GST_BUFFER_FLAG_DELTA_UNIT);
-    gst_buffer_replace (&frame->out_buffer, new_buf);
-    gst_buffer_unref (new_buf);
-    /* some result checking seems to make some compilers happy */
-    if (G_UNLIKELY (!ok)) {
-      GST_ERROR_OBJECT (h265parse, "failed to insert SPS/PPS");
-    }
+
+    if (gst_pad_push (srcpad, buffer) != GST_FLOW_OK)
+      break;
   }
+}
 
-  return send_done;
+/* returns TRUE if a GOP will be replayed before the next AU, which is only
+ * done for a consumer that was linked after the keyframe of the GOP */
+static gboolean
+gst_h265_parse_request_gop_replay (GstH265Parse * h265parse)
+{
+  gboolean cached;
+
+  if (!g_atomic_int_compare_and_exchange (&h265parse->gop_new_consumer, TRUE,
+          FALSE))
+    return FALSE;
+
+  GST_OBJECT_LOCK (h265parse);
+  cached = h265parse->gop_cache && !g_queue_is_empty (&h265parse->gop);
+  GST_OBJECT_UNLOCK (h265parse);
+
+  if (cached)
+    g_atomic_int_set (&h265parse->gop_replay, TRUE);
+
+  return cached;
+}
+
+/* attaches the parse results of the AU to @buffer */
+static void
+gst_h265_parse_attach_au_meta (GstH265Parse * h265parse, GstBuffer * buffer)
+{
+  GstH26xAUMeta *meta;
+
+  if (h265parse->au_nals->len == 0)
+    return;
+
+  /* may have been carried over from the input */
+  if ((meta = gst_buffer_get_h26x_au_meta (buffer)))
+    gst_buffer_remove_meta (buffer, (GstMeta *) meta);
+
+  meta = gst_buffer_add_h26x_au_meta (buffer, GST_H26X_AU_META_CODEC_H265,
+      (GstH26xAUNal *) h265parse->au_nals->data, h265parse->au_nals->len);
+  meta->flags = h265parse->au_flags;
+  if (h265parse->keyframe)
+    meta->flags |= GST_H26X_AU_META_FLAG_KEYFRAME;
+  meta->slice_types = h265parse->au_slice_types;
+  meta->poc = h265parse->poc;
+  meta->recovery_cnt = h265parse->au_recovery_cnt;
+  meta->vps_id = h265parse->au_vps_id;
+  meta->sps_id = h265parse->au_sps_id;
+  meta->pps_id = h265parse->au_pps_id;
 }
 
 static GstFlowReturn
@@ -2279,6 +2904,7 @@ gst_h265_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
   GstH265Parse *h265parse;
   GstBuffer *buffer;
   GstEvent *event;
+  gboolean sent_headers = FALSE;
 
   h265parse = GST_H265_PARSE (parse);
 
@@ -2310,6 +2936,14 @@ gst_h265_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     h265parse->sent_codec_tag = TRUE;
   }
 
+  /* give new consumers the current GOP, unless this AU starts a new one */
+  if (g_atomic_int_compare_and_exchange (&h265parse->gop_replay, TRUE, FALSE)
+      && GST_BUFFER_FLAG_IS_SET (frame->buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    gst_h265_parse_replay_gop (h265parse);
+
+  gst_h265_parse_attach_au_meta (h265parse,
+      frame->out_buffer ? frame->out_buffer : frame->buffer);
+
   buffer = frame->buffer;
 
   if ((event = check_pending_key_unit_event (h265parse->force_key_unit_event,
@@ -2356,6 +2990,7 @@ gst_h265_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
 
         if (gst_h265_parse_handle_vps_sps_pps_nals (h265parse, buffer, frame)) {
           h265parse->last_report = new_ts;
+          sent_headers = TRUE;
         }
       }
 
@@ -2370,7 +3005,8 @@ gst_h265_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     if (h265parse->idr_pos >= 0) {
       GST_LOG_OBJECT (h265parse, "IDR nal at offset %d", h265parse->idr_pos);
 
-      gst_h265_parse_handle_vps_sps_pps_nals (h265parse, buffer, frame);
+      sent_headers =
+          gst_h265_parse_handle_vps_sps_pps_nals (h265parse, buffer, frame);
 
       /* we pushed whatever we had */
       h265parse->push_codec = FALSE;
@@ -2456,6 +3092,17 @@ gst_h265_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     }
   }
 
+  if (h265parse->gop_cache) {
+    gboolean has_headers = h265parse->align == GST_H265_PARSE_ALIGN_AU &&
+        (sent_headers || (h265parse->have_vps_in_frame
+            && h265parse->have_sps_in_frame && h265parse->have_pps_in_frame));
+
+    gst_h265_parse_cache_gop (h265parse,
+        frame->out_buffer ? frame->out_buffer : frame->buffer, has_headers);
+  } else if (!g_queue_is_empty (&h265parse->gop)) {
+    gst_h265_parse_clear_gop (h265parse);
+  }
+
   gst_h265_parse_reset_frame (h265parse);
 
   return GST_FLOW_OK;
@@ -2738,6 +3385,7 @@ gst_h265_parse_event (GstBaseParse * parse, GstEvent * event)
     }
     case GST_EVENT_FLUSH_STOP:
       h265parse->push_codec = TRUE;
+      gst_h265_parse_clear_gop (h265parse);
       res = GST_BASE_PARSE_CLASS (parent_class)->sink_event (parse, event);
       break;
     case GST_EVENT_SEGMENT:
@@ -2776,6 +3424,15 @@ gst_h265_parse_src_event (GstBaseParse * parse, GstEvent * event)
             " all_headers %d count %d", gst_event_get_seqnum (event),
             GST_TIME_ARGS (running_time), all_headers, count);
 
+        /* Only an immediate request can be answered with the past */
+        if (!GST_CLOCK_TIME_IS_VALID (running_time)
+            && gst_h265_parse_request_gop_replay (h265parse)) {
+          GST_DEBUG_OBJECT (h265parse, "answering from the GOP cache");
+          gst_event_unref (event);
+          res = TRUE;
+          break;
+        }
+
         if (all_headers) {
           h265parse->pending_key_unit_ts = running_time;
           gst_event_replace (&h265parse->force_key_unit_event, event);
@@ -2784,6 +3441,11 @@ gst_h265_parse_src_event (GstBaseParse * parse, GstEvent * event)
       res = GST_BASE_PARSE_CLASS (parent_class)->src_event (parse, event);
       break;
     }
+    case GST_EVENT_RECONFIGURE:
+      /* e.g. a new branch after a tee, which may ask for a key unit next */
+      g_atomic_int_set (&h265parse->gop_new_consumer, TRUE);
+      res = GST_BASE_PARSE_CLASS (parent_class)->src_event (parse, event);
+      break;
     default:
       res = GST_BASE_PARSE_CLASS (parent_class)->src_event (parse, event);
       break;
@@ -2803,6 +3465,11 @@ gst_h265_parse_set_property (GObject * object, guint prop_id,
     case PROP_CONFIG_INTERVAL:
       parse->interval = g_value_get_int (value);
       break;
+    case PROP_GOP_CACHE:
+      GST_OBJECT_LOCK (parse);
+      parse->gop_cache = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (parse);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -2820,6 +3487,9 @@ gst_h265_parse_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_CONFIG_INTERVAL:
       g_value_set_int (value, parse->interval);
       break;
+    case PROP_GOP_CACHE:
+      g_value_set_boolean (value, parse->gop_cache);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
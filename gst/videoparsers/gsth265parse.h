@@ -24,10 +24,22 @@
 #include <gst/gst.h>
 #include <gst/base/gstbaseparse.h>
 #include <gst/codecparsers/gsth265parser.h>
+#include <gst/codecparsers/gsth26xaumeta.h>
 #include <gst/video/video.h>
 
 G_BEGIN_DECLS
 
+#define GST_H265_PARSE_SEI_CACHE_SIZE 4
+
+/* A recently parsed SEI NALU and its messages */
+typedef struct
+{
+  GBytes *nal;
+  GArray *messages;
+  /* the SPS the messages were parsed with */
+  GstH265SPS *sps;
+} GstH265ParseSEICache;
+
 #define GST_TYPE_H265_PARSE \
   (gst_h265_parse_get_type())
 #define GST_H265_PARSE(obj) \
@@ -87,6 +99,14 @@ struct _GstH265Parse
   GstBuffer *vps_nals[GST_H265_MAX_VPS_COUNT];
   GstBuffer *sps_nals[GST_H265_MAX_SPS_COUNT];
   GstBuffer *pps_nals[GST_H265_MAX_PPS_COUNT];
+  /* their checksums, -1 if they must be parsed again when repeated */
+  gint64 vps_crc[GST_H265_MAX_VPS_COUNT];
+  gint64 sps_crc[GST_H265_MAX_SPS_COUNT];
+  gint64 pps_crc[GST_H265_MAX_PPS_COUNT];
+
+  /* recently parsed SEI NALUs, reused when repeated */
+  GstH265ParseSEICache sei_cache[GST_H265_PARSE_SEI_CACHE_SIZE];
+  guint sei_cache_pos;
 
   /* Infos we need to keep track of */
   guint8 sei_pic_struct;
@@ -100,11 +120,33 @@ struct _GstH265Parse
   gint idr_pos, sei_pos;
   gboolean update_caps;
   GstAdapter *frame_out;
+  /* input buffer the NALUs being processed point into, if any */
+  GstBuffer *nal_src;
+  /* region of an input buffer still to be collected in frame_out */
+  GstBuffer *frame_out_src;
+  gsize frame_out_offset, frame_out_size;
+  /* number of memories collected in frame_out */
+  guint frame_out_n_mem;
   gboolean keyframe;
   gboolean header;
   /* AU state */
   gboolean picture_start;
 
+  /* parse results of the AU, attached to it as GstH26xAUMeta */
+  GArray *au_nals;
+  GstH26xAUMetaFlags au_flags;
+  guint au_slice_types;
+  gboolean au_have_picture;
+  gint au_recovery_cnt;
+  gint au_vps_id, au_sps_id, au_pps_id;
+
+  /* picture order count of the current picture and derivation state, 8.3.1 */
+  gint32 poc;
+  gint32 prev_tid0_poc;
+  gboolean have_prev_tid0_pic;
+  /* slice type of the last independent slice segment */
+  gint slice_type;
+
   /* props */
   gint interval;
 
@@ -113,6 +155,15 @@ struct _GstH265Parse
   GstClockTime pending_key_unit_ts;
   GstEvent *force_key_unit_event;
 
+  /* AUs since the last keyframe, pushed again for new consumers */
+  gboolean gop_cache;
+  GQueue gop;
+  gsize gop_size;
+  gint gop_idr_pos;
+  gboolean gop_has_headers;
+  gint gop_replay;
+  gint gop_new_consumer;
+
   GstVideoMasteringDisplayInfo mastering_display_info;
   guint mastering_display_info_state;
 
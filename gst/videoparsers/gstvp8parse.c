@@ -0,0 +1,291 @@
+/* GStreamer
+ *
+ * gstvp8parse.c: VP8 video parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-vp8parse
+ * @title: vp8parse
+ *
+ * Marks VP8 key frames and puts the frame size and profile of the stream
+ * into the caps. Only the frame tag of inter frames is looked at; key frames
+ * are parsed up to the end of the frame header.
+ *
+ * Input buffers are expected to hold one frame each, as output by demuxers
+ * and depayloaders.
+ *
+ * ## Example launch line
+ * |[
+ * gst-launch-1.0 filesrc location=video.webm ! matroskademux ! vp8parse ! mp4mux ! filesink location=video.mp4
+ * ]|
+ *
+ * Since: 1.18
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/base/base.h>
+#include <gst/pbutils/pbutils.h>
+#include "gstvp8parse.h"
+
+GST_DEBUG_CATEGORY (vp8_parse_debug);
+#define GST_CAT_DEFAULT vp8_parse_debug
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-vp8, parsed = (boolean) true"));
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-vp8"));
+
+#define parent_class gst_vp8_parse_parent_class
+G_DEFINE_TYPE (GstVp8Parse, gst_vp8_parse, GST_TYPE_BASE_PARSE);
+
+static gboolean gst_vp8_parse_start (GstBaseParse * parse);
+static gboolean gst_vp8_parse_stop (GstBaseParse * parse);
+static GstFlowReturn gst_vp8_parse_handle_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame, gint * skipsize);
+static GstFlowReturn gst_vp8_parse_pre_push_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame);
+static gboolean gst_vp8_parse_set_caps (GstBaseParse * parse, GstCaps * caps);
+
+static void
+gst_vp8_parse_class_init (GstVp8ParseClass * klass)
+{
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseParseClass *parse_class = GST_BASE_PARSE_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (vp8_parse_debug, "vp8parse", 0, "vp8 parser");
+
+  /* Override BaseParse vfuncs */
+  parse_class->start = GST_DEBUG_FUNCPTR (gst_vp8_parse_start);
+  parse_class->stop = GST_DEBUG_FUNCPTR (gst_vp8_parse_stop);
+  parse_class->handle_frame = GST_DEBUG_FUNCPTR (gst_vp8_parse_handle_frame);
+  parse_class->pre_push_frame =
+      GST_DEBUG_FUNCPTR (gst_vp8_parse_pre_push_frame);
+  parse_class->set_sink_caps = GST_DEBUG_FUNCPTR (gst_vp8_parse_set_caps);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &srctemplate);
+  gst_element_class_add_static_pad_template (gstelement_class, &sinktemplate);
+
+  gst_element_class_set_static_metadata (gstelement_class, "VP8 parser",
+      "Codec/Parser/Video",
+      "Parses VP8 streams", "GStreamer maintainers "
+      "<gstreamer-devel@lists.freedesktop.org>");
+}
+
+static void
+gst_vp8_parse_init (GstVp8Parse * vp8parse)
+{
+  gst_base_parse_set_pts_interpolation (GST_BASE_PARSE (vp8parse), FALSE);
+  GST_PAD_SET_ACCEPT_INTERSECT (GST_BASE_PARSE_SINK_PAD (vp8parse));
+  GST_PAD_SET_ACCEPT_TEMPLATE (GST_BASE_PARSE_SINK_PAD (vp8parse));
+}
+
+static void
+gst_vp8_parse_reset (GstVp8Parse * vp8parse)
+{
+  gst_vp8_parser_init (&vp8parse->parser);
+
+  vp8parse->version = 0;
+  vp8parse->width = vp8parse->height = 0;
+
+  vp8parse->update_caps = FALSE;
+  vp8parse->sent_codec_tag = FALSE;
+}
+
+static gboolean
+gst_vp8_parse_start (GstBaseParse * parse)
+{
+  GstVp8Parse *vp8parse = GST_VP8_PARSE (parse);
+
+  GST_DEBUG_OBJECT (parse, "start");
+
+  gst_vp8_parse_reset (vp8parse);
+
+  /* the frame tag */
+  gst_base_parse_set_min_frame_size (parse, 3);
+
+  return TRUE;
+}
+
+static gboolean
+gst_vp8_parse_stop (GstBaseParse * parse)
+{
+  GstVp8Parse *vp8parse = GST_VP8_PARSE (parse);
+
+  GST_DEBUG_OBJECT (parse, "stop");
+
+  gst_vp8_parse_reset (vp8parse);
+
+  return TRUE;
+}
+
+static void
+gst_vp8_parse_update_src_caps (GstVp8Parse * vp8parse, GstCaps * caps)
+{
+  GstCaps *sink_caps, *src_caps;
+
+  if (G_UNLIKELY (!vp8parse->update_caps &&
+          gst_pad_has_current_caps (GST_BASE_PARSE_SRC_PAD (vp8parse))))
+    return;
+
+  /* if this is being called from the first _setcaps call, caps on the sinkpad
+   * aren't set yet and so they need to be passed as an argument */
+  if (caps)
+    sink_caps = gst_caps_ref (caps);
+  else
+    sink_caps = gst_pad_get_current_caps (GST_BASE_PARSE_SINK_PAD (vp8parse));
+
+  /* carry over input caps as much as possible; override with our own stuff */
+  if (!sink_caps)
+    sink_caps = gst_caps_new_empty_simple ("video/x-vp8");
+
+  caps = gst_caps_copy (sink_caps);
+
+  if (vp8parse->width > 0 && vp8parse->height > 0) {
+    gchar *profile = g_strdup_printf ("%u", vp8parse->version);
+
+    gst_caps_set_simple (caps, "width", G_TYPE_INT, vp8parse->width,
+        "height", G_TYPE_INT, vp8parse->height,
+        "profile", G_TYPE_STRING, profile, NULL);
+    g_free (profile);
+  }
+
+  gst_caps_set_simple (caps, "parsed", G_TYPE_BOOLEAN, TRUE, NULL);
+
+  src_caps = gst_pad_get_current_caps (GST_BASE_PARSE_SRC_PAD (vp8parse));
+  if (!(src_caps && gst_caps_is_strictly_equal (src_caps, caps))) {
+    GST_DEBUG_OBJECT (vp8parse, "new src caps %" GST_PTR_FORMAT, caps);
+    gst_pad_set_caps (GST_BASE_PARSE_SRC_PAD (vp8parse), caps);
+  }
+
+  vp8parse->update_caps = FALSE;
+
+  if (src_caps)
+    gst_caps_unref (src_caps);
+  gst_caps_unref (caps);
+  gst_caps_unref (sink_caps);
+}
+
+static gboolean
+gst_vp8_parse_set_caps (GstBaseParse * parse, GstCaps * caps)
+{
+  GstVp8Parse *vp8parse = GST_VP8_PARSE (parse);
+
+  vp8parse->update_caps = TRUE;
+  gst_vp8_parse_update_src_caps (vp8parse, caps);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_vp8_parse_handle_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame, gint * skipsize)
+{
+  GstVp8Parse *vp8parse = GST_VP8_PARSE (parse);
+  GstBuffer *buffer = frame->buffer;
+  GstVp8FrameHdr frame_hdr;
+  GstMapInfo map;
+  gboolean keyframe;
+  gsize size;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (parse, "Couldn't map incoming buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  /* input buffers hold whole frames, and the first bit of the frame tag
+   * tells key frames apart */
+  keyframe = !(map.data[0] & 0x01);
+
+  if (keyframe) {
+    if (gst_vp8_parser_parse_frame_header (&vp8parse->parser, &frame_hdr,
+            map.data, map.size) == GST_VP8_PARSER_OK) {
+      if (frame_hdr.version != vp8parse->version ||
+          frame_hdr.width != vp8parse->width ||
+          frame_hdr.height != vp8parse->height) {
+        GST_DEBUG_OBJECT (parse, "version %u, %ux%u", frame_hdr.version,
+            frame_hdr.width, frame_hdr.height);
+
+        vp8parse->version = frame_hdr.version;
+        vp8parse->width = frame_hdr.width;
+        vp8parse->height = frame_hdr.height;
+        vp8parse->update_caps = TRUE;
+      }
+    } else {
+      GST_WARNING_OBJECT (parse, "failed to parse key frame header");
+    }
+  }
+
+  size = map.size;
+  gst_buffer_unmap (buffer, &map);
+
+  GST_LOG_OBJECT (parse, "frame of %" G_GSIZE_FORMAT " bytes, keyframe %d",
+      size, keyframe);
+
+  gst_vp8_parse_update_src_caps (vp8parse, NULL);
+
+  if (keyframe)
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  else
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  return gst_base_parse_finish_frame (parse, frame, size);
+}
+
+static GstFlowReturn
+gst_vp8_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
+{
+  GstVp8Parse *vp8parse = GST_VP8_PARSE (parse);
+
+  if (!vp8parse->sent_codec_tag) {
+    GstTagList *taglist;
+    GstCaps *caps;
+
+    /* codec tag */
+    caps = gst_pad_get_current_caps (GST_BASE_PARSE_SRC_PAD (parse));
+    if (G_UNLIKELY (caps == NULL)) {
+      if (GST_PAD_IS_FLUSHING (GST_BASE_PARSE_SRC_PAD (parse))) {
+        GST_INFO_OBJECT (parse, "Src pad is flushing");
+        return GST_FLOW_FLUSHING;
+      } else {
+        GST_INFO_OBJECT (parse, "Src pad is not negotiated!");
+        return GST_FLOW_NOT_NEGOTIATED;
+      }
+    }
+
+    taglist = gst_tag_list_new_empty ();
+    gst_pb_utils_add_codec_description_to_tag_list (taglist,
+        GST_TAG_VIDEO_CODEC, caps);
+    gst_caps_unref (caps);
+
+    gst_base_parse_merge_tags (parse, taglist, GST_TAG_MERGE_REPLACE);
+    gst_tag_list_unref (taglist);
+
+    /* also signals the end of first-frame processing */
+    vp8parse->sent_codec_tag = TRUE;
+  }
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,531 @@
+/* GStreamer
+ *
+ * gstvp9parse.c: VP9 video parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-vp9parse
+ * @title: vp9parse
+ *
+ * Parses the uncompressed header of VP9 frames to mark key frames, and puts
+ * the profile, frame size, bit depth and chroma format into the caps.
+ *
+ * Input buffers are expected to hold one frame or one superframe each, as
+ * output by demuxers and depayloaders. When downstream asks for
+ * alignment=frame, superframes are split into their frames; the output
+ * buffers share the memory of the input, and the superframe index is
+ * dropped. Only the last frame of a superframe, the one that is shown,
+ * keeps the presentation timestamp.
+ *
+ * ## Example launch line
+ * |[
+ * gst-launch-1.0 filesrc location=video.webm ! matroskademux ! vp9parse ! mp4mux ! filesink location=video.mp4
+ * ]|
+ *
+ * Since: 1.18
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/base/base.h>
+#include <gst/pbutils/pbutils.h>
+#include "gstvp9parse.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (vp9_parse_debug);
+#define GST_CAT_DEFAULT vp9_parse_debug
+
+enum
+{
+  GST_VP9_PARSE_ALIGN_NONE,
+  GST_VP9_PARSE_ALIGN_SUPER_FRAME,
+  GST_VP9_PARSE_ALIGN_FRAME
+};
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-vp9, parsed = (boolean) true, "
+        "alignment = (string) { super-frame, frame }"));
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-vp9"));
+
+#define parent_class gst_vp9_parse_parent_class
+G_DEFINE_TYPE (GstVp9Parse, gst_vp9_parse, GST_TYPE_BASE_PARSE);
+
+static void gst_vp9_parse_finalize (GObject * object);
+
+static gboolean gst_vp9_parse_start (GstBaseParse * parse);
+static gboolean gst_vp9_parse_stop (GstBaseParse * parse);
+static GstFlowReturn gst_vp9_parse_handle_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame, gint * skipsize);
+static GstFlowReturn gst_vp9_parse_pre_push_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame);
+static gboolean gst_vp9_parse_set_caps (GstBaseParse * parse, GstCaps * caps);
+
+static void
+gst_vp9_parse_class_init (GstVp9ParseClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseParseClass *parse_class = GST_BASE_PARSE_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (vp9_parse_debug, "vp9parse", 0, "vp9 parser");
+
+  gobject_class->finalize = gst_vp9_parse_finalize;
+
+  /* Override BaseParse vfuncs */
+  parse_class->start = GST_DEBUG_FUNCPTR (gst_vp9_parse_start);
+  parse_class->stop = GST_DEBUG_FUNCPTR (gst_vp9_parse_stop);
+  parse_class->handle_frame = GST_DEBUG_FUNCPTR (gst_vp9_parse_handle_frame);
+  parse_class->pre_push_frame =
+      GST_DEBUG_FUNCPTR (gst_vp9_parse_pre_push_frame);
+  parse_class->set_sink_caps = GST_DEBUG_FUNCPTR (gst_vp9_parse_set_caps);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &srctemplate);
+  gst_element_class_add_static_pad_template (gstelement_class, &sinktemplate);
+
+  gst_element_class_set_static_metadata (gstelement_class, "VP9 parser",
+      "Codec/Parser/Converter/Video",
+      "Parses VP9 streams", "GStreamer maintainers "
+      "<gstreamer-devel@lists.freedesktop.org>");
+}
+
+static void
+gst_vp9_parse_init (GstVp9Parse * vp9parse)
+{
+  gst_base_parse_set_pts_interpolation (GST_BASE_PARSE (vp9parse), FALSE);
+  GST_PAD_SET_ACCEPT_INTERSECT (GST_BASE_PARSE_SINK_PAD (vp9parse));
+  GST_PAD_SET_ACCEPT_TEMPLATE (GST_BASE_PARSE_SINK_PAD (vp9parse));
+}
+
+static void
+gst_vp9_parse_finalize (GObject * object)
+{
+  GstVp9Parse *vp9parse = GST_VP9_PARSE (object);
+
+  gst_vp9_parser_free (vp9parse->parser);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_vp9_parse_reset (GstVp9Parse * vp9parse)
+{
+  /* the parser keeps reference frame sizes and segmentation state */
+  gst_vp9_parser_free (vp9parse->parser);
+  vp9parse->parser = gst_vp9_parser_new ();
+
+  vp9parse->in_alignment = GST_VP9_PARSE_ALIGN_SUPER_FRAME;
+  vp9parse->alignment = GST_VP9_PARSE_ALIGN_NONE;
+
+  vp9parse->profile = GST_VP9_PROFILE_UNDEFINED;
+  vp9parse->width = vp9parse->height = 0;
+  vp9parse->bit_depth = 0;
+  vp9parse->subsampling_x = vp9parse->subsampling_y = -1;
+
+  vp9parse->update_caps = FALSE;
+  vp9parse->sent_codec_tag = FALSE;
+}
+
+static gboolean
+gst_vp9_parse_start (GstBaseParse * parse)
+{
+  GstVp9Parse *vp9parse = GST_VP9_PARSE (parse);
+
+  GST_DEBUG_OBJECT (parse, "start");
+
+  gst_vp9_parse_reset (vp9parse);
+
+  /* the smallest frame, a shown existing frame */
+  gst_base_parse_set_min_frame_size (parse, 1);
+
+  return TRUE;
+}
+
+static gboolean
+gst_vp9_parse_stop (GstBaseParse * parse)
+{
+  GstVp9Parse *vp9parse = GST_VP9_PARSE (parse);
+
+  GST_DEBUG_OBJECT (parse, "stop");
+
+  gst_vp9_parse_reset (vp9parse);
+
+  return TRUE;
+}
+
+static const gchar *
+gst_vp9_parse_get_alignment_string (guint alignment)
+{
+  switch (alignment) {
+    case GST_VP9_PARSE_ALIGN_SUPER_FRAME:
+      return "super-frame";
+    case GST_VP9_PARSE_ALIGN_FRAME:
+      return "frame";
+    default:
+      return "none";
+  }
+}
+
+static guint
+gst_vp9_parse_alignment_from_caps (GstCaps * caps)
+{
+  GstStructure *s;
+  const gchar *str;
+
+  if (!caps || gst_caps_get_size (caps) == 0)
+    return GST_VP9_PARSE_ALIGN_NONE;
+
+  s = gst_caps_get_structure (caps, 0);
+  if ((str = gst_structure_get_string (s, "alignment"))) {
+    if (strcmp (str, "super-frame") == 0)
+      return GST_VP9_PARSE_ALIGN_SUPER_FRAME;
+    else if (strcmp (str, "frame") == 0)
+      return GST_VP9_PARSE_ALIGN_FRAME;
+  }
+
+  return GST_VP9_PARSE_ALIGN_NONE;
+}
+
+/* check downstream caps to configure the output alignment */
+static void
+gst_vp9_parse_negotiate (GstVp9Parse * vp9parse)
+{
+  GstCaps *caps;
+  guint alignment = GST_VP9_PARSE_ALIGN_NONE;
+
+  caps = gst_pad_get_allowed_caps (GST_BASE_PARSE_SRC_PAD (vp9parse));
+  GST_DEBUG_OBJECT (vp9parse, "allowed caps: %" GST_PTR_FORMAT, caps);
+
+  /* concentrate on leading structure, since decodebin parser
+   * capsfilter always includes parser template caps */
+  if (caps)
+    caps = gst_caps_truncate (caps);
+
+  if (caps && !gst_caps_is_empty (caps)) {
+    GstCaps *in_align_caps;
+
+    /* keep the input alignment if downstream accepts it */
+    in_align_caps = gst_caps_new_simple ("video/x-vp9",
+        "alignment", G_TYPE_STRING,
+        gst_vp9_parse_get_alignment_string (vp9parse->in_alignment), NULL);
+    if (gst_caps_can_intersect (in_align_caps, caps)) {
+      alignment = vp9parse->in_alignment;
+    } else {
+      /* fixate to avoid ambiguity with lists when parsing */
+      caps = gst_caps_fixate (caps);
+      alignment = gst_vp9_parse_alignment_from_caps (caps);
+    }
+    gst_caps_unref (in_align_caps);
+  }
+
+  /* default */
+  if (!alignment)
+    alignment = vp9parse->in_alignment;
+
+  /* frames are not merged back into superframes */
+  if (vp9parse->in_alignment == GST_VP9_PARSE_ALIGN_FRAME)
+    alignment = GST_VP9_PARSE_ALIGN_FRAME;
+
+  GST_DEBUG_OBJECT (vp9parse, "selected alignment %s, input alignment %s",
+      gst_vp9_parse_get_alignment_string (alignment),
+      gst_vp9_parse_get_alignment_string (vp9parse->in_alignment));
+
+  if (alignment != vp9parse->alignment)
+    vp9parse->update_caps = TRUE;
+  vp9parse->alignment = alignment;
+
+  if (caps)
+    gst_caps_unref (caps);
+}
+
+static const gchar *
+gst_vp9_parse_get_chroma_format (gint subsampling_x, gint subsampling_y)
+{
+  if (subsampling_x == 1 && subsampling_y == 1)
+    return "4:2:0";
+  else if (subsampling_x == 1 && subsampling_y == 0)
+    return "4:2:2";
+  else if (subsampling_x == 0 && subsampling_y == 1)
+    return "4:4:0";
+  else if (subsampling_x == 0 && subsampling_y == 0)
+    return "4:4:4";
+
+  return NULL;
+}
+
+static void
+gst_vp9_parse_update_src_caps (GstVp9Parse * vp9parse, GstCaps * caps)
+{
+  GstCaps *sink_caps, *src_caps;
+  const gchar *chroma_format;
+
+  if (G_UNLIKELY (!vp9parse->update_caps &&
+          gst_pad_has_current_caps (GST_BASE_PARSE_SRC_PAD (vp9parse))))
+    return;
+
+  /* if this is being called from the first _setcaps call, caps on the sinkpad
+   * aren't set yet and so they need to be passed as an argument */
+  if (caps)
+    sink_caps = gst_caps_ref (caps);
+  else
+    sink_caps = gst_pad_get_current_caps (GST_BASE_PARSE_SINK_PAD (vp9parse));
+
+  /* carry over input caps as much as possible; override with our own stuff */
+  if (!sink_caps)
+    sink_caps = gst_caps_new_empty_simple ("video/x-vp9");
+
+  caps = gst_caps_copy (sink_caps);
+
+  if (vp9parse->width > 0 && vp9parse->height > 0)
+    gst_caps_set_simple (caps, "width", G_TYPE_INT, vp9parse->width,
+        "height", G_TYPE_INT, vp9parse->height, NULL);
+
+  if (vp9parse->profile < GST_VP9_PROFILE_UNDEFINED) {
+    gchar *profile = g_strdup_printf ("%u", vp9parse->profile);
+
+    gst_caps_set_simple (caps, "profile", G_TYPE_STRING, profile, NULL);
+    g_free (profile);
+  }
+
+  if (vp9parse->bit_depth > 0)
+    gst_caps_set_simple (caps, "bit-depth-luma", G_TYPE_UINT,
+        vp9parse->bit_depth, "bit-depth-chroma", G_TYPE_UINT,
+        vp9parse->bit_depth, NULL);
+
+  chroma_format = gst_vp9_parse_get_chroma_format (vp9parse->subsampling_x,
+      vp9parse->subsampling_y);
+  if (chroma_format)
+    gst_caps_set_simple (caps, "chroma-format", G_TYPE_STRING, chroma_format,
+        NULL);
+
+  gst_caps_set_simple (caps, "parsed", G_TYPE_BOOLEAN, TRUE,
+      "alignment", G_TYPE_STRING,
+      gst_vp9_parse_get_alignment_string (vp9parse->alignment), NULL);
+
+  src_caps = gst_pad_get_current_caps (GST_BASE_PARSE_SRC_PAD (vp9parse));
+  if (!(src_caps && gst_caps_is_strictly_equal (src_caps, caps))) {
+    GST_DEBUG_OBJECT (vp9parse, "new src caps %" GST_PTR_FORMAT, caps);
+    gst_pad_set_caps (GST_BASE_PARSE_SRC_PAD (vp9parse), caps);
+  }
+
+  vp9parse->update_caps = FALSE;
+
+  if (src_caps)
+    gst_caps_unref (src_caps);
+  gst_caps_unref (caps);
+  gst_caps_unref (sink_caps);
+}
+
+static gboolean
+gst_vp9_parse_set_caps (GstBaseParse * parse, GstCaps * caps)
+{
+  GstVp9Parse *vp9parse = GST_VP9_PARSE (parse);
+
+  vp9parse->in_alignment = gst_vp9_parse_alignment_from_caps (caps);
+  if (vp9parse->in_alignment == GST_VP9_PARSE_ALIGN_NONE)
+    vp9parse->in_alignment = GST_VP9_PARSE_ALIGN_SUPER_FRAME;
+
+  gst_vp9_parse_negotiate (vp9parse);
+  vp9parse->update_caps = TRUE;
+  gst_vp9_parse_update_src_caps (vp9parse, caps);
+
+  return TRUE;
+}
+
+/* parses the uncompressed header of the frame at @data, returns whether it
+ * is a shown key frame */
+static gboolean
+gst_vp9_parse_parse_frame (GstVp9Parse * vp9parse, const guint8 * data,
+    gsize size)
+{
+  GstVp9Parser *parser = vp9parse->parser;
+  GstVp9FrameHdr frame_hdr;
+
+  if (gst_vp9_parser_parse_frame_header (parser, &frame_hdr, data,
+          size) != GST_VP9_PARSER_OK) {
+    GST_WARNING_OBJECT (vp9parse, "failed to parse frame header");
+    return FALSE;
+  }
+
+  /* frame_type is not set for shown existing frames */
+  if (frame_hdr.show_existing_frame)
+    return FALSE;
+
+  /* the size is unknown when predicted from a reference that wasn't seen */
+  if (frame_hdr.width > 0 && (frame_hdr.profile != vp9parse->profile ||
+          frame_hdr.width != vp9parse->width ||
+          frame_hdr.height != vp9parse->height ||
+          parser->bit_depth != vp9parse->bit_depth ||
+          parser->subsampling_x != vp9parse->subsampling_x ||
+          parser->subsampling_y != vp9parse->subsampling_y)) {
+    GST_DEBUG_OBJECT (vp9parse, "profile %u, %ux%u, %u bit, subsampling %d,%d",
+        frame_hdr.profile, frame_hdr.width, frame_hdr.height,
+        parser->bit_depth, parser->subsampling_x, parser->subsampling_y);
+
+    vp9parse->profile = frame_hdr.profile;
+    vp9parse->width = frame_hdr.width;
+    vp9parse->height = frame_hdr.height;
+    vp9parse->bit_depth = parser->bit_depth;
+    vp9parse->subsampling_x = parser->subsampling_x;
+    vp9parse->subsampling_y = parser->subsampling_y;
+    vp9parse->update_caps = TRUE;
+  }
+
+  return frame_hdr.frame_type == GST_VP9_KEY_FRAME && frame_hdr.show_frame;
+}
+
+static void
+gst_vp9_parse_set_flags (GstBuffer * buffer, gboolean keyframe)
+{
+  if (keyframe)
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  else
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+static GstFlowReturn
+gst_vp9_parse_handle_frame (GstBaseParse * parse,
+    GstBaseParseFrame * frame, gint * skipsize)
+{
+  GstVp9Parse *vp9parse = GST_VP9_PARSE (parse);
+  GstBuffer *buffer = frame->buffer;
+  GstVp9SuperframeInfo superframe_info;
+  gboolean keyframes[GST_VP9_MAX_FRAMES_IN_SUPERFRAME];
+  gboolean keyframe = FALSE;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstMapInfo map;
+  gsize size;
+  guint offset = 0, i;
+
+  if (G_UNLIKELY (vp9parse->alignment == GST_VP9_PARSE_ALIGN_NONE))
+    gst_vp9_parse_negotiate (vp9parse);
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (parse, "Couldn't map incoming buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  /* input buffers hold whole frames or superframes */
+  if (gst_vp9_parser_parse_superframe_info (vp9parse->parser,
+          &superframe_info, map.data, map.size) != GST_VP9_PARSER_OK) {
+    GST_WARNING_OBJECT (parse, "invalid superframe, skipping %" G_GSIZE_FORMAT
+        " bytes", map.size);
+    *skipsize = map.size;
+    gst_buffer_unmap (buffer, &map);
+    return GST_FLOW_OK;
+  }
+
+  for (i = 0; i < superframe_info.frames_in_superframe; i++) {
+    keyframes[i] = gst_vp9_parse_parse_frame (vp9parse, map.data + offset,
+        superframe_info.frame_sizes[i]);
+    keyframe |= keyframes[i];
+    offset += superframe_info.frame_sizes[i];
+  }
+
+  size = map.size;
+  gst_buffer_unmap (buffer, &map);
+
+  GST_LOG_OBJECT (parse, "%u frames in %" G_GSIZE_FORMAT " bytes, keyframe %d",
+      superframe_info.frames_in_superframe, size, keyframe);
+
+  gst_vp9_parse_update_src_caps (vp9parse, NULL);
+
+  if (vp9parse->alignment != GST_VP9_PARSE_ALIGN_FRAME ||
+      superframe_info.frames_in_superframe == 1) {
+    gst_vp9_parse_set_flags (buffer, keyframe);
+    return gst_base_parse_finish_frame (parse, frame, size);
+  }
+
+  /* split the superframe, the output buffers are taken from the input
+   * without copying */
+  offset = 0;
+  for (i = 0; i < superframe_info.frames_in_superframe; i++) {
+    GstBaseParseFrame subframe;
+    guint32 frame_size = superframe_info.frame_sizes[i];
+
+    gst_base_parse_frame_init (&subframe);
+    subframe.flags |= frame->flags;
+    subframe.offset = frame->offset;
+    subframe.overhead = frame->overhead;
+    subframe.buffer = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL,
+        offset, frame_size);
+
+    /* only the shown frame, the last one, is presented */
+    if (i < superframe_info.frames_in_superframe - 1) {
+      GST_BUFFER_PTS (subframe.buffer) = GST_CLOCK_TIME_NONE;
+      GST_BUFFER_DURATION (subframe.buffer) = GST_CLOCK_TIME_NONE;
+    }
+    gst_vp9_parse_set_flags (subframe.buffer, keyframes[i]);
+
+    ret = gst_base_parse_finish_frame (parse, &subframe, frame_size);
+    gst_base_parse_frame_free (&subframe);
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    offset += frame_size;
+  }
+
+  /* what is left is the superframe index */
+  frame->flags |= GST_BASE_PARSE_FRAME_FLAG_DROP;
+
+  return gst_base_parse_finish_frame (parse, frame, size - offset);
+}
+
+static GstFlowReturn
+gst_vp9_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
+{
+  GstVp9Parse *vp9parse = GST_VP9_PARSE (parse);
+
+  if (!vp9parse->sent_codec_tag) {
+    GstTagList *taglist;
+    GstCaps *caps;
+
+    /* codec tag */
+    caps = gst_pad_get_current_caps (GST_BASE_PARSE_SRC_PAD (parse));
+    if (G_UNLIKELY (caps == NULL)) {
+      if (GST_PAD_IS_FLUSHING (GST_BASE_PARSE_SRC_PAD (parse))) {
+        GST_INFO_OBJECT (parse, "Src pad is flushing");
+        return GST_FLOW_FLUSHING;
+      } else {
+        GST_INFO_OBJECT (parse, "Src pad is not negotiated!");
+        return GST_FLOW_NOT_NEGOTIATED;
+      }
+    }
+
+    taglist = gst_tag_list_new_empty ();
+    gst_pb_utils_add_codec_description_to_tag_list (taglist,
+        GST_TAG_VIDEO_CODEC, caps);
+    gst_caps_unref (caps);
+
+    gst_base_parse_merge_tags (parse, taglist, GST_TAG_MERGE_REPLACE);
+    gst_tag_list_unref (taglist);
+
+    /* also signals the end of first-frame processing */
+    vp9parse->sent_codec_tag = TRUE;
+  }
+
+  return GST_FLOW_OK;
+}
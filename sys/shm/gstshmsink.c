@@ -31,6 +31,13 @@
  * ! shmsink socket-path=/tmp/blah shm-size=2000000
  * ]| Send video to shm buffers.
  *
+ * By default, a client that does not release its buffers makes shmsink wait
+ * for it, which stalls all the other clients. Limit what each client can
+ * hold with #GstShmSink:client-max-buffers and #GstShmSink:client-max-bytes
+ * and choose what happens past those limits with #GstShmSink:client-policy.
+ * The #GstShmSink:stats property tells how much each client holds and how
+ * many buffers it missed.
+ *
  */
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -58,17 +65,29 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_RING_SIZE,
+  PROP_CLIENT_MAX_BUFFERS,
+  PROP_CLIENT_MAX_BYTES,
+  PROP_CLIENT_POLICY,
+  PROP_STATS
 };
 
 struct GstShmClient
 {
   ShmClient *client;
   GstPollFD pollfd;
+  /* Readable when the client acked buffers through the ring */
+  GstPollFD ringpollfd;
 };
 
 #define DEFAULT_SIZE ( 64 * 1024 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_RING_SIZE 0
+#define MAX_RING_SIZE (64 * 1024)
+#define DEFAULT_CLIENT_MAX_BUFFERS 0
+#define DEFAULT_CLIENT_MAX_BYTES 0
+#define DEFAULT_CLIENT_POLICY GST_SHM_SINK_CLIENT_POLICY_BLOCK
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -81,6 +100,30 @@ static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS_ANY);
 
+#define GST_TYPE_SHM_SINK_CLIENT_POLICY \
+  (gst_shm_sink_client_policy_get_type ())
+static GType
+gst_shm_sink_client_policy_get_type (void)
+{
+  static GType gtype = 0;
+
+  if (gtype == 0) {
+    static const GEnumValue values[] = {
+      {GST_SHM_SINK_CLIENT_POLICY_BLOCK,
+          "Wait until the client releases a buffer", "block"},
+      {GST_SHM_SINK_CLIENT_POLICY_DROP_OLDEST,
+          "Drop the oldest buffer the client did not read, or the new one",
+          "drop-oldest"},
+      {GST_SHM_SINK_CLIENT_POLICY_DISCONNECT, "Disconnect the client",
+          "disconnect"},
+      {0, NULL, NULL}
+    };
+
+    gtype = g_enum_register_static ("GstShmSinkClientPolicy", values);
+  }
+  return gtype;
+}
+
 #define gst_shm_sink_parent_class parent_class
 G_DEFINE_TYPE (GstShmSink, gst_shm_sink, GST_TYPE_BASE_SINK);
 
@@ -355,6 +398,10 @@ gst_shm_sink_init (GstShmSink * self)
   self->unlock = FALSE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->ring_size = DEFAULT_RING_SIZE;
+  self->client_max_buffers = DEFAULT_CLIENT_MAX_BUFFERS;
+  self->client_max_bytes = DEFAULT_CLIENT_MAX_BYTES;
+  self->client_policy = DEFAULT_CLIENT_POLICY;
 
   gst_allocation_params_init (&self->params);
 }
@@ -417,6 +464,59 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+      g_param_spec_uint ("ring-size",
+          "Size of the buffer ring",
+          "Number of buffers each client can hold when sending them through "
+          "a ring in shared memory instead of the socket, rounded up to a "
+          "power of two (0 = use the socket). Needs a shmsrc that supports "
+          "it, only applies to new clients",
+          0, MAX_RING_SIZE, DEFAULT_RING_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CLIENT_MAX_BUFFERS,
+      g_param_spec_uint ("client-max-buffers",
+          "Max buffers per client",
+          "Maximum number of buffers a client can hold before client-policy "
+          "applies (0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_CLIENT_MAX_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CLIENT_MAX_BYTES,
+      g_param_spec_uint64 ("client-max-bytes",
+          "Max bytes per client",
+          "Maximum number of bytes a client can hold before client-policy "
+          "applies (0 = unlimited)",
+          0, G_MAXUINT64, DEFAULT_CLIENT_MAX_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstShmSink:client-policy:
+   *
+   * What to do when a client holds as many buffers as client-max-buffers,
+   * client-max-bytes or its ring allow. Only clients with a ring can have
+   * their oldest buffer taken back, the others miss the new buffers instead.
+   */
+  g_object_class_install_property (gobject_class, PROP_CLIENT_POLICY,
+      g_param_spec_enum ("client-policy",
+          "Client policy",
+          "What to do with a client that holds too many buffers",
+          GST_TYPE_SHM_SINK_CLIENT_POLICY, DEFAULT_CLIENT_POLICY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstShmSink:stats:
+   *
+   * Statistics about the shared memory area. The "clients" field is an
+   * array with one structure per client, with its "fd" as passed to
+   * #GstShmSink::client-connected, the "pending-buffers" and
+   * "pending-bytes" it holds and the "dropped-buffers" it missed.
+   */
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Statistics about the use of the shared memory area",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -505,11 +605,96 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_RING_SIZE:
+      GST_OBJECT_LOCK (object);
+      self->ring_size = g_value_get_uint (value);
+      if (self->pipe)
+        ret = sp_writer_set_ring_size (self->pipe, self->ring_size);
+      GST_OBJECT_UNLOCK (object);
+      if (ret < 0)
+        GST_WARNING_OBJECT (object, "Rings are not supported, buffers will "
+            "be sent through the socket");
+      break;
+    case PROP_CLIENT_MAX_BUFFERS:
+      GST_OBJECT_LOCK (object);
+      self->client_max_buffers = g_value_get_uint (value);
+      if (self->pipe)
+        sp_writer_set_client_limits (self->pipe, self->client_max_buffers,
+            self->client_max_bytes);
+      GST_OBJECT_UNLOCK (object);
+      g_cond_broadcast (&self->cond);
+      break;
+    case PROP_CLIENT_MAX_BYTES:
+      GST_OBJECT_LOCK (object);
+      self->client_max_bytes = g_value_get_uint64 (value);
+      if (self->pipe)
+        sp_writer_set_client_limits (self->pipe, self->client_max_buffers,
+            self->client_max_bytes);
+      GST_OBJECT_UNLOCK (object);
+      g_cond_broadcast (&self->cond);
+      break;
+    case PROP_CLIENT_POLICY:
+      GST_OBJECT_LOCK (object);
+      self->client_policy = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (object);
+      g_cond_broadcast (&self->cond);
+      break;
     default:
       break;
   }
 }
 
+/* Must be called with the object lock held */
+static GstStructure *
+gst_shm_sink_get_stats (GstShmSink * self)
+{
+  ShmAllocStats stats = { 0, };
+  GValue clients = G_VALUE_INIT;
+  GstStructure *s;
+  gsize free_bytes;
+  gdouble fragmentation = 0.0;
+  GList *item;
+
+  if (self->pipe)
+    sp_writer_get_alloc_stats (self->pipe, &stats);
+
+  /* How much of the free space can't be used for one large buffer */
+  free_bytes = stats.size - stats.used;
+  if (free_bytes > 0)
+    fragmentation = 1.0 - (gdouble) stats.largest_free / free_bytes;
+
+  g_value_init (&clients, GST_TYPE_ARRAY);
+  for (item = self->clients; item; item = item->next) {
+    struct GstShmClient *gclient = item->data;
+    ShmClientStats cstats;
+    GValue v = G_VALUE_INIT;
+
+    sp_writer_get_client_stats (gclient->client, &cstats);
+
+    g_value_init (&v, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&v,
+        gst_structure_new ("application/x-shm-sink-client-stats",
+            "fd", G_TYPE_INT, gclient->pollfd.fd,
+            "pending-buffers", G_TYPE_UINT, cstats.n_pending,
+            "pending-bytes", G_TYPE_UINT64, (guint64) cstats.bytes_pending,
+            "dropped-buffers", G_TYPE_UINT64, (guint64) cstats.n_dropped,
+            NULL));
+    gst_value_array_append_and_take_value (&clients, &v);
+  }
+
+  s = gst_structure_new ("application/x-shm-sink-stats",
+      "shm-size", G_TYPE_UINT64, (guint64) stats.size,
+      "allocated-bytes", G_TYPE_UINT64, (guint64) stats.used,
+      "free-bytes", G_TYPE_UINT64, (guint64) free_bytes,
+      "largest-free-block", G_TYPE_UINT64, (guint64) stats.largest_free,
+      "allocated-blocks", G_TYPE_UINT, stats.n_blocks,
+      "free-blocks", G_TYPE_UINT, stats.n_free_blocks,
+      "fragmentation", G_TYPE_DOUBLE, fragmentation, NULL);
+  gst_structure_take_value (s, "clients", &clients);
+
+  return s;
+}
+
 static void
 gst_shm_sink_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -534,6 +719,21 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_RING_SIZE:
+      g_value_set_uint (value, self->ring_size);
+      break;
+    case PROP_CLIENT_MAX_BUFFERS:
+      g_value_set_uint (value, self->client_max_buffers);
+      break;
+    case PROP_CLIENT_MAX_BYTES:
+      g_value_set_uint64 (value, self->client_max_bytes);
+      break;
+    case PROP_CLIENT_POLICY:
+      g_value_set_enum (value, self->client_policy);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_shm_sink_get_stats (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -569,6 +769,12 @@ gst_shm_sink_start (GstBaseSink * bsink)
     return FALSE;
   }
 
+  if (sp_writer_set_ring_size (self->pipe, self->ring_size) < 0)
+    GST_WARNING_OBJECT (self, "Rings are not supported, buffers will be sent "
+        "through the socket");
+  sp_writer_set_client_limits (self->pipe, self->client_max_buffers,
+      self->client_max_bytes);
+
   sp_set_data (self->pipe, self);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
@@ -640,11 +846,70 @@ gst_shm_sink_stop (GstBaseSink * bsink)
   return TRUE;
 }
 
+static void
+free_buffer_locked (GstBuffer * buffer, void *data)
+{
+  GSList **list = data;
+
+  g_assert (buffer != NULL);
+
+  *list = g_slist_prepend (*list, buffer);
+}
+
+/* Applies the client policy to the clients that can't take a buffer of
+ * @size more, must be called with the object lock held, drops it while
+ * freeing buffers */
+static void
+gst_shm_sink_enforce_client_policy (GstShmSink * self, gsize size)
+{
+  GSList *list = NULL;
+  GList *item;
+
+  if (self->client_policy == GST_SHM_SINK_CLIENT_POLICY_BLOCK)
+    return;
+
+  for (item = self->clients; item; item = item->next) {
+    struct GstShmClient *gclient = item->data;
+
+    if (!sp_writer_client_is_full (self->pipe, gclient->client, size))
+      continue;
+
+    if (self->client_policy == GST_SHM_SINK_CLIENT_POLICY_DISCONNECT) {
+      GST_WARNING_OBJECT (self, "Client %d holds too many buffers, "
+          "disconnecting it", gclient->pollfd.fd);
+      /* The poll thread then closes it */
+      sp_writer_shutdown_client (gclient->client);
+      continue;
+    }
+
+    /* Otherwise sp_writer_send_buf() skips it for this buffer */
+    while (sp_writer_client_is_full (self->pipe, gclient->client, size)) {
+      if (sp_writer_drop_oldest (self->pipe, gclient->client,
+              (sp_buffer_free_callback) free_buffer_locked, &list) <= 0)
+        break;
+    }
+    GST_LOG_OBJECT (self, "Client %d holds too many buffers, dropping",
+        gclient->pollfd.fd);
+  }
+
+  if (list) {
+    GST_OBJECT_UNLOCK (self);
+    g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+    GST_OBJECT_LOCK (self);
+  }
+}
+
 static gboolean
-gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
+gst_shm_sink_can_render (GstShmSink * self, GstClockTime time, gsize size)
 {
   ShmBuffer *b;
 
+  /* Wait for the full clients to release some buffers, with the other
+   * policies sp_writer_send_buf() skips them */
+  if (self->client_policy == GST_SHM_SINK_CLIENT_POLICY_BLOCK &&
+      !sp_writer_can_send (self->pipe, size))
+    return FALSE;
+
   if (time == GST_CLOCK_TIME_NONE || self->buffer_time == GST_CLOCK_TIME_NONE)
     return TRUE;
 
@@ -688,7 +953,10 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     }
   }
 
-  while (!gst_shm_sink_can_render (self, GST_BUFFER_TIMESTAMP (buf))) {
+  gst_shm_sink_enforce_client_policy (self, gst_buffer_get_size (buf));
+
+  while (!gst_shm_sink_can_render (self, GST_BUFFER_TIMESTAMP (buf),
+          gst_buffer_get_size (buf))) {
     g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
     if (self->unlock) {
       GST_OBJECT_UNLOCK (self);
@@ -812,16 +1080,6 @@ error:
   return GST_FLOW_ERROR;
 }
 
-static void
-free_buffer_locked (GstBuffer * buffer, void *data)
-{
-  GSList **list = data;
-
-  g_assert (buffer != NULL);
-
-  *list = g_slist_prepend (*list, buffer);
-}
-
 static gpointer
 pollthread_func (gpointer data)
 {
@@ -832,6 +1090,13 @@ pollthread_func (gpointer data)
 
   while (!self->stop) {
 
+    /* Only sleep when there is no ack waiting in the rings, the clients
+     * then wake us up through the ring fds */
+    GST_OBJECT_LOCK (self);
+    if (!sp_writer_prepare_wait (self->pipe))
+      timeout = 0;
+    GST_OBJECT_UNLOCK (self);
+
     do {
       rv = gst_poll_wait (self->poll, timeout);
     } while (rv < 0 && errno == EINTR);
@@ -881,7 +1146,16 @@ pollthread_func (gpointer data)
       gclient->pollfd.fd = sp_writer_get_client_fd (client);
       gst_poll_add_fd (self->poll, &gclient->pollfd);
       gst_poll_fd_ctl_read (self->poll, &gclient->pollfd, TRUE);
+      gst_poll_fd_init (&gclient->ringpollfd);
+      gclient->ringpollfd.fd = sp_writer_get_client_ring_fd (client);
+      if (gclient->ringpollfd.fd >= 0) {
+        gst_poll_add_fd (self->poll, &gclient->ringpollfd);
+        gst_poll_fd_ctl_read (self->poll, &gclient->ringpollfd, TRUE);
+      }
+      /* The streaming thread goes through the clients too */
+      GST_OBJECT_LOCK (self);
       self->clients = g_list_prepend (self->clients, gclient);
+      GST_OBJECT_UNLOCK (self);
       g_signal_emit (self, signals[SIGNAL_CLIENT_CONNECTED], 0,
           gclient->pollfd.fd);
       /* we need to call gst_poll_wait before calling gst_poll_* status
@@ -925,6 +1199,22 @@ pollthread_func (gpointer data)
         if (rv == 0)
           gst_buffer_unref (tag);
       }
+
+      if (gclient->ringpollfd.fd >= 0) {
+        GSList *list = NULL;
+
+        GST_OBJECT_LOCK (self);
+        rv = sp_writer_recv_acks (self->pipe, gclient->client,
+            (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
+        GST_OBJECT_UNLOCK (self);
+        g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+
+        if (rv < 0) {
+          GST_WARNING_OBJECT (self, "One client has a broken ring,"
+              " closing (retval: %d)", rv);
+          goto close_client;
+        }
+      }
       continue;
     close_client:
       {
@@ -932,12 +1222,14 @@ pollthread_func (gpointer data)
         GST_OBJECT_LOCK (self);
         sp_writer_close_client (self->pipe, gclient->client,
             (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
+        self->clients = g_list_remove (self->clients, gclient);
         GST_OBJECT_UNLOCK (self);
         g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
       }
 
       gst_poll_remove_fd (self->poll, &gclient->pollfd);
-      self->clients = g_list_remove (self->clients, gclient);
+      if (gclient->ringpollfd.fd >= 0)
+        gst_poll_remove_fd (self->poll, &gclient->ringpollfd);
 
       g_signal_emit (self, signals[SIGNAL_CLIENT_DISCONNECTED], 0,
           gclient->pollfd.fd);
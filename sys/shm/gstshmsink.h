@@ -42,6 +42,21 @@ typedef struct _GstShmSink GstShmSink;
 typedef struct _GstShmSinkClass GstShmSinkClass;
 typedef struct _GstShmSinkAllocator GstShmSinkAllocator;
 
+/**
+ * GstShmSinkClientPolicy:
+ * @GST_SHM_SINK_CLIENT_POLICY_BLOCK: wait until the client releases a buffer
+ * @GST_SHM_SINK_CLIENT_POLICY_DROP_OLDEST: drop buffers for that client only
+ * @GST_SHM_SINK_CLIENT_POLICY_DISCONNECT: disconnect the client
+ *
+ * What to do with a client that holds as many buffers as it is allowed to.
+ */
+typedef enum
+{
+  GST_SHM_SINK_CLIENT_POLICY_BLOCK,
+  GST_SHM_SINK_CLIENT_POLICY_DROP_OLDEST,
+  GST_SHM_SINK_CLIENT_POLICY_DISCONNECT
+} GstShmSinkClientPolicy;
+
 struct _GstShmSink
 {
   GstBaseSink element;
@@ -63,6 +78,10 @@ struct _GstShmSink
   gboolean stop;
   gboolean unlock;
   GstClockTimeDiff buffer_time;
+  guint ring_size;
+  guint client_max_buffers;
+  guint64 client_max_bytes;
+  GstShmSinkClientPolicy client_policy;
 
   GCond cond;
 
@@ -41,6 +41,7 @@
 #include "gstshmsrc.h"
 
 #include <gst/gst.h>
+#include <gst/allocators/allocators.h>
 
 #include <string.h>
 
@@ -63,17 +64,83 @@ struct GstShmBuffer
 {
   char *buf;
   GstShmPipe *pipe;
+  /* Where @buf is in its area */
+  gulong offset;
 };
 
 
 GST_DEBUG_CATEGORY_STATIC (shmsrc_debug);
 #define GST_CAT_DEFAULT shmsrc_debug
 
+static GQuark gst_shm_buffer_quark;
+
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS_ANY);
 
+/********************
+ * CUSTOM ALLOCATOR *
+ ********************/
+
+/* Makes the fd memories of the buffers, mapping them reads through the
+ * mapping of the area that shmpipe already has */
+
+#define GST_TYPE_SHM_SRC_ALLOCATOR \
+  (gst_shm_src_allocator_get_type())
+
+typedef struct _GstShmSrcAllocator
+{
+  GstFdAllocator parent;
+} GstShmSrcAllocator;
+
+typedef struct _GstShmSrcAllocatorClass
+{
+  GstFdAllocatorClass parent;
+} GstShmSrcAllocatorClass;
+
+GType gst_shm_src_allocator_get_type (void);
+
+G_DEFINE_TYPE (GstShmSrcAllocator, gst_shm_src_allocator,
+    GST_TYPE_FD_ALLOCATOR);
+
+static gpointer
+gst_shm_src_allocator_mem_map (GstMemory * mem, gsize maxsize,
+    GstMapFlags flags)
+{
+  struct GstShmBuffer *gsb;
+  GstMemory *parent;
+
+  /* find the real parent, the shared memories have the same offsets */
+  if ((parent = mem->parent) == NULL)
+    parent = mem;
+
+  gsb = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (parent),
+      gst_shm_buffer_quark);
+  g_return_val_if_fail (gsb != NULL, NULL);
+
+  return gsb->buf - gsb->offset;
+}
+
+static void
+gst_shm_src_allocator_mem_unmap (GstMemory * mem)
+{
+}
+
+static void
+gst_shm_src_allocator_class_init (GstShmSrcAllocatorClass * klass)
+{
+}
+
+static void
+gst_shm_src_allocator_init (GstShmSrcAllocator * self)
+{
+  GstAllocator *allocator = GST_ALLOCATOR (self);
+
+  allocator->mem_map = gst_shm_src_allocator_mem_map;
+  allocator->mem_unmap = gst_shm_src_allocator_mem_unmap;
+}
+
 #define gst_shm_src_parent_class parent_class
 G_DEFINE_TYPE (GstShmSrc, gst_shm_src, GST_TYPE_PUSH_SRC);
 
@@ -145,6 +212,8 @@ gst_shm_src_class_init (GstShmSrcClass * klass)
       "Olivier Crete <olivier.crete@collabora.co.uk>");
 
   GST_DEBUG_CATEGORY_INIT (shmsrc_debug, "shmsrc", 0, "Shared Memory Source");
+
+  gst_shm_buffer_quark = g_quark_from_static_string ("GstShmBuffer");
 }
 
 static void
@@ -152,6 +221,9 @@ gst_shm_src_init (GstShmSrc * self)
 {
   self->poll = gst_poll_new (TRUE);
   gst_poll_fd_init (&self->pollfd);
+  gst_poll_fd_init (&self->ringpollfd);
+  self->fd_allocator = g_object_new (GST_TYPE_SHM_SRC_ALLOCATOR, NULL);
+  gst_object_ref_sink (self->fd_allocator);
 }
 
 static void
@@ -159,6 +231,7 @@ gst_shm_src_finalize (GObject * object)
 {
   GstShmSrc *self = GST_SHM_SRC (object);
 
+  gst_object_unref (self->fd_allocator);
   gst_poll_free (self->poll);
   g_free (self->socket_path);
 
@@ -259,6 +332,7 @@ gst_shm_src_start_reading (GstShmSrc * self)
   self->pollfd.fd = sp_get_fd (self->pipe->pipe);
   gst_poll_add_fd (self->poll, &self->pollfd);
   gst_poll_fd_ctl_read (self->poll, &self->pollfd, TRUE);
+  gst_poll_fd_init (&self->ringpollfd);
 
   return TRUE;
 }
@@ -318,6 +392,45 @@ free_buffer (gpointer data)
   g_slice_free (struct GstShmBuffer, gsb);
 }
 
+/* Returns a memory for the part of the area's fd that holds the buffer of
+ * @gsb, so that downstream can pass the fd on instead of copying the data.
+ * Its offset is the one in the fd and it ends with the buffer. The memories
+ * shared from it keep it alive, so @gsb goes back to the sink once all of
+ * them are gone. */
+static GstMemory *
+gst_shm_src_get_fd_memory (GstShmSrc * self, struct GstShmBuffer *gsb,
+    gsize size)
+{
+  GstMemory *memory;
+  gint fd, area_id;
+  gsize area_size;
+  gulong offset;
+
+  GST_OBJECT_LOCK (self);
+  fd = sp_client_get_buf_fd (gsb->pipe->pipe, gsb->buf, &area_id, &area_size,
+      &offset);
+  GST_OBJECT_UNLOCK (self);
+
+  if (fd < 0 || offset + size > area_size)
+    return NULL;
+
+  /* The fd belongs to the area, which stays open until the buffer is
+   * released */
+  memory = gst_fd_allocator_alloc (self->fd_allocator, fd, offset + size,
+      GST_FD_MEMORY_FLAG_DONT_CLOSE);
+  if (!memory)
+    return NULL;
+
+  gst_memory_resize (memory, offset, size);
+  GST_MINI_OBJECT_FLAG_SET (memory, GST_MEMORY_FLAG_READONLY);
+
+  gsb->offset = offset;
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (memory),
+      gst_shm_buffer_quark, gsb, free_buffer);
+
+  return memory;
+}
+
 static GstFlowReturn
 gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
 {
@@ -326,6 +439,7 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gchar *buf = NULL;
   int rv = 0;
   struct GstShmBuffer *gsb;
+  GstMemory *memory;
 
   GST_DEBUG_OBJECT (self, "Stopping %p", self);
 
@@ -340,41 +454,61 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   GST_OBJECT_UNLOCK (self);
 
   do {
-    if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
-      if (errno == EBUSY)
+    gboolean can_wait;
+
+    /* With a ring, only wait once it is empty */
+    GST_OBJECT_LOCK (self);
+    can_wait = sp_client_prepare_wait (pipe->pipe);
+    GST_OBJECT_UNLOCK (self);
+
+    if (can_wait) {
+      if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
+        if (errno == EBUSY)
+          goto flushing;
+        GST_ELEMENT_ERROR (self, RESOURCE, READ,
+            ("Failed to read from shmsrc"),
+            ("Poll failed on fd: %s", strerror (errno)));
+        goto error;
+      }
+
+      if (self->unlocked)
         goto flushing;
-      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-          ("Poll failed on fd: %s", strerror (errno)));
-      goto error;
-    }
 
-    if (self->unlocked)
-      goto flushing;
+      if (gst_poll_fd_has_closed (self->poll, &self->pollfd)) {
+        GST_ELEMENT_ERROR (self, RESOURCE, READ,
+            ("Failed to read from shmsrc"), ("Control socket has closed"));
+        goto error;
+      }
 
-    if (gst_poll_fd_has_closed (self->poll, &self->pollfd)) {
-      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-          ("Control socket has closed"));
-      goto error;
+      if (gst_poll_fd_has_error (self->poll, &self->pollfd)) {
+        GST_ELEMENT_ERROR (self, RESOURCE, READ,
+            ("Failed to read from shmsrc"), ("Control socket has error"));
+        goto error;
+      }
+
+      if (!gst_poll_fd_can_read (self->poll, &self->pollfd) &&
+          !(self->ringpollfd.fd >= 0 &&
+              gst_poll_fd_can_read (self->poll, &self->ringpollfd)))
+        continue;
     }
 
-    if (gst_poll_fd_has_error (self->poll, &self->pollfd)) {
+    buf = NULL;
+    GST_LOG_OBJECT (self, "Reading from pipe");
+    GST_OBJECT_LOCK (self);
+    rv = sp_client_recv (pipe->pipe, &buf);
+    if (rv >= 0 && self->ringpollfd.fd < 0 &&
+        sp_client_get_ring_fd (pipe->pipe) >= 0) {
+      GST_DEBUG_OBJECT (self, "Receiving buffers through a ring");
+      self->ringpollfd.fd = sp_client_get_ring_fd (pipe->pipe);
+      gst_poll_add_fd (self->poll, &self->ringpollfd);
+      gst_poll_fd_ctl_read (self->poll, &self->ringpollfd, TRUE);
+    }
+    GST_OBJECT_UNLOCK (self);
+    if (rv < 0) {
       GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-          ("Control socket has error"));
+          ("Error reading control data: %d", rv));
       goto error;
     }
-
-    if (gst_poll_fd_can_read (self->poll, &self->pollfd)) {
-      buf = NULL;
-      GST_LOG_OBJECT (self, "Reading from pipe");
-      GST_OBJECT_LOCK (self);
-      rv = sp_client_recv (pipe->pipe, &buf);
-      GST_OBJECT_UNLOCK (self);
-      if (rv < 0) {
-        GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
-            ("Error reading control data: %d", rv));
-        goto error;
-      }
-    }
   } while (buf == NULL);
 
   GST_LOG_OBJECT (self, "Got buffer %p of size %d", buf, rv);
@@ -383,8 +517,14 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gsb->buf = buf;
   gsb->pipe = pipe;
 
-  *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
-      buf, rv, 0, rv, gsb, free_buffer);
+  memory = gst_shm_src_get_fd_memory (self, gsb, rv);
+  if (memory) {
+    *outbuf = gst_buffer_new ();
+    gst_buffer_append_memory (*outbuf, memory);
+  } else {
+    *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        buf, rv, 0, rv, gsb, free_buffer);
+  }
 
   return GST_FLOW_OK;
 
@@ -471,6 +611,9 @@ gst_shm_pipe_dec (GstShmPipe * pipe)
 
   gst_poll_remove_fd (pipe->src->poll, &pipe->src->pollfd);
   gst_poll_fd_init (&pipe->src->pollfd);
+  if (pipe->src->ringpollfd.fd >= 0)
+    gst_poll_remove_fd (pipe->src->poll, &pipe->src->ringpollfd);
+  gst_poll_fd_init (&pipe->src->ringpollfd);
 
   GST_OBJECT_UNLOCK (pipe->src);
 
@@ -52,10 +52,14 @@ struct _GstShmSrc
   GstShmPipe *pipe;
   GstPoll *poll;
   GstPollFD pollfd;
+  /* Readable when the ring got new buffers */
+  GstPollFD ringpollfd;
 
 
   GstFlowReturn flow_return;
   gboolean unlocked;
+
+  GstAllocator *fd_allocator;
 };
 
 struct _GstShmSrcClass
@@ -23,6 +23,7 @@
  */
 
 
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -33,19 +34,53 @@
 #include <string.h>
 #include <assert.h>
 
+/* The space is handed out in granules, the last one possibly shorter than
+ * the others, so that at most one block starts in each of them and a block
+ * can be found from its offset without walking all the blocks. A granule is
+ * a cache line, which bounds the space lost on small buffers while keeping
+ * the table of block starts, one pointer per granule, at an eighth of the
+ * size of the area.
+ *
+ * Free blocks are kept in segregated lists as in TLSF: the first level
+ * splits the sizes in powers of two, the second level splits each power of
+ * two in SL_COUNT ranges. Bitmaps of the non-empty lists give a free block
+ * that is large enough in constant time. Each block also knows its
+ * neighbours in the space, free or not, so that freed blocks are merged in
+ * constant time too. */
+
+#define GRANULE_SHIFT 6
+#define GRANULE (1UL << GRANULE_SHIFT)
+
+#define SL_SHIFT 4
+#define SL_COUNT (1 << SL_SHIFT)
+#define FL_COUNT (sizeof (unsigned long) * 8 - SL_SHIFT + 1)
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
+  /* The number of granules in it */
+  unsigned long n_granules;
+
+  /* The block starting in each granule, free or not */
+  ShmAllocBlock **starts;
+
+  /* The free lists and which of them are not empty */
+  unsigned long fl_bitmap;
+  unsigned int sl_bitmap[FL_COUNT];
+  ShmAllocBlock *free_lists[FL_COUNT][SL_COUNT];
 
-  /* chained list of the blocks contained in this space */
-  ShmAllocBlock *blocks;
+  /* Statistics */
+  unsigned int n_blocks;
+  unsigned int n_free_blocks;
+  size_t used;
 };
 
-/* A single block of data */
+/* A single block of data, or of free space */
 struct _ShmAllocBlock
 {
+  /* 0 if the block is free */
   int use_count;
 
   /* Pointer back to the AllocSpace where this block is */
@@ -53,13 +88,165 @@ struct _ShmAllocBlock
 
   /* The offset of this block in the alloc space */
   unsigned long offset;
-  /* The size of the block */
+  /* The size of the block as requested */
   unsigned long size;
+  /* The size of the block in granules */
+  unsigned long n_granules;
 
-  /* Pointer to the next block in the chain */
-  ShmAllocBlock *next;
+  /* The blocks before and after this one in the space */
+  ShmAllocBlock *prev_phys;
+  ShmAllocBlock *next_phys;
+
+  /* The other blocks in the same free list, if free */
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
 };
 
+static inline unsigned int
+find_first_set (unsigned long word)
+{
+#ifdef __GNUC__
+  return __builtin_ctzl (word);
+#else
+  unsigned int bit = 0;
+
+  while (!(word & 1)) {
+    word >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+static inline unsigned int
+find_last_set (unsigned long word)
+{
+#ifdef __GNUC__
+  return sizeof (unsigned long) * 8 - 1 - __builtin_clzl (word);
+#else
+  unsigned int bit = 0;
+
+  while (word >>= 1)
+    bit++;
+  return bit;
+#endif
+}
+
+/* The free list that blocks of @n_granules go in */
+static void
+mapping_insert (unsigned long n_granules, unsigned int *fl, unsigned int *sl)
+{
+  if (n_granules < SL_COUNT) {
+    *fl = 0;
+    *sl = n_granules;
+  } else {
+    unsigned int last = find_last_set (n_granules);
+
+    *fl = last - SL_SHIFT + 1;
+    *sl = (n_granules >> (last - SL_SHIFT)) ^ SL_COUNT;
+  }
+}
+
+/* The first free list whose blocks all have at least @n_granules */
+static void
+mapping_search (unsigned long n_granules, unsigned int *fl, unsigned int *sl)
+{
+  if (n_granules >= SL_COUNT)
+    n_granules += (1UL << (find_last_set (n_granules) - SL_SHIFT)) - 1;
+
+  mapping_insert (n_granules, fl, sl);
+}
+
+static void
+insert_free_block (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  unsigned int fl, sl;
+
+  mapping_insert (block->n_granules, &fl, &sl);
+
+  block->prev_free = NULL;
+  block->next_free = self->free_lists[fl][sl];
+  if (block->next_free)
+    block->next_free->prev_free = block;
+  self->free_lists[fl][sl] = block;
+
+  self->fl_bitmap |= 1UL << fl;
+  self->sl_bitmap[fl] |= 1U << sl;
+  self->n_free_blocks++;
+}
+
+static void
+remove_free_block (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  unsigned int fl, sl;
+
+  mapping_insert (block->n_granules, &fl, &sl);
+
+  if (block->prev_free)
+    block->prev_free->next_free = block->next_free;
+  else
+    self->free_lists[fl][sl] = block->next_free;
+  if (block->next_free)
+    block->next_free->prev_free = block->prev_free;
+
+  if (!self->free_lists[fl][sl]) {
+    self->sl_bitmap[fl] &= ~(1U << sl);
+    if (!self->sl_bitmap[fl])
+      self->fl_bitmap &= ~(1UL << fl);
+  }
+  self->n_free_blocks--;
+}
+
+/* A free block of at least @n_granules, or NULL */
+static ShmAllocBlock *
+find_free_block (ShmAllocSpace * self, unsigned long n_granules)
+{
+  ShmAllocBlock *block;
+  unsigned int fl, sl;
+  unsigned long fl_map = 0;
+  unsigned int sl_map = 0;
+
+  mapping_search (n_granules, &fl, &sl);
+
+  if (fl < FL_COUNT) {
+    sl_map = self->sl_bitmap[fl] & (~0U << sl);
+    if (fl + 1 < FL_COUNT)
+      fl_map = self->fl_bitmap & (~0UL << (fl + 1));
+  }
+
+  if (!sl_map) {
+    if (!fl_map)
+      goto no_block;
+    fl = find_first_set (fl_map);
+    sl_map = self->sl_bitmap[fl];
+  }
+  sl = find_first_set (sl_map);
+
+  return self->free_lists[fl][sl];
+
+no_block:
+  /* The list the request maps to can still have a block that is large
+   * enough, this only happens when the space is nearly full */
+  mapping_insert (n_granules, &fl, &sl);
+  for (block = self->free_lists[fl][sl]; block; block = block->next_free) {
+    if (block->n_granules >= n_granules)
+      return block;
+  }
+
+  return NULL;
+}
+
+/* The bytes covered by @block, the last granule can be short */
+static inline unsigned long
+block_extent (ShmAllocBlock * block)
+{
+  unsigned long extent = block->n_granules << GRANULE_SHIFT;
+
+  if (block->offset + extent > block->space->size)
+    extent = block->space->size - block->offset;
+
+  return extent;
+}
 
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
@@ -69,6 +256,20 @@ shm_alloc_space_new (size_t size)
   memset (self, 0, sizeof (ShmAllocSpace));
 
   self->size = size;
+  self->n_granules = (size + GRANULE - 1) >> GRANULE_SHIFT;
+
+  if (self->n_granules > 0) {
+    ShmAllocBlock *block = spalloc_new (ShmAllocBlock);
+
+    self->starts = spalloc_alloc (self->n_granules * sizeof (ShmAllocBlock *));
+    memset (self->starts, 0, self->n_granules * sizeof (ShmAllocBlock *));
+
+    memset (block, 0, sizeof (ShmAllocBlock));
+    block->space = self;
+    block->n_granules = self->n_granules;
+    self->starts[0] = block;
+    insert_free_block (self, block);
+  }
 
   return self;
 }
@@ -76,7 +277,19 @@ shm_alloc_space_new (size_t size)
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  assert (self && self->n_blocks == 0);
+
+  if (self->n_granules > 0) {
+    ShmAllocBlock *block = self->starts[0];
+
+    /* All the space is one free block again */
+    assert (block && block->n_granules == self->n_granules);
+    remove_free_block (self, block);
+    spalloc_free (ShmAllocBlock, block);
+
+    spalloc_free1 (self->n_granules * sizeof (ShmAllocBlock *), self->starts);
+  }
+
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -85,42 +298,46 @@ ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
   ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
-
+  unsigned long n_granules;
 
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
+  n_granules = (size + GRANULE - 1) >> GRANULE_SHIFT;
+  if (n_granules == 0)
+    n_granules = 1;
 
-    max_size = item->offset - prev_end_offset;
+  /* Return NULL if there is no big enough space */
+  if (n_granules > self->n_granules)
+    return NULL;
 
-    if (max_size >= size)
-      break;
+  block = find_free_block (self, n_granules);
+  if (!block || block->offset + size > self->size)
+    return NULL;
 
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
+  remove_free_block (self, block);
+
+  /* Give the rest back */
+  if (block->n_granules > n_granules) {
+    ShmAllocBlock *rest = spalloc_new (ShmAllocBlock);
+
+    memset (rest, 0, sizeof (ShmAllocBlock));
+    rest->space = self;
+    rest->offset = block->offset + (n_granules << GRANULE_SHIFT);
+    rest->n_granules = block->n_granules - n_granules;
+    rest->prev_phys = block;
+    rest->next_phys = block->next_phys;
+    if (rest->next_phys)
+      rest->next_phys->prev_phys = rest;
+    block->next_phys = rest;
+    block->n_granules = n_granules;
+
+    self->starts[rest->offset >> GRANULE_SHIFT] = rest;
+    insert_free_block (self, rest);
   }
 
-  /* Return NULL if there is no big enough space, otherwise, there is space
-   * at the end */
-  assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
-    return NULL;
-
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
   block->size = size;
   block->use_count = 1;
-  block->space = self;
-
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
 
-  block->next = item;
+  self->n_blocks++;
+  self->used += block_extent (block);
 
   return block;
 }
@@ -131,40 +348,89 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
   return block->offset;
 }
 
+/* Merges @next into @block, which comes right before it */
+static void
+merge_blocks (ShmAllocSpace * self, ShmAllocBlock * block,
+    ShmAllocBlock * next)
+{
+  block->n_granules += next->n_granules;
+  block->next_phys = next->next_phys;
+  if (block->next_phys)
+    block->next_phys->prev_phys = block;
+
+  self->starts[next->offset >> GRANULE_SHIFT] = NULL;
+  spalloc_free (ShmAllocBlock, next);
+}
+
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
 
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  self->n_blocks--;
+  self->used -= block_extent (block);
+  block->size = 0;
+
+  if (block->next_phys && block->next_phys->use_count == 0) {
+    remove_free_block (self, block->next_phys);
+    merge_blocks (self, block, block->next_phys);
+  }
+
+  if (block->prev_phys && block->prev_phys->use_count == 0) {
+    ShmAllocBlock *prev = block->prev_phys;
+
+    remove_free_block (self, prev);
+    merge_blocks (self, prev, block);
+    block = prev;
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  insert_free_block (self, block);
 }
 
+/* Only looks at the granules between the start of the block and @offset,
+ * so this is constant time for the offsets shmsink sends, which are the
+ * start of a block plus some alignment. */
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
   ShmAllocBlock *block = NULL;
+  unsigned long granule = offset >> GRANULE_SHIFT;
 
-  for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
-      return block;
-  }
+  if (granule >= self->n_granules)
+    return NULL;
+
+  while (!(block = self->starts[granule]))
+    granule--;
+
+  if (block->use_count > 0 && offset < block->offset + block->size)
+    return block;
 
   return NULL;
 }
 
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats)
+{
+  memset (stats, 0, sizeof (ShmAllocStats));
+
+  stats->size = self->size;
+  stats->used = self->used;
+  stats->n_blocks = self->n_blocks;
+  stats->n_free_blocks = self->n_free_blocks;
+
+  /* The largest free block is in the last non-empty list */
+  if (self->fl_bitmap) {
+    unsigned int fl = find_last_set (self->fl_bitmap);
+    unsigned int sl = find_last_set (self->sl_bitmap[fl]);
+    ShmAllocBlock *block;
+
+    for (block = self->free_lists[fl][sl]; block; block = block->next_free) {
+      if (block_extent (block) > stats->largest_free)
+        stats->largest_free = block_extent (block);
+    }
+  }
+}
+
 
 void
 shm_alloc_space_block_inc (ShmAllocBlock * block)
@@ -53,6 +53,17 @@ extern "C" {
 typedef struct _ShmAllocSpace ShmAllocSpace;
 typedef struct _ShmAllocBlock ShmAllocBlock;
 
+typedef struct
+{
+  /* The size of the space, and the part of it used by blocks */
+  size_t size;
+  size_t used;
+  /* The size of the largest block that could be allocated */
+  size_t largest_free;
+  unsigned int n_blocks;
+  unsigned int n_free_blocks;
+} ShmAllocStats;
+
 ShmAllocSpace *shm_alloc_space_new (size_t size);
 void shm_alloc_space_free (ShmAllocSpace * self);
 
@@ -66,6 +77,8 @@ void shm_alloc_space_block_dec (ShmAllocBlock * block);
 ShmAllocBlock * shm_alloc_space_block_get (ShmAllocSpace * space,
     unsigned long offset);
 
+void shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats);
+
 
 #ifdef __cplusplus
 }
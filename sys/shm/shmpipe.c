@@ -27,6 +27,11 @@
 #include "config.h"
 #endif
 
+/* for memfd_create() and the seals */
+#if defined (HAVE_MEMFD_CREATE) && !defined (_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_OSX
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL SO_NOSIGPIPE
@@ -47,6 +52,11 @@
 #include <sys/mman.h>
 #include <assert.h>
 
+#if defined (HAVE_SYS_EVENTFD_H) && defined (__ATOMIC_SEQ_CST)
+#include <sys/eventfd.h>
+#define SHM_PIPE_HAVE_RING 1
+#endif
+
 #include "shmalloc.h"
 
 /*
@@ -55,7 +65,8 @@
  * The defined types are:
  * type 1: new shm area
  * Area length
- * Size of path (followed by path)
+ * Size of path (followed by path, if not 0)
+ * A read-only fd of the area is attached as SCM_RIGHTS
  *
  * type 2: Close shm area:
  * No payload
@@ -67,9 +78,18 @@
  * type 4: ack buffer
  * offset
  *
+ * type 5: new ring
+ * number of slots
+ * The ring memory, then the eventfds signalling new buffers and new acks
+ * are attached as SCM_RIGHTS
+ *
  * Type 4 goes from the client to the server
  * The rest are from the server to the client
  * The client should never write in the SHM
+ *
+ * Once a client got a ring, new buffers go in the buffer ring and acks in
+ * the ack ring instead of types 3 and 4, see ShmRingHeader. The socket is
+ * still used for the shm areas and acks the ring had no space for.
  */
 
 
@@ -80,7 +100,73 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_RING = 5
+};
+
+#define RING_MAX_SLOTS (1 << 16)
+#define RING_N_FDS 3
+/* Most fds attached to a command */
+#define MAX_FDS RING_N_FDS
+
+/*
+ * Each ring has a single producer and a single consumer and lives in
+ * memory shared by the writer and one client. The consumer sets "waiting"
+ * before it sleeps on its eventfd, the producer only writes to the eventfd
+ * if that flag was set, so there is no syscall as long as both sides keep
+ * up. The producer can take back the oldest slot the consumer has not
+ * read yet, so both sides advance "tail" with a compare-and-swap.
+ */
+typedef struct
+{
+  /* Next slot to fill, only written by the producer */
+  uint32_t head;
+  uint32_t pad0[15];
+  /* Next slot to read, see sp_ring_reclaim() */
+  uint32_t tail;
+  /* Set by the consumer when it is about to sleep */
+  uint32_t waiting;
+  uint32_t pad1[14];
+} ShmRingIndices;
+
+typedef struct
+{
+  int32_t area_id;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+} ShmRingSlot;
+
+typedef struct
+{
+  uint32_t n_slots;
+  uint32_t pad[15];
+  /* From the writer to the client */
+  ShmRingIndices buffers;
+  /* From the client to the writer */
+  ShmRingIndices acks;
+  /* Followed by n_slots buffer slots, then n_slots ack slots */
+} ShmRingHeader;
+
+typedef struct _ShmRing ShmRing;
+
+struct _ShmRing
+{
+  int shm_fd;
+  ShmRingHeader *header;
+  size_t len;
+  uint32_t n_slots;
+
+  /* The ring this side produces and the one it consumes */
+  ShmRingIndices *out;
+  ShmRingSlot *out_slots;
+  ShmRingIndices *in;
+  ShmRingSlot *in_slots;
+
+  /* Readable when there is something in "in" while we wait */
+  int wakeup_fd;
+  /* Written when the other side waits for "out" */
+  int notify_fd;
 };
 
 typedef struct _ShmArea ShmArea;
@@ -93,6 +179,8 @@ struct _ShmArea
   int is_writer;
 
   int shm_fd;
+  /* The read-only fd sent to the clients, for a writer */
+  int client_fd;
 
   char *shm_area_buf;
   size_t shm_area_len;
@@ -141,12 +229,29 @@ struct _ShmPipe
   ShmClient *clients;
 
   mode_t perms;
+
+  /* Number of ring slots for new clients, 0 to not use rings */
+  unsigned int ring_size;
+  /* Most buffers and bytes a client can hold, 0 for no limit */
+  unsigned int client_max_buffers;
+  size_t client_max_bytes;
+  /* On the client side, the ring shared with the writer */
+  ShmRing *ring;
 };
 
 struct _ShmClient
 {
   int fd;
 
+  ShmRing *ring;
+  /* Buffers sent to this client and not acked yet */
+  unsigned int n_pending;
+  size_t bytes_pending;
+  /* Buffers not sent or taken back because the client was full */
+  unsigned long n_dropped;
+  /* Set once the writer gave up on the client */
+  int shut_down;
+
   ShmClient *next;
 };
 
@@ -179,14 +284,20 @@ struct CommandBuffer
     {
       unsigned long offset;
     } ack_buffer;
+    struct
+    {
+      unsigned int n_slots;
+    } ring;
   } payload;
 };
 
-static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size);
+static ShmArea *sp_open_shm (char *path, int fd, int id, mode_t perms,
+    size_t size);
 static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
     ShmBuffer * prev_buf, ShmClient * client, void **tag);
 static void sp_shm_area_dec (ShmPipe * self, ShmArea * area);
+static void sp_ring_free (ShmRing * ring);
 
 
 
@@ -244,7 +355,7 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
   if (listen (self->main_socket, LISTEN_BACKLOG) < 0)
     RETURN_ERROR ("listen() failed (%d): %s\n", errno, strerror (errno));
 
-  self->shm_area = sp_open_shm (NULL, ++self->next_area_id, perms, size);
+  self->shm_area = sp_open_shm (NULL, -1, ++self->next_area_id, perms, size);
 
   self->perms = perms;
 
@@ -263,16 +374,51 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
   return NULL;                                            \
   } while (0)
 
+#ifdef HAVE_MEMFD_CREATE
+
+/* Returns a new memfd, and in @ro_fd another fd of the same memory that
+ * can only be used to read it */
+static int
+sp_create_memfd (int *ro_fd)
+{
+  char procpath[32];
+  int flags = MFD_CLOEXEC;
+  int fd;
+
+#ifdef MFD_ALLOW_SEALING
+  flags |= MFD_ALLOW_SEALING;
+#endif
+
+  fd = memfd_create ("shmpipe", flags);
+  if (fd < 0)
+    return -1;
+
+  /* Opening it again is the only way to get a file description that is
+   * not writable */
+  snprintf (procpath, sizeof (procpath), "/proc/self/fd/%d", fd);
+  *ro_fd = open (procpath, O_RDONLY | O_CLOEXEC);
+  if (*ro_fd < 0) {
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+#endif
+
 /**
  * sp_open_shm:
  * @path: Path of the shm area for a reader,
- *  NULL if this is a writer (then it will allocate its own path)
+ *  NULL if this is a writer (then it will allocate its own memory)
+ * @fd: The fd of the shm area for a reader, used instead of @path,
+ *  or -1
  *
  * Opens a ShmArea
  */
 
 static ShmArea *
-sp_open_shm (char *path, int id, mode_t perms, size_t size)
+sp_open_shm (char *path, int fd, int id, mode_t perms, size_t size)
 {
   ShmArea *area = spalloc_new (ShmArea);
   char tmppath[32];
@@ -287,10 +433,10 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
 
   area->shm_area_len = size;
 
-  area->is_writer = (path == NULL);
+  area->is_writer = (path == NULL && fd < 0);
 
 
-  if (path)
+  if (!area->is_writer)
     flags = O_RDONLY;
   else
 #ifdef HAVE_OSX
@@ -300,30 +446,60 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
 #endif
 
   area->shm_fd = -1;
+  area->client_fd = -1;
+  tmppath[0] = 0;
 
-  if (path) {
+  if (fd >= 0) {
+    area->shm_fd = fd;
+  } else if (path) {
     area->shm_fd = shm_open (path, flags, perms);
   } else {
-    do {
-      snprintf (tmppath, sizeof (tmppath), "/shmpipe.%5d.%5d", getpid (), i++);
-      area->shm_fd = shm_open (tmppath, flags, perms);
-    } while (area->shm_fd < 0 && errno == EEXIST);
+#ifdef HAVE_MEMFD_CREATE
+    area->shm_fd = sp_create_memfd (&area->client_fd);
+    if (area->shm_fd < 0)
+#endif
+      do {
+        snprintf (tmppath, sizeof (tmppath), "/shmpipe.%5d.%5d", getpid (),
+            i++);
+        area->shm_fd = shm_open (tmppath, flags, perms);
+      } while (area->shm_fd < 0 && errno == EEXIST);
   }
 
   if (area->shm_fd < 0)
     RETURN_ERROR ("shm_open failed on %s (%d): %s\n",
         path ? path : tmppath, errno, strerror (errno));
 
-  if (!path) {
-    area->shm_area_name = strdup (tmppath);
+  if (area->is_writer) {
+    /* There is no name for a memfd, the clients get the fd */
+    if (tmppath[0])
+      area->shm_area_name = strdup (tmppath);
 
     if (ftruncate (area->shm_fd, size))
       RETURN_ERROR ("Could not resize memory area to header size,"
           " ftruncate failed (%d): %s\n", errno, strerror (errno));
 
+#if defined (HAVE_MEMFD_CREATE) && defined (F_ADD_SEALS)
+    /* So that the clients know they can't get SIGBUS from it */
+    if (area->client_fd >= 0)
+      fcntl (area->shm_fd, F_ADD_SEALS,
+          F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+
+    /* The clients can still use the path if this fails */
+    if (area->client_fd < 0)
+      area->client_fd = shm_open (tmppath, O_RDONLY, perms);
+
     prot = PROT_READ | PROT_WRITE;
   } else {
-    area->shm_area_name = strdup (path);
+    struct stat st;
+
+    if (path)
+      area->shm_area_name = strdup (path);
+
+    if (fstat (area->shm_fd, &st) < 0 || st.st_size < (off_t) size)
+      RETURN_ERROR ("shm area is smaller than %lu bytes (%d): %s\n",
+          (unsigned long) size, errno, strerror (errno));
+
     prot = PROT_READ;
   }
 
@@ -356,6 +532,9 @@ sp_close_shm (ShmArea * area)
   if (area->shm_fd >= 0)
     close (area->shm_fd);
 
+  if (area->client_fd >= 0)
+    close (area->client_fd);
+
   if (area->shm_area_name) {
     if (area->is_writer)
       shm_unlink (area->shm_area_name);
@@ -426,6 +605,9 @@ sp_dec (ShmPipe * self)
   while (self->shm_area)
     sp_shm_area_dec (self, self->shm_area);
 
+  if (self->ring)
+    sp_ring_free (self->ring);
+
   spalloc_free (ShmPipe, self);
 }
 
@@ -471,6 +653,287 @@ sp_writer_setperms_shm (ShmPipe * self, mode_t perms)
   return ret;
 }
 
+#ifdef SHM_PIPE_HAVE_RING
+
+static int
+sp_ring_map (ShmRing * ring, int prot)
+{
+  char *slots;
+
+  ring->header = mmap (NULL, ring->len, prot, MAP_SHARED, ring->shm_fd, 0);
+  if (ring->header == MAP_FAILED)
+    return -1;
+
+  slots = (char *) ring->header + sizeof (ShmRingHeader);
+  ring->out_slots = (ShmRingSlot *) slots;
+  ring->in_slots = (ShmRingSlot *) slots + ring->n_slots;
+
+  return 0;
+}
+
+/* Creates the ring of a new client, on the writer side */
+static ShmRing *
+sp_ring_new (unsigned int n_slots)
+{
+  ShmRing *ring = spalloc_new (ShmRing);
+  char tmppath[32];
+  int i = 0;
+
+  memset (ring, 0, sizeof (ShmRing));
+  ring->header = MAP_FAILED;
+  ring->wakeup_fd = -1;
+  ring->notify_fd = -1;
+  ring->n_slots = n_slots;
+  ring->len = sizeof (ShmRingHeader) + 2 * n_slots * sizeof (ShmRingSlot);
+
+  do {
+    snprintf (tmppath, sizeof (tmppath), "/shmpipe-ring.%5d.%5d", getpid (),
+        i++);
+    ring->shm_fd = shm_open (tmppath, O_RDWR | O_CREAT | O_EXCL,
+        S_IRUSR | S_IWUSR);
+  } while (ring->shm_fd < 0 && errno == EEXIST);
+
+  if (ring->shm_fd < 0)
+    goto error;
+
+  /* Only the client that gets the fd can open it */
+  shm_unlink (tmppath);
+
+  if (ftruncate (ring->shm_fd, ring->len))
+    goto error;
+
+  if (sp_ring_map (ring, PROT_READ | PROT_WRITE) < 0)
+    goto error;
+
+  ring->header->n_slots = n_slots;
+  ring->out = &ring->header->buffers;
+  ring->in = &ring->header->acks;
+
+  ring->wakeup_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ring->notify_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ring->wakeup_fd < 0 || ring->notify_fd < 0)
+    goto error;
+
+  return ring;
+
+error:
+  fprintf (stderr, "Could not create ring (%d): %s\n", errno,
+      strerror (errno));
+  sp_ring_free (ring);
+  return NULL;
+}
+
+/* Maps the ring received from the writer, takes ownership of the fds */
+static ShmRing *
+sp_ring_open (int *fds, unsigned int n_slots)
+{
+  ShmRing *ring = spalloc_new (ShmRing);
+  struct stat st;
+  ShmRingSlot *slots;
+
+  memset (ring, 0, sizeof (ShmRing));
+  ring->header = MAP_FAILED;
+  ring->shm_fd = fds[0];
+  ring->wakeup_fd = fds[1];
+  ring->notify_fd = fds[2];
+  ring->n_slots = n_slots;
+  ring->len = sizeof (ShmRingHeader) + 2 * n_slots * sizeof (ShmRingSlot);
+
+  if (n_slots == 0 || n_slots > RING_MAX_SLOTS || (n_slots & (n_slots - 1)))
+    goto error;
+
+  if (fstat (ring->shm_fd, &st) < 0 || st.st_size < (off_t) ring->len)
+    goto error;
+
+  if (sp_ring_map (ring, PROT_READ | PROT_WRITE) < 0)
+    goto error;
+
+  if (ring->header->n_slots != n_slots)
+    goto error;
+
+  /* The other way around from the writer */
+  slots = ring->out_slots;
+  ring->out_slots = ring->in_slots;
+  ring->in_slots = slots;
+  ring->out = &ring->header->acks;
+  ring->in = &ring->header->buffers;
+
+  return ring;
+
+error:
+  sp_ring_free (ring);
+  return NULL;
+}
+
+static void
+sp_ring_free (ShmRing * ring)
+{
+  if (ring->header != MAP_FAILED)
+    munmap (ring->header, ring->len);
+  if (ring->shm_fd >= 0)
+    close (ring->shm_fd);
+  if (ring->wakeup_fd >= 0)
+    close (ring->wakeup_fd);
+  if (ring->notify_fd >= 0)
+    close (ring->notify_fd);
+
+  spalloc_free (ShmRing, ring);
+}
+
+/* Returns 0 if the ring is full */
+static int
+sp_ring_push (ShmRing * ring, int area_id, unsigned long offset,
+    unsigned long size)
+{
+  ShmRingSlot *slot;
+  uint32_t head = ring->out->head;
+  uint32_t tail = __atomic_load_n (&ring->out->tail, __ATOMIC_ACQUIRE);
+
+  if (head - tail >= ring->n_slots)
+    return 0;
+
+  slot = &ring->out_slots[head & (ring->n_slots - 1)];
+  slot->area_id = area_id;
+  slot->offset = offset;
+  slot->size = size;
+
+  __atomic_store_n (&ring->out->head, head + 1, __ATOMIC_RELEASE);
+
+  /* Pairs with the fence in sp_ring_prepare_wait(), either the consumer
+   * sees the new head or we see that it is waiting */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_exchange_n (&ring->out->waiting, 0, __ATOMIC_ACQ_REL)) {
+    uint64_t one = 1;
+
+    if (write (ring->notify_fd, &one, sizeof (one)) < 0)
+      fprintf (stderr, "Could not wake up the ring consumer (%d): %s\n",
+          errno, strerror (errno));
+  }
+
+  return 1;
+}
+
+/* Returns 1 and the next slot with its position, 0 if the ring is empty or
+ * -1 if the other side broke it */
+static int
+sp_ring_peek (ShmRing * ring, ShmRingSlot * slot, uint32_t * pos)
+{
+  uint32_t tail = __atomic_load_n (&ring->in->tail, __ATOMIC_ACQUIRE);
+  uint32_t head = __atomic_load_n (&ring->in->head, __ATOMIC_ACQUIRE);
+
+  if (head == tail)
+    return 0;
+
+  if (head - tail > ring->n_slots)
+    return -1;
+
+  *slot = ring->in_slots[tail & (ring->n_slots - 1)];
+  *pos = tail;
+  return 1;
+}
+
+/* Returns 0 if the producer took the slot at @pos back after we peeked
+ * it, the slot must then be ignored */
+static int
+sp_ring_consume (ShmRing * ring, uint32_t pos)
+{
+  return __atomic_compare_exchange_n (&ring->in->tail, &pos, pos + 1, 0,
+      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/* Takes back the oldest slot of the producer's ring that the consumer has
+ * not read yet. Returns 1 and that slot, 0 if there is none */
+static int
+sp_ring_reclaim (ShmRing * ring, ShmRingSlot * slot)
+{
+  uint32_t head = ring->out->head;
+  uint32_t tail = __atomic_load_n (&ring->out->tail, __ATOMIC_ACQUIRE);
+
+  /* Only we write the slots, so they can't change under us */
+  do {
+    if (head == tail || head - tail > ring->n_slots)
+      return 0;
+    *slot = ring->out_slots[tail & (ring->n_slots - 1)];
+  } while (!__atomic_compare_exchange_n (&ring->out->tail, &tail, tail + 1, 0,
+          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  return 1;
+}
+
+/* Returns 1 if the ring is empty and the producer will wake us up through
+ * wakeup_fd for the next slot */
+static int
+sp_ring_prepare_wait (ShmRing * ring)
+{
+  uint64_t count;
+
+  if (read (ring->wakeup_fd, &count, sizeof (count)) < 0 && errno != EAGAIN)
+    return 0;
+
+  __atomic_store_n (&ring->in->waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&ring->in->head, __ATOMIC_ACQUIRE) !=
+      __atomic_load_n (&ring->in->tail, __ATOMIC_RELAXED)) {
+    __atomic_store_n (&ring->in->waiting, 0, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  return 1;
+}
+
+#else
+
+static ShmRing *
+sp_ring_new (unsigned int n_slots)
+{
+  return NULL;
+}
+
+static ShmRing *
+sp_ring_open (int *fds, unsigned int n_slots)
+{
+  return NULL;
+}
+
+static void
+sp_ring_free (ShmRing * ring)
+{
+}
+
+static int
+sp_ring_push (ShmRing * ring, int area_id, unsigned long offset,
+    unsigned long size)
+{
+  return 0;
+}
+
+static int
+sp_ring_peek (ShmRing * ring, ShmRingSlot * slot, uint32_t * pos)
+{
+  return 0;
+}
+
+static int
+sp_ring_consume (ShmRing * ring, uint32_t pos)
+{
+  return 0;
+}
+
+static int
+sp_ring_reclaim (ShmRing * ring, ShmRingSlot * slot)
+{
+  return 0;
+}
+
+static int
+sp_ring_prepare_wait (ShmRing * ring)
+{
+  return 1;
+}
+
+#endif
+
 static int
 send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
     int area_id)
@@ -485,6 +948,71 @@ send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
   return 1;
 }
 
+static int
+send_command_with_fds (int fd, struct CommandBuffer *cb,
+    unsigned short int type, int area_id, int *fds, int n_fds)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE (sizeof (int) * MAX_FDS)];
+  } control;
+
+  assert (n_fds <= MAX_FDS);
+
+  cb->type = type;
+  cb->area_id = area_id;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE (sizeof (int) * n_fds);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int) * n_fds);
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * n_fds);
+
+  if (sendmsg (fd, &msg, MSG_NOSIGNAL) != sizeof (struct CommandBuffer))
+    return 0;
+
+  return 1;
+}
+
+static int
+send_new_shm_area (int fd, ShmArea * area)
+{
+  struct CommandBuffer cb = { 0 };
+  int pathlen = 0;
+
+  if (area->shm_area_name)
+    pathlen = strlen (area->shm_area_name) + 1;
+
+  cb.payload.new_shm_area.size = area->shm_area_len;
+  cb.payload.new_shm_area.path_size = pathlen;
+  if (area->client_fd >= 0) {
+    if (!send_command_with_fds (fd, &cb, COMMAND_NEW_SHM_AREA, area->id,
+            &area->client_fd, 1))
+      return 0;
+  } else {
+    if (!send_command (fd, &cb, COMMAND_NEW_SHM_AREA, area->id))
+      return 0;
+  }
+
+  if (pathlen &&
+      send (fd, area->shm_area_name, pathlen, MSG_NOSIGNAL) != pathlen)
+    return 0;
+
+  return 1;
+}
+
 int
 sp_writer_resize (ShmPipe * self, size_t size)
 {
@@ -492,12 +1020,11 @@ sp_writer_resize (ShmPipe * self, size_t size)
   ShmArea *old_current;
   ShmClient *client;
   int c = 0;
-  int pathlen;
 
   if (self->shm_area->shm_area_len == size)
     return 0;
 
-  newarea = sp_open_shm (NULL, ++self->next_area_id, self->perms, size);
+  newarea = sp_open_shm (NULL, -1, ++self->next_area_id, self->perms, size);
 
   if (!newarea)
     return -1;
@@ -506,8 +1033,6 @@ sp_writer_resize (ShmPipe * self, size_t size)
   newarea->next = self->shm_area;
   self->shm_area = newarea;
 
-  pathlen = strlen (newarea->shm_area_name) + 1;
-
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
 
@@ -515,13 +1040,7 @@ sp_writer_resize (ShmPipe * self, size_t size)
             old_current->id))
       continue;
 
-    cb.payload.new_shm_area.size = newarea->shm_area_len;
-    cb.payload.new_shm_area.path_size = pathlen;
-    if (!send_command (client->fd, &cb, COMMAND_NEW_SHM_AREA, newarea->id))
-      continue;
-
-    if (send (client->fd, newarea->shm_area_name, pathlen, MSG_NOSIGNAL) !=
-        pathlen)
+    if (!send_new_shm_area (client->fd, newarea))
       continue;
     c++;
   }
@@ -614,12 +1133,30 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   sb->tag = tag;
 
   for (client = self->clients; client; client = client->next) {
-    struct CommandBuffer cb = { 0 };
-    cb.payload.buffer.offset = offset;
-    cb.payload.buffer.size = bsize;
-    if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
+    if (client->shut_down)
+      continue;
+
+    if (sp_writer_client_is_full (self, client, size)) {
+      client->n_dropped++;
       continue;
+    }
+
+    if (client->ring) {
+      if (!sp_ring_push (client->ring, area->id, offset, bsize)) {
+        client->n_dropped++;
+        continue;
+      }
+    } else {
+      struct CommandBuffer cb = { 0 };
+      cb.payload.buffer.offset = offset;
+      cb.payload.buffer.size = bsize;
+      if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER,
+              self->shm_area->id))
+        continue;
+    }
     sb->clients[i++] = client->fd;
+    client->n_pending++;
+    client->bytes_pending += size;
     c++;
   }
 
@@ -652,6 +1189,67 @@ recv_command (int fd, struct CommandBuffer *cb)
   }
 }
 
+/* Like recv_command(), but also returns the fds sent with the command */
+static int
+recv_command_fds (int fd, struct CommandBuffer *cb, int *fds, int *n_fds)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE (sizeof (int) * MAX_FDS)];
+  } control;
+  int flags = MSG_DONTWAIT;
+  int retval;
+
+  *n_fds = 0;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+#ifdef MSG_CMSG_CLOEXEC
+  flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+  retval = recvmsg (fd, &msg, flags);
+  if (retval < 0)
+    return retval;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    int *received = (int *) CMSG_DATA (cmsg);
+    int i, n;
+
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+    for (i = 0; i < n; i++) {
+      if (*n_fds < MAX_FDS)
+        fds[(*n_fds)++] = received[i];
+      else
+        close (received[i]);
+    }
+  }
+
+  return retval;
+}
+
+static void
+close_fds (int *fds, int n_fds)
+{
+  int i;
+
+  for (i = 0; i < n_fds; i++)
+    close (fds[i]);
+}
+
 long int
 sp_client_recv (ShmPipe * self, char **buf)
 {
@@ -659,27 +1257,83 @@ sp_client_recv (ShmPipe * self, char **buf)
   ShmArea *newarea;
   ShmArea *area;
   struct CommandBuffer cb;
+  int fds[MAX_FDS];
+  int n_fds;
   int retval;
+  int unknown_area = 0;
+
+  if (self->ring) {
+    ShmRingSlot slot;
+    uint32_t pos;
+
+    /* Buffers from the ring come first, the socket only has the commands
+     * that were sent after them */
+  again:
+    retval = sp_ring_peek (self->ring, &slot, &pos);
+    if (retval < 0)
+      return -5;
+
+    if (retval > 0) {
+      for (area = self->shm_area; area; area = area->next) {
+        if (area->id == slot.area_id)
+          break;
+      }
+
+      if (area) {
+        /* The writer dropped it in the meantime */
+        if (!sp_ring_consume (self->ring, pos))
+          goto again;
+        if (slot.offset > area->shm_area_len ||
+            slot.size > area->shm_area_len - slot.offset)
+          return -23;
+        *buf = area->shm_area_buf + slot.offset;
+        sp_shm_area_inc (area);
+        return slot.size;
+      }
+
+      /* The new area is still waiting in the socket */
+      unknown_area = 1;
+    }
+  }
 
-  if (!recv_command (self->main_socket, &cb))
+  retval = recv_command_fds (self->main_socket, &cb, fds, &n_fds);
+  if (retval != sizeof (struct CommandBuffer)) {
+    close_fds (fds, n_fds);
+    /* With a ring, there is not always something to read */
+    if (self->ring && retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return unknown_area ? -23 : 0;
     return -1;
+  }
+
+  if (cb.type != COMMAND_NEW_RING && cb.type != COMMAND_NEW_SHM_AREA)
+    close_fds (fds, n_fds);
 
   switch (cb.type) {
     case COMMAND_NEW_SHM_AREA:
-      assert (cb.payload.new_shm_area.path_size > 0);
       assert (cb.payload.new_shm_area.size > 0);
 
-      area_name = malloc (cb.payload.new_shm_area.path_size + 1);
-      retval = recv (self->main_socket, area_name,
-          cb.payload.new_shm_area.path_size, 0);
-      if (retval != cb.payload.new_shm_area.path_size) {
-        free (area_name);
+      /* Older writers only send the path */
+      if (n_fds > 1) {
+        close_fds (fds + 1, n_fds - 1);
+        n_fds = 1;
+      }
+
+      if (cb.payload.new_shm_area.path_size > 0) {
+        area_name = malloc (cb.payload.new_shm_area.path_size + 1);
+        retval = recv (self->main_socket, area_name,
+            cb.payload.new_shm_area.path_size, 0);
+        if (retval != cb.payload.new_shm_area.path_size) {
+          free (area_name);
+          close_fds (fds, n_fds);
+          return -3;
+        }
+        /* Ensure area_name is NULL terminated */
+        area_name[retval] = 0;
+      } else if (n_fds == 0) {
         return -3;
       }
-      /* Ensure area_name is NULL terminated */
-      area_name[retval] = 0;
 
-      newarea = sp_open_shm (area_name, cb.area_id, 0,
+      newarea = sp_open_shm (area_name, n_fds ? fds[0] : -1, cb.area_id, 0,
           cb.payload.new_shm_area.size);
       free (area_name);
       if (!newarea)
@@ -709,6 +1363,17 @@ sp_client_recv (ShmPipe * self, char **buf)
       }
       return -23;
 
+    case COMMAND_NEW_RING:
+      if (n_fds != RING_N_FDS || self->ring) {
+        close_fds (fds, n_fds);
+        return -6;
+      }
+
+      self->ring = sp_ring_open (fds, cb.payload.ring.n_slots);
+      if (!self->ring)
+        return -7;
+      break;
+
     default:
       return -99;
   }
@@ -744,11 +1409,201 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
   return 0;
 }
 
+/* Finds the buffer at @offset in area @area_id that was sent to @client */
+static ShmBuffer *
+sp_writer_find_client_buffer (ShmPipe * self, ShmClient * client,
+    int area_id, unsigned long offset, ShmBuffer ** prev_buf)
+{
+  ShmBuffer *buf;
+  int i;
+
+  *prev_buf = NULL;
+  for (buf = self->buffers; buf; buf = buf->next) {
+    if (buf->shm_area->id == area_id && buf->offset == offset) {
+      for (i = 0; i < buf->num_clients; i++) {
+        if (buf->clients[i] == client->fd)
+          return buf;
+      }
+    }
+    *prev_buf = buf;
+  }
+
+  return NULL;
+}
+
+/* Handles all the acks in the ring of @client, calls @callback with the tag
+ * of the buffers that are not used anymore. Returns the number of acks or
+ * a negative value if the ring is broken. */
+int
+sp_writer_recv_acks (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void *user_data)
+{
+  ShmRingSlot slot;
+  uint32_t pos;
+  int n = 0;
+  int ret;
+
+  if (!client->ring)
+    return 0;
+
+  while ((ret = sp_ring_peek (client->ring, &slot, &pos)) > 0) {
+    ShmBuffer *buf = NULL, *prev_buf = NULL;
+    void *tag = NULL;
+
+    /* Nobody else consumes the acks */
+    sp_ring_consume (client->ring, pos);
+
+    buf = sp_writer_find_client_buffer (self, client, slot.area_id,
+        slot.offset, &prev_buf);
+    if (!buf)
+      return -2;
+
+    if (sp_shmbuf_dec (self, buf, prev_buf, client, &tag) == 0 && callback)
+      callback (tag, user_data);
+    n++;
+  }
+
+  if (ret < 0)
+    return -3;
+
+  return n;
+}
+
+/* Returns 1 if there is no ack waiting in any ring and the clients will
+ * wake up the fds from sp_writer_get_client_ring_fd() for the next one */
+int
+sp_writer_prepare_wait (ShmPipe * self)
+{
+  ShmClient *client;
+  int ret = 1;
+
+  for (client = self->clients; client; client = client->next) {
+    if (client->ring && !sp_ring_prepare_wait (client->ring))
+      ret = 0;
+  }
+
+  return ret;
+}
+
+/* Takes back the oldest buffer sent to @client that it has not read yet,
+ * which is only possible with a ring, calls @callback with its tag if it is
+ * not used anymore. Returns 1 if a buffer was dropped, 0 if there is none
+ * or a negative value on error. */
+int
+sp_writer_drop_oldest (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void *user_data)
+{
+  ShmBuffer *buf, *prev_buf = NULL;
+  ShmRingSlot slot;
+  void *tag = NULL;
+
+  if (!client->ring || !sp_ring_reclaim (client->ring, &slot))
+    return 0;
+
+  buf = sp_writer_find_client_buffer (self, client, slot.area_id,
+      slot.offset, &prev_buf);
+  if (!buf)
+    return -2;
+
+  client->n_dropped++;
+  if (sp_shmbuf_dec (self, buf, prev_buf, client, &tag) == 0 && callback)
+    callback (tag, user_data);
+
+  return 1;
+}
+
+int
+sp_writer_set_client_limits (ShmPipe * self, unsigned int max_buffers,
+    size_t max_bytes)
+{
+  self->client_max_buffers = max_buffers;
+  self->client_max_bytes = max_bytes;
+
+  return 0;
+}
+
+/* Returns 1 if @client can't take a buffer of @size more without going
+ * over its ring or the limits. A buffer over the byte limit still goes to
+ * a client that holds nothing. */
+int
+sp_writer_client_is_full (ShmPipe * self, ShmClient * client, size_t size)
+{
+  if (client->shut_down)
+    return 0;
+
+  if (client->ring && client->n_pending >= client->ring->n_slots)
+    return 1;
+
+  if (self->client_max_buffers &&
+      client->n_pending >= self->client_max_buffers)
+    return 1;
+
+  if (self->client_max_bytes && client->n_pending &&
+      client->bytes_pending + size > self->client_max_bytes)
+    return 1;
+
+  return 0;
+}
+
+/* Returns 0 if a client can't take a buffer of @size more */
+int
+sp_writer_can_send (ShmPipe * self, size_t size)
+{
+  ShmClient *client;
+
+  for (client = self->clients; client; client = client->next) {
+    if (sp_writer_client_is_full (self, client, size))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Stops sending to @client and closes its socket, the app then sees an
+ * error on it and calls sp_writer_close_client() as usual */
+void
+sp_writer_shutdown_client (ShmClient * client)
+{
+  client->shut_down = 1;
+  shutdown (client->fd, SHUT_RDWR);
+}
+
+void
+sp_writer_get_client_stats (ShmClient * client, ShmClientStats * stats)
+{
+  stats->n_pending = client->n_pending;
+  stats->bytes_pending = client->bytes_pending;
+  stats->n_dropped = client->n_dropped;
+}
+
+int
+sp_writer_set_ring_size (ShmPipe * self, unsigned int n_slots)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  unsigned int size = 1;
+
+  if (n_slots > RING_MAX_SLOTS)
+    return -1;
+
+  if (n_slots > 0) {
+    while (size < n_slots)
+      size <<= 1;
+    n_slots = size;
+  }
+
+  self->ring_size = n_slots;
+  return 0;
+#else
+  return n_slots ? -1 : 0;
+#endif
+}
+
 int
 sp_client_recv_finish (ShmPipe * self, char *buf)
 {
   ShmArea *shm_area = NULL;
   unsigned long offset;
+  int area_id;
   struct CommandBuffer cb = { 0 };
 
   for (shm_area = self->shm_area; shm_area; shm_area = shm_area->next) {
@@ -760,9 +1615,14 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
   assert (shm_area);
 
   offset = buf - shm_area->shm_area_buf;
+  area_id = shm_area->id;
 
   sp_shm_area_dec (self, shm_area);
 
+  /* The socket is only used if the ring is full */
+  if (self->ring && sp_ring_push (self->ring, area_id, offset, 0))
+    return 1;
+
   cb.payload.ack_buffer.offset = offset;
   return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER,
       self->shm_area->id);
@@ -811,7 +1671,6 @@ sp_writer_accept_client (ShmPipe * self)
   ShmClient *client = NULL;
   int fd;
   struct CommandBuffer cb = { 0 };
-  int pathlen = strlen (self->shm_area->shm_area_name) + 1;
 
 
   fd = accept (self->main_socket, NULL, NULL);
@@ -821,22 +1680,33 @@ sp_writer_accept_client (ShmPipe * self)
     return NULL;
   }
 
-  cb.payload.new_shm_area.size = self->shm_area->shm_area_len;
-  cb.payload.new_shm_area.path_size = pathlen;
-  if (!send_command (fd, &cb, COMMAND_NEW_SHM_AREA, self->shm_area->id)) {
+  if (!send_new_shm_area (fd, self->shm_area)) {
     fprintf (stderr, "Sending new shm area failed: %s", strerror (errno));
     goto error;
   }
 
-  if (send (fd, self->shm_area->shm_area_name, pathlen, MSG_NOSIGNAL) !=
-      pathlen) {
-    fprintf (stderr, "Sending new shm area path failed: %s", strerror (errno));
-    goto error;
-  }
-
   client = spalloc_new (ShmClient);
+  memset (client, 0, sizeof (ShmClient));
   client->fd = fd;
 
+  if (self->ring_size) {
+    int fds[RING_N_FDS];
+
+    client->ring = sp_ring_new (self->ring_size);
+    if (!client->ring)
+      goto error_client;
+
+    fds[0] = client->ring->shm_fd;
+    fds[1] = client->ring->notify_fd;
+    fds[2] = client->ring->wakeup_fd;
+    cb.payload.ring.n_slots = self->ring_size;
+    if (!send_command_with_fds (fd, &cb, COMMAND_NEW_RING, self->shm_area->id,
+            fds, RING_N_FDS)) {
+      fprintf (stderr, "Sending new ring failed: %s", strerror (errno));
+      goto error_client;
+    }
+  }
+
   /* Prepend ot linked list */
   client->next = self->clients;
   self->clients = client;
@@ -844,6 +1714,10 @@ sp_writer_accept_client (ShmPipe * self)
 
   return client;
 
+error_client:
+  if (client->ring)
+    sp_ring_free (client->ring);
+  spalloc_free (ShmClient, client);
 error:
   shutdown (fd, SHUT_RDWR);
   close (fd);
@@ -872,6 +1746,8 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
   }
   assert (had_client);
 
+  client->n_pending--;
+  client->bytes_pending -= buf->size;
   buf->use_count--;
 
   if (buf->use_count == 0) {
@@ -933,6 +1809,8 @@ again:
 
   self->num_clients--;
 
+  if (client->ring)
+    sp_ring_free (client->ring);
   spalloc_free (ShmClient, client);
 }
 
@@ -957,6 +1835,56 @@ sp_writer_get_client_fd (ShmClient * client)
   return client->fd;
 }
 
+int
+sp_writer_get_client_ring_fd (ShmClient * client)
+{
+  if (client->ring)
+    return client->ring->wakeup_fd;
+
+  return -1;
+}
+
+/* Returns the fd of the area that @buf is in, or -1 if there is none, and
+ * the offset of @buf in it */
+int
+sp_client_get_buf_fd (ShmPipe * self, char *buf, int *area_id,
+    size_t * area_size, unsigned long *offset)
+{
+  ShmArea *area;
+
+  for (area = self->shm_area; area; area = area->next) {
+    if (buf >= area->shm_area_buf &&
+        buf < area->shm_area_buf + area->shm_area_len) {
+      *area_id = area->id;
+      *area_size = area->shm_area_len;
+      *offset = buf - area->shm_area_buf;
+      return area->shm_fd;
+    }
+  }
+
+  return -1;
+}
+
+int
+sp_client_get_ring_fd (ShmPipe * self)
+{
+  if (self->ring)
+    return self->ring->wakeup_fd;
+
+  return -1;
+}
+
+/* Returns 1 if there is no buffer waiting in the ring and the writer will
+ * wake up the fd from sp_client_get_ring_fd() for the next one */
+int
+sp_client_prepare_wait (ShmPipe * self)
+{
+  if (!self->ring)
+    return 1;
+
+  return sp_ring_prepare_wait (self->ring);
+}
+
 int
 sp_writer_pending_writes (ShmPipe * self)
 {
@@ -995,3 +1923,14 @@ sp_writer_get_max_buf_size (ShmPipe * self)
 
   return self->shm_area->shm_area_len;
 }
+
+void
+sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats)
+{
+  if (self->shm_area == NULL || self->shm_area->allocspace == NULL) {
+    memset (stats, 0, sizeof (ShmAllocStats));
+    return;
+  }
+
+  shm_alloc_space_get_stats (self->shm_area->allocspace, stats);
+}
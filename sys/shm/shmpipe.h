@@ -46,6 +46,13 @@
  * for events on the client fd (the ones where sp_writer_recv() is
  * called), and then try to re-alloc.
  *
+ * sp_writer_send_buf() skips the clients that hold as many buffers as
+ * their ring or the limits from sp_writer_set_client_limits() allow, and
+ * counts them as dropped. The writer can check for those with
+ * sp_writer_client_is_full() first to wait, take back their oldest unread
+ * buffer with sp_writer_drop_oldest() or give up on them with
+ * sp_writer_shutdown_client().
+ *
  * The reader (client) connect to the writer with sp_client_open() And
  * select()s on the fd from sp_get_fd() until there is something to
  * read.  Then they must read using sp_client_recv() which will return
@@ -68,6 +75,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "shmalloc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -80,6 +88,15 @@ typedef struct _ShmBuffer ShmBuffer;
 
 typedef void (*sp_buffer_free_callback) (void * tag, void * user_data);
 
+typedef struct
+{
+  /* Buffers sent to the client and not acked yet, and their total size */
+  unsigned int n_pending;
+  size_t bytes_pending;
+  /* Buffers the client missed because it was full */
+  unsigned long n_dropped;
+} ShmClientStats;
+
 ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms);
 const char *sp_writer_get_path (ShmPipe *pipe);
 void sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
@@ -93,6 +110,8 @@ int sp_writer_resize (ShmPipe * self, size_t size);
 int sp_get_fd (ShmPipe * self);
 const char *sp_get_shm_area_name (ShmPipe *self);
 int sp_writer_get_client_fd (ShmClient * client);
+int sp_writer_get_client_ring_fd (ShmClient * client);
+int sp_writer_set_ring_size (ShmPipe * self, unsigned int n_slots);
 
 ShmBlock *sp_writer_alloc_block (ShmPipe * self, size_t size);
 void sp_writer_free_block (ShmBlock *block);
@@ -100,11 +119,25 @@ int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void * tag);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 size_t sp_writer_get_max_buf_size (ShmPipe * self);
+void sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats);
 
 ShmClient * sp_writer_accept_client (ShmPipe * self);
 void sp_writer_close_client (ShmPipe *self, ShmClient * client,
     sp_buffer_free_callback callback, void * user_data);
 int sp_writer_recv (ShmPipe * self, ShmClient * client, void ** tag);
+int sp_writer_recv_acks (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void * user_data);
+int sp_writer_prepare_wait (ShmPipe * self);
+int sp_writer_can_send (ShmPipe * self, size_t size);
+
+int sp_writer_set_client_limits (ShmPipe * self, unsigned int max_buffers,
+    size_t max_bytes);
+int sp_writer_client_is_full (ShmPipe * self, ShmClient * client,
+    size_t size);
+int sp_writer_drop_oldest (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void * user_data);
+void sp_writer_shutdown_client (ShmClient * client);
+void sp_writer_get_client_stats (ShmClient * client, ShmClientStats * stats);
 
 int sp_writer_pending_writes (ShmPipe * self);
 
@@ -115,6 +148,10 @@ void *sp_writer_buf_get_tag (ShmBuffer * buffer);
 ShmPipe *sp_client_open (const char *path);
 long int sp_client_recv (ShmPipe * self, char **buf);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
+int sp_client_get_buf_fd (ShmPipe * self, char *buf, int *area_id,
+    size_t * area_size, unsigned long *offset);
+int sp_client_get_ring_fd (ShmPipe * self);
+int sp_client_prepare_wait (ShmPipe * self);
 void sp_client_close (ShmPipe * self);
 
 #ifdef __cplusplus
@@ -0,0 +1,1285 @@
+/* GStreamer
+ *
+ * codecparsers.c: benchmark for the codec parsers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measures the H.264, H.265, MPEG video, VC-1, VP8 and VP9 parsers one
+ * parsing function at a time: how fast a stream is split into NAL units,
+ * packets or BDUs, and how fast the headers found in there are parsed. Each
+ * call is timed on its own and for every function the throughput over the
+ * units it was handed is reported, in MB/s and in units per second.
+ *
+ * Without arguments synthetic streams are used: the small headers of the
+ * parsers' unit tests (written out here for H.265) followed by random slice
+ * data, with the slice sizes of high bitrate 4K video.
+ *
+ * Real input can be given on the command line as CODEC:PATH, with CODEC
+ * one of h264, h265, mpegvideo, vc1, vp8 or vp9. A file holds a byte
+ * stream, or a single frame for VP8 and VP9. A directory is taken as a
+ * libFuzzer corpus: each file in it is one input and is parsed once, with
+ * a new parser. Besides the throughput, the number of inputs that were
+ * refused somewhere and the slowest input are reported then, so that
+ * optimizations can be checked on malformed data as well. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbitwriter.h>
+#include <gst/codecparsers/gsth264parser.h>
+#include <gst/codecparsers/gsth265parser.h>
+#include <gst/codecparsers/gstmpegvideoparser.h>
+#include <gst/codecparsers/gstvc1parser.h>
+#include <gst/codecparsers/gstvp8parser.h>
+#include <gst/codecparsers/gstvp9parser.h>
+
+#define SYNTHETIC_SIZE (64 * 1024 * 1024)
+#define MIN_SLICE_SIZE (16 * 1024)
+#define MAX_SLICE_SIZE (256 * 1024)
+#define SLICES_PER_PICTURE 4
+#define GOP_LENGTH 30
+#define ITERATIONS 10
+
+#define MAX_FUNCS 8
+
+typedef struct
+{
+  guint64 calls;
+  guint64 failures;
+  guint64 bytes;
+  GstClockTime time;
+} Stats;
+
+typedef void (*MakeInputsFunc) (GRand * rand, GPtrArray * inputs);
+typedef gpointer (*ParserNewFunc) (void);
+typedef void (*RunFunc) (gpointer parser, const guint8 * data, gsize size,
+    Stats * stats);
+
+typedef struct
+{
+  const gchar *name;
+  /* NULL terminated, indexed like the stats */
+  const gchar *funcs[MAX_FUNCS];
+  MakeInputsFunc make_inputs;
+  /* NULL if the codec has no parser object */
+  ParserNewFunc parser_new;
+  GDestroyNotify parser_free;
+  RunFunc run;
+} Codec;
+
+static inline void
+account (Stats * stats, GstClockTime start, gsize bytes, gboolean ok)
+{
+  stats->time += gst_util_get_timestamp () - start;
+  stats->calls++;
+  stats->bytes += bytes;
+  if (!ok)
+    stats->failures++;
+}
+
+/* Synthetic streams */
+
+static const guint8 start_code[] = { 0x00, 0x00, 0x00, 0x01 };
+static const guint8 rbsp_stop_bit = 0x80;
+
+/* Appends @data to @stream with emulation prevention, so that no start
+ * code appears, also not together with the bytes @stream ends with. MPEG
+ * video has no emulation prevention, there this only keeps the random
+ * data free of start codes. */
+static void
+append_escaped (GByteArray * stream, const guint8 * data, gsize size)
+{
+  gsize i, pos = stream->len;
+  guint zeros = 0;
+
+  while (zeros < 2 && zeros < pos && stream->data[pos - zeros - 1] == 0x00)
+    zeros++;
+
+  g_byte_array_set_size (stream, pos + size + size / 2 + 1);
+
+  for (i = 0; i < size; i++) {
+    if (zeros == 2 && data[i] <= 0x03) {
+      stream->data[pos++] = 0x03;
+      zeros = 0;
+    }
+    zeros = data[i] ? 0 : zeros + 1;
+    stream->data[pos++] = data[i];
+  }
+
+  g_byte_array_set_size (stream, pos);
+}
+
+static void
+append_random (GByteArray * stream, GRand * rand, gsize size)
+{
+  guint8 *data = g_malloc (size);
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    data[i] = g_rand_int (rand);
+
+  append_escaped (stream, data, size);
+  g_free (data);
+}
+
+static gsize
+random_slice_size (GRand * rand)
+{
+  return g_rand_int_range (rand, MIN_SLICE_SIZE, MAX_SLICE_SIZE);
+}
+
+/* The unit tests' main profile SPS and PPS, buffering period SEI and
+ * IDR slice header */
+static const guint8 h264_sps[] = {
+  0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x15,
+  0xec, 0xa4, 0xbf, 0x2e, 0x02, 0x20, 0x00, 0x00,
+  0x03, 0x00, 0x2e, 0xe6, 0xb2, 0x80, 0x01, 0xe2,
+  0xc5, 0xb2, 0xc0
+};
+
+static const guint8 h264_pps[] = {
+  0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xec, 0xb2
+};
+
+static const guint8 h264_sei[] = {
+  0x00, 0x00, 0x00, 0x01, 0x06, 0x00, 0x01, 0xc0
+};
+
+static const guint8 h264_slice_idr[] = {
+  0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00,
+  0x10, 0xff, 0xfe, 0xf6, 0xf0, 0xfe, 0x05, 0x36,
+  0x56, 0x04, 0x50, 0x96, 0x7b, 0x3f, 0x53, 0xe1
+};
+
+static void
+make_h264_inputs (GRand * rand, GPtrArray * inputs)
+{
+  GByteArray *stream = g_byte_array_new ();
+  guint frame, i;
+
+  for (frame = 0; stream->len < SYNTHETIC_SIZE; frame++) {
+    if (frame % GOP_LENGTH == 0) {
+      g_byte_array_append (stream, h264_sps, sizeof (h264_sps));
+      g_byte_array_append (stream, h264_pps, sizeof (h264_pps));
+      g_byte_array_append (stream, h264_sei, sizeof (h264_sei));
+    }
+
+    for (i = 0; i < SLICES_PER_PICTURE; i++) {
+      g_byte_array_append (stream, h264_slice_idr, sizeof (h264_slice_idr));
+      append_random (stream, rand, random_slice_size (rand));
+      g_byte_array_append (stream, &rbsp_stop_bit, 1);
+    }
+  }
+
+  g_ptr_array_add (inputs, g_byte_array_free_to_bytes (stream));
+}
+
+/* There are no H.265 headers in the unit tests, so these are written here:
+ * 3840x2160 main profile, level 5.1, with 64x64 CTBs */
+#define H265_WIDTH 3840
+#define H265_HEIGHT 2160
+#define H265_CTB_SIZE 64
+#define H265_SLICE_ADDRESS_BITS 11
+
+static void
+put_u (GstBitWriter * bw, guint32 value, guint nbits)
+{
+  gst_bit_writer_put_bits_uint32 (bw, value, nbits);
+}
+
+static void
+put_ue (GstBitWriter * bw, guint32 value)
+{
+  guint nbits = g_bit_storage (value + 1);
+
+  if (nbits > 1)
+    put_u (bw, 0, nbits - 1);
+  put_u (bw, value + 1, nbits);
+}
+
+static void
+put_se (GstBitWriter * bw, gint32 value)
+{
+  put_ue (bw, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+static void
+put_h265_nal_header (GstBitWriter * bw, GstH265NalUnitType type)
+{
+  gst_bit_writer_init (bw);
+  put_u (bw, 0, 1);
+  put_u (bw, type, 6);
+  put_u (bw, 0, 6);
+  put_u (bw, 1, 3);
+}
+
+static void
+put_h265_profile_tier_level (GstBitWriter * bw)
+{
+  put_u (bw, 0, 2);
+  put_u (bw, 0, 1);
+  put_u (bw, GST_H265_PROFILE_IDC_MAIN, 5);
+  put_u (bw, 0x60000000, 32);
+  /* progressive, not interlaced, not non-packed, frame only */
+  put_u (bw, 0x9, 4);
+  put_u (bw, 0, 32);
+  put_u (bw, 0, 12);
+  put_u (bw, 153, 8);
+}
+
+static void
+put_h265_sub_layer_ordering_info (GstBitWriter * bw)
+{
+  put_u (bw, 1, 1);
+  put_ue (bw, 4);
+  put_ue (bw, 2);
+  put_ue (bw, 0);
+}
+
+/* Finishes the NAL unit in @bw with the RBSP stop bit and returns it with
+ * a start code in front */
+static GByteArray *
+finish_h265_nal (GstBitWriter * bw)
+{
+  GByteArray *nal = g_byte_array_new ();
+
+  put_u (bw, 1, 1);
+  gst_bit_writer_align_bytes (bw, 0);
+
+  g_byte_array_append (nal, start_code, sizeof (start_code));
+  append_escaped (nal, gst_bit_writer_get_data (bw),
+      gst_bit_writer_get_size (bw) / 8);
+  gst_bit_writer_reset (bw);
+
+  return nal;
+}
+
+static GByteArray *
+make_h265_vps (void)
+{
+  GstBitWriter bw;
+
+  put_h265_nal_header (&bw, GST_H265_NAL_VPS);
+  put_u (&bw, 0, 4);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 0, 6);
+  put_u (&bw, 0, 3);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 0xffff, 16);
+  put_h265_profile_tier_level (&bw);
+  put_h265_sub_layer_ordering_info (&bw);
+  put_u (&bw, 0, 6);
+  put_ue (&bw, 0);
+  /* no timing info, no extension */
+  put_u (&bw, 0, 2);
+
+  return finish_h265_nal (&bw);
+}
+
+static GByteArray *
+make_h265_sps (void)
+{
+  GstBitWriter bw;
+
+  put_h265_nal_header (&bw, GST_H265_NAL_SPS);
+  put_u (&bw, 0, 4);
+  put_u (&bw, 0, 3);
+  put_u (&bw, 1, 1);
+  put_h265_profile_tier_level (&bw);
+  put_ue (&bw, 0);
+  /* 4:2:0, 8 bits, no conformance window */
+  put_ue (&bw, 1);
+  put_ue (&bw, H265_WIDTH);
+  put_ue (&bw, H265_HEIGHT);
+  put_u (&bw, 0, 1);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  put_ue (&bw, 4);
+  put_h265_sub_layer_ordering_info (&bw);
+  /* 8x8 to 64x64 coding blocks, 4x4 to 32x32 transform blocks */
+  put_ue (&bw, 0);
+  put_ue (&bw, 3);
+  put_ue (&bw, 0);
+  put_ue (&bw, 3);
+  put_ue (&bw, 1);
+  put_ue (&bw, 1);
+  /* no scaling lists, AMP, SAO, no PCM */
+  put_u (&bw, 0, 1);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 0, 1);
+  /* no short or long term reference picture sets, temporal MVP, strong
+   * intra smoothing, no VUI, no extension */
+  put_ue (&bw, 0);
+  put_u (&bw, 0, 1);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 0, 2);
+
+  return finish_h265_nal (&bw);
+}
+
+static GByteArray *
+make_h265_pps (void)
+{
+  GstBitWriter bw;
+
+  put_h265_nal_header (&bw, GST_H265_NAL_PPS);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  /* no dependent slices, output flag or extra slice header bits, no sign
+   * data hiding or CABAC init */
+  put_u (&bw, 0, 7);
+  put_ue (&bw, 0);
+  put_ue (&bw, 0);
+  put_se (&bw, 0);
+  /* no constrained intra, transform skip or CU QP delta */
+  put_u (&bw, 0, 3);
+  put_se (&bw, 0);
+  put_se (&bw, 0);
+  /* no slice chroma QP offsets, weighted prediction, transquant bypass,
+   * tiles, entropy coding sync, loop filter across slices, deblocking
+   * control, scaling lists or list modification */
+  put_u (&bw, 0, 10);
+  put_ue (&bw, 0);
+  /* no slice header extension, no PPS extension */
+  put_u (&bw, 0, 2);
+
+  return finish_h265_nal (&bw);
+}
+
+static GByteArray *
+make_h265_sei (void)
+{
+  GstBitWriter bw;
+
+  put_h265_nal_header (&bw, GST_H265_NAL_PREFIX_SEI);
+  put_u (&bw, GST_H265_SEI_RECOVERY_POINT, 8);
+  put_u (&bw, 1, 8);
+  /* recovery_poc_cnt 0, exact match, no broken link */
+  put_se (&bw, 0);
+  put_u (&bw, 1, 1);
+  put_u (&bw, 0, 1);
+  put_u (&bw, 1, 1);
+  gst_bit_writer_align_bytes (&bw, 0);
+
+  return finish_h265_nal (&bw);
+}
+
+static GByteArray *
+make_h265_slice_header (guint slice)
+{
+  guint n_ctbs = (H265_WIDTH / H265_CTB_SIZE) *
+      ((H265_HEIGHT + H265_CTB_SIZE - 1) / H265_CTB_SIZE);
+  GstBitWriter bw;
+
+  put_h265_nal_header (&bw, GST_H265_NAL_SLICE_IDR_W_RADL);
+  put_u (&bw, slice == 0, 1);
+  put_u (&bw, 0, 1);
+  put_ue (&bw, 0);
+  if (slice > 0)
+    put_u (&bw, slice * n_ctbs / SLICES_PER_PICTURE,
+        H265_SLICE_ADDRESS_BITS);
+  put_ue (&bw, GST_H265_I_SLICE);
+  /* no SAO in this slice */
+  put_u (&bw, 0, 2);
+  put_se (&bw, 0);
+
+  /* the byte_alignment() is the same as the RBSP stop bit */
+  return finish_h265_nal (&bw);
+}
+
+static void
+make_h265_inputs (GRand * rand, GPtrArray * inputs)
+{
+  GByteArray *stream = g_byte_array_new ();
+  GByteArray *vps, *sps, *pps, *sei;
+  GByteArray *slices[SLICES_PER_PICTURE];
+  guint frame, i;
+
+  vps = make_h265_vps ();
+  sps = make_h265_sps ();
+  pps = make_h265_pps ();
+  sei = make_h265_sei ();
+  for (i = 0; i < SLICES_PER_PICTURE; i++)
+    slices[i] = make_h265_slice_header (i);
+
+  for (frame = 0; stream->len < SYNTHETIC_SIZE; frame++) {
+    if (frame % GOP_LENGTH == 0) {
+      g_byte_array_append (stream, vps->data, vps->len);
+      g_byte_array_append (stream, sps->data, sps->len);
+      g_byte_array_append (stream, pps->data, pps->len);
+    }
+    g_byte_array_append (stream, sei->data, sei->len);
+
+    for (i = 0; i < SLICES_PER_PICTURE; i++) {
+      g_byte_array_append (stream, slices[i]->data, slices[i]->len);
+      append_random (stream, rand, random_slice_size (rand));
+      g_byte_array_append (stream, &rbsp_stop_bit, 1);
+    }
+  }
+
+  g_byte_array_unref (vps);
+  g_byte_array_unref (sps);
+  g_byte_array_unref (pps);
+  g_byte_array_unref (sei);
+  for (i = 0; i < SLICES_PER_PICTURE; i++)
+    g_byte_array_unref (slices[i]);
+
+  g_ptr_array_add (inputs, g_byte_array_free_to_bytes (stream));
+}
+
+/* The unit tests' sequence header, sequence extension and GOP, and the
+ * picture header and picture coding extension and slice header of their
+ * I frame */
+static const guint8 mpeg2_seq[] = {
+  0x00, 0x00, 0x01, 0xb3, 0x02, 0x00, 0x18, 0x15,
+  0xff, 0xff, 0xe0, 0x28, 0x00, 0x00, 0x01, 0xb5,
+  0x14, 0x8a, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+  0x01, 0xb8, 0x00, 0x08, 0x00, 0x00
+};
+
+static const guint8 mpeg2_picture[] = {
+  0x00, 0x00, 0x01, 0x00, 0x00, 0x0f, 0xff, 0xf8,
+  0x00, 0x00, 0x01, 0xb5, 0x8f, 0xff, 0xf3, 0x41,
+  0x80
+};
+
+static const guint8 mpeg2_slice[] = {
+  0x00, 0x00, 0x01, 0x01, 0x23, 0xf8, 0x7d, 0x29,
+  0x48, 0x8b, 0x94, 0xa5, 0x22, 0x20
+};
+
+static void
+make_mpeg_video_inputs (GRand * rand, GPtrArray * inputs)
+{
+  GByteArray *stream = g_byte_array_new ();
+  guint frame, i;
+
+  for (frame = 0; stream->len < SYNTHETIC_SIZE; frame++) {
+    if (frame % GOP_LENGTH == 0)
+      g_byte_array_append (stream, mpeg2_seq, sizeof (mpeg2_seq));
+    g_byte_array_append (stream, mpeg2_picture, sizeof (mpeg2_picture));
+
+    for (i = 0; i < SLICES_PER_PICTURE; i++) {
+      g_byte_array_append (stream, mpeg2_slice, sizeof (mpeg2_slice));
+      append_random (stream, rand, random_slice_size (rand));
+    }
+  }
+
+  g_ptr_array_add (inputs, g_byte_array_free_to_bytes (stream));
+}
+
+/* The unit tests' 1920x1080 advanced profile sequence header, entry point
+ * and the start of their I frame */
+static const guint8 vc1_seq[] = {
+  0x00, 0x00, 0x01, 0x0f, 0xdb, 0xfe, 0x3b, 0xf2,
+  0x1b, 0xca, 0x3b, 0xf8, 0x86, 0xf1, 0x80, 0xca,
+  0x02, 0x02, 0x03, 0x09, 0xa5, 0xb8, 0xd7, 0x07,
+  0xfc
+};
+
+static const guint8 vc1_entrypoint[] = {
+  0x00, 0x00, 0x01, 0x0e, 0x5a, 0xc7, 0xfc, 0xef,
+  0xc8, 0x6c, 0x40
+};
+
+static const guint8 vc1_frame[] = {
+  0x00, 0x00, 0x01, 0x0d, 0x69, 0x1c, 0x80, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7f
+};
+
+static void
+make_vc1_inputs (GRand * rand, GPtrArray * inputs)
+{
+  GByteArray *stream = g_byte_array_new ();
+  guint frame;
+
+  for (frame = 0; stream->len < SYNTHETIC_SIZE; frame++) {
+    if (frame % GOP_LENGTH == 0) {
+      g_byte_array_append (stream, vc1_seq, sizeof (vc1_seq));
+      g_byte_array_append (stream, vc1_entrypoint, sizeof (vc1_entrypoint));
+    }
+
+    g_byte_array_append (stream, vc1_frame, sizeof (vc1_frame));
+    append_random (stream, rand,
+        SLICES_PER_PICTURE * random_slice_size (rand));
+  }
+
+  g_ptr_array_add (inputs, g_byte_array_free_to_bytes (stream));
+}
+
+/* The unit tests' 176x144 key frame and the following inter frame, up to
+ * the end of their first partition */
+static const guint8 vp8_key_frame[] = {
+  0x50, 0x1d, 0x00, 0x9d, 0x01, 0x2a, 0xb0, 0x00, 0x90, 0x00, 0x00, 0x07,
+  0x08, 0x85, 0x85, 0x88, 0x85, 0x84, 0x88, 0x02, 0x02, 0x03, 0x55, 0xd2,
+  0x82, 0xf1, 0x8e, 0xd1, 0x00, 0x13, 0xee, 0x83, 0x17, 0x70, 0xd0, 0xf8,
+  0x34, 0xdc, 0x9e, 0x9a, 0x6f, 0x7a, 0x6b, 0xb0, 0x26, 0x33, 0xf7, 0xe1,
+  0xba, 0x59, 0xef, 0x1e, 0x97, 0xe6, 0xc4, 0x4e, 0x49, 0x72, 0x22, 0x6d,
+  0x72, 0x1a, 0xeb, 0x53, 0x48, 0x32, 0x3a, 0x22, 0x44, 0x5a, 0x61, 0xc5,
+  0x1f, 0xd8, 0xb2, 0xf3, 0x3c, 0xb6, 0x40, 0x7b, 0x7b, 0x83, 0x74, 0xb8,
+  0x56, 0xfb, 0xdc, 0xac, 0x00, 0x01, 0x55, 0xfc, 0x9d, 0xda, 0x9c, 0x5f,
+  0xf0, 0xfe, 0x7a, 0xf1, 0xc4, 0x9a, 0xa9, 0x04, 0x0a, 0xfd, 0x51, 0xe2,
+  0xca, 0x64, 0x57, 0xda, 0x5c, 0x0c, 0x16, 0x95, 0x54, 0x79, 0x48, 0xdc,
+  0x2c, 0x26, 0xf9, 0x27, 0x52, 0x1f, 0xc2, 0xd6, 0x6e, 0xdc, 0xa6, 0xae,
+  0x95, 0x02, 0xff, 0xaf, 0xa7, 0xdd, 0xa1, 0xb1, 0x7e, 0x03, 0x8d, 0x98,
+  0x14, 0x6c, 0x80, 0x39, 0x86, 0x65, 0x13, 0x33, 0xad, 0xdc, 0x2e, 0x84,
+  0xaa, 0xa8, 0xaa, 0xe4, 0x93, 0x10, 0x18, 0xca, 0x31, 0xe8, 0xa2, 0x1b,
+  0x49, 0x9e, 0xc0, 0xe2, 0x94, 0xc6, 0x80, 0x70, 0xe0, 0xf8, 0x41, 0x91,
+  0x92, 0xc4, 0xab, 0xf1, 0x46, 0xde, 0x8b, 0xfe, 0x3c, 0x3e, 0x2d, 0xc0,
+  0xb4, 0x90, 0xc3, 0x62, 0xef, 0xc7, 0xfb, 0x8f, 0xe0, 0x13, 0x79, 0x0f,
+  0x52, 0x64, 0xfb, 0x2b, 0x65, 0x17, 0x6f, 0x25, 0x2a, 0x9c, 0xfb, 0x98,
+  0x86, 0xb4, 0x09, 0x8b, 0x37, 0x67, 0x54, 0x32, 0x7e, 0xcc, 0x07, 0xff,
+  0xb4, 0x15, 0xd0, 0x11, 0x30, 0x2e, 0x0f, 0x12, 0xc9, 0xff, 0xfd, 0x9b,
+  0x69, 0x44, 0x65, 0x60
+};
+
+static const guint8 vp8_inter_frame[] = {
+  0x51, 0x0c, 0x00, 0x00, 0x10, 0x10, 0x00, 0x1e, 0xcb, 0x03, 0xdc, 0xc3,
+  0xed, 0xef, 0x1d, 0x30, 0xe3, 0x45, 0xc8, 0x86, 0xa6, 0xa4, 0x9c, 0x8e,
+  0x72, 0xee, 0xae, 0x46, 0x79, 0x53, 0x58, 0x0b, 0x01, 0xb1, 0xf4, 0x06,
+  0x5c, 0xc0, 0x18, 0xb8, 0x2b, 0xa0, 0x00, 0x3f, 0x06, 0x9a, 0x28, 0x55,
+  0x3b, 0x5f, 0x2b, 0x02, 0x14, 0x03, 0x93, 0xdf, 0x09, 0xe3, 0x22, 0x23,
+  0x53, 0xd3, 0xa8, 0x84, 0x34, 0x05, 0x0d, 0xec, 0xa9, 0x49, 0x72, 0xee,
+  0x9f, 0x4a, 0x0e, 0xbe, 0x98, 0xbc, 0x01, 0x08, 0x9e, 0xd5, 0x6a, 0xb2,
+  0x47, 0x0c, 0x19, 0xe0, 0x60, 0x3e, 0x3c, 0x75, 0xef, 0x65, 0xc6, 0x6c,
+  0x4f, 0xdb, 0x05, 0x38, 0x40
+};
+
+static void
+make_vp8_inputs (GRand * rand, GPtrArray * inputs)
+{
+  gsize total = 0;
+  guint frame;
+
+  for (frame = 0; total < SYNTHETIC_SIZE; frame++) {
+    GByteArray *data = g_byte_array_new ();
+
+    if (frame % GOP_LENGTH == 0)
+      g_byte_array_append (data, vp8_key_frame, sizeof (vp8_key_frame));
+    else
+      g_byte_array_append (data, vp8_inter_frame, sizeof (vp8_inter_frame));
+    append_random (data, rand, SLICES_PER_PICTURE * random_slice_size (rand));
+
+    total += data->len;
+    g_ptr_array_add (inputs, g_byte_array_free_to_bytes (data));
+  }
+}
+
+/* The unit tests' 320x240 key frame and the hidden inter frame and shown
+ * existing frame of their superframe */
+static const guint8 vp9_key_frame[] = {
+  0x82, 0x49, 0x83, 0x42, 0x20, 0x13, 0xf0, 0x0e, 0xf6, 0x14, 0x07, 0x80,
+  0x00, 0x01, 0xaa
+};
+
+static const guint8 vp9_inter_frame[] = {
+  0x84, 0x00, 0x40, 0x01, 0x38, 0x50, 0x1e, 0x00, 0x00, 0x04, 0xbb
+};
+
+static const guint8 vp9_show_existing_frame[] = { 0x88 };
+
+/* two frames, four bytes per frame size */
+#define VP9_SUPERFRAME_MARKER 0xd9
+
+static void
+append_uint32_le (GByteArray * data, guint32 value)
+{
+  guint8 bytes[4];
+
+  GST_WRITE_UINT32_LE (bytes, value);
+  g_byte_array_append (data, bytes, sizeof (bytes));
+}
+
+static void
+make_vp9_inputs (GRand * rand, GPtrArray * inputs)
+{
+  const guint8 superframe_marker = VP9_SUPERFRAME_MARKER;
+  const guint8 no_superframe_index = 0x00;
+  gsize total = 0;
+  guint frame;
+
+  for (frame = 0; total < SYNTHETIC_SIZE; frame++) {
+    GByteArray *data = g_byte_array_new ();
+
+    if (frame % GOP_LENGTH == 0) {
+      g_byte_array_append (data, vp9_key_frame, sizeof (vp9_key_frame));
+      append_random (data, rand,
+          SLICES_PER_PICTURE * random_slice_size (rand));
+      /* must not look like a superframe index */
+      g_byte_array_append (data, &no_superframe_index, 1);
+    } else {
+      guint inter_size;
+
+      g_byte_array_append (data, vp9_inter_frame, sizeof (vp9_inter_frame));
+      append_random (data, rand,
+          SLICES_PER_PICTURE * random_slice_size (rand));
+      inter_size = data->len;
+
+      g_byte_array_append (data, vp9_show_existing_frame,
+          sizeof (vp9_show_existing_frame));
+      g_byte_array_append (data, &superframe_marker, 1);
+      append_uint32_le (data, inter_size);
+      append_uint32_le (data, sizeof (vp9_show_existing_frame));
+      g_byte_array_append (data, &superframe_marker, 1);
+    }
+
+    total += data->len;
+    g_ptr_array_add (inputs, g_byte_array_free_to_bytes (data));
+  }
+}
+
+/* Parsing */
+
+enum
+{
+  H264_IDENTIFY_NALU,
+  H264_PARSE_SPS,
+  H264_PARSE_PPS,
+  H264_PARSE_SEI,
+  H264_PARSE_SLICE_HDR
+};
+
+static void
+run_h264 (gpointer parser, const guint8 * data, gsize size, Stats * stats)
+{
+  GstH264NalParser *nalparser = parser;
+  GstH264ParserResult res, ret;
+  GstH264NalUnit nalu;
+  GstClockTime start;
+  guint offset = 0;
+
+  do {
+    start = gst_util_get_timestamp ();
+    res = gst_h264_parser_identify_nalu (nalparser, data, offset, size,
+        &nalu);
+    if (res != GST_H264_PARSER_OK && res != GST_H264_PARSER_NO_NAL_END) {
+      account (&stats[H264_IDENTIFY_NALU], start, size - offset, FALSE);
+      break;
+    }
+    account (&stats[H264_IDENTIFY_NALU], start, nalu.size, TRUE);
+    offset = nalu.offset + nalu.size;
+
+    switch (nalu.type) {
+      case GST_H264_NAL_SPS:{
+        GstH264SPS sps;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h264_parser_parse_sps (nalparser, &nalu, &sps, TRUE);
+        account (&stats[H264_PARSE_SPS], start, nalu.size,
+            ret == GST_H264_PARSER_OK);
+        if (ret == GST_H264_PARSER_OK)
+          gst_h264_sps_clear (&sps);
+        break;
+      }
+      case GST_H264_NAL_PPS:{
+        GstH264PPS pps;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h264_parser_parse_pps (nalparser, &nalu, &pps);
+        account (&stats[H264_PARSE_PPS], start, nalu.size,
+            ret == GST_H264_PARSER_OK);
+        if (ret == GST_H264_PARSER_OK)
+          gst_h264_pps_clear (&pps);
+        break;
+      }
+      case GST_H264_NAL_SEI:{
+        GArray *messages;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h264_parser_parse_sei (nalparser, &nalu, &messages);
+        account (&stats[H264_PARSE_SEI], start, nalu.size,
+            ret == GST_H264_PARSER_OK);
+        g_array_free (messages, TRUE);
+        break;
+      }
+      case GST_H264_NAL_SLICE:
+      case GST_H264_NAL_SLICE_IDR:{
+        GstH264SliceHdr slice;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h264_parser_parse_slice_hdr (nalparser, &nalu, &slice,
+            TRUE, TRUE);
+        account (&stats[H264_PARSE_SLICE_HDR], start, nalu.size,
+            ret == GST_H264_PARSER_OK);
+        break;
+      }
+      default:
+        break;
+    }
+  } while (res == GST_H264_PARSER_OK);
+}
+
+enum
+{
+  H265_IDENTIFY_NALU,
+  H265_PARSE_VPS,
+  H265_PARSE_SPS,
+  H265_PARSE_PPS,
+  H265_PARSE_SEI,
+  H265_PARSE_SLICE_HDR
+};
+
+static void
+run_h265 (gpointer parser, const guint8 * data, gsize size, Stats * stats)
+{
+  GstH265Parser *h265parser = parser;
+  GstH265ParserResult res, ret;
+  GstH265NalUnit nalu;
+  GstClockTime start;
+  guint offset = 0;
+
+  do {
+    start = gst_util_get_timestamp ();
+    res = gst_h265_parser_identify_nalu (h265parser, data, offset, size,
+        &nalu);
+    if (res != GST_H265_PARSER_OK && res != GST_H265_PARSER_NO_NAL_END) {
+      account (&stats[H265_IDENTIFY_NALU], start, size - offset, FALSE);
+      break;
+    }
+    account (&stats[H265_IDENTIFY_NALU], start, nalu.size, TRUE);
+    offset = nalu.offset + nalu.size;
+
+    switch (nalu.type) {
+      case GST_H265_NAL_VPS:{
+        GstH265VPS vps;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h265_parser_parse_vps (h265parser, &nalu, &vps);
+        account (&stats[H265_PARSE_VPS], start, nalu.size,
+            ret == GST_H265_PARSER_OK);
+        break;
+      }
+      case GST_H265_NAL_SPS:{
+        GstH265SPS sps;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h265_parser_parse_sps (h265parser, &nalu, &sps, TRUE);
+        account (&stats[H265_PARSE_SPS], start, nalu.size,
+            ret == GST_H265_PARSER_OK);
+        break;
+      }
+      case GST_H265_NAL_PPS:{
+        GstH265PPS pps;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h265_parser_parse_pps (h265parser, &nalu, &pps);
+        account (&stats[H265_PARSE_PPS], start, nalu.size,
+            ret == GST_H265_PARSER_OK);
+        break;
+      }
+      case GST_H265_NAL_PREFIX_SEI:
+      case GST_H265_NAL_SUFFIX_SEI:{
+        GArray *messages;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h265_parser_parse_sei (h265parser, &nalu, &messages);
+        account (&stats[H265_PARSE_SEI], start, nalu.size,
+            ret == GST_H265_PARSER_OK);
+        g_array_free (messages, TRUE);
+        break;
+      }
+      case GST_H265_NAL_SLICE_TRAIL_N:
+      case GST_H265_NAL_SLICE_TRAIL_R:
+      case GST_H265_NAL_SLICE_TSA_N:
+      case GST_H265_NAL_SLICE_TSA_R:
+      case GST_H265_NAL_SLICE_STSA_N:
+      case GST_H265_NAL_SLICE_STSA_R:
+      case GST_H265_NAL_SLICE_RADL_N:
+      case GST_H265_NAL_SLICE_RADL_R:
+      case GST_H265_NAL_SLICE_RASL_N:
+      case GST_H265_NAL_SLICE_RASL_R:
+      case GST_H265_NAL_SLICE_BLA_W_LP:
+      case GST_H265_NAL_SLICE_BLA_W_RADL:
+      case GST_H265_NAL_SLICE_BLA_N_LP:
+      case GST_H265_NAL_SLICE_IDR_W_RADL:
+      case GST_H265_NAL_SLICE_IDR_N_LP:
+      case GST_H265_NAL_SLICE_CRA_NUT:{
+        GstH265SliceHdr slice;
+
+        start = gst_util_get_timestamp ();
+        ret = gst_h265_parser_parse_slice_hdr (h265parser, &nalu, &slice);
+        account (&stats[H265_PARSE_SLICE_HDR], start, nalu.size,
+            ret == GST_H265_PARSER_OK);
+        if (ret == GST_H265_PARSER_OK)
+          gst_h265_slice_hdr_free (&slice);
+        break;
+      }
+      default:
+        break;
+    }
+  } while (res == GST_H265_PARSER_OK);
+}
+
+enum
+{
+  MPEG_VIDEO_PARSE,
+  MPEG_VIDEO_PARSE_SEQUENCE_HEADER,
+  MPEG_VIDEO_PARSE_SEQUENCE_EXTENSION,
+  MPEG_VIDEO_PARSE_GOP,
+  MPEG_VIDEO_PARSE_PICTURE_HEADER,
+  MPEG_VIDEO_PARSE_PICTURE_EXTENSION,
+  MPEG_VIDEO_PARSE_SLICE_HEADER
+};
+
+static void
+run_mpeg_video (gpointer parser, const guint8 * data, gsize size,
+    Stats * stats)
+{
+  GstMpegVideoSequenceHdr seqhdr;
+  gboolean have_seqhdr = FALSE;
+  GstMpegVideoPacket packet;
+  GstClockTime start;
+  guint offset = 0;
+  gboolean ok;
+
+  while (offset < size) {
+    start = gst_util_get_timestamp ();
+    ok = gst_mpeg_video_parse (&packet, data, size, offset);
+    if (!ok) {
+      account (&stats[MPEG_VIDEO_PARSE], start, size - offset, FALSE);
+      break;
+    }
+    /* the last packet ends with the data */
+    if (packet.size < 0)
+      packet.size = size - packet.offset;
+    account (&stats[MPEG_VIDEO_PARSE], start, packet.size, TRUE);
+
+    if (packet.type >= GST_MPEG_VIDEO_PACKET_SLICE_MIN &&
+        packet.type <= GST_MPEG_VIDEO_PACKET_SLICE_MAX) {
+      if (have_seqhdr) {
+        GstMpegVideoSliceHdr slice;
+
+        start = gst_util_get_timestamp ();
+        ok = gst_mpeg_video_packet_parse_slice_header (&packet, &slice,
+            &seqhdr, NULL);
+        account (&stats[MPEG_VIDEO_PARSE_SLICE_HEADER], start, packet.size,
+            ok);
+      }
+    } else if (packet.type == GST_MPEG_VIDEO_PACKET_SEQUENCE) {
+      start = gst_util_get_timestamp ();
+      have_seqhdr = gst_mpeg_video_packet_parse_sequence_header (&packet,
+          &seqhdr);
+      account (&stats[MPEG_VIDEO_PARSE_SEQUENCE_HEADER], start, packet.size,
+          have_seqhdr);
+    } else if (packet.type == GST_MPEG_VIDEO_PACKET_GOP) {
+      GstMpegVideoGop gop;
+
+      start = gst_util_get_timestamp ();
+      ok = gst_mpeg_video_packet_parse_gop (&packet, &gop);
+      account (&stats[MPEG_VIDEO_PARSE_GOP], start, packet.size, ok);
+    } else if (packet.type == GST_MPEG_VIDEO_PACKET_PICTURE) {
+      GstMpegVideoPictureHdr pichdr;
+
+      start = gst_util_get_timestamp ();
+      ok = gst_mpeg_video_packet_parse_picture_header (&packet, &pichdr);
+      account (&stats[MPEG_VIDEO_PARSE_PICTURE_HEADER], start, packet.size,
+          ok);
+    } else if (packet.type == GST_MPEG_VIDEO_PACKET_EXTENSION &&
+        packet.offset < size) {
+      switch (data[packet.offset] >> 4) {
+        case GST_MPEG_VIDEO_PACKET_EXT_SEQUENCE:{
+          GstMpegVideoSequenceExt seqext;
+
+          start = gst_util_get_timestamp ();
+          ok = gst_mpeg_video_packet_parse_sequence_extension (&packet,
+              &seqext);
+          account (&stats[MPEG_VIDEO_PARSE_SEQUENCE_EXTENSION], start,
+              packet.size, ok);
+          break;
+        }
+        case GST_MPEG_VIDEO_PACKET_EXT_PICTURE:{
+          GstMpegVideoPictureExt picext;
+
+          start = gst_util_get_timestamp ();
+          ok = gst_mpeg_video_packet_parse_picture_extension (&packet,
+              &picext);
+          account (&stats[MPEG_VIDEO_PARSE_PICTURE_EXTENSION], start,
+              packet.size, ok);
+          break;
+        }
+        default:
+          break;
+      }
+    }
+
+    offset = packet.offset + packet.size;
+  }
+}
+
+enum
+{
+  VC1_IDENTIFY_NEXT_BDU,
+  VC1_PARSE_SEQUENCE_HEADER,
+  VC1_PARSE_ENTRY_POINT_HEADER,
+  VC1_PARSE_FRAME_HEADER
+};
+
+static void
+run_vc1 (gpointer parser, const guint8 * data, gsize size, Stats * stats)
+{
+  GstVC1SeqHdr seqhdr;
+  gboolean have_seqhdr = FALSE;
+  GstVC1ParserResult res, ret;
+  GstVC1BDU bdu;
+  GstClockTime start;
+  gsize offset = 0;
+
+  do {
+    start = gst_util_get_timestamp ();
+    res = gst_vc1_identify_next_bdu (data + offset, size - offset, &bdu);
+    if (res != GST_VC1_PARSER_OK && res != GST_VC1_PARSER_NO_BDU_END) {
+      account (&stats[VC1_IDENTIFY_NEXT_BDU], start, size - offset, FALSE);
+      break;
+    }
+    if (res == GST_VC1_PARSER_NO_BDU_END)
+      bdu.size = size - offset - bdu.offset;
+    account (&stats[VC1_IDENTIFY_NEXT_BDU], start, bdu.size, TRUE);
+
+    switch (bdu.type) {
+      case GST_VC1_SEQUENCE:
+        start = gst_util_get_timestamp ();
+        ret = gst_vc1_parse_sequence_header (bdu.data + bdu.offset, bdu.size,
+            &seqhdr);
+        have_seqhdr = ret == GST_VC1_PARSER_OK;
+        account (&stats[VC1_PARSE_SEQUENCE_HEADER], start, bdu.size,
+            have_seqhdr);
+        break;
+      case GST_VC1_ENTRYPOINT:
+        if (have_seqhdr) {
+          GstVC1EntryPointHdr entrypoint;
+
+          start = gst_util_get_timestamp ();
+          ret = gst_vc1_parse_entry_point_header (bdu.data + bdu.offset,
+              bdu.size, &entrypoint, &seqhdr);
+          account (&stats[VC1_PARSE_ENTRY_POINT_HEADER], start, bdu.size,
+              ret == GST_VC1_PARSER_OK);
+        }
+        break;
+      case GST_VC1_FRAME:
+        if (have_seqhdr) {
+          GstVC1FrameHdr framehdr;
+
+          start = gst_util_get_timestamp ();
+          ret = gst_vc1_parse_frame_header (bdu.data + bdu.offset, bdu.size,
+              &framehdr, &seqhdr, NULL);
+          account (&stats[VC1_PARSE_FRAME_HEADER], start, bdu.size,
+              ret == GST_VC1_PARSER_OK);
+        }
+        break;
+      default:
+        break;
+    }
+
+    offset += bdu.offset + bdu.size;
+  } while (res == GST_VC1_PARSER_OK && offset < size);
+}
+
+enum
+{
+  VP8_PARSE_FRAME_HEADER
+};
+
+static gpointer
+vp8_parser_new (void)
+{
+  GstVp8Parser *parser = g_new0 (GstVp8Parser, 1);
+
+  gst_vp8_parser_init (parser);
+
+  return parser;
+}
+
+static void
+run_vp8 (gpointer parser, const guint8 * data, gsize size, Stats * stats)
+{
+  GstVp8ParserResult res;
+  GstVp8FrameHdr frame_hdr;
+  GstClockTime start;
+
+  start = gst_util_get_timestamp ();
+  res = gst_vp8_parser_parse_frame_header (parser, &frame_hdr, data, size);
+  account (&stats[VP8_PARSE_FRAME_HEADER], start, size,
+      res == GST_VP8_PARSER_OK);
+}
+
+enum
+{
+  VP9_PARSE_SUPERFRAME_INFO,
+  VP9_PARSE_FRAME_HEADER
+};
+
+static void
+run_vp9 (gpointer parser, const guint8 * data, gsize size, Stats * stats)
+{
+  GstVp9SuperframeInfo info;
+  GstVp9ParserResult res;
+  GstVp9FrameHdr frame_hdr;
+  GstClockTime start;
+  gsize offset = 0;
+  guint i;
+
+  if (size == 0)
+    return;
+
+  start = gst_util_get_timestamp ();
+  res = gst_vp9_parser_parse_superframe_info (parser, &info, data, size);
+  account (&stats[VP9_PARSE_SUPERFRAME_INFO], start, size,
+      res == GST_VP9_PARSER_OK);
+  if (res != GST_VP9_PARSER_OK)
+    return;
+
+  for (i = 0; i < info.frames_in_superframe; i++) {
+    start = gst_util_get_timestamp ();
+    res = gst_vp9_parser_parse_frame_header (parser, &frame_hdr,
+        data + offset, info.frame_sizes[i]);
+    account (&stats[VP9_PARSE_FRAME_HEADER], start, info.frame_sizes[i],
+        res == GST_VP9_PARSER_OK);
+    offset += info.frame_sizes[i];
+  }
+}
+
+static const Codec codecs[] = {
+  {"h264",
+      {"identify_nalu", "parse_sps", "parse_pps", "parse_sei",
+          "parse_slice_hdr", NULL},
+      make_h264_inputs, (ParserNewFunc) gst_h264_nal_parser_new,
+      (GDestroyNotify) gst_h264_nal_parser_free, run_h264},
+  {"h265",
+      {"identify_nalu", "parse_vps", "parse_sps", "parse_pps", "parse_sei",
+          "parse_slice_hdr", NULL},
+      make_h265_inputs, (ParserNewFunc) gst_h265_parser_new,
+      (GDestroyNotify) gst_h265_parser_free, run_h265},
+  {"mpegvideo",
+      {"parse", "parse_sequence_header", "parse_sequence_extension",
+          "parse_gop", "parse_picture_header", "parse_picture_extension",
+          "parse_slice_header", NULL},
+      make_mpeg_video_inputs, NULL, NULL, run_mpeg_video},
+  {"vc1",
+      {"identify_next_bdu", "parse_sequence_header",
+          "parse_entry_point_header", "parse_frame_header", NULL},
+      make_vc1_inputs, NULL, NULL, run_vc1},
+  {"vp8",
+      {"parse_frame_header", NULL},
+      make_vp8_inputs, vp8_parser_new, g_free, run_vp8},
+  {"vp9",
+      {"parse_superframe_info", "parse_frame_header", NULL},
+      make_vp9_inputs, (ParserNewFunc) gst_vp9_parser_new,
+      (GDestroyNotify) gst_vp9_parser_free, run_vp9},
+};
+
+/* Runs @inputs through a new parser, one after the other */
+static void
+run_inputs (const Codec * codec, GPtrArray * inputs, Stats * stats)
+{
+  gpointer parser = codec->parser_new ? codec->parser_new () : NULL;
+  guint i;
+
+  for (i = 0; i < inputs->len; i++) {
+    gsize size;
+    const guint8 *data = g_bytes_get_data (inputs->pdata[i], &size);
+
+    codec->run (parser, data, size, stats);
+  }
+
+  if (parser)
+    codec->parser_free (parser);
+}
+
+static guint64
+count_failures (const Codec * codec, const Stats * stats)
+{
+  guint64 failures = 0;
+  guint i;
+
+  for (i = 0; codec->funcs[i]; i++)
+    failures += stats[i].failures;
+
+  return failures;
+}
+
+static void
+report (const Codec * codec, const gchar * input, const Stats * stats)
+{
+  guint i;
+
+  for (i = 0; codec->funcs[i]; i++) {
+    gdouble seconds = (gdouble) MAX (stats[i].time, 1) / GST_SECOND;
+
+    if (stats[i].calls == 0)
+      continue;
+
+    g_print ("%-10s %-24s %-26s: %9.1f MB/s, %11.0f units/s (%"
+        G_GUINT64_FORMAT " units, %" G_GUINT64_FORMAT " failed)\n",
+        codec->name, input, codec->funcs[i],
+        stats[i].bytes / seconds / 1e6, stats[i].calls / seconds,
+        stats[i].calls, stats[i].failures);
+  }
+}
+
+static void
+run_repeated (const Codec * codec, const gchar * input, GPtrArray * inputs)
+{
+  Stats stats[MAX_FUNCS] = { {0,}, };
+  guint i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    run_inputs (codec, inputs, stats);
+
+  report (codec, input, stats);
+}
+
+static GPtrArray *
+read_input (const gchar * filename)
+{
+  GPtrArray *inputs;
+  GError *err = NULL;
+  gchar *contents;
+  gsize size;
+
+  if (!g_file_get_contents (filename, &contents, &size, &err)) {
+    g_printerr ("Could not read %s: %s\n", filename, err->message);
+    g_clear_error (&err);
+    return NULL;
+  }
+
+  inputs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+  g_ptr_array_add (inputs, g_bytes_new_take (contents, size));
+
+  return inputs;
+}
+
+static gboolean
+run_corpus (const Codec * codec, const gchar * path)
+{
+  Stats stats[MAX_FUNCS] = { {0,}, };
+  GstClockTime slowest_time = 0;
+  guint n_inputs = 0, n_refused = 0;
+  gchar *slowest = NULL;
+  GError *err = NULL;
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, &err);
+  if (!dir) {
+    g_printerr ("Could not open %s: %s\n", path, err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  while ((name = g_dir_read_name (dir))) {
+    gchar *filename = g_build_filename (path, name, NULL);
+    GPtrArray *inputs = NULL;
+    GstClockTime start, time;
+    guint64 failures;
+
+    if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+      inputs = read_input (filename);
+    g_free (filename);
+    if (!inputs)
+      continue;
+
+    failures = count_failures (codec, stats);
+    start = gst_util_get_timestamp ();
+    run_inputs (codec, inputs, stats);
+    time = gst_util_get_timestamp () - start;
+
+    n_inputs++;
+    if (count_failures (codec, stats) > failures)
+      n_refused++;
+    if (time > slowest_time) {
+      slowest_time = time;
+      g_free (slowest);
+      slowest = g_strdup (name);
+    }
+
+    g_ptr_array_unref (inputs);
+  }
+  g_dir_close (dir);
+
+  report (codec, path, stats);
+  g_print ("%-10s %-24s: %u inputs, %u refused, slowest %s: %"
+      GST_TIME_FORMAT "\n", codec->name, path, n_inputs, n_refused,
+      GST_STR_NULL (slowest), GST_TIME_ARGS (slowest_time));
+  g_free (slowest);
+
+  return TRUE;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  guint c;
+  gint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc < 2) {
+    for (c = 0; c < G_N_ELEMENTS (codecs); c++) {
+      GRand *rand = g_rand_new_with_seed (c);
+      GPtrArray *inputs =
+          g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+
+      codecs[c].make_inputs (rand, inputs);
+      run_repeated (&codecs[c], "synthetic", inputs);
+
+      g_ptr_array_unref (inputs);
+      g_rand_free (rand);
+    }
+    return 0;
+  }
+
+  for (i = 1; i < argc; i++) {
+    gchar **arg = g_strsplit (argv[i], ":", 2);
+    gboolean ok = TRUE;
+
+    for (c = 0; c < G_N_ELEMENTS (codecs); c++) {
+      if (!g_strcmp0 (arg[0], codecs[c].name))
+        break;
+    }
+
+    if (c == G_N_ELEMENTS (codecs) || !arg[1]) {
+      g_printerr ("Usage: %s [h264|h265|mpegvideo|vc1|vp8|vp9:FILE|DIR ...]\n",
+          argv[0]);
+      g_strfreev (arg);
+      return 1;
+    }
+
+    if (g_file_test (arg[1], G_FILE_TEST_IS_DIR)) {
+      ok = run_corpus (&codecs[c], arg[1]);
+    } else {
+      GPtrArray *inputs = read_input (arg[1]);
+
+      if (inputs) {
+        run_repeated (&codecs[c], arg[1], inputs);
+        g_ptr_array_unref (inputs);
+      } else {
+        ok = FALSE;
+      }
+    }
+
+    g_strfreev (arg);
+    if (!ok)
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+/* GStreamer
+ *
+ * crc.c: benchmark for the shared CRC routines
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Compares the throughput of the byte at a time CRC-32/MPEG-2 and
+ * CRC-16/CCITT loops with the slicing-by-8 and PCLMULQDQ versions, for
+ * sizes from a short section up to a large payload. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#include <gst/crc-private.h>
+
+#define TOTAL_SIZE (256 * 1024 * 1024)
+
+typedef guint32 (*CrcFunc) (const guint8 * data, gsize len);
+
+static guint32
+crc32_bytes (const guint8 * data, gsize len)
+{
+  return _gst_crc32_mpeg2_update_bytes (_gst_crc_get_tables (), 0xffffffff,
+      data, len);
+}
+
+static guint32
+crc32_sb8 (const guint8 * data, gsize len)
+{
+  return _gst_crc32_mpeg2_update_sb8 (_gst_crc_get_tables (), 0xffffffff,
+      data, len);
+}
+
+#ifdef GST_CRC_HAVE_PCLMUL
+static guint32
+crc32_pclmul (const guint8 * data, gsize len)
+{
+  return _gst_crc32_mpeg2_update_pclmul (_gst_crc_get_tables (), 0xffffffff,
+      data, len);
+}
+#endif
+
+static guint32
+crc32_dispatch (const guint8 * data, gsize len)
+{
+  return gst_crc32_mpeg2 (data, len);
+}
+
+static guint32
+crc16_bytes (const guint8 * data, gsize len)
+{
+  const GstCrcTables *t = _gst_crc_get_tables ();
+  guint16 crc = 0xffff;
+
+  while (len--)
+    crc = (crc << 8) ^ t->crc16[0][(crc >> 8) ^ *data++];
+
+  return crc;
+}
+
+static guint32
+crc16_sb8 (const guint8 * data, gsize len)
+{
+  return gst_crc16_ccitt_update (0xffff, data, len);
+}
+
+static void
+run (const gchar * name, CrcFunc func, const guint8 * data, gsize size)
+{
+  GstClockTime start, end;
+  guint32 crc = 0;
+  guint i, n = TOTAL_SIZE / size;
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < n; i++)
+    crc ^= func (data + (i & 7), size);
+  end = gst_util_get_timestamp ();
+
+  g_print ("%-14s size %7" G_GSIZE_FORMAT ": %" GST_TIME_FORMAT
+      ", %.1f MB/s (0x%08x)\n", name, size, GST_TIME_ARGS (end - start),
+      (gdouble) n * size * GST_SECOND / MAX (end - start, 1) / 1e6, crc);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  static const gsize sizes[] = { 20, 188, 1024, 4096, 64 * 1024, 1024 * 1024 };
+  guint8 *data;
+  guint i;
+
+  gst_init (&argc, &argv);
+
+  data = g_malloc (sizes[G_N_ELEMENTS (sizes) - 1] + 8);
+  for (i = 0; i < sizes[G_N_ELEMENTS (sizes) - 1] + 8; i++)
+    data[i] = g_random_int ();
+
+  g_print ("PCLMULQDQ: %s\n",
+      _gst_crc_get_tables ()->have_pclmul ? "available" : "not available");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    run ("crc32 bytes", crc32_bytes, data, sizes[i]);
+    run ("crc32 sb8", crc32_sb8, data, sizes[i]);
+#ifdef GST_CRC_HAVE_PCLMUL
+    if (_gst_crc_get_tables ()->have_pclmul)
+      run ("crc32 pclmul", crc32_pclmul, data, sizes[i]);
+#endif
+    run ("crc32", crc32_dispatch, data, sizes[i]);
+    run ("crc16 bytes", crc16_bytes, data, sizes[i]);
+    run ("crc16 sb8", crc16_sb8, data, sizes[i]);
+  }
+
+  g_free (data);
+
+  return 0;
+}
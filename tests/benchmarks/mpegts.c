@@ -0,0 +1,558 @@
+/* GStreamer
+ *
+ * mpegts.c: benchmark for the MPEG-TS muxer and demuxer hot paths
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Pushes fixed synthetic workloads through the muxer core of mpegtsmux
+ * (tsmux) and through the packetizer shared by tsdemux and tsparse, without
+ * any pipeline around them:
+ *
+ *   spts: one program with H.264 video and AAC audio
+ *   mpts: MPTS_PROGRAMS such programs
+ *
+ * The muxer runs both with one GstBuffer per packet (alloc-func) and with
+ * packets written straight into the output (packet-funcs). The muxer output
+ * is then used as the demuxer input, parsed the way mpegtsbase does, and
+ * once more with sub-buffers created for every run of packets as
+ * tsparse does in split-programs mode.
+ *
+ * For every run, one JSON object is written per line with the throughput,
+ * the number of mini objects (buffers, memories, sections, ...) allocated
+ * per packet and the per input buffer latency distribution. Allocations are
+ * counted with a tracer hook and reported as null if the core was built
+ * without tracer hooks. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/mpegts/mpegts.h>
+
+#include "tsmux.h"
+#include "mpegtspacketizer.h"
+
+GST_DEBUG_CATEGORY (mpegtsmux_debug);
+
+#define SPTS_DURATION 120
+#define MPTS_PROGRAMS 8
+#define MPTS_DURATION 30
+
+#define VIDEO_FPS 25
+#define VIDEO_GOP 50
+#define VIDEO_I_SIZE (96 * 1024)
+#define VIDEO_P_SIZE (12 * 1024)
+/* 1024 samples at 48 kHz, in 90 kHz units */
+#define AUDIO_DURATION 1920
+#define AUDIO_SIZE 384
+
+#define DEMUX_CHUNK_SIZE (188 * 348)
+#define DEMUX_BATCH 64
+
+#define TS_90KHZ 90000
+
+/* Mini objects created, counted by the tracer hook */
+static guint64 n_allocs;
+static gboolean have_alloc_hook;
+
+typedef struct
+{
+  GstTracer parent;
+} AllocTracer;
+
+typedef struct
+{
+  GstTracerClass parent_class;
+} AllocTracerClass;
+
+static GType alloc_tracer_get_type (void);
+G_DEFINE_TYPE (AllocTracer, alloc_tracer, GST_TYPE_TRACER);
+
+static void
+on_mini_object_created (GObject * self, GstClockTime ts,
+    GstMiniObject * object)
+{
+  n_allocs++;
+  have_alloc_hook = TRUE;
+}
+
+static void
+alloc_tracer_class_init (AllocTracerClass * klass)
+{
+}
+
+static void
+alloc_tracer_init (AllocTracer * self)
+{
+  gst_tracing_register_hook (GST_TRACER (self), "mini-object-created",
+      G_CALLBACK (on_mini_object_created));
+}
+
+typedef struct
+{
+  const gchar *benchmark;
+  const gchar *workload;
+
+  guint64 packets;
+  guint64 bytes;
+  guint64 allocs;
+  GstClockTime elapsed;
+  /* GstClockTime per input buffer */
+  GArray *latencies;
+} Result;
+
+static void
+result_init (Result * result, const gchar * benchmark, const gchar * workload)
+{
+  memset (result, 0, sizeof (Result));
+  result->benchmark = benchmark;
+  result->workload = workload;
+  result->latencies = g_array_sized_new (FALSE, FALSE, sizeof (GstClockTime),
+      64 * 1024);
+  n_allocs = 0;
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+  GstClockTime la = *(const GstClockTime *) a;
+  GstClockTime lb = *(const GstClockTime *) b;
+
+  return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static GstClockTime
+result_percentile (Result * result, guint percentile)
+{
+  guint len = result->latencies->len;
+
+  if (len == 0)
+    return 0;
+
+  return g_array_index (result->latencies, GstClockTime,
+      (len - 1) * percentile / 100);
+}
+
+static void
+result_print (Result * result, FILE * out)
+{
+  gdouble seconds = (gdouble) MAX (result->elapsed, 1) / GST_SECOND;
+  gchar allocs[32], allocs_per_packet[32];
+
+  g_array_sort (result->latencies, compare_latency);
+
+  if (have_alloc_hook) {
+    g_snprintf (allocs, sizeof (allocs), "%" G_GUINT64_FORMAT, result->allocs);
+    g_snprintf (allocs_per_packet, sizeof (allocs_per_packet), "%.4f",
+        (gdouble) result->allocs / MAX (result->packets, 1));
+  } else {
+    g_strlcpy (allocs, "null", sizeof (allocs));
+    g_strlcpy (allocs_per_packet, "null", sizeof (allocs_per_packet));
+  }
+
+  fprintf (out, "{\"benchmark\": \"%s\", \"workload\": \"%s\", "
+      "\"packets\": %" G_GUINT64_FORMAT ", \"bytes\": %" G_GUINT64_FORMAT ", "
+      "\"seconds\": %.6f, \"packets_per_second\": %.0f, "
+      "\"megabytes_per_second\": %.2f, "
+      "\"allocations\": %s, \"allocations_per_packet\": %s, "
+      "\"buffers\": %u, \"latency_p50_ns\": %" G_GUINT64_FORMAT ", "
+      "\"latency_p99_ns\": %" G_GUINT64_FORMAT ", "
+      "\"latency_max_ns\": %" G_GUINT64_FORMAT "}\n",
+      result->benchmark, result->workload, result->packets, result->bytes,
+      seconds, result->packets / seconds, result->bytes / seconds / 1e6,
+      allocs, allocs_per_packet, result->latencies->len,
+      result_percentile (result, 50), result_percentile (result, 99),
+      result_percentile (result, 100));
+  fflush (out);
+
+  g_array_free (result->latencies, TRUE);
+}
+
+/* Synthetic input: video and audio frames of every program, in DTS order */
+
+typedef struct
+{
+  TsMuxStream *stream;
+  gboolean video;
+  guint n_frames;
+  gint64 next_ts;
+} InputStream;
+
+typedef struct
+{
+  TsMux *mux;
+  GArray *streams;
+  guint8 *payload;
+  gint64 end_ts;
+
+  /* packet-funcs output */
+  GByteArray *output;
+  gboolean capture;
+} MuxSetup;
+
+static guint8 *
+mux_packet_alloc (void *user_data)
+{
+  MuxSetup *setup = user_data;
+  guint len = setup->output->len;
+
+  g_byte_array_set_size (setup->output, len + 188);
+
+  return setup->output->data + len;
+}
+
+static gboolean
+mux_packet_write (guint8 * packet, void *user_data, gint64 new_pcr)
+{
+  MuxSetup *setup = user_data;
+
+  /* Only keep the output of the capture run */
+  if (!setup->capture)
+    g_byte_array_set_size (setup->output, 0);
+
+  return TRUE;
+}
+
+static void
+mux_buffer_alloc (GstBuffer ** buf, void *user_data)
+{
+  *buf = gst_buffer_new_allocate (NULL, 188, NULL);
+}
+
+static gboolean
+mux_buffer_write (GstBuffer * buf, void *user_data, gint64 new_pcr)
+{
+  gst_buffer_unref (buf);
+
+  return TRUE;
+}
+
+static void
+mux_setup_init (MuxSetup * setup, guint n_programs, guint duration,
+    gboolean packet_funcs)
+{
+  guint i;
+
+  memset (setup, 0, sizeof (MuxSetup));
+  setup->mux = tsmux_new ();
+  setup->streams = g_array_new (FALSE, TRUE, sizeof (InputStream));
+  setup->payload = g_malloc (VIDEO_I_SIZE);
+  memset (setup->payload, 0xa5, VIDEO_I_SIZE);
+  setup->end_ts = (gint64) duration * TS_90KHZ;
+  setup->output = g_byte_array_new ();
+
+  if (packet_funcs) {
+    tsmux_set_packet_funcs (setup->mux, mux_packet_alloc, mux_packet_write,
+        setup);
+  } else {
+    tsmux_set_alloc_func (setup->mux, mux_buffer_alloc, setup);
+    tsmux_set_write_func (setup->mux, mux_buffer_write, setup);
+  }
+
+  for (i = 0; i < n_programs; i++) {
+    TsMuxProgram *program = tsmux_program_new (setup->mux, 0);
+    InputStream video = { NULL, TRUE, 0, 0 };
+    InputStream audio = { NULL, FALSE, 0, 0 };
+
+    video.stream = tsmux_create_stream (setup->mux, TSMUX_ST_VIDEO_H264,
+        TSMUX_PID_AUTO, NULL);
+    audio.stream = tsmux_create_stream (setup->mux, TSMUX_ST_AUDIO_AAC,
+        TSMUX_PID_AUTO, NULL);
+    tsmux_program_add_stream (program, video.stream);
+    tsmux_program_add_stream (program, audio.stream);
+    tsmux_program_set_pcr_stream (program, video.stream);
+
+    /* Don't have all programs start at exactly the same time */
+    video.next_ts = audio.next_ts = i * TS_90KHZ / VIDEO_FPS / n_programs;
+
+    g_array_append_val (setup->streams, video);
+    g_array_append_val (setup->streams, audio);
+  }
+}
+
+static void
+mux_setup_clear (MuxSetup * setup)
+{
+  tsmux_free (setup->mux);
+  g_array_free (setup->streams, TRUE);
+  g_free (setup->payload);
+  g_byte_array_unref (setup->output);
+}
+
+static InputStream *
+mux_next_input (MuxSetup * setup)
+{
+  InputStream *next = NULL;
+  guint i;
+
+  for (i = 0; i < setup->streams->len; i++) {
+    InputStream *input = &g_array_index (setup->streams, InputStream, i);
+
+    if (!next || input->next_ts < next->next_ts)
+      next = input;
+  }
+
+  return next->next_ts < setup->end_ts ? next : NULL;
+}
+
+/* Returns the muxed stream if @capture is set */
+static GByteArray *
+run_mux (const gchar * benchmark, const gchar * workload, guint n_programs,
+    guint duration, gboolean packet_funcs, gboolean capture, FILE * out)
+{
+  MuxSetup setup;
+  Result result;
+  InputStream *input;
+  GstClockTime start, end;
+  GByteArray *output = NULL;
+
+  mux_setup_init (&setup, n_programs, duration, packet_funcs);
+  setup.capture = capture;
+
+  result_init (&result, benchmark, workload);
+  start = gst_util_get_timestamp ();
+
+  while ((input = mux_next_input (&setup))) {
+    GstClockTime t0 = gst_util_get_timestamp (), latency;
+    gboolean keyframe;
+    guint size;
+
+    if (input->video) {
+      keyframe = input->n_frames % VIDEO_GOP == 0;
+      size = keyframe ? VIDEO_I_SIZE : VIDEO_P_SIZE;
+    } else {
+      keyframe = TRUE;
+      size = AUDIO_SIZE;
+    }
+
+    tsmux_stream_add_data (input->stream, setup.payload, size, NULL,
+        input->next_ts, input->next_ts, keyframe);
+    while (tsmux_stream_bytes_in_buffer (input->stream) > 0) {
+      if (!tsmux_write_stream_packet (setup.mux, input->stream))
+        g_error ("Failed to write packet");
+    }
+
+    latency = gst_util_get_timestamp () - t0;
+    g_array_append_val (result.latencies, latency);
+
+    result.bytes += size;
+    input->n_frames++;
+    input->next_ts += input->video ? TS_90KHZ / VIDEO_FPS : AUDIO_DURATION;
+  }
+
+  end = gst_util_get_timestamp ();
+  result.elapsed = end - start;
+  result.allocs = n_allocs;
+  result.packets = setup.mux->n_bytes / 188;
+
+  result_print (&result, out);
+
+  if (capture) {
+    output = setup.output;
+    setup.output = g_byte_array_new ();
+  }
+  mux_setup_clear (&setup);
+
+  return output;
+}
+
+/* Consumes the sections of PSI packets like mpegtsbase does, so that the
+ * PMT PIDs are known after the PAT */
+static void
+demux_handle_psi (MpegTSPacketizer2 * packetizer, guint8 * known_psi,
+    MpegTSPacketizerPacket * packet)
+{
+  GstMpegtsSection *section;
+  GList *others = NULL, *l;
+
+  section = mpegts_packetizer_push_section (packetizer, packet, &others);
+  if (section)
+    others = g_list_prepend (others, section);
+
+  for (l = others; l; l = l->next) {
+    section = l->data;
+
+    if (section->section_type == GST_MPEGTS_SECTION_PAT) {
+      GPtrArray *pat = gst_mpegts_section_get_pat (section);
+      guint i;
+
+      for (i = 0; pat && i < pat->len; i++) {
+        GstMpegtsPatProgram *program = g_ptr_array_index (pat, i);
+
+        known_psi[program->network_or_program_map_PID] = 1;
+      }
+      if (pat)
+        g_ptr_array_unref (pat);
+    } else if (section->section_type == GST_MPEGTS_SECTION_PMT) {
+      gst_mpegts_section_get_pmt (section);
+    }
+    gst_mpegts_section_unref (section);
+  }
+  g_list_free (others);
+}
+
+static void
+run_demux (const gchar * benchmark, const gchar * workload,
+    GByteArray * stream, gboolean sub_buffers, FILE * out)
+{
+  MpegTSPacketizer2 *packetizer;
+  MpegTSPacketizerPacket packets[DEMUX_BATCH];
+  Result result;
+  GstClockTime start, end;
+  guint8 *known_psi;
+  gsize offset;
+  guint64 payload_bytes = 0;
+
+  packetizer = mpegts_packetizer_new ();
+  mpegts_packetizer_set_keep_buffers (packetizer, sub_buffers);
+  known_psi = g_malloc0 (0x2000);
+  known_psi[0] = 1;
+
+  result_init (&result, benchmark, workload);
+  start = gst_util_get_timestamp ();
+
+  for (offset = 0; offset < stream->len; offset += DEMUX_CHUNK_SIZE) {
+    GstClockTime t0 = gst_util_get_timestamp (), latency;
+    gsize size = MIN (DEMUX_CHUNK_SIZE, stream->len - offset);
+    GstBuffer *buf;
+    guint n_packets, i;
+
+    buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        stream->data + offset, size, 0, size, NULL, NULL);
+    GST_BUFFER_OFFSET (buf) = offset;
+    mpegts_packetizer_push (packetizer, buf);
+
+    while (mpegts_packetizer_next_packets (packetizer, packets, DEMUX_BATCH,
+            &n_packets) != PACKET_NEED_MORE) {
+      GstBuffer *run_buf = NULL;
+      gsize run_offset = 0, run_size = 0;
+
+      for (i = 0; i < n_packets; i++) {
+        MpegTSPacketizerPacket *packet = &packets[i];
+
+        if (known_psi[packet->pid])
+          demux_handle_psi (packetizer, known_psi, packet);
+        else if (packet->payload)
+          payload_bytes += packet->data_end - packet->payload;
+
+        if (sub_buffers) {
+          GstBuffer *pbuf;
+          gsize poffset;
+
+          /* Merge runs of consecutive packets into one sub-buffer */
+          pbuf = mpegts_packetizer_get_packet_buffer (packetizer, packet,
+              &poffset);
+          if (pbuf && pbuf == run_buf && poffset == run_offset + run_size) {
+            run_size += 188;
+            continue;
+          }
+          if (run_buf)
+            gst_buffer_unref (gst_buffer_copy_region (run_buf,
+                    GST_BUFFER_COPY_ALL, run_offset, run_size));
+          run_buf = pbuf;
+          run_offset = poffset;
+          run_size = 188;
+        }
+      }
+      if (run_buf)
+        gst_buffer_unref (gst_buffer_copy_region (run_buf,
+                GST_BUFFER_COPY_ALL, run_offset, run_size));
+
+      result.packets += n_packets;
+    }
+
+    latency = gst_util_get_timestamp () - t0;
+    g_array_append_val (result.latencies, latency);
+  }
+
+  end = gst_util_get_timestamp ();
+  result.elapsed = end - start;
+  result.allocs = n_allocs;
+  result.bytes = stream->len;
+
+  g_object_unref (packetizer);
+  g_free (known_psi);
+
+  if (payload_bytes == 0)
+    g_warning ("%s %s: no payload parsed", benchmark, workload);
+
+  result_print (&result, out);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  gchar *output = NULL;
+  GOptionEntry options[] = {
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Write the results to FILE instead of stdout", "FILE"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GByteArray *spts, *mpts;
+  FILE *out = stdout;
+
+  ctx = g_option_context_new ("- MPEG-TS mux/demux benchmark");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_option_context_free (ctx);
+    g_clear_error (&err);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  gst_init (NULL, NULL);
+  gst_mpegts_initialize ();
+  GST_DEBUG_CATEGORY_INIT (mpegtsmux_debug, "mpegtsmux", 0,
+      "MPEG Transport Stream muxer");
+
+  g_object_new (alloc_tracer_get_type (), NULL);
+
+  if (output && !(out = fopen (output, "w"))) {
+    g_printerr ("Could not open %s for writing\n", output);
+    return 1;
+  }
+
+  run_mux ("tsmux-alloc-func", "spts", 1, SPTS_DURATION, FALSE, FALSE, out);
+  spts = run_mux ("tsmux-packet-funcs", "spts", 1, SPTS_DURATION, TRUE, TRUE,
+      out);
+  run_mux ("tsmux-alloc-func", "mpts", MPTS_PROGRAMS, MPTS_DURATION, FALSE,
+      FALSE, out);
+  mpts = run_mux ("tsmux-packet-funcs", "mpts", MPTS_PROGRAMS, MPTS_DURATION,
+      TRUE, TRUE, out);
+
+  run_demux ("packetizer", "spts", spts, FALSE, out);
+  run_demux ("packetizer-sub-buffers", "spts", spts, TRUE, out);
+  run_demux ("packetizer", "mpts", mpts, FALSE, out);
+  run_demux ("packetizer-sub-buffers", "mpts", mpts, TRUE, out);
+
+  g_byte_array_unref (spts);
+  g_byte_array_unref (mpts);
+
+  if (out != stdout)
+    fclose (out);
+  g_free (output);
+
+  return 0;
+}
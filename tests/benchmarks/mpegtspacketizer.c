@@ -0,0 +1,197 @@
+/* GStreamer
+ *
+ * mpegtspacketizer.c: benchmark for the MPEG-TS demuxer packetizer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measures how many transport stream packets per second the packetizer of
+ * tsdemux/tsparse can split and parse, both one packet at a time and in
+ * batches, and how fast it finds sync again after garbage. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "mpegtspacketizer.h"
+
+#define NUM_PACKETS (100 * 1000)
+#define BUFFER_PACKETS 7
+#define PCR_PACKET_INTERVAL 40
+#define GARBAGE_SIZE (16 * 1024 * 1024)
+#define BATCH_SIZE 64
+
+typedef guint (*DrainFunc) (MpegTSPacketizer2 * packetizer);
+
+/* Creates @n_packets packets on one PID, with a PCR in every
+ * PCR_PACKET_INTERVAL'th packet */
+static guint8 *
+make_stream (guint packet_size, guint n_packets)
+{
+  guint8 *data, *packet;
+  guint sync_offset = packet_size == MPEGTS_M2TS_PACKETSIZE ? 4 : 0;
+  guint i;
+
+  data = g_malloc0 (packet_size * n_packets);
+
+  for (i = 0; i < n_packets; i++) {
+    packet = data + i * packet_size + sync_offset;
+
+    packet[0] = 0x47;
+    packet[1] = (i == 0 ? 0x40 : 0x00) | 0x01;
+    packet[2] = 0x00;
+
+    if (i % PCR_PACKET_INTERVAL == 0) {
+      guint64 pcr_base = i * 300;
+
+      /* adaptation field with PCR, followed by payload */
+      packet[3] = 0x30 | (i & 0x0f);
+      packet[4] = 7;
+      packet[5] = 0x10;
+      packet[6] = (pcr_base >> 25) & 0xff;
+      packet[7] = (pcr_base >> 17) & 0xff;
+      packet[8] = (pcr_base >> 9) & 0xff;
+      packet[9] = (pcr_base >> 1) & 0xff;
+      packet[10] = ((pcr_base & 0x1) << 7) | 0x7e;
+      packet[11] = 0x00;
+      memset (packet + 12, 0xa5, 188 - 12);
+    } else {
+      packet[3] = 0x10 | (i & 0x0f);
+      memset (packet + 4, 0xa5, 188 - 4);
+    }
+  }
+
+  return data;
+}
+
+static guint
+drain_single (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPacket packet;
+  MpegTSPacketizerPacketReturn ret;
+  guint count = 0;
+
+  while ((ret = mpegts_packetizer_next_packet (packetizer,
+              &packet)) != PACKET_NEED_MORE) {
+    if (ret == PACKET_OK)
+      count++;
+    mpegts_packetizer_clear_packet (packetizer, &packet);
+  }
+
+  return count;
+}
+
+static guint
+drain_batch (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPacket packets[BATCH_SIZE];
+  guint n_packets, count = 0;
+
+  while (mpegts_packetizer_next_packets (packetizer, packets, BATCH_SIZE,
+          &n_packets) != PACKET_NEED_MORE)
+    count += n_packets;
+
+  return count;
+}
+
+static void
+run_parse (const gchar * name, guint packet_size, DrainFunc drain)
+{
+  MpegTSPacketizer2 *packetizer;
+  GstClockTime start, end;
+  guint8 *data;
+  gsize chunk_size = BUFFER_PACKETS * packet_size;
+  guint i, count = 0;
+
+  data = make_stream (packet_size, NUM_PACKETS);
+  packetizer = mpegts_packetizer_new ();
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i + BUFFER_PACKETS <= NUM_PACKETS; i += BUFFER_PACKETS) {
+    GstBuffer *buf;
+
+    buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        data + i * packet_size, chunk_size, 0, chunk_size, NULL, NULL);
+    GST_BUFFER_OFFSET (buf) = i * packet_size;
+    mpegts_packetizer_push (packetizer, buf);
+    count += drain (packetizer);
+  }
+  end = gst_util_get_timestamp ();
+
+  g_object_unref (packetizer);
+  g_free (data);
+
+  if (count != i)
+    g_warning ("%s: parsed %u packets", name, count);
+
+  g_print ("%-20s packet-size %u: %" GST_TIME_FORMAT ", %.0f packets/s\n",
+      name, packet_size, GST_TIME_ARGS (end - start),
+      (gdouble) count * GST_SECOND / MAX (end - start, 1));
+}
+
+static void
+run_sync (guint packet_size)
+{
+  MpegTSPacketizer2 *packetizer;
+  GstClockTime start, end;
+  guint8 *data, *packets;
+  gsize size = GARBAGE_SIZE + 16 * packet_size;
+  guint count;
+
+  /* garbage without any sync byte, followed by a few packets */
+  data = g_malloc (size);
+  memset (data, 0xff, GARBAGE_SIZE);
+  packets = make_stream (packet_size, 16);
+  memcpy (data + GARBAGE_SIZE, packets, 16 * packet_size);
+  g_free (packets);
+
+  packetizer = mpegts_packetizer_new ();
+
+  start = gst_util_get_timestamp ();
+  mpegts_packetizer_push (packetizer, gst_buffer_new_wrapped (data, size));
+  count = drain_single (packetizer);
+  end = gst_util_get_timestamp ();
+
+  g_object_unref (packetizer);
+
+  g_print ("%-20s packet-size %u: %" GST_TIME_FORMAT
+      ", %.1f MB/s (%u packets)\n", "sync", packet_size,
+      GST_TIME_ARGS (end - start),
+      (gdouble) GARBAGE_SIZE * GST_SECOND / MAX (end - start, 1) / 1e6, count);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  static const guint packet_sizes[] = {
+    MPEGTS_NORMAL_PACKETSIZE, MPEGTS_M2TS_PACKETSIZE
+  };
+  guint i;
+
+  gst_init (&argc, &argv);
+
+  for (i = 0; i < G_N_ELEMENTS (packet_sizes); i++) {
+    run_parse ("next_packet", packet_sizes[i], drain_single);
+    run_parse ("next_packets", packet_sizes[i], drain_batch);
+    run_sync (packet_sizes[i]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,293 @@
+/* GStreamer
+ *
+ * startcode.c: benchmark for the codec parsers' start code scanning
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measures how fast start codes are found in byte streams, both with the
+ * scanner shared by the codec parsers and with
+ * gst_byte_reader_masked_scan_uint32() which they used before, and how fast
+ * the H.264, H.265 and MPEG video parsers split a stream into NAL units or
+ * packets.
+ *
+ * Real bitstreams can be given on the command line as
+ * h264:FILE, h265:FILE or mpegvideo:FILE; without any, synthetic streams
+ * with the slice sizes of high bitrate 4K video are used. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbytereader.h>
+#include <gst/codecparsers/gsth264parser.h>
+#include <gst/codecparsers/gsth265parser.h>
+#include <gst/codecparsers/gstmpegvideoparser.h>
+
+#include "nalutils.h"
+
+#define SYNTHETIC_SIZE (64 * 1024 * 1024)
+#define MIN_SLICE_SIZE (16 * 1024)
+#define MAX_SLICE_SIZE (256 * 1024)
+#define ITERATIONS 10
+
+typedef enum
+{
+  CODEC_H264,
+  CODEC_H265,
+  CODEC_MPEG_VIDEO
+} Codec;
+
+static const gchar *codec_names[] = { "h264", "h265", "mpegvideo" };
+
+typedef guint (*RunFunc) (const guint8 * data, gsize size);
+
+/* Random slices, with emulation prevention so that the payload contains no
+ * start codes */
+static guint8 *
+make_stream (Codec codec, gsize size)
+{
+  GRand *rand = g_rand_new_with_seed (size);
+  guint8 *data = g_malloc (size);
+  gsize pos = 0;
+
+  while (pos + 8 < size) {
+    gsize end = MIN (size, pos + g_rand_int_range (rand, MIN_SLICE_SIZE,
+            MAX_SLICE_SIZE));
+    guint zeros = 0;
+
+    data[pos++] = 0x00;
+    data[pos++] = 0x00;
+    data[pos++] = 0x01;
+    switch (codec) {
+      case CODEC_H264:
+        /* non-IDR slice */
+        data[pos++] = 0x41;
+        break;
+      case CODEC_H265:
+        /* TRAIL_R slice */
+        data[pos++] = 0x02;
+        data[pos++] = 0x01;
+        break;
+      case CODEC_MPEG_VIDEO:
+        /* slice */
+        data[pos++] = 0x01;
+        break;
+    }
+
+    while (pos < end) {
+      guint8 byte = g_rand_int (rand);
+
+      if (zeros == 2 && byte <= 0x03) {
+        data[pos++] = 0x03;
+        zeros = 0;
+        continue;
+      }
+      zeros = byte ? 0 : zeros + 1;
+      data[pos++] = byte;
+    }
+  }
+
+  /* No partial start code at the end */
+  while (pos < size)
+    data[pos++] = 0xff;
+
+  g_rand_free (rand);
+
+  return data;
+}
+
+static guint
+run_masked_scan (const guint8 * data, gsize size)
+{
+  GstByteReader br;
+  guint count = 0;
+  gint off = 0;
+
+  gst_byte_reader_init (&br, data, size);
+
+  while ((off = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00,
+              0x00000100, off, size - off)) >= 0) {
+    count++;
+    off += 3;
+  }
+
+  return count;
+}
+
+static guint
+run_scan (const guint8 * data, gsize size)
+{
+  guint count = 0;
+  gsize pos = 0;
+  gint off;
+
+  while ((off = scan_for_start_codes (data + pos, size - pos)) >= 0) {
+    count++;
+    pos += off + 3;
+  }
+
+  return count;
+}
+
+static guint
+run_h264_identify (const guint8 * data, gsize size)
+{
+  GstH264NalParser *parser = gst_h264_nal_parser_new ();
+  GstH264NalUnit nalu;
+  GstH264ParserResult res;
+  guint count = 0, offset = 0;
+
+  do {
+    res = gst_h264_parser_identify_nalu (parser, data, offset, size, &nalu);
+    if (res != GST_H264_PARSER_OK && res != GST_H264_PARSER_NO_NAL_END)
+      break;
+    count++;
+    offset = nalu.offset + nalu.size;
+  } while (res == GST_H264_PARSER_OK);
+
+  gst_h264_nal_parser_free (parser);
+
+  return count;
+}
+
+static guint
+run_h265_identify (const guint8 * data, gsize size)
+{
+  GstH265Parser *parser = gst_h265_parser_new ();
+  GstH265NalUnit nalu;
+  GstH265ParserResult res;
+  guint count = 0, offset = 0;
+
+  do {
+    res = gst_h265_parser_identify_nalu (parser, data, offset, size, &nalu);
+    if (res != GST_H265_PARSER_OK && res != GST_H265_PARSER_NO_NAL_END)
+      break;
+    count++;
+    offset = nalu.offset + nalu.size;
+  } while (res == GST_H265_PARSER_OK);
+
+  gst_h265_parser_free (parser);
+
+  return count;
+}
+
+static guint
+run_mpeg_video_parse (const guint8 * data, gsize size)
+{
+  GstMpegVideoPacket packet;
+  guint count = 0, offset = 0;
+
+  while (gst_mpeg_video_parse (&packet, data, size, offset)) {
+    count++;
+    if (packet.size < 0)
+      break;
+    offset = packet.offset + packet.size;
+  }
+
+  return count;
+}
+
+static void
+run (const gchar * name, const gchar * input, RunFunc func,
+    const guint8 * data, gsize size)
+{
+  GstClockTime start, end;
+  guint i, count = 0;
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < ITERATIONS; i++)
+    count = func (data, size);
+  end = gst_util_get_timestamp ();
+
+  g_print ("%-16s %-24s: %" GST_TIME_FORMAT ", %.1f MB/s (%u units)\n",
+      name, input, GST_TIME_ARGS ((end - start) / ITERATIONS),
+      (gdouble) size * ITERATIONS * GST_SECOND / MAX (end - start, 1) / 1e6,
+      count);
+}
+
+static void
+run_all (Codec codec, const gchar * input, const guint8 * data, gsize size)
+{
+  run ("masked-scan", input, run_masked_scan, data, size);
+  run ("scan", input, run_scan, data, size);
+
+  switch (codec) {
+    case CODEC_H264:
+      run ("h264-identify", input, run_h264_identify, data, size);
+      break;
+    case CODEC_H265:
+      run ("h265-identify", input, run_h265_identify, data, size);
+      break;
+    case CODEC_MPEG_VIDEO:
+      run ("mpegvideo-parse", input, run_mpeg_video_parse, data, size);
+      break;
+  }
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  Codec codec;
+  gint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc < 2) {
+    for (codec = CODEC_H264; codec <= CODEC_MPEG_VIDEO; codec++) {
+      guint8 *data = make_stream (codec, SYNTHETIC_SIZE);
+
+      run_all (codec, codec_names[codec], data, SYNTHETIC_SIZE);
+      g_free (data);
+    }
+    return 0;
+  }
+
+  for (i = 1; i < argc; i++) {
+    gchar **arg = g_strsplit (argv[i], ":", 2);
+    GError *err = NULL;
+    gchar *contents;
+    gsize size;
+
+    for (codec = CODEC_H264; codec <= CODEC_MPEG_VIDEO; codec++) {
+      if (!g_strcmp0 (arg[0], codec_names[codec]))
+        break;
+    }
+
+    if (codec > CODEC_MPEG_VIDEO || !arg[1]) {
+      g_printerr ("Usage: %s [h264|h265|mpegvideo:FILE ...]\n", argv[0]);
+      g_strfreev (arg);
+      return 1;
+    }
+
+    if (!g_file_get_contents (arg[1], &contents, &size, &err)) {
+      g_printerr ("Could not read %s: %s\n", arg[1], err->message);
+      g_clear_error (&err);
+      g_strfreev (arg);
+      return 1;
+    }
+
+    run_all (codec, arg[1], (const guint8 *) contents, size);
+
+    g_free (contents);
+    g_strfreev (arg);
+  }
+
+  return 0;
+}
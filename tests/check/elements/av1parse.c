@@ -0,0 +1,202 @@
+/* GStreamer
+ *
+ * av1parse.c: unit tests for av1parse
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/check.h>
+
+/* temporal delimiter, sequence header (320x240, main profile, 8 bit 4:2:0),
+ * key frame header and a tile group */
+static const guint8 tu_key[] = {
+  0x12, 0x00, 0x0a, 0x0b, 0x00, 0x00, 0x00, 0x42, 0x61, 0x3f, 0x77, 0xbf,
+  0xff, 0x30, 0x08, 0x1a, 0x02, 0x10, 0x01, 0x22, 0x03, 0xaa, 0xbb, 0xcc
+};
+
+/* temporal delimiter, inter frame header and a tile group */
+static const guint8 tu_inter[] = {
+  0x12, 0x00, 0x1a, 0x07, 0x30, 0x03, 0xc0, 0x40, 0x00, 0x00, 0x40, 0x22,
+  0x03, 0xaa, 0xbb, 0xcc
+};
+
+/* the same temporal units in the Annex B format */
+static const guint8 tu_key_annexb[] = {
+  0x1d, 0x1c, 0x02, 0x12, 0x00, 0x0d, 0x0a, 0x0b, 0x00, 0x00, 0x00, 0x42,
+  0x61, 0x3f, 0x77, 0xbf, 0xff, 0x30, 0x08, 0x04, 0x1a, 0x02, 0x10, 0x01,
+  0x05, 0x22, 0x03, 0xaa, 0xbb, 0xcc
+};
+
+static const guint8 tu_inter_annexb[] = {
+  0x14, 0x13, 0x02, 0x12, 0x00, 0x09, 0x1a, 0x07, 0x30, 0x03, 0xc0, 0x40,
+  0x00, 0x00, 0x40, 0x05, 0x22, 0x03, 0xaa, 0xbb, 0xcc
+};
+
+static void
+push_data (GstHarness * h, const guint8 * data, gsize size)
+{
+  GstBuffer *buf;
+
+  buf = gst_buffer_new_and_alloc (size);
+  gst_buffer_fill (buf, 0, data, size);
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+}
+
+static void
+pull_and_check (GstHarness * h, const guint8 * data, gsize size,
+    gboolean keyframe)
+{
+  GstBuffer *buf;
+
+  buf = gst_harness_pull (h);
+  fail_unless (buf != NULL);
+  fail_unless_equals_int (gst_buffer_get_size (buf), size);
+  fail_unless (gst_buffer_memcmp (buf, 0, data, size) == 0);
+  fail_unless_equals_int (!GST_BUFFER_FLAG_IS_SET (buf,
+          GST_BUFFER_FLAG_DELTA_UNIT), keyframe);
+  gst_buffer_unref (buf);
+}
+
+GST_START_TEST (test_av1parse_obu_stream)
+{
+  GstHarness *h;
+  GstCaps *caps;
+  GstStructure *s;
+  const GValue *value;
+  GstBuffer *codec_data;
+  gint width, height;
+
+  h = gst_harness_new ("av1parse");
+  gst_harness_set_src_caps_str (h,
+      "video/x-av1, stream-format=(string)obu-stream, alignment=(string)tu");
+
+  push_data (h, tu_key, sizeof (tu_key));
+  push_data (h, tu_inter, sizeof (tu_inter));
+
+  pull_and_check (h, tu_key, sizeof (tu_key), TRUE);
+  pull_and_check (h, tu_inter, sizeof (tu_inter), FALSE);
+
+  caps = gst_pad_get_current_caps (h->sinkpad);
+  fail_unless (caps != NULL);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless (gst_structure_get_int (s, "width", &width));
+  fail_unless (gst_structure_get_int (s, "height", &height));
+  fail_unless_equals_int (width, 320);
+  fail_unless_equals_int (height, 240);
+  fail_unless_equals_string (gst_structure_get_string (s, "profile"), "main");
+  fail_unless_equals_string (gst_structure_get_string (s, "chroma-format"),
+      "4:2:0");
+
+  /* AV1CodecConfigurationRecord followed by the sequence header OBU */
+  value = gst_structure_get_value (s, "codec_data");
+  fail_unless (value != NULL);
+  codec_data = gst_value_get_buffer (value);
+  fail_unless_equals_int (gst_buffer_get_size (codec_data), 4 + 13);
+  {
+    const guint8 header[] = { 0x81, 0x08, 0x0c, 0x00 };
+
+    fail_unless (gst_buffer_memcmp (codec_data, 0, header, 4) == 0);
+    fail_unless (gst_buffer_memcmp (codec_data, 4, tu_key + 2, 13) == 0);
+  }
+  gst_caps_unref (caps);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_av1parse_byte_stream)
+{
+  GstHarness *h;
+  GstBuffer *buf;
+
+  h = gst_harness_new ("av1parse");
+  gst_harness_set_src_caps_str (h,
+      "video/x-av1, stream-format=(string)obu-stream");
+
+  /* both temporal units in one buffer, the end of the second one is only
+   * known on EOS */
+  buf = gst_buffer_new_and_alloc (sizeof (tu_key) + sizeof (tu_inter));
+  gst_buffer_fill (buf, 0, tu_key, sizeof (tu_key));
+  gst_buffer_fill (buf, sizeof (tu_key), tu_inter, sizeof (tu_inter));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  fail_unless (gst_harness_push_event (h, gst_event_new_eos ()));
+
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 2);
+  pull_and_check (h, tu_key, sizeof (tu_key), TRUE);
+  pull_and_check (h, tu_inter, sizeof (tu_inter), FALSE);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_av1parse_to_annexb)
+{
+  GstHarness *h;
+
+  h = gst_harness_new ("av1parse");
+  gst_harness_set_caps_str (h,
+      "video/x-av1, stream-format=(string)obu-stream, alignment=(string)tu",
+      "video/x-av1, stream-format=(string)annexb, alignment=(string)tu");
+
+  push_data (h, tu_key, sizeof (tu_key));
+  push_data (h, tu_inter, sizeof (tu_inter));
+
+  pull_and_check (h, tu_key_annexb, sizeof (tu_key_annexb), TRUE);
+  pull_and_check (h, tu_inter_annexb, sizeof (tu_inter_annexb), FALSE);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_av1parse_from_annexb)
+{
+  GstHarness *h;
+
+  h = gst_harness_new ("av1parse");
+  gst_harness_set_caps_str (h,
+      "video/x-av1, stream-format=(string)annexb, alignment=(string)tu",
+      "video/x-av1, stream-format=(string)obu-stream, alignment=(string)tu");
+
+  push_data (h, tu_key_annexb, sizeof (tu_key_annexb));
+  push_data (h, tu_inter_annexb, sizeof (tu_inter_annexb));
+
+  pull_and_check (h, tu_key, sizeof (tu_key), TRUE);
+  pull_and_check (h, tu_inter, sizeof (tu_inter), FALSE);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+static Suite *
+av1parse_suite (void)
+{
+  Suite *s = suite_create ("av1parse");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_av1parse_obu_stream);
+  tcase_add_test (tc_chain, test_av1parse_byte_stream);
+  tcase_add_test (tc_chain, test_av1parse_to_annexb);
+  tcase_add_test (tc_chain, test_av1parse_from_annexb);
+
+  return s;
+}
+
+GST_CHECK_MAIN (av1parse);
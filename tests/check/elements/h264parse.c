@@ -25,6 +25,7 @@
 
 #include <gst/check/check.h>
 #include <gst/video/video.h>
+#include <gst/codecparsers/gsth26xaumeta.h>
 #include "parser.h"
 
 #define SRC_CAPS_TMPL   "video/x-h264, parsed=(boolean)false"
@@ -566,6 +567,464 @@ GST_START_TEST (test_parse_sei_closedcaptions)
 
 GST_END_TEST;
 
+GST_START_TEST (test_parse_gop_cache)
+{
+  GstHarness *h;
+  GstBuffer *buf;
+  gsize idr_size;
+  guint upstream_events;
+  gint i;
+
+  const guint8 idr_au[] = {
+    0x00, 0x00, 0x00, 0x14, 0x65, 0x88, 0x84, 0x00,
+    0x10, 0xff, 0xfe, 0xf6, 0xf0, 0xfe, 0x05, 0x36,
+    0x56, 0x04, 0x50, 0x96, 0x7b, 0x3f, 0x53, 0xe1
+  };
+  const guint8 p_au[] = {
+    0x00, 0x00, 0x00, 0x08, 0x41, 0xe0, 0x00, 0x10,
+    0xff, 0xfe, 0xf6, 0xf0
+  };
+
+  h = gst_harness_new ("h264parse");
+  g_object_set (h->element, "gop-cache", TRUE, NULL);
+
+  gst_harness_set_src_caps_str (h,
+      "video/x-h264, stream-format=(string)avc, alignment=(string)au,"
+      " codec_data=(buffer)014d4015ffe10017674d4015eca4bf2e0220000003002ee6b28001e2c5b2c001000468ebecb2,"
+      " width=(int)32, height=(int)24, framerate=(fraction)30/1,"
+      " pixel-aspect-ratio=(fraction)1/1");
+
+  buf = gst_buffer_new_and_alloc (sizeof (idr_au));
+  gst_buffer_fill (buf, 0, idr_au, sizeof (idr_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  buf = gst_harness_pull (h);
+  idr_size = gst_buffer_get_size (buf);
+  gst_buffer_unref (buf);
+
+  buf = gst_buffer_new_and_alloc (sizeof (p_au));
+  gst_buffer_fill (buf, 0, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  gst_buffer_unref (gst_harness_pull (h));
+
+  /* a key unit at a given running time is not answered from the cache */
+  upstream_events = gst_harness_upstream_events_received (h);
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_video_event_new_upstream_force_key_unit (GST_SECOND, TRUE, 1)));
+  fail_unless_equals_int (gst_harness_upstream_events_received (h),
+      upstream_events + 1);
+
+  /* neither is an immediate one from a consumer that got the keyframe, it
+   * would receive the AUs a second time */
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+              TRUE, 1)));
+  fail_unless_equals_int (gst_harness_upstream_events_received (h),
+      upstream_events + 2);
+
+  buf = gst_buffer_new_and_alloc (sizeof (p_au));
+  gst_buffer_fill (buf, 0, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 1);
+  gst_buffer_unref (gst_harness_pull (h));
+
+  /* a new consumer asking for a key unit gets the GOP so far, before the
+   * next AU, and the request doesn't go upstream */
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_event_new_reconfigure ()));
+  upstream_events = gst_harness_upstream_events_received (h);
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+              TRUE, 1)));
+  fail_unless_equals_int (gst_harness_upstream_events_received (h),
+      upstream_events);
+
+  buf = gst_buffer_new_and_alloc (sizeof (p_au));
+  gst_buffer_fill (buf, 0, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 4);
+
+  buf = gst_harness_pull (h);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT));
+  fail_if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+  fail_unless (gst_buffer_get_size (buf) >= idr_size);
+  fail_unless (gst_buffer_memcmp (buf, gst_buffer_get_size (buf) - 20,
+          idr_au + 4, 20) == 0);
+  gst_buffer_unref (buf);
+
+  for (i = 0; i < 3; i++) {
+    buf = gst_harness_pull (h);
+    fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+    fail_unless_equals_int (gst_buffer_get_size (buf), sizeof (p_au));
+    gst_buffer_unref (buf);
+  }
+
+  /* the new consumer got its GOP, its next request goes upstream */
+  upstream_events = gst_harness_upstream_events_received (h);
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+              TRUE, 1)));
+  fail_unless_equals_int (gst_harness_upstream_events_received (h),
+      upstream_events + 1);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_parse_au_meta)
+{
+  GstH26xAUMeta *meta;
+  GstH26xAUNal *nal;
+  GstHarness *h;
+  GstBuffer *buf, *copy;
+
+  const guint8 idr_au[] = {
+    0x00, 0x00, 0x00, 0x14, 0x65, 0x88, 0x84, 0x00,
+    0x10, 0xff, 0xfe, 0xf6, 0xf0, 0xfe, 0x05, 0x36,
+    0x56, 0x04, 0x50, 0x96, 0x7b, 0x3f, 0x53, 0xe1
+  };
+  const guint8 p_au[] = {
+    0x00, 0x00, 0x00, 0x08, 0x41, 0xe0, 0x00, 0x10,
+    0xff, 0xfe, 0xf6, 0xf0
+  };
+
+  h = gst_harness_new ("h264parse");
+
+  gst_harness_set_src_caps_str (h,
+      "video/x-h264, stream-format=(string)avc, alignment=(string)au,"
+      " codec_data=(buffer)014d4015ffe10017674d4015eca4bf2e0220000003002ee6b28001e2c5b2c001000468ebecb2,"
+      " width=(int)32, height=(int)24, framerate=(fraction)30/1,"
+      " pixel-aspect-ratio=(fraction)1/1");
+
+  buf = gst_buffer_new_and_alloc (sizeof (idr_au));
+  gst_buffer_fill (buf, 0, idr_au, sizeof (idr_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+
+  buf = gst_harness_pull (h);
+  meta = gst_buffer_get_h26x_au_meta (buf);
+  fail_unless (meta != NULL);
+  fail_unless_equals_int (meta->codec, GST_H26X_AU_META_CODEC_H264);
+  fail_unless (meta->flags & GST_H26X_AU_META_FLAG_KEYFRAME);
+  fail_unless (meta->flags & GST_H26X_AU_META_FLAG_IDR);
+  fail_if (meta->flags & GST_H26X_AU_META_FLAG_RECOVERY_POINT);
+  fail_unless (GST_H26X_AU_META_HAS_SLICE_TYPE (meta, GST_H264_I_SLICE));
+  fail_if (GST_H26X_AU_META_HAS_SLICE_TYPE (meta, GST_H264_P_SLICE));
+  fail_unless_equals_int (meta->frame_num, 0);
+  fail_unless_equals_int (meta->poc, 0);
+  fail_unless_equals_int (meta->sps_id, 0);
+  fail_unless_equals_int (meta->pps_id, 0);
+  /* the slice is last, after any parameter sets that were inserted */
+  fail_unless (meta->n_nals >= 1);
+  nal = &meta->nals[meta->n_nals - 1];
+  fail_unless_equals_int (nal->type, GST_H264_NAL_SLICE_IDR);
+  fail_unless_equals_int (nal->slice_type, GST_H264_I_SLICE);
+  fail_unless_equals_int (nal->size, sizeof (idr_au));
+  fail_unless_equals_int (nal->offset + nal->size, gst_buffer_get_size (buf));
+  fail_unless (gst_buffer_memcmp (buf, nal->offset, idr_au,
+          sizeof (idr_au)) == 0);
+
+  /* the offsets belong to the memory, copying only the metadata drops it */
+  copy = gst_buffer_new ();
+  gst_buffer_copy_into (copy, buf, GST_BUFFER_COPY_METADATA, 0, -1);
+  fail_unless (gst_buffer_get_h26x_au_meta (copy) == NULL);
+  gst_buffer_unref (copy);
+  gst_buffer_unref (buf);
+
+  buf = gst_buffer_new_and_alloc (sizeof (p_au));
+  gst_buffer_fill (buf, 0, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+
+  buf = gst_harness_pull (h);
+  meta = gst_buffer_get_h26x_au_meta (buf);
+  fail_unless (meta != NULL);
+  fail_if (meta->flags & GST_H26X_AU_META_FLAG_KEYFRAME);
+  fail_if (meta->flags & GST_H26X_AU_META_FLAG_IDR);
+  fail_unless (GST_H26X_AU_META_HAS_SLICE_TYPE (meta, GST_H264_P_SLICE));
+  fail_unless_equals_int (meta->n_nals, 1);
+  fail_unless_equals_int (meta->nals[0].offset, 0);
+  fail_unless_equals_int (meta->nals[0].size, sizeof (p_au));
+  fail_unless_equals_int (meta->nals[0].type, GST_H264_NAL_SLICE);
+  fail_unless_equals_int (meta->nals[0].slice_type, GST_H264_P_SLICE);
+  gst_buffer_unref (buf);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+#define AVC_CAPS "video/x-h264, stream-format=(string)avc, " \
+    "alignment=(string)au, codec_data=(buffer)014d4015ffe10017674d4015eca4" \
+    "bf2e0220000003002ee6b28001e2c5b2c001000468ebecb2, width=(int)32, " \
+    "height=(int)24, framerate=(fraction)30/1"
+#define BYTE_STREAM_AU_CAPS "video/x-h264, " \
+    "stream-format=(string)byte-stream, alignment=(string)au"
+
+static const guint8 start_code[] = { 0x00, 0x00, 0x00, 0x01 };
+
+/* appends @nal to the AVC @au and the byte-stream @expected */
+static void
+append_nal (GByteArray * au, GByteArray * expected, const guint8 * nal,
+    gsize size)
+{
+  guint8 len[4];
+
+  GST_WRITE_UINT32_BE (len, size);
+  g_byte_array_append (au, len, sizeof (len));
+  g_byte_array_append (au, nal, size);
+  g_byte_array_append (expected, start_code, sizeof (start_code));
+  g_byte_array_append (expected, nal, size);
+}
+
+/* an AUD, @n_sei SEI and a P slice */
+static void
+make_p_au (guint n_sei, GByteArray * au, GByteArray * expected)
+{
+  const guint8 aud[] = { 0x09, 0xf0 };
+  const guint8 sei[] = { 0x06, 0x05, 0x04, 0xde, 0xad, 0xbe, 0xef, 0x80 };
+  const guint8 slice[] = { 0x41, 0xe0, 0x00, 0x10, 0xff, 0xfe, 0xf6, 0xf0 };
+  guint i;
+
+  append_nal (au, expected, aud, sizeof (aud));
+  for (i = 0; i < n_sei; i++)
+    append_nal (au, expected, sei, sizeof (sei));
+  append_nal (au, expected, slice, sizeof (slice));
+}
+
+static GstHarness *
+setup_avc_to_byte_stream (void)
+{
+  const guint8 idr_au[] = {
+    0x00, 0x00, 0x00, 0x14, 0x65, 0x88, 0x84, 0x00,
+    0x10, 0xff, 0xfe, 0xf6, 0xf0, 0xfe, 0x05, 0x36,
+    0x56, 0x04, 0x50, 0x96, 0x7b, 0x3f, 0x53, 0xe1
+  };
+  GstHarness *h;
+  GstBuffer *buf;
+
+  h = gst_harness_new ("h264parse");
+  gst_harness_set_sink_caps_str (h, BYTE_STREAM_AU_CAPS);
+  gst_harness_set_src_caps_str (h, AVC_CAPS);
+
+  /* gets the SPS and PPS inserted */
+  buf = gst_buffer_new_and_alloc (sizeof (idr_au));
+  gst_buffer_fill (buf, 0, idr_au, sizeof (idr_au));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  gst_buffer_unref (gst_harness_pull (h));
+
+  return h;
+}
+
+GST_START_TEST (test_parse_convert_zero_copy)
+{
+  GByteArray *au, *expected;
+  GstMapInfo in_map, map;
+  GstMemory *in_mem;
+  GstHarness *h;
+  GstBuffer *buf;
+  gsize shared = 0;
+  guint i, n_nals = 4;
+
+  h = setup_avc_to_byte_stream ();
+
+  au = g_byte_array_new ();
+  expected = g_byte_array_new ();
+  make_p_au (n_nals - 2, au, expected);
+
+  buf = gst_buffer_new_and_alloc (au->len);
+  gst_buffer_fill (buf, 0, au->data, au->len);
+  in_mem = gst_memory_ref (gst_buffer_peek_memory (buf, 0));
+  fail_unless (gst_memory_map (in_mem, &in_map, GST_MAP_READ));
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+
+  buf = gst_harness_pull (h);
+  fail_unless_equals_int (gst_buffer_get_size (buf), expected->len);
+  fail_unless (gst_buffer_memcmp (buf, 0, expected->data,
+          expected->len) == 0);
+
+  /* the NALUs are regions of the input, only the start codes are new */
+  for (i = 0; i < gst_buffer_n_memory (buf); i++) {
+    GstMemory *mem = gst_buffer_peek_memory (buf, i);
+
+    fail_unless (gst_memory_map (mem, &map, GST_MAP_READ));
+    if (map.data >= in_map.data && map.data < in_map.data + in_map.size) {
+      fail_unless (map.data + map.size <= in_map.data + in_map.size);
+      shared += map.size;
+    } else {
+      fail_unless_equals_int (map.size, sizeof (start_code));
+      fail_unless (memcmp (map.data, start_code, sizeof (start_code)) == 0);
+    }
+    gst_memory_unmap (mem, &map);
+  }
+  fail_unless_equals_int (shared, expected->len - n_nals * 4);
+  gst_buffer_unref (buf);
+
+  gst_memory_unmap (in_mem, &in_map);
+  gst_memory_unref (in_mem);
+  g_byte_array_unref (au);
+  g_byte_array_unref (expected);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_parse_convert_many_nals)
+{
+  GByteArray *au, *expected;
+  GstHarness *h;
+  GstBuffer *buf;
+
+  h = setup_avc_to_byte_stream ();
+
+  /* each NALU needs a start code and a region of the input, more than fit
+   * in a buffer */
+  au = g_byte_array_new ();
+  expected = g_byte_array_new ();
+  make_p_au (gst_buffer_get_max_memory (), au, expected);
+
+  buf = gst_buffer_new_and_alloc (au->len);
+  gst_buffer_fill (buf, 0, au->data, au->len);
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+
+  buf = gst_harness_pull (h);
+  fail_unless (gst_buffer_n_memory (buf) <= gst_buffer_get_max_memory ());
+  fail_unless_equals_int (gst_buffer_get_size (buf), expected->len);
+  fail_unless (gst_buffer_memcmp (buf, 0, expected->data,
+          expected->len) == 0);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+  gst_buffer_unref (buf);
+
+  g_byte_array_unref (au);
+  g_byte_array_unref (expected);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+#ifndef GST_DISABLE_GST_DEBUG
+typedef struct
+{
+  guint repeated_sps;
+  guint repeated_pps;
+  guint repeated_sei;
+  guint caps_checks;
+} ParsedNals;
+
+/* counts what h264parse says about the parameter sets and SEI it skips */
+static void
+count_parsed_nals (GstDebugCategory * category, GstDebugLevel level,
+    const gchar * file, const gchar * function, gint line, GObject * object,
+    GstDebugMessage * message, gpointer user_data)
+{
+  ParsedNals *parsed = user_data;
+  const gchar *msg;
+
+  if (strcmp (gst_debug_category_get_name (category), "h264parse") != 0)
+    return;
+
+  msg = gst_debug_message_get (message);
+  if (g_str_has_suffix (msg, "repeated, not parsing it again")) {
+    if (g_str_has_prefix (msg, "SPS"))
+      parsed->repeated_sps++;
+    else if (g_str_has_prefix (msg, "PPS"))
+      parsed->repeated_pps++;
+    else if (g_str_has_prefix (msg, "SEI"))
+      parsed->repeated_sei++;
+  } else if (strcmp (msg, "triggering src caps check") == 0) {
+    parsed->caps_checks++;
+  }
+}
+
+static void
+push_au_check_parsed (GstHarness * h, const guint8 * data, gsize size,
+    ParsedNals * parsed, guint repeated_sps, guint repeated_pps,
+    guint repeated_sei)
+{
+  GstBuffer *buf = gst_buffer_new_and_alloc (size);
+
+  gst_buffer_fill (buf, 0, data, size);
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+  gst_buffer_unref (gst_harness_pull (h));
+
+  fail_unless_equals_int (parsed->repeated_sps, repeated_sps);
+  fail_unless_equals_int (parsed->repeated_pps, repeated_pps);
+  fail_unless_equals_int (parsed->repeated_sei, repeated_sei);
+}
+
+GST_START_TEST (test_parse_repeated_headers)
+{
+  ParsedNals parsed = { 0, };
+  GstStructure *s;
+  GstHarness *h;
+  GstCaps *caps;
+  guint events, caps_checks;
+  gint width;
+
+  /* the SPS and PPS of the codec_data, an SEI and an IDR slice */
+  const guint8 au[] = {
+    0x00, 0x00, 0x00, 0x17, 0x67, 0x4d, 0x40, 0x15,
+    0xec, 0xa4, 0xbf, 0x2e, 0x02, 0x20, 0x00, 0x00,
+    0x03, 0x00, 0x2e, 0xe6, 0xb2, 0x80, 0x01, 0xe2,
+    0xc5, 0xb2, 0xc0,
+    0x00, 0x00, 0x00, 0x04, 0x68, 0xeb, 0xec, 0xb2,
+    0x00, 0x00, 0x00, 0x08, 0x06, 0x05, 0x04, 0xde,
+    0xad, 0xbe, 0xef, 0x80,
+    0x00, 0x00, 0x00, 0x14, 0x65, 0x88, 0x84, 0x00,
+    0x10, 0xff, 0xfe, 0xf6, 0xf0, 0xfe, 0x05, 0x36,
+    0x56, 0x04, 0x50, 0x96, 0x7b, 0x3f, 0x53, 0xe1
+  };
+  guint8 changed_au[sizeof (au)];
+
+  /* the same with pic_width_in_mbs_minus1 2 instead of 1 in the SPS */
+  memcpy (changed_au, au, sizeof (au));
+  changed_au[9] = 0xa6;
+
+  gst_debug_set_threshold_for_name ("h264parse", GST_LEVEL_LOG);
+  gst_debug_add_log_function (count_parsed_nals, &parsed, NULL);
+
+  h = gst_harness_new ("h264parse");
+
+  /* without a size, which would override the one of the SPS */
+  gst_harness_set_src_caps_str (h,
+      "video/x-h264, stream-format=(string)avc, alignment=(string)au,"
+      " codec_data=(buffer)014d4015ffe10017674d4015eca4bf2e0220000003002ee6b28001e2c5b2c001000468ebecb2,"
+      " framerate=(fraction)30/1, pixel-aspect-ratio=(fraction)1/1");
+  memset (&parsed, 0, sizeof (parsed));
+
+  /* the parameter sets are the ones of the codec_data, the SEI is new */
+  push_au_check_parsed (h, au, sizeof (au), &parsed, 1, 1, 0);
+  fail_unless_equals_int (parsed.caps_checks, 0);
+
+  /* nothing new at all, and no caps event either */
+  events = gst_harness_events_received (h);
+  push_au_check_parsed (h, au, sizeof (au), &parsed, 2, 2, 1);
+  fail_unless_equals_int (parsed.caps_checks, 0);
+  fail_unless_equals_int (gst_harness_events_received (h), events);
+
+  /* a changed SPS is parsed, and so are the PPS and SEI that depend on it */
+  push_au_check_parsed (h, changed_au, sizeof (changed_au), &parsed, 2, 2, 1);
+  fail_unless (parsed.caps_checks > 0);
+  caps = gst_pad_get_current_caps (h->sinkpad);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless (gst_structure_get_int (s, "width", &width));
+  fail_unless_equals_int (width, 48);
+  gst_caps_unref (caps);
+
+  /* and then skipped again when repeated */
+  caps_checks = parsed.caps_checks;
+  events = gst_harness_events_received (h);
+  push_au_check_parsed (h, changed_au, sizeof (changed_au), &parsed, 3, 3, 2);
+  fail_unless_equals_int (parsed.caps_checks, caps_checks);
+  fail_unless_equals_int (gst_harness_events_received (h), events);
+
+  gst_harness_teardown (h);
+
+  gst_debug_remove_log_function (count_parsed_nals);
+  gst_debug_unset_threshold_for_name ("h264parse");
+}
+
+GST_END_TEST;
+#endif
+
 /*
  * TODO:
  *   - Both push- and pull-modes need to be tested
@@ -669,6 +1128,13 @@ main (int argc, char **argv)
     s = suite_create ("h264parse");
     suite_add_tcase (s, tc_chain);
     tcase_add_test (tc_chain, test_parse_sei_closedcaptions);
+    tcase_add_test (tc_chain, test_parse_gop_cache);
+    tcase_add_test (tc_chain, test_parse_au_meta);
+    tcase_add_test (tc_chain, test_parse_convert_zero_copy);
+    tcase_add_test (tc_chain, test_parse_convert_many_nals);
+#ifndef GST_DISABLE_GST_DEBUG
+    tcase_add_test (tc_chain, test_parse_repeated_headers);
+#endif
     nf += gst_check_run_suite (s, "h264parse", __FILE__);
   }
 
@@ -0,0 +1,295 @@
+/*
+ * GStreamer
+ *
+ * unit test for h265parse
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+/* 64x64 Main profile, with the VPS, SPS and PPS in the codec_data */
+#define HVC1_CAPS "video/x-h265, stream-format=(string)hvc1, " \
+    "alignment=(string)au, codec_data=(buffer)" \
+    "0101600000009000000000001ef000fcfdf8f800000f03a00001001740010c01ffff01" \
+    "600000030090000003000003001eac09a10001001b420101016000000300900000030000" \
+    "03001ea020810596b924c208a2000100064401c0718012, " \
+    "framerate=(fraction)30/1"
+#define BYTE_STREAM_CAPS "video/x-h265, stream-format=(string)byte-stream, " \
+    "alignment=(string)au"
+
+/* an IDR AU and a P AU, with 4 byte NAL lengths */
+static const guint8 idr_au[] = {
+  0x00, 0x00, 0x00, 0x0b, 0x26, 0x01, 0xaf, 0xaf,
+  0x06, 0xb8, 0x63, 0xef, 0x3a, 0x7f, 0x3e
+};
+
+static const guint8 p_au[] = {
+  0x00, 0x00, 0x00, 0x0d, 0x02, 0x01, 0xd0, 0x09,
+  0x77, 0xaf, 0x06, 0xb8, 0x63, 0xef, 0x3a, 0x7f,
+  0x3e
+};
+
+static void
+push_au (GstHarness * h, const guint8 * data, gsize size)
+{
+  GstBuffer *buf = gst_buffer_new_and_alloc (size);
+
+  gst_buffer_fill (buf, 0, data, size);
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+}
+
+static void
+push_force_key_unit (GstHarness * h, GstClockTime running_time,
+    gboolean forwarded)
+{
+  guint upstream_events = gst_harness_upstream_events_received (h);
+
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_video_event_new_upstream_force_key_unit (running_time, TRUE,
+              1)));
+  fail_unless_equals_int (gst_harness_upstream_events_received (h),
+      upstream_events + (forwarded ? 1 : 0));
+}
+
+GST_START_TEST (test_parse_gop_cache)
+{
+  GstHarness *h;
+  GstBuffer *buf;
+  gint i;
+
+  h = gst_harness_new ("h265parse");
+  g_object_set (h->element, "gop-cache", TRUE, NULL);
+  gst_harness_set_sink_caps_str (h, BYTE_STREAM_CAPS);
+  gst_harness_set_src_caps_str (h, HVC1_CAPS);
+
+  push_au (h, idr_au, sizeof (idr_au));
+  push_au (h, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 2);
+  for (i = 0; i < 2; i++)
+    gst_buffer_unref (gst_harness_pull (h));
+
+  /* a key unit at a given running time is not answered from the cache,
+   * neither is an immediate one from a consumer that got the keyframe */
+  push_force_key_unit (h, GST_SECOND, TRUE);
+  push_force_key_unit (h, GST_CLOCK_TIME_NONE, TRUE);
+
+  push_au (h, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 1);
+  gst_buffer_unref (gst_harness_pull (h));
+
+  /* a new consumer asking for a key unit gets the GOP so far, before the
+   * next AU, and the request doesn't go upstream */
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_event_new_reconfigure ()));
+  push_force_key_unit (h, GST_CLOCK_TIME_NONE, FALSE);
+
+  push_au (h, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 4);
+
+  buf = gst_harness_pull (h);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT));
+  fail_if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+  /* with the parameter sets in front of the slice */
+  fail_unless (gst_buffer_get_size (buf) > sizeof (idr_au));
+  fail_unless (gst_buffer_memcmp (buf,
+          gst_buffer_get_size (buf) - (sizeof (idr_au) - 4), idr_au + 4,
+          sizeof (idr_au) - 4) == 0);
+  gst_buffer_unref (buf);
+
+  for (i = 0; i < 3; i++) {
+    buf = gst_harness_pull (h);
+    fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+    fail_unless_equals_int (gst_buffer_get_size (buf), sizeof (p_au));
+    fail_unless (gst_buffer_memcmp (buf, 4, p_au + 4,
+            sizeof (p_au) - 4) == 0);
+    gst_buffer_unref (buf);
+  }
+
+  /* the new consumer got its GOP, its next request goes upstream */
+  push_force_key_unit (h, GST_CLOCK_TIME_NONE, TRUE);
+
+  /* a consumer linked before a keyframe gets that one, no replay */
+  fail_unless (gst_harness_push_upstream_event (h,
+          gst_event_new_reconfigure ()));
+  push_au (h, idr_au, sizeof (idr_au));
+  push_force_key_unit (h, GST_CLOCK_TIME_NONE, TRUE);
+  push_au (h, p_au, sizeof (p_au));
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 2);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+#ifndef GST_DISABLE_GST_DEBUG
+typedef struct
+{
+  guint repeated_vps;
+  guint repeated_sps;
+  guint repeated_pps;
+  guint repeated_sei;
+} ParsedNals;
+
+/* counts what h265parse says about the parameter sets and SEI it skips */
+static void
+count_parsed_nals (GstDebugCategory * category, GstDebugLevel level,
+    const gchar * file, const gchar * function, gint line, GObject * object,
+    GstDebugMessage * message, gpointer user_data)
+{
+  ParsedNals *parsed = user_data;
+  const gchar *msg;
+
+  if (strcmp (gst_debug_category_get_name (category), "h265parse") != 0)
+    return;
+
+  msg = gst_debug_message_get (message);
+  if (!g_str_has_suffix (msg, "repeated, not parsing it again"))
+    return;
+
+  if (g_str_has_prefix (msg, "VPS"))
+    parsed->repeated_vps++;
+  else if (g_str_has_prefix (msg, "SPS"))
+    parsed->repeated_sps++;
+  else if (g_str_has_prefix (msg, "PPS"))
+    parsed->repeated_pps++;
+  else if (g_str_has_prefix (msg, "SEI"))
+    parsed->repeated_sei++;
+}
+
+static void
+push_au_check_parsed (GstHarness * h, const guint8 * data, gsize size,
+    ParsedNals * parsed, guint repeated_vps, guint repeated_sps,
+    guint repeated_pps, guint repeated_sei)
+{
+  push_au (h, data, size);
+  gst_buffer_unref (gst_harness_pull (h));
+
+  fail_unless_equals_int (parsed->repeated_vps, repeated_vps);
+  fail_unless_equals_int (parsed->repeated_sps, repeated_sps);
+  fail_unless_equals_int (parsed->repeated_pps, repeated_pps);
+  fail_unless_equals_int (parsed->repeated_sei, repeated_sei);
+}
+
+static gint
+get_caps_width (GstHarness * h)
+{
+  GstCaps *caps = gst_pad_get_current_caps (h->sinkpad);
+  gint width = 0;
+
+  gst_structure_get_int (gst_caps_get_structure (caps, 0), "width", &width);
+  gst_caps_unref (caps);
+
+  return width;
+}
+
+GST_START_TEST (test_parse_repeated_headers)
+{
+  ParsedNals parsed = { 0, };
+  GstHarness *h;
+  guint events;
+
+  /* the VPS, SPS and PPS of the codec_data, an SEI and an IDR slice */
+  const guint8 au[] = {
+    0x00, 0x00, 0x00, 0x17, 0x40, 0x01, 0x0c, 0x01,
+    0xff, 0xff, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+    0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+    0x1e, 0xac, 0x09,
+    0x00, 0x00, 0x00, 0x1b, 0x42, 0x01, 0x01, 0x01,
+    0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+    0x03, 0x00, 0x00, 0x03, 0x00, 0x1e, 0xa0, 0x20,
+    0x81, 0x05, 0x96, 0xb9, 0x24, 0xc2, 0x08,
+    0x00, 0x00, 0x00, 0x06, 0x44, 0x01, 0xc0, 0x71,
+    0x80, 0x12,
+    0x00, 0x00, 0x00, 0x09, 0x4e, 0x01, 0x05, 0x04,
+    0xde, 0xad, 0xbe, 0xef, 0x80,
+    0x00, 0x00, 0x00, 0x0b, 0x26, 0x01, 0xaf, 0xaf,
+    0x06, 0xb8, 0x63, 0xef, 0x3a, 0x7f, 0x3e
+  };
+  /* the same with a 128 pixels wide SPS */
+  const guint8 changed_au[] = {
+    0x00, 0x00, 0x00, 0x17, 0x40, 0x01, 0x0c, 0x01,
+    0xff, 0xff, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+    0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+    0x1e, 0xac, 0x09,
+    0x00, 0x00, 0x00, 0x1b, 0x42, 0x01, 0x01, 0x01,
+    0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+    0x03, 0x00, 0x00, 0x03, 0x00, 0x1e, 0xa0, 0x10,
+    0x20, 0x41, 0x65, 0xae, 0x49, 0x30, 0x82,
+    0x00, 0x00, 0x00, 0x06, 0x44, 0x01, 0xc0, 0x71,
+    0x80, 0x12,
+    0x00, 0x00, 0x00, 0x09, 0x4e, 0x01, 0x05, 0x04,
+    0xde, 0xad, 0xbe, 0xef, 0x80,
+    0x00, 0x00, 0x00, 0x0b, 0x26, 0x01, 0xaf, 0xaf,
+    0x06, 0xb8, 0x63, 0xef, 0x3a, 0x7f, 0x3e
+  };
+
+  gst_debug_set_threshold_for_name ("h265parse", GST_LEVEL_LOG);
+  gst_debug_add_log_function (count_parsed_nals, &parsed, NULL);
+
+  h = gst_harness_new ("h265parse");
+  gst_harness_set_sink_caps_str (h, BYTE_STREAM_CAPS);
+  gst_harness_set_src_caps_str (h, HVC1_CAPS);
+  memset (&parsed, 0, sizeof (parsed));
+
+  /* the parameter sets are the ones of the codec_data, the SEI is new */
+  push_au_check_parsed (h, au, sizeof (au), &parsed, 1, 1, 1, 0);
+  fail_unless_equals_int (get_caps_width (h), 64);
+
+  /* nothing new at all, and no caps event either */
+  events = gst_harness_events_received (h);
+  push_au_check_parsed (h, au, sizeof (au), &parsed, 2, 2, 2, 1);
+  fail_unless_equals_int (gst_harness_events_received (h), events);
+
+  /* a changed SPS is parsed, and so are the PPS and SEI that depend on it,
+   * but not the VPS */
+  push_au_check_parsed (h, changed_au, sizeof (changed_au), &parsed, 3, 2, 2,
+      1);
+  fail_unless_equals_int (get_caps_width (h), 128);
+
+  /* and then skipped again when repeated */
+  events = gst_harness_events_received (h);
+  push_au_check_parsed (h, changed_au, sizeof (changed_au), &parsed, 4, 3, 3,
+      2);
+  fail_unless_equals_int (gst_harness_events_received (h), events);
+
+  gst_harness_teardown (h);
+
+  gst_debug_remove_log_function (count_parsed_nals);
+  gst_debug_unset_threshold_for_name ("h265parse");
+}
+
+GST_END_TEST;
+#endif
+
+static Suite *
+h265parse_suite (void)
+{
+  Suite *s = suite_create ("h265parse");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_parse_gop_cache);
+#ifndef GST_DISABLE_GST_DEBUG
+  tcase_add_test (tc_chain, test_parse_repeated_headers);
+#endif
+
+  return s;
+}
+
+GST_CHECK_MAIN (h265parse);
@@ -0,0 +1,224 @@
+/* GStreamer
+ *
+ * unit test for intervideosink and intervideosrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#define CAPS_16X16 "video/x-raw, format=(string)I420, width=(int)16, " \
+    "height=(int)16, framerate=(fraction)30/1"
+#define CAPS_32X16 "video/x-raw, format=(string)I420, width=(int)32, " \
+    "height=(int)16, framerate=(fraction)30/1"
+#define SIZE_16X16 (16 * 16 * 3 / 2)
+#define SIZE_32X16 (32 * 16 * 3 / 2)
+#define BLACK_Y 16
+
+/* The sources run at the framerate of the sink */
+#define FRAME_TIME(n) gst_util_uint64_scale (n, GST_SECOND, 30)
+
+/* Both ends use a base time of 0, so the running time of the frames is the
+ * clock time the sources match them by. The sink shows each frame once and
+ * doesn't wait for the clock. */
+static GstHarness *
+setup_sink (const gchar * channel, const gchar * caps)
+{
+  GstHarness *h;
+  gchar *desc;
+
+  desc = g_strdup_printf ("intervideosink channel=%s sync=false "
+      "show-preroll-frame=false", channel);
+  h = gst_harness_new_parse (desc);
+  g_free (desc);
+  gst_harness_set_src_caps_str (h, caps);
+
+  return h;
+}
+
+static GstHarness *
+setup_src (const gchar * channel)
+{
+  GstHarness *h;
+  gchar *desc;
+
+  desc = g_strdup_printf ("intervideosrc channel=%s", channel);
+  h = gst_harness_new_parse (desc);
+  g_free (desc);
+  gst_harness_use_testclock (h);
+  gst_harness_play (h);
+
+  return h;
+}
+
+/* Shows a frame filled with @value at @pts */
+static void
+push_frame (GstHarness * h, gsize size, guint8 value, GstClockTime pts)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, size, NULL);
+
+  gst_buffer_memset (buf, 0, value, size);
+  GST_BUFFER_PTS (buf) = pts;
+  GST_BUFFER_DURATION (buf) = FRAME_TIME (1);
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+}
+
+/* A live source waits for the clock before pushing each frame */
+static GstBuffer *
+pull_frame (GstHarness * h)
+{
+  fail_unless (gst_harness_crank_single_clock_wait (h));
+  return gst_harness_pull (h);
+}
+
+static void
+check_frame (GstHarness * h, gsize size, guint8 value, gboolean gap)
+{
+  GstBuffer *buf = pull_frame (h);
+  guint8 v = 0;
+
+  fail_unless_equals_int (gst_buffer_get_size (buf), size);
+  gst_buffer_extract (buf, 0, &v, 1);
+  fail_unless_equals_int (v, value);
+  fail_unless_equals_int (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_GAP),
+      gap);
+  gst_buffer_unref (buf);
+}
+
+GST_START_TEST (test_two_sources_ring)
+{
+  GstHarness *sink, *src1, *src2;
+  gint i;
+
+  sink = setup_sink ("ring", CAPS_16X16);
+  for (i = 0; i < 8; i++)
+    push_frame (sink, SIZE_16X16, 100 + i, FRAME_TIME (i));
+
+  /* Each source goes through all the frames of the ring at its own pace,
+   * taking a frame doesn't hide it from the other source */
+  src1 = setup_src ("ring");
+  src2 = setup_src ("ring");
+  for (i = 0; i < 4; i++)
+    check_frame (src1, SIZE_16X16, 100 + i, FALSE);
+  for (i = 0; i < 8; i++)
+    check_frame (src2, SIZE_16X16, 100 + i, FALSE);
+  for (i = 4; i < 8; i++)
+    check_frame (src1, SIZE_16X16, 100 + i, FALSE);
+
+  gst_harness_teardown (src1);
+  gst_harness_teardown (src2);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_two_sources_closest)
+{
+  static const guint8 expected[] = {
+    100, 100, 101, 101, 101, 102, 102, 102
+  };
+  GstHarness *sink, *src1, *src2;
+  guint i;
+
+  /* Frames every 100 ms, the sources run at 30 fps */
+  sink = setup_sink ("closest", CAPS_16X16);
+  for (i = 0; i < 3; i++)
+    push_frame (sink, SIZE_16X16, 100 + i, i * 100 * GST_MSECOND);
+
+  src1 = setup_src ("closest");
+  src2 = setup_src ("closest");
+  for (i = 0; i < G_N_ELEMENTS (expected); i++) {
+    gboolean gap = i > 0 && expected[i] == expected[i - 1];
+
+    check_frame (src1, SIZE_16X16, expected[i], gap);
+    check_frame (src2, SIZE_16X16, expected[i], gap);
+  }
+
+  gst_harness_teardown (src1);
+  gst_harness_teardown (src2);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_two_sources_cursor)
+{
+  GstHarness *sink, *src1, *src2;
+  gint i;
+
+  /* The newer frame comes first in time */
+  sink = setup_sink ("cursor", CAPS_16X16);
+  push_frame (sink, SIZE_16X16, 100, FRAME_TIME (3));
+  push_frame (sink, SIZE_16X16, 101, FRAME_TIME (0));
+
+  /* Once a source showed the newer frame it doesn't go back to the older
+   * one, even when that one is closer */
+  src1 = setup_src ("cursor");
+  for (i = 0; i < 4; i++)
+    check_frame (src1, SIZE_16X16, 101, i > 0);
+
+  /* A source that starts later has its own cursor */
+  src2 = setup_src ("cursor");
+  for (i = 0; i < 4; i++)
+    check_frame (src2, SIZE_16X16, 101, i > 0);
+
+  gst_harness_teardown (src1);
+  gst_harness_teardown (src2);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_caps_change_clears_frames)
+{
+  GstHarness *sink, *src1, *src2;
+
+  sink = setup_sink ("caps", CAPS_16X16);
+  push_frame (sink, SIZE_16X16, 100, FRAME_TIME (0));
+
+  /* The frames of the old format are gone, the source shows black */
+  gst_harness_set_src_caps_str (sink, CAPS_32X16);
+  src1 = setup_src ("caps");
+  check_frame (src1, SIZE_32X16, BLACK_Y, FALSE);
+
+  push_frame (sink, SIZE_32X16, 101, FRAME_TIME (0));
+  src2 = setup_src ("caps");
+  check_frame (src2, SIZE_32X16, 101, FALSE);
+
+  gst_harness_teardown (src1);
+  gst_harness_teardown (src2);
+  gst_harness_teardown (sink);
+}
+
+GST_END_TEST;
+
+static Suite *
+intervideo_suite (void)
+{
+  Suite *s = suite_create ("intervideo");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_two_sources_ring);
+  tcase_add_test (tc_chain, test_two_sources_closest);
+  tcase_add_test (tc_chain, test_two_sources_cursor);
+  tcase_add_test (tc_chain, test_caps_change_clears_frames);
+
+  return s;
+}
+
+GST_CHECK_MAIN (intervideo);
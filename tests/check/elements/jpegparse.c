@@ -23,6 +23,8 @@
 #include <unistd.h>
 
 #include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/codecparsers/gstjpegrestartmeta.h>
 
 /* This test doesn't use actual JPEG data, but some fake data that we know
    will trigger certain paths in jpegparse. */
@@ -150,6 +152,17 @@ guint8 test_data_sof0[] = {
 
 guint8 test_data_eoi[] = { 0xff, 0xd9 };
 
+guint8 test_data_restart[] = { 0xff, 0xd8,
+  0xff, 0xdd, 0x00, 0x04, 0x00, 0x02,   /* restart interval = 2 */
+  0xff, 0xda, 0x00, 0x04, 0x22, 0x33,   /* start of scan */
+  0x44, 0xff, 0x00, 0x55,
+  0xff, 0xd0,                   /* RST0 at 18 */
+  0x66,
+  0xff, 0xd1,                   /* RST1 at 21 */
+  0x77, 0xff, 0x00,
+  0xff, 0xd9
+};
+
 static GList *
 _make_buffers_in (GList * buffer_in, guint8 * test_data, gsize test_data_size)
 {
@@ -367,6 +380,65 @@ GST_START_TEST (test_parse_comment)
 
 GST_END_TEST;
 
+static void
+check_restart_meta (GstBuffer * buffer)
+{
+  GstJpegRestartMeta *meta;
+
+  fail_unless_equals_int (gst_buffer_get_size (buffer),
+      sizeof (test_data_restart));
+  fail_unless (gst_buffer_memcmp (buffer, 0, test_data_restart,
+          sizeof (test_data_restart)) == 0);
+
+  meta = gst_buffer_get_jpeg_restart_meta (buffer);
+  fail_unless (meta != NULL);
+  fail_unless (gst_meta_api_type_has_tag (GST_JPEG_RESTART_META_API_TYPE,
+          g_quark_from_static_string (GST_META_TAG_MEMORY_STR)));
+  fail_unless_equals_int (meta->restart_interval, 2);
+  fail_unless_equals_int (meta->n_scans, 1);
+  fail_unless_equals_int (meta->n_markers, 2);
+  fail_unless_equals_int (meta->markers[0].offset, 18);
+  fail_unless_equals_int (meta->markers[0].index, 0);
+  fail_unless_equals_int (meta->markers[0].scan, 0);
+  fail_unless_equals_int (meta->markers[1].offset, 21);
+  fail_unless_equals_int (meta->markers[1].index, 1);
+  fail_unless_equals_int (meta->markers[1].scan, 0);
+}
+
+GST_START_TEST (test_parse_restart_markers)
+{
+  GstHarness *h;
+  GstBuffer *buffer;
+  gsize i;
+
+  h = gst_harness_new ("jpegparse");
+  gst_harness_set_src_caps_str (h, "image/jpeg");
+
+  /* all at once, then byte by byte to have the scan resumed in the middle
+   * of every segment */
+  fail_unless_equals_int (gst_harness_push (h,
+          gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+              test_data_restart, sizeof (test_data_restart), 0,
+              sizeof (test_data_restart), NULL, NULL)), GST_FLOW_OK);
+  for (i = 0; i < sizeof (test_data_restart); i++) {
+    fail_unless_equals_int (gst_harness_push (h,
+            gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+                test_data_restart + i, 1, 0, 1, NULL, NULL)), GST_FLOW_OK);
+  }
+  fail_unless (gst_harness_push_event (h, gst_event_new_eos ()));
+
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 2);
+  for (i = 0; i < 2; i++) {
+    buffer = gst_harness_pull (h);
+    check_restart_meta (buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
 static Suite *
 jpegparse_suite (void)
 {
@@ -378,6 +450,7 @@ jpegparse_suite (void)
   tcase_add_test (tc_chain, test_parse_all_in_one_buf);
   tcase_add_test (tc_chain, test_parse_app1_exif);
   tcase_add_test (tc_chain, test_parse_comment);
+  tcase_add_test (tc_chain, test_parse_restart_markers);
 
   return s;
 }
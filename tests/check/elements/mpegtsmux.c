@@ -21,6 +21,8 @@
 #include <gst/check/gstcheck.h>
 #include <string.h>
 #include <gst/video/video.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -148,10 +150,10 @@ cleanup_tsmux (GstElement * mux, const gchar * sinkname)
 }
 
 static void
-check_tsmux_pad (GstStaticPadTemplate * srctemplate,
+check_tsmux_pad_full (GstStaticPadTemplate * srctemplate,
     const gchar * src_caps_string, gint pes_id, gint pmt_id,
     const gchar * sinkname, CheckOutputBuffersFunc check_func, guint n_bufs,
-    gssize input_buf_size, guint alignment)
+    gssize input_buf_size, guint alignment, gboolean batch_packets)
 {
   GstClockTime ts;
   GstElement *mux;
@@ -166,6 +168,8 @@ check_tsmux_pad (GstStaticPadTemplate * srctemplate,
 
   if (alignment != 0)
     g_object_set (mux, "alignment", alignment, NULL);
+  if (batch_packets)
+    g_object_set (mux, "batch-packets", TRUE, NULL);
 
   fail_unless (gst_element_set_state (mux,
           GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
@@ -348,6 +352,15 @@ check_tsmux_pad (GstStaticPadTemplate * srctemplate,
   g_free (padname);
 }
 
+static void
+check_tsmux_pad (GstStaticPadTemplate * srctemplate,
+    const gchar * src_caps_string, gint pes_id, gint pmt_id,
+    const gchar * sinkname, CheckOutputBuffersFunc check_func, guint n_bufs,
+    gssize input_buf_size, guint alignment)
+{
+  check_tsmux_pad_full (srctemplate, src_caps_string, pes_id, pmt_id,
+      sinkname, check_func, n_bufs, input_buf_size, alignment, FALSE);
+}
 
 GST_START_TEST (test_video)
 {
@@ -774,6 +787,345 @@ GST_START_TEST (test_align)
 
 GST_END_TEST;
 
+GST_START_TEST (test_batch_align)
+{
+  check_tsmux_pad_full (&video_src_template, VIDEO_CAPS_STRING, 0xE0, 0x1b,
+      "sink_%d", test_align_check_output, 817, -1, 7, TRUE);
+}
+
+GST_END_TEST;
+
+static void
+test_batch_check_output (GList * bufs)
+{
+  const GValue *streamheader;
+  GstCaps *caps;
+  guint i;
+
+  /* the streamheader only holds the PAT and PMT packets */
+  caps = gst_pad_get_current_caps (mysinkpad);
+  fail_unless (caps != NULL);
+  streamheader = gst_structure_get_value (gst_caps_get_structure (caps, 0),
+      "streamheader");
+  fail_unless (streamheader != NULL);
+  fail_unless (gst_value_array_get_size (streamheader) >= 2);
+  for (i = 0; i < gst_value_array_get_size (streamheader); i++) {
+    GstBuffer *hbuf =
+        gst_value_get_buffer (gst_value_array_get_value (streamheader, i));
+
+    fail_unless_equals_int (gst_buffer_get_size (hbuf), 188);
+  }
+  gst_caps_unref (caps);
+
+  GST_LOG ("%u buffers", g_list_length (bufs));
+  while (bufs != NULL) {
+    GstBuffer *buf = bufs->data;
+    gsize size;
+
+    size = gst_buffer_get_size (buf);
+    GST_LOG ("buffer, size = %5u", (guint) size);
+    /* only the last buffer may be partially filled */
+    if (bufs->next != NULL)
+      fail_unless_equals_int (size, 32 * 188);
+    fail_unless (size > 0 && size % 188 == 0);
+    fail_unless_equals_int (gst_buffer_n_memory (buf), 1);
+    bufs = bufs->next;
+  }
+}
+
+GST_START_TEST (test_batch_packets)
+{
+  check_tsmux_pad_full (&video_src_template, VIDEO_CAPS_STRING, 0xE0, 0x1b,
+      "sink_%d", test_batch_check_output, 100, -1, 0, TRUE);
+}
+
+GST_END_TEST;
+
+static void
+check_constant_bitrate (gboolean m2ts_mode)
+{
+  GstElement *mux;
+  GstBuffer *inbuffer;
+  GstCaps *caps;
+  GstClockTime ts = 0;
+  gchar *padname;
+  GList *l;
+  guint i, n_packets = 0, n_null = 0;
+  guint packet_size = m2ts_mode ? 192 : 188;
+  gint cc[0x2000];
+
+  for (i = 0; i < G_N_ELEMENTS (cc); i++)
+    cc[i] = -1;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) 2000000, "m2ts-mode", m2ts_mode,
+      NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* 1 second of 1000 byte frames, well below the mux rate */
+  for (i = 0; i <= 25; i++) {
+    inbuffer = gst_buffer_new_and_alloc (1000);
+    gst_buffer_memset (inbuffer, 0, 0, 1000);
+    GST_BUFFER_PTS (inbuffer) = GST_BUFFER_DTS (inbuffer) = ts;
+    if (i % KEYFRAME_DISTANCE != 0)
+      GST_BUFFER_FLAG_SET (inbuffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    ts += 40 * GST_MSECOND;
+  }
+
+  for (l = buffers; l; l = l->next) {
+    GstMapInfo map;
+    gsize offset;
+
+    gst_buffer_map (GST_BUFFER (l->data), &map, GST_MAP_READ);
+    fail_unless (map.size % packet_size == 0);
+    for (offset = packet_size - 188; offset < map.size; offset += packet_size) {
+      guint pid = GST_READ_UINT16_BE (map.data + offset + 1) & 0x1FFF;
+      guint8 flags = map.data[offset + 3];
+
+      fail_unless (map.data[offset] == 0x47);
+      n_packets++;
+      if (pid == 0x1FFF) {
+        n_null++;
+        continue;
+      }
+
+      /* the counter only advances on packets with payload, PCR-only
+       * packets repeat it */
+      if (cc[pid] != -1) {
+        if (flags & 0x10)
+          fail_unless_equals_int (flags & 0x0f, (cc[pid] + 1) & 0x0f);
+        else
+          fail_unless_equals_int (flags & 0x0f, cc[pid]);
+      }
+      cc[pid] = flags & 0x0f;
+    }
+    gst_buffer_unmap (GST_BUFFER (l->data), &map);
+  }
+
+  /* everything up to the last frame is paced at 2 Mbit/s for 1 second,
+   * followed by the packets of the last frame */
+  GST_LOG ("%u packets, %u null packets", n_packets, n_null);
+  fail_unless (n_packets >= 2000000 / 8 / packet_size);
+  fail_unless (n_packets < 2000000 / 8 / packet_size + 30);
+  fail_unless (n_null > 0);
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_START_TEST (test_constant_bitrate)
+{
+  check_constant_bitrate (FALSE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_constant_bitrate_m2ts)
+{
+  check_constant_bitrate (TRUE);
+}
+
+GST_END_TEST;
+
+static GByteArray *
+mux_with_packetize_threads (guint n_threads)
+{
+  GstElement *mux;
+  GstBuffer *inbuffer;
+  GstCaps *caps;
+  GByteArray *output;
+  GstClockTime ts = 0;
+  gchar *padname;
+  GList *l;
+  guint i, threads;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "packetize-threads", n_threads, NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  /* not allowed to change while running */
+  g_object_set (mux, "packetize-threads", n_threads + 1, NULL);
+  g_object_get (mux, "packetize-threads", &threads, NULL);
+  fail_unless_equals_int (threads, n_threads);
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  for (i = 0; i < 50; i++) {
+    gsize size = 1000 + (i * 7919) % 30000;
+
+    inbuffer = gst_buffer_new_and_alloc (size);
+    gst_buffer_memset (inbuffer, 0, i, size);
+    GST_BUFFER_PTS (inbuffer) = GST_BUFFER_DTS (inbuffer) = ts;
+    if (i % KEYFRAME_DISTANCE != 0)
+      GST_BUFFER_FLAG_SET (inbuffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    ts += 40 * GST_MSECOND;
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  output = g_byte_array_new ();
+  for (l = buffers; l; l = l->next) {
+    GstMapInfo map;
+
+    gst_buffer_map (GST_BUFFER (l->data), &map, GST_MAP_READ);
+    g_byte_array_append (output, map.data, map.size);
+    gst_buffer_unmap (GST_BUFFER (l->data), &map);
+  }
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+
+  return output;
+}
+
+#define MPTS_PROGRAMS 4
+
+/* Mux one video stream into each of MPTS_PROGRAMS programs */
+static GByteArray *
+mux_mpts_with_packetize_threads (guint n_threads)
+{
+  GstElement *pipeline, *mux, *src[MPTS_PROGRAMS], *sink;
+  GstStructure *prog_map;
+  GstSample *sample;
+  GByteArray *output;
+  GString *desc;
+  GstCaps *caps;
+  guint i, j;
+
+  desc = g_string_new (NULL);
+  g_string_append_printf (desc, "mpegtsmux name=mux packetize-threads=%u ! "
+      "appsink name=sink sync=false", n_threads);
+  prog_map = gst_structure_new_empty ("program_map");
+  for (i = 0; i < MPTS_PROGRAMS; i++) {
+    gchar *padname = g_strdup_printf ("sink_%u", i);
+
+    g_string_append_printf (desc, " appsrc name=src%u format=time ! mux.%s",
+        i, padname);
+    gst_structure_set (prog_map, padname, G_TYPE_INT, i + 1, NULL);
+    g_free (padname);
+  }
+  pipeline = gst_parse_launch (desc->str, NULL);
+  g_string_free (desc, TRUE);
+  fail_unless (pipeline != NULL);
+
+  mux = gst_bin_get_by_name (GST_BIN (pipeline), "mux");
+  g_object_set (mux, "prog-map", prog_map, NULL);
+  gst_structure_free (prog_map);
+  gst_object_unref (mux);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  for (i = 0; i < MPTS_PROGRAMS; i++) {
+    gchar *name = g_strdup_printf ("src%u", i);
+
+    src[i] = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    gst_app_src_set_caps (GST_APP_SRC (src[i]), caps);
+    g_free (name);
+  }
+  gst_caps_unref (caps);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  /* the programs have frames of different sizes at different times */
+  for (i = 0; i < 50; i++) {
+    for (j = 0; j < MPTS_PROGRAMS; j++) {
+      gsize size = 500 + ((i + 1) * (j + 3) * 7919) % 20000;
+      GstBuffer *buf = gst_buffer_new_and_alloc (size);
+
+      gst_buffer_memset (buf, 0, i + j, size);
+      GST_BUFFER_PTS (buf) = GST_BUFFER_DTS (buf) =
+          i * 40 * GST_MSECOND + j * 7 * GST_MSECOND;
+      if (i % KEYFRAME_DISTANCE != j)
+        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+      fail_unless_equals_int (gst_app_src_push_buffer (GST_APP_SRC (src[j]),
+              buf), GST_FLOW_OK);
+    }
+  }
+  for (j = 0; j < MPTS_PROGRAMS; j++) {
+    gst_app_src_end_of_stream (GST_APP_SRC (src[j]));
+    gst_object_unref (src[j]);
+  }
+
+  output = g_byte_array_new ();
+  while ((sample = gst_app_sink_pull_sample (GST_APP_SINK (sink)))) {
+    GstMapInfo map;
+
+    gst_buffer_map (gst_sample_get_buffer (sample), &map, GST_MAP_READ);
+    g_byte_array_append (output, map.data, map.size);
+    gst_buffer_unmap (gst_sample_get_buffer (sample), &map);
+    gst_sample_unref (sample);
+  }
+  fail_unless (gst_app_sink_is_eos (GST_APP_SINK (sink)));
+
+  gst_object_unref (sink);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return output;
+}
+
+static void
+compare_packetize_output (GByteArray * serial, GByteArray * parallel)
+{
+  fail_unless (serial->len > 0);
+  fail_unless_equals_int (parallel->len, serial->len);
+  fail_unless (memcmp (parallel->data, serial->data, serial->len) == 0);
+
+  g_byte_array_unref (serial);
+  g_byte_array_unref (parallel);
+}
+
+GST_START_TEST (test_packetize_threads)
+{
+  compare_packetize_output (mux_with_packetize_threads (0),
+      mux_with_packetize_threads (4));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_packetize_threads_mpts)
+{
+  GByteArray *serial;
+  gboolean pids[0x2000] = { FALSE, };
+  guint i, n_es_pids = 0;
+
+  serial = mux_mpts_with_packetize_threads (0);
+
+  /* all programs made it into the output */
+  fail_unless (serial->len % 188 == 0);
+  for (i = 0; i < serial->len; i += 188) {
+    guint pid = GST_READ_UINT16_BE (serial->data + i + 1) & 0x1FFF;
+
+    fail_unless (serial->data[i] == 0x47);
+    /* elementary streams come after the PMTs */
+    if (pid >= 0x40 && pid != 0x1FFF && !pids[pid]) {
+      pids[pid] = TRUE;
+      n_es_pids++;
+    }
+  }
+  fail_unless_equals_int (n_es_pids, MPTS_PROGRAMS);
+
+  compare_packetize_output (serial, mux_mpts_with_packetize_threads (4));
+}
+
+GST_END_TEST;
+
 static void
 test_keyframe_propagation_check_output (GList * bufs)
 {
@@ -819,6 +1171,12 @@ mpegtsmux_suite (void)
   tcase_add_test (tc_chain, test_multiple_state_change);
   tcase_add_test (tc_chain, test_align);
   tcase_add_test (tc_chain, test_keyframe_flag_propagation);
+  tcase_add_test (tc_chain, test_batch_align);
+  tcase_add_test (tc_chain, test_batch_packets);
+  tcase_add_test (tc_chain, test_constant_bitrate);
+  tcase_add_test (tc_chain, test_constant_bitrate_m2ts);
+  tcase_add_test (tc_chain, test_packetize_threads);
+  tcase_add_test (tc_chain, test_packetize_threads_mpts);
 
   return s;
 }
@@ -26,6 +26,7 @@
 
 #include <gst/gst.h>
 #include <gst/check/gstcheck.h>
+#include <gst/allocators/allocators.h>
 
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -42,7 +43,7 @@ GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
 
 static void
-setup_shm (void)
+setup_shm_with_ring (guint ring_size)
 {
   gchar *socket_path = NULL;
 
@@ -52,7 +53,8 @@ setup_shm (void)
   srcpad = gst_check_setup_src_pad (sink, &src_template);
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
-  g_object_set (sink, "socket-path", "shm-unit-test", NULL);
+  g_object_set (sink, "socket-path", "shm-unit-test", "ring-size", ring_size,
+      NULL);
 
   fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
       GST_STATE_CHANGE_ASYNC);
@@ -69,6 +71,18 @@ setup_shm (void)
       GST_STATE_CHANGE_SUCCESS);
 }
 
+static void
+setup_shm (void)
+{
+  setup_shm_with_ring (0);
+}
+
+static void
+setup_shm_ring (void)
+{
+  setup_shm_with_ring (16);
+}
+
 static void
 teardown_shm (void)
 {
@@ -107,6 +121,8 @@ GST_START_TEST (test_shm_sysmem_alloc)
 
   buf = buffers->data;
   fail_unless (gst_buffer_get_size (buf) == 1000);
+  /* shmsrc hands out the part of the area's fd that holds the data */
+  fail_unless (gst_is_fd_memory (gst_buffer_peek_memory (buf, 0)));
 
   gst_check_drop_buffers ();
   teardown_shm ();
@@ -162,6 +178,8 @@ GST_START_TEST (test_shm_alloc)
 
   buf = buffers->data;
   fail_unless (gst_buffer_get_size (buf) == size);
+  /* shmsrc hands out the part of the area's fd that holds the data */
+  fail_unless (gst_is_fd_memory (gst_buffer_peek_memory (buf, 0)));
 
   gst_check_drop_buffers ();
   teardown_shm ();
@@ -169,7 +187,493 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
-GST_START_TEST (test_shm_live)
+typedef struct
+{
+  guint64 shm_size;
+  guint64 allocated;
+  guint64 free_bytes;
+  guint64 largest_free;
+  guint blocks;
+  guint free_blocks;
+  gdouble fragmentation;
+} ShmStats;
+
+static void
+get_shm_stats (ShmStats * s)
+{
+  GstStructure *stats;
+
+  g_object_get (sink, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+
+  fail_unless (gst_structure_get (stats,
+          "shm-size", G_TYPE_UINT64, &s->shm_size,
+          "allocated-bytes", G_TYPE_UINT64, &s->allocated,
+          "free-bytes", G_TYPE_UINT64, &s->free_bytes,
+          "largest-free-block", G_TYPE_UINT64, &s->largest_free,
+          "allocated-blocks", G_TYPE_UINT, &s->blocks,
+          "free-blocks", G_TYPE_UINT, &s->free_blocks,
+          "fragmentation", G_TYPE_DOUBLE, &s->fragmentation, NULL));
+  gst_structure_free (stats);
+
+  fail_unless_equals_uint64 (s->free_bytes, s->shm_size - s->allocated);
+}
+
+/* How long to wait for shmsrc to ack a buffer before giving up */
+#define ACK_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+/* Blocks are freed when shmsrc acks them, which is asynchronous */
+static void
+wait_for_shm_blocks (ShmStats * s, guint blocks)
+{
+  gint64 deadline = g_get_monotonic_time () + ACK_TIMEOUT;
+
+  get_shm_stats (s);
+  while (s->blocks != blocks) {
+    fail_if (g_get_monotonic_time () > deadline,
+        "%u blocks still allocated, expected %u", s->blocks, blocks);
+    g_usleep (G_USEC_PER_SEC / 100);
+    get_shm_stats (s);
+  }
+}
+
+/* The stats shmsink keeps for its @n-th client */
+static void
+get_client_stats (guint n, guint * pending, guint64 * pending_bytes,
+    guint64 * dropped)
+{
+  GstStructure *stats, *client_stats;
+  const GValue *clients;
+
+  g_object_get (sink, "stats", &stats, NULL);
+  clients = gst_structure_get_value (stats, "clients");
+  fail_unless (clients != NULL);
+  fail_unless (n < gst_value_array_get_size (clients));
+
+  client_stats = g_value_get_boxed (gst_value_array_get_value (clients, n));
+  fail_unless (gst_structure_get (client_stats,
+          "pending-buffers", G_TYPE_UINT, pending,
+          "pending-bytes", G_TYPE_UINT64, pending_bytes,
+          "dropped-buffers", G_TYPE_UINT64, dropped, NULL));
+  gst_structure_free (stats);
+}
+
+/* Waits until the @n-th client acked all but @pending buffers */
+static void
+wait_for_client_pending (guint n, guint pending)
+{
+  gint64 deadline = g_get_monotonic_time () + ACK_TIMEOUT;
+  guint64 pending_bytes, dropped;
+  guint cur;
+
+  get_client_stats (n, &cur, &pending_bytes, &dropped);
+  while (cur != pending) {
+    fail_if (g_get_monotonic_time () > deadline,
+        "client %u has %u buffers pending, expected %u", n, cur, pending);
+    g_usleep (G_USEC_PER_SEC / 100);
+    get_client_stats (n, &cur, &pending_bytes, &dropped);
+  }
+}
+
+/* Number of clients in the stats of shmsink */
+static guint
+get_n_clients (void)
+{
+  GstStructure *stats;
+  const GValue *clients;
+  guint n;
+
+  g_object_get (sink, "stats", &stats, NULL);
+  clients = gst_structure_get_value (stats, "clients");
+  fail_unless (clients != NULL);
+  n = gst_value_array_get_size (clients);
+  gst_structure_free (stats);
+
+  return n;
+}
+
+/* Clients connect and disconnect in the poll thread, which is asynchronous */
+static void
+wait_for_n_clients (guint n)
+{
+  gint64 deadline = g_get_monotonic_time () + ACK_TIMEOUT;
+  guint cur;
+
+  while ((cur = get_n_clients ()) != n) {
+    fail_if (g_get_monotonic_time () > deadline,
+        "%u clients connected, expected %u", cur, n);
+    g_usleep (G_USEC_PER_SEC / 100);
+  }
+}
+
+/* Releases the @n-th buffer that shmsrc pushed */
+static void
+drop_nth_buffer (GList * received, guint n)
+{
+  GstBuffer *buf = g_list_nth_data (received, n);
+
+  fail_unless (buf != NULL);
+  gst_buffer_unref (buf);
+}
+
+GST_START_TEST (test_shm_stats)
+{
+  ShmStats stats;
+  GstSegment segment;
+  GList *received;
+  guint64 block_size;
+  guint size;
+  gint i;
+
+  g_object_get (sink, "shm-size", &size, NULL);
+
+  /* Nothing was sent yet, the whole area is one free block */
+  get_shm_stats (&stats);
+  fail_unless_equals_uint64 (stats.shm_size, size);
+  fail_unless_equals_uint64 (stats.allocated, 0);
+  fail_unless_equals_uint64 (stats.free_bytes, size);
+  fail_unless_equals_uint64 (stats.largest_free, size);
+  fail_unless_equals_int (stats.blocks, 0);
+  fail_unless_equals_int (stats.free_blocks, 1);
+  fail_unless_equals_float (stats.fragmentation, 0.0);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < 4; i++)
+    fail_unless (gst_pad_push (srcpad,
+            gst_buffer_new_allocate (NULL, 1000, NULL)) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 4)
+    g_cond_wait (&check_cond, &check_mutex);
+  received = buffers;
+  buffers = NULL;
+  g_mutex_unlock (&check_mutex);
+
+  /* The blocks are allocated one after the other from the start of the
+   * area, each rounded up to the allocator's granule */
+  get_shm_stats (&stats);
+  fail_unless_equals_int (stats.blocks, 4);
+  fail_unless_equals_int (stats.free_blocks, 1);
+  fail_unless_equals_int (stats.allocated % 4, 0);
+  block_size = stats.allocated / 4;
+  fail_unless (block_size >= 1000);
+  fail_unless (block_size < 1000 + 64);
+  fail_unless_equals_uint64 (stats.largest_free, stats.free_bytes);
+  fail_unless_equals_float (stats.fragmentation, 0.0);
+
+  /* A hole between two used blocks fragments the free space */
+  drop_nth_buffer (received, 1);
+  wait_for_shm_blocks (&stats, 3);
+  fail_unless_equals_uint64 (stats.allocated, 3 * block_size);
+  fail_unless_equals_int (stats.free_blocks, 2);
+  fail_unless_equals_uint64 (stats.largest_free,
+      stats.free_bytes - block_size);
+  fail_unless (stats.fragmentation > 0.0);
+
+  /* Freeing the next block grows the hole instead of adding one */
+  drop_nth_buffer (received, 2);
+  wait_for_shm_blocks (&stats, 2);
+  fail_unless_equals_uint64 (stats.allocated, 2 * block_size);
+  fail_unless_equals_int (stats.free_blocks, 2);
+  fail_unless_equals_uint64 (stats.largest_free,
+      stats.free_bytes - 2 * block_size);
+  fail_unless (stats.fragmentation > 0.0);
+
+  /* The last block joins the hole and the free space after it */
+  drop_nth_buffer (received, 3);
+  wait_for_shm_blocks (&stats, 1);
+  fail_unless_equals_uint64 (stats.allocated, block_size);
+  fail_unless_equals_int (stats.free_blocks, 1);
+  fail_unless_equals_uint64 (stats.largest_free, stats.free_bytes);
+  fail_unless_equals_float (stats.fragmentation, 0.0);
+
+  /* And the whole area is one free block again */
+  drop_nth_buffer (received, 0);
+  wait_for_shm_blocks (&stats, 0);
+  fail_unless_equals_uint64 (stats.allocated, 0);
+  fail_unless_equals_int (stats.free_blocks, 1);
+  fail_unless_equals_uint64 (stats.largest_free, size);
+  fail_unless_equals_float (stats.fragmentation, 0.0);
+
+  g_list_free (received);
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_sub_buffer)
+{
+  ShmStats stats;
+  GstSegment segment;
+  GstBuffer *buf, *sub;
+  GstMapInfo map;
+  guint8 data[1000];
+  guint64 pending_bytes, dropped;
+  guint i, pending;
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i;
+  buf = gst_buffer_new_allocate (NULL, sizeof (data), NULL);
+  gst_buffer_fill (buf, 0, data, sizeof (data));
+  fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (buffers == NULL)
+    g_cond_wait (&check_cond, &check_mutex);
+  buf = buffers->data;
+  g_list_free (buffers);
+  buffers = NULL;
+  g_mutex_unlock (&check_mutex);
+
+  /* The sub-buffer keeps the block after its parent is gone */
+  sub = gst_buffer_copy_region (buf, GST_BUFFER_COPY_MEMORY, 100, 200);
+  fail_unless (gst_is_fd_memory (gst_buffer_peek_memory (sub, 0)));
+  gst_buffer_unref (buf);
+
+  /* shmsrc doesn't ack the buffer while the sub-buffer uses it */
+  get_client_stats (0, &pending, &pending_bytes, &dropped);
+  fail_unless_equals_int (pending, 1);
+  fail_unless_equals_uint64 (pending_bytes, sizeof (data));
+  get_shm_stats (&stats);
+  fail_unless_equals_int (stats.blocks, 1);
+
+  fail_unless (gst_buffer_map (sub, &map, GST_MAP_READ));
+  fail_unless_equals_int (map.size, 200);
+  fail_unless (memcmp (map.data, data + 100, 200) == 0);
+  gst_buffer_unmap (sub, &map);
+
+  gst_buffer_unref (sub);
+  wait_for_client_pending (0, 0);
+  wait_for_shm_blocks (&stats, 0);
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_client_drop)
+{
+  GstSegment segment;
+  guint pending;
+  guint64 pending_bytes, dropped;
+  gint i;
+
+  /* The check sink pad keeps all the buffers, so shmsrc never releases
+   * them and the client is full after two */
+  g_object_set (sink, "client-max-buffers", 2, NULL);
+  gst_util_set_object_arg (G_OBJECT (sink), "client-policy", "drop-oldest");
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < 4; i++)
+    fail_unless (gst_pad_push (srcpad,
+            gst_buffer_new_allocate (NULL, 1000, NULL)) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 2)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  get_client_stats (0, &pending, &pending_bytes, &dropped);
+
+  fail_unless_equals_int (pending, 2);
+  fail_unless_equals_uint64 (pending_bytes, 2000);
+  fail_unless_equals_uint64 (dropped, 2);
+
+  gst_check_drop_buffers ();
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+static gboolean blocked;
+
+static GstPadProbeReturn
+blocked_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  g_mutex_lock (&check_mutex);
+  blocked = TRUE;
+  g_cond_broadcast (&check_cond);
+  g_mutex_unlock (&check_mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstBuffer *
+new_numbered_buffer (guint8 n)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, 1000, NULL);
+
+  gst_buffer_memset (buf, 0, n, 1000);
+  return buf;
+}
+
+static guint8
+get_buffer_number (GstBuffer * buf)
+{
+  guint8 n;
+
+  fail_unless_equals_int (gst_buffer_extract (buf, 0, &n, 1), 1);
+  return n;
+}
+
+GST_START_TEST (test_shm_ring_drop_oldest)
+{
+  GstSegment segment;
+  GstPad *pad;
+  gulong probe;
+  guint pending;
+  guint64 pending_bytes, dropped;
+  gint i;
+
+  g_object_set (sink, "client-max-buffers", 2, NULL);
+  gst_util_set_object_arg (G_OBJECT (sink), "client-policy", "drop-oldest");
+
+  /* shmsrc reads the first buffer from the ring and stops there, it holds
+   * that buffer and leaves the next ones unread in the ring */
+  blocked = FALSE;
+  pad = gst_element_get_static_pad (src, "src");
+  probe = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM |
+      GST_PAD_PROBE_TYPE_BUFFER, blocked_cb, NULL, NULL);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  fail_unless (gst_pad_push (srcpad, new_numbered_buffer (0)) == GST_FLOW_OK);
+  g_mutex_lock (&check_mutex);
+  while (!blocked)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  /* The second buffer fills the client, then each new buffer takes the
+   * place of the oldest unread one */
+  for (i = 1; i < 4; i++)
+    fail_unless (gst_pad_push (srcpad,
+            new_numbered_buffer (i)) == GST_FLOW_OK);
+
+  get_client_stats (0, &pending, &pending_bytes, &dropped);
+  fail_unless_equals_int (pending, 2);
+  fail_unless_equals_uint64 (pending_bytes, 2000);
+  fail_unless_equals_uint64 (dropped, 2);
+
+  /* So the client gets the buffer it held and the newest one */
+  gst_pad_remove_probe (pad, probe);
+  gst_object_unref (pad);
+
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < 2)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+
+  wait_for_client_pending (0, 2);
+  fail_unless_equals_int (g_list_length (buffers), 2);
+  fail_unless_equals_int (get_buffer_number (buffers->data), 0);
+  fail_unless_equals_int (get_buffer_number (buffers->next->data), 3);
+
+  gst_check_drop_buffers ();
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+static GstPadProbeReturn
+count_buffers_cb (GstPad * pad, GstPadProbeInfo * info, gint * count)
+{
+  g_atomic_int_inc (count);
+
+  return GST_PAD_PROBE_OK;
+}
+
+GST_START_TEST (test_shm_client_disconnect)
+{
+  GstElement *consumer, *fakesink;
+  GstSegment segment;
+  GstPad *pad;
+  gchar *socket_path, *desc;
+  gint64 deadline;
+  gint count = 0;
+  gint i;
+
+  /* The check sink pad keeps all the buffers, so that client is full after
+   * two. The other one releases them right away */
+  g_object_set (sink, "client-max-buffers", 2, NULL);
+  gst_util_set_object_arg (G_OBJECT (sink), "client-policy", "disconnect");
+
+  g_object_get (sink, "socket-path", &socket_path, NULL);
+  desc = g_strdup_printf ("shmsrc socket-path=%s ! fakesink name=sink "
+      "sync=false", socket_path);
+  consumer = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  g_free (socket_path);
+  fail_unless (consumer != NULL);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (consumer), "sink");
+  pad = gst_element_get_static_pad (fakesink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) count_buffers_cb, &count, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (fakesink);
+
+  fail_unless (gst_element_set_state (consumer, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  wait_for_n_clients (2);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* The newest client comes first in the stats. Waiting for it to release
+   * each buffer keeps it under the limit */
+  for (i = 0; i < 2; i++) {
+    fail_unless (gst_pad_push (srcpad,
+            gst_buffer_new_allocate (NULL, 1000, NULL)) == GST_FLOW_OK);
+    wait_for_client_pending (0, 0);
+  }
+  wait_for_client_pending (1, 2);
+
+  /* The next buffer disconnects the full client, but not the other one */
+  fail_unless (gst_pad_push (srcpad,
+          gst_buffer_new_allocate (NULL, 1000, NULL)) == GST_FLOW_OK);
+  wait_for_n_clients (1);
+
+  for (i = 3; i < 5; i++) {
+    fail_unless (gst_pad_push (srcpad,
+            gst_buffer_new_allocate (NULL, 1000, NULL)) == GST_FLOW_OK);
+    wait_for_client_pending (0, 0);
+  }
+
+  deadline = g_get_monotonic_time () + ACK_TIMEOUT;
+  while (g_atomic_int_get (&count) < 5) {
+    fail_if (g_get_monotonic_time () > deadline,
+        "the other client got %d buffers, expected 5",
+        g_atomic_int_get (&count));
+    g_usleep (G_USEC_PER_SEC / 100);
+  }
+  fail_unless_equals_int (g_atomic_int_get (&count), 5);
+  fail_unless_equals_int (get_n_clients (), 1);
+
+  fail_unless (gst_element_set_state (consumer, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (consumer);
+
+  gst_check_drop_buffers ();
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+static void
+check_shm_live (guint ring_size)
 {
   GstElement *producer, *consumer;
   GstElement *src, *sink;
@@ -182,7 +686,7 @@ GST_START_TEST (test_shm_live)
 
   sink = gst_element_factory_make ("shmsink", NULL);
   g_object_set (sink, "socket-path", "shm-unit-test", "wait-for-connection",
-      FALSE, NULL);
+      FALSE, "ring-size", ring_size, NULL);
 
   producer = gst_pipeline_new ("producer-pipeline");
   gst_bin_add_many (GST_BIN (producer), src, sink, NULL);
@@ -227,6 +731,18 @@ GST_START_TEST (test_shm_live)
   g_free (socket_path);
 }
 
+GST_START_TEST (test_shm_live)
+{
+  check_shm_live (0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_live_ring)
+{
+  check_shm_live (16);
+}
+
 GST_END_TEST;
 
 static Suite *
@@ -239,10 +755,20 @@ shm_suite (void)
   tcase_add_checked_fixture (tc, setup_shm, NULL);
   tcase_add_test (tc, test_shm_sysmem_alloc);
   tcase_add_test (tc, test_shm_alloc);
+  tcase_add_test (tc, test_shm_stats);
+  tcase_add_test (tc, test_shm_sub_buffer);
+  tcase_add_test (tc, test_shm_client_drop);
+  tcase_add_test (tc, test_shm_client_disconnect);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("shm-ring");
+  tcase_add_checked_fixture (tc, setup_shm_ring, NULL);
+  tcase_add_test (tc, test_shm_ring_drop_oldest);
   suite_add_tcase (s, tc);
 
   tc = tcase_create ("shm2");
   tcase_add_test (tc, test_shm_live);
+  tcase_add_test (tc, test_shm_live_ring);
   suite_add_tcase (s, tc);
 
   return s;
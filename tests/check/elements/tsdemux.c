@@ -0,0 +1,679 @@
+/* GStreamer
+ *
+ * unit test for tsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/mpegts/mpegts.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The seek index is internal to the plugin */
+#include "../../../gst/mpegtsdemux/mpegtsindex.c"
+
+#define N_FRAMES 250
+#define FRAME_SIZE 4000
+#define FRAME_DURATION (40 * GST_MSECOND)
+#define KEYFRAME_DISTANCE 10
+#define N_PROGRAMS_MAX 2
+#define TEST_PID(program) (0x40 + (program))
+
+#define PACKET_SIZE 188
+#define PMT_PID 0x100
+#define VIDEO_PID 0x101
+
+static gchar *ts_location, *index_location;
+
+static void
+wait_for_eos (GstElement * pipeline)
+{
+  GstBus *bus = gst_element_get_bus (pipeline);
+  GstMessage *msg;
+
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+}
+
+/* Mux 10 seconds of MPEG-2 video into a transport stream file, with the
+ * video of program n (from 1 to @n_programs) on PID TEST_PID (n) */
+static void
+write_test_stream_programs (guint n_programs)
+{
+  GstElement *pipeline, *mux, *src[N_PROGRAMS_MAX];
+  GstStructure *prog_map;
+  GString *desc;
+  GstCaps *caps;
+  gint fd;
+  guint i, j;
+
+  fail_unless (n_programs <= N_PROGRAMS_MAX);
+
+  fd = g_file_open_tmp ("tsdemux-XXXXXX.ts", &ts_location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+  fd = g_file_open_tmp ("tsdemux-XXXXXX.idx", &index_location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+  g_unlink (index_location);
+
+  desc = g_string_new (NULL);
+  g_string_append_printf (desc, "mpegtsmux name=mux ! filesink location=%s",
+      ts_location);
+  prog_map = gst_structure_new_empty ("program_map");
+  for (i = 0; i < n_programs; i++) {
+    gchar *padname = g_strdup_printf ("sink_%u", TEST_PID (i + 1));
+
+    g_string_append_printf (desc, " appsrc name=src%u format=time ! mux.%s",
+        i, padname);
+    gst_structure_set (prog_map, padname, G_TYPE_INT, i + 1, NULL);
+    g_free (padname);
+  }
+  pipeline = gst_parse_launch (desc->str, NULL);
+  g_string_free (desc, TRUE);
+  fail_unless (pipeline != NULL);
+
+  mux = gst_bin_get_by_name (GST_BIN (pipeline), "mux");
+  g_object_set (mux, "prog-map", prog_map, NULL);
+  gst_structure_free (prog_map);
+  gst_object_unref (mux);
+
+  caps = gst_caps_from_string ("video/mpeg, mpegversion=(int)2, "
+      "systemstream=(boolean)false, parsed=(boolean)true");
+  for (i = 0; i < n_programs; i++) {
+    gchar *name = g_strdup_printf ("src%u", i);
+
+    src[i] = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    gst_app_src_set_caps (GST_APP_SRC (src[i]), caps);
+    g_free (name);
+  }
+  gst_caps_unref (caps);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  for (i = 0; i < N_FRAMES; i++) {
+    for (j = 0; j < n_programs; j++) {
+      GstBuffer *buf = gst_buffer_new_and_alloc (FRAME_SIZE);
+
+      gst_buffer_memset (buf, 0, i, FRAME_SIZE);
+      GST_BUFFER_PTS (buf) = GST_BUFFER_DTS (buf) = i * FRAME_DURATION;
+      GST_BUFFER_DURATION (buf) = FRAME_DURATION;
+      if (i % KEYFRAME_DISTANCE != 0)
+        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+      fail_unless_equals_int (gst_app_src_push_buffer (GST_APP_SRC (src[j]),
+              buf), GST_FLOW_OK);
+    }
+  }
+  for (j = 0; j < n_programs; j++) {
+    gst_app_src_end_of_stream (GST_APP_SRC (src[j]));
+    gst_object_unref (src[j]);
+  }
+
+  wait_for_eos (pipeline);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+static void
+write_test_stream (void)
+{
+  write_test_stream_programs (1);
+}
+
+static void
+remove_test_stream (void)
+{
+  g_unlink (ts_location);
+  g_unlink (index_location);
+  g_free (ts_location);
+  g_free (index_location);
+  ts_location = index_location = NULL;
+}
+
+typedef struct
+{
+  /* whether a seek is done, and whether its flush went through */
+  gboolean seek;
+  gboolean flushed;
+  /* the first buffer output after the seek, if any */
+  GstClockTime first_pts;
+  /* reads done by the demuxer after the seek until that buffer */
+  guint64 first_pull;
+  guint64 last_pull;
+  gboolean pulled_backwards;
+} DemuxProbeData;
+
+static GstPadProbeReturn
+sink_probe_cb (GstPad * pad, GstPadProbeInfo * info, DemuxProbeData * data)
+{
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+        GST_EVENT_FLUSH_STOP)
+      data->flushed = TRUE;
+  } else if (data->flushed == data->seek
+      && !GST_CLOCK_TIME_IS_VALID (data->first_pts)) {
+    data->first_pts = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+pull_probe_cb (GstPad * pad, GstPadProbeInfo * info, DemuxProbeData * data)
+{
+  guint64 offset = GST_PAD_PROBE_INFO_OFFSET (info);
+
+  if (!data->flushed || GST_CLOCK_TIME_IS_VALID (data->first_pts))
+    return GST_PAD_PROBE_OK;
+
+  if (data->first_pull == -1)
+    data->first_pull = offset;
+  else if (offset < data->last_pull)
+    data->pulled_backwards = TRUE;
+  data->last_pull = offset;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Play the test stream with a seek to @seek_pos if valid. @data gets the
+ * first buffer output after the seek, or the very first one without a
+ * seek, and the reads done to get it after the seek */
+static void
+demux_test_stream (GstClockTime seek_pos, DemuxProbeData * data)
+{
+  GstElement *pipeline, *demux, *sink;
+  GstPad *pad;
+  gchar *desc;
+
+  memset (data, 0, sizeof (DemuxProbeData));
+  data->seek = GST_CLOCK_TIME_IS_VALID (seek_pos);
+  data->first_pts = GST_CLOCK_TIME_NONE;
+  data->first_pull = -1;
+
+  desc = g_strdup_printf ("filesrc location=%s ! tsdemux name=d "
+      "index-location=%s d. ! fakesink name=sink sync=false", ts_location,
+      index_location);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_FLUSH, (GstPadProbeCallback) sink_probe_cb,
+      data, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (sink);
+
+  demux = gst_bin_get_by_name (GST_BIN (pipeline), "d");
+  pad = gst_element_get_static_pad (demux, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_PULL | GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) pull_probe_cb, data, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (demux);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  if (data->seek) {
+    fail_unless (gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+            GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, seek_pos));
+    fail_unless_equals_int (gst_element_get_state (pipeline, NULL, NULL,
+            GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+  }
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  wait_for_eos (pipeline);
+  fail_unless (GST_CLOCK_TIME_IS_VALID (data->first_pts));
+
+  /* the index is written when going back to READY */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_START_TEST (test_index_round_trip)
+{
+  MpegTSIndex *index, *loaded;
+  GError *err = NULL;
+  gint fd;
+  guint i;
+
+  fd = g_file_open_tmp ("tsdemux-XXXXXX.idx", &index_location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+
+  index = mpegts_index_new (123456789);
+  /* out of order, the index keeps them sorted by offset */
+  for (i = 0; i < 100; i++)
+    mpegts_index_add_entry (index, ((i * 37) % 100) * 188 * 1000,
+        ((i * 37) % 100) * GST_SECOND, i % 3 ? MPEGTS_INDEX_ENTRY_PCR :
+        MPEGTS_INDEX_ENTRY_KEYFRAME);
+  fail_unless (index->dirty);
+  fail_unless_equals_int (index->entries->len, 100);
+
+  fail_unless (mpegts_index_save (index, index_location, &err));
+  fail_unless (err == NULL);
+  fail_if (index->dirty);
+
+  loaded = mpegts_index_load (index_location, &err);
+  fail_unless (loaded != NULL);
+  fail_unless (err == NULL);
+  fail_if (loaded->dirty);
+  fail_unless_equals_uint64 (loaded->stream_size, 123456789);
+  fail_unless_equals_int (loaded->entries->len, index->entries->len);
+  for (i = 0; i < index->entries->len; i++) {
+    MpegTSIndexEntry *a = &g_array_index (index->entries, MpegTSIndexEntry, i);
+    MpegTSIndexEntry *b = &g_array_index (loaded->entries, MpegTSIndexEntry, i);
+
+    fail_unless_equals_uint64 (a->offset, b->offset);
+    fail_unless_equals_uint64 (a->ts, b->ts);
+    fail_unless_equals_int (a->flags, b->flags);
+  }
+
+  fail_unless_equals_uint64 (mpegts_index_lookup (loaded, 50 * GST_SECOND + 1,
+          MPEGTS_INDEX_ENTRY_PCR | MPEGTS_INDEX_ENTRY_KEYFRAME)->offset,
+      50 * 188 * 1000);
+
+  mpegts_index_free (index);
+  mpegts_index_free (loaded);
+  g_unlink (index_location);
+  g_free (index_location);
+  index_location = NULL;
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_load_invalid)
+{
+  MpegTSIndex *index;
+  GError *err = NULL;
+  gchar *contents;
+  gsize size;
+  gint fd;
+  guint i;
+
+  fd = g_file_open_tmp ("tsdemux-XXXXXX.idx", &index_location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+
+  index = mpegts_index_new (1000000);
+  for (i = 0; i < 10; i++)
+    mpegts_index_add_entry (index, i * 100000, i * GST_SECOND,
+        MPEGTS_INDEX_ENTRY_KEYFRAME);
+  fail_unless (mpegts_index_save (index, index_location, NULL));
+  mpegts_index_free (index);
+  fail_unless (g_file_get_contents (index_location, &contents, &size, NULL));
+
+  /* truncated in the header and in the entries */
+  for (i = 0; i < size; i += 7) {
+    fail_unless (g_file_set_contents (index_location, contents, i, NULL));
+    index = mpegts_index_load (index_location, &err);
+    fail_unless (index == NULL);
+    fail_unless (g_error_matches (err, GST_STREAM_ERROR,
+            GST_STREAM_ERROR_FORMAT));
+    g_clear_error (&err);
+  }
+
+  /* entries out of order */
+  memset (contents + INDEX_HEADER_SIZE + 5 * INDEX_ENTRY_SIZE + 1, 0, 7);
+  fail_unless (g_file_set_contents (index_location, contents, size, NULL));
+  fail_unless (mpegts_index_load (index_location, &err) == NULL);
+  fail_unless (err != NULL);
+  g_clear_error (&err);
+
+  /* wrong magic */
+  contents[0] = 'X';
+  fail_unless (g_file_set_contents (index_location, contents, size, NULL));
+  fail_unless (mpegts_index_load (index_location, &err) == NULL);
+  fail_unless (err != NULL);
+  g_clear_error (&err);
+
+  g_free (contents);
+  g_unlink (index_location);
+  g_free (index_location);
+  index_location = NULL;
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_file)
+{
+  const MpegTSIndexEntry *entry;
+  DemuxProbeData data;
+  MpegTSIndex *index;
+  GstClockTime start;
+  GStatBuf st;
+
+  write_test_stream ();
+  fail_unless (g_stat (ts_location, &st) == 0);
+
+  /* playback fills the index and writes it out */
+  demux_test_stream (GST_CLOCK_TIME_NONE, &data);
+  start = data.first_pts;
+  index = mpegts_index_load (index_location, NULL);
+  fail_unless (index != NULL);
+  fail_unless_equals_uint64 (index->stream_size, st.st_size);
+  fail_unless (index->entries->len > 0);
+
+  /* and seeking with it reads straight from the keyframe before the seek
+   * position, without looking for it in the stream */
+  entry = mpegts_index_lookup (index, 5 * GST_SECOND,
+      MPEGTS_INDEX_ENTRY_KEYFRAME);
+  fail_unless (entry != NULL);
+  demux_test_stream (5 * GST_SECOND, &data);
+  fail_unless_equals_uint64 (data.first_pull, entry->offset);
+  fail_if (data.pulled_backwards);
+
+  /* which is the first buffer output */
+  fail_unless_equals_uint64 (data.first_pts, entry->ts);
+  fail_unless (data.first_pts >= start);
+  fail_unless (data.first_pts - start <= 5 * GST_SECOND);
+  fail_unless_equals_uint64 ((data.first_pts - start) %
+      (KEYFRAME_DISTANCE * FRAME_DURATION), 0);
+
+  mpegts_index_free (index);
+  remove_test_stream ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_file_corrupt)
+{
+  static const gchar garbage[] = "TSIX\0\0\0\1garbage";
+  DemuxProbeData data;
+  MpegTSIndex *index;
+  GStatBuf st;
+
+  write_test_stream ();
+  fail_unless (g_stat (ts_location, &st) == 0);
+
+  /* a corrupt index is ignored, seeking falls back to scanning the stream
+   * and a new index is written */
+  fail_unless (g_file_set_contents (index_location, garbage,
+          sizeof (garbage) - 1, NULL));
+  demux_test_stream (5 * GST_SECOND, &data);
+
+  index = mpegts_index_load (index_location, NULL);
+  fail_unless (index != NULL);
+  fail_unless_equals_uint64 (index->stream_size, st.st_size);
+  fail_unless (index->entries->len > 0);
+  mpegts_index_free (index);
+
+  remove_test_stream ();
+}
+
+GST_END_TEST;
+
+#ifndef GST_DISABLE_GST_DEBUG
+/* counts the PCRs the packetizer parsed, per program */
+static void
+count_pcrs (GstDebugCategory * category, GstDebugLevel level,
+    const gchar * file, const gchar * function, gint line, GObject * object,
+    GstDebugMessage * message, gpointer user_data)
+{
+  guint *pcrs = user_data;
+  guint pid;
+
+  if (strcmp (gst_debug_category_get_name (category), "mpegtspacketizer") != 0)
+    return;
+
+  if (sscanf (gst_debug_message_get (message), "pcr 0x%x", &pid) == 1
+      && pid > TEST_PID (0) && pid <= TEST_PID (N_PROGRAMS_MAX))
+    pcrs[pid - TEST_PID (1)]++;
+}
+
+static void
+pad_added_cb (GstElement * demux, GstPad * pad, GList ** pads)
+{
+  *pads = g_list_append (*pads, gst_pad_get_name (pad));
+}
+
+/* Demuxes program 2 of the test stream in push mode, so that there is no
+ * initial scan of the whole file, and returns the names of the pads */
+static GList *
+demux_program_2 (gboolean filter, guint * pcrs)
+{
+  GstElement *pipeline, *demux;
+  GList *pads = NULL;
+  gchar *desc;
+
+  desc = g_strdup_printf ("filesrc location=%s ! queue ! tsdemux name=d "
+      "program-number=2 program-filter=%d d. ! fakesink sync=false",
+      ts_location, filter);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  demux = gst_bin_get_by_name (GST_BIN (pipeline), "d");
+  g_signal_connect (demux, "pad-added", G_CALLBACK (pad_added_cb), &pads);
+  gst_object_unref (demux);
+
+  gst_debug_set_threshold_for_name ("mpegtspacketizer", GST_LEVEL_DEBUG);
+  gst_debug_add_log_function (count_pcrs, pcrs, NULL);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  wait_for_eos (pipeline);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  gst_debug_remove_log_function (count_pcrs);
+  gst_debug_unset_threshold_for_name ("mpegtspacketizer");
+
+  return pads;
+}
+
+GST_START_TEST (test_program_filter)
+{
+  guint pcrs[N_PROGRAMS_MAX] = { 0, };
+  GList *pads;
+  guint pid;
+
+  write_test_stream_programs (2);
+
+  /* without the filter, the packets of both programs are parsed */
+  pads = demux_program_2 (FALSE, pcrs);
+  fail_unless (pcrs[0] > 0);
+  fail_unless (pcrs[1] > 0);
+  g_list_free_full (pads, g_free);
+
+  /* with it, only the pads of the selected program appear and the packets
+   * of the other program are dropped before being parsed */
+  memset (pcrs, 0, sizeof (pcrs));
+  pads = demux_program_2 (TRUE, pcrs);
+  fail_unless_equals_int (g_list_length (pads), 1);
+  fail_unless (sscanf (pads->data, "video_%*x_%x", &pid) == 1);
+  fail_unless_equals_int (pid, TEST_PID (2));
+  fail_unless_equals_int (pcrs[0], 0);
+  fail_unless (pcrs[1] > 0);
+  g_list_free_full (pads, g_free);
+
+  remove_test_stream ();
+}
+
+GST_END_TEST;
+#endif
+
+/* Writes @section (of which ownership is taken) as the only section of a
+ * transport packet on @pid */
+static void
+write_section_packet (GstMpegtsSection * section, guint16 pid, guint8 cc,
+    guint8 * packet)
+{
+  const guint8 *data;
+  gsize size;
+
+  data = gst_mpegts_section_packetize (section, &size);
+  fail_unless (data != NULL);
+  fail_unless (size <= PACKET_SIZE - 5);
+
+  memset (packet, 0xff, PACKET_SIZE);
+  packet[0] = 0x47;
+  packet[1] = 0x40 | (pid >> 8);
+  packet[2] = pid & 0xff;
+  packet[3] = 0x10 | (cc & 0x0f);
+  packet[4] = 0;
+  memcpy (packet + 5, data, size);
+  gst_mpegts_section_unref (section);
+}
+
+static void
+write_null_packet (guint8 * packet)
+{
+  memset (packet, 0xff, PACKET_SIZE);
+  packet[0] = 0x47;
+  packet[1] = 0x1f;
+  packet[2] = 0xff;
+  packet[3] = 0x10;
+}
+
+/* A PAT with program 1 */
+static GstMpegtsSection *
+make_pat (guint8 version)
+{
+  GPtrArray *pat = gst_mpegts_pat_new ();
+  GstMpegtsPatProgram *program = gst_mpegts_pat_program_new ();
+  GstMpegtsSection *section;
+
+  program->program_number = 1;
+  program->network_or_program_map_PID = PMT_PID;
+  g_ptr_array_add (pat, program);
+
+  section = gst_mpegts_section_from_pat (pat, 1);
+  section->version_number = version;
+
+  return section;
+}
+
+/* The PMT of program 1, with an MPEG-2 video stream */
+static GstMpegtsSection *
+make_pmt (guint8 version)
+{
+  GstMpegtsPMT *pmt = gst_mpegts_pmt_new ();
+  GstMpegtsPMTStream *stream = gst_mpegts_pmt_stream_new ();
+  GstMpegtsSection *section;
+
+  pmt->program_number = 1;
+  pmt->pcr_pid = VIDEO_PID;
+  stream->stream_type = GST_MPEGTS_STREAM_TYPE_VIDEO_MPEG2;
+  stream->pid = VIDEO_PID;
+  g_ptr_array_add (pmt->streams, stream);
+
+  section = gst_mpegts_section_from_pmt (pmt, PMT_PID);
+  section->version_number = version;
+
+  return section;
+}
+
+GST_START_TEST (test_repeated_sections_reused)
+{
+  GstMpegtsSection *sections[6];
+  GstHarness *h;
+  GstMessage *msg;
+  GstBuffer *buf;
+  GstMapInfo map;
+  GstBus *bus;
+  guint i, n = 0;
+
+  gst_mpegts_initialize ();
+
+  h = gst_harness_new_with_padnames ("tsdemux", "sink", NULL);
+  bus = gst_bus_new ();
+  gst_element_set_bus (h->element, bus);
+  gst_harness_set_src_caps_str (h, "video/mpegts, "
+      "systemstream=(boolean)true, packetsize=(int)188");
+
+  /* The PAT and PMT in version 0, then 1, then 0 again. The messages about
+   * the first ones are still on the bus when the last ones arrive */
+  buf = gst_buffer_new_and_alloc (10 * PACKET_SIZE);
+  fail_unless (gst_buffer_map (buf, &map, GST_MAP_WRITE));
+  for (i = 0; i < 3; i++) {
+    write_section_packet (make_pat (i % 2), 0x0000, i,
+        map.data + 2 * i * PACKET_SIZE);
+    write_section_packet (make_pmt (i % 2), PMT_PID, i,
+        map.data + (2 * i + 1) * PACKET_SIZE);
+  }
+  for (i = 6; i < 10; i++)
+    write_null_packet (map.data + i * PACKET_SIZE);
+  gst_buffer_unmap (buf, &map);
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+
+  while ((msg = gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT))) {
+    GstMpegtsSection *section = gst_message_parse_mpegts_section (msg);
+
+    if (section) {
+      fail_unless (n < G_N_ELEMENTS (sections));
+      sections[n++] = section;
+    }
+    gst_message_unref (msg);
+  }
+  fail_unless_equals_int (n, 6);
+
+  for (i = 0; i < n; i++) {
+    fail_unless_equals_int (GST_MPEGTS_SECTION_TYPE (sections[i]),
+        i % 2 ? GST_MPEGTS_SECTION_PMT : GST_MPEGTS_SECTION_PAT);
+    fail_unless_equals_int (sections[i]->version_number, (i / 2) % 2);
+  }
+
+  /* the repeated tables are the sections handed out the first time */
+  fail_unless (sections[4] == sections[0]);
+  fail_unless (sections[5] == sections[1]);
+  fail_unless (sections[2] != sections[0]);
+  fail_unless (sections[3] != sections[1]);
+
+  for (i = 0; i < n; i++)
+    gst_mpegts_section_unref (sections[i]);
+  gst_element_set_bus (h->element, NULL);
+  gst_object_unref (bus);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsdemux_suite (void)
+{
+  Suite *s = suite_create ("tsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  init_mpegts_index ();
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_index_round_trip);
+  tcase_add_test (tc_chain, test_index_load_invalid);
+  tcase_add_test (tc_chain, test_index_file);
+  tcase_add_test (tc_chain, test_index_file_corrupt);
+#ifndef GST_DISABLE_GST_DEBUG
+  tcase_add_test (tc_chain, test_program_filter);
+#endif
+  tcase_add_test (tc_chain, test_repeated_sections_reused);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsdemux);
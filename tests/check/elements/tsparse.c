@@ -0,0 +1,257 @@
+/* GStreamer
+ *
+ * unit test for tsparse
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <gst/mpegts/mpegts.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PACKET_SIZE 188
+#define N_PROGRAMS 2
+#define N_FRAMES 50
+#define FRAME_SIZE 4000
+#define FRAME_DURATION (40 * GST_MSECOND)
+/* the video of program n is on PID TEST_PID (n) */
+#define TEST_PID(program) (0x40 + (program))
+
+#define PACKET_PID(data) (GST_READ_UINT16_BE ((data) + 1) & 0x1fff)
+
+/* Mux 2 seconds of MPEG-2 video into each of the programs 1 to N_PROGRAMS */
+static GstBuffer *
+mux_programs (void)
+{
+  GstElement *pipeline, *mux, *src[N_PROGRAMS], *sink;
+  GstStructure *prog_map;
+  GstSample *sample;
+  GByteArray *output;
+  GString *desc;
+  GstCaps *caps;
+  guint i, j;
+  gsize size;
+
+  desc = g_string_new ("mpegtsmux name=mux ! appsink name=sink sync=false");
+  prog_map = gst_structure_new_empty ("program_map");
+  for (i = 0; i < N_PROGRAMS; i++) {
+    gchar *padname = g_strdup_printf ("sink_%u", TEST_PID (i + 1));
+
+    g_string_append_printf (desc, " appsrc name=src%u format=time ! mux.%s",
+        i, padname);
+    gst_structure_set (prog_map, padname, G_TYPE_INT, i + 1, NULL);
+    g_free (padname);
+  }
+  pipeline = gst_parse_launch (desc->str, NULL);
+  g_string_free (desc, TRUE);
+  fail_unless (pipeline != NULL);
+
+  mux = gst_bin_get_by_name (GST_BIN (pipeline), "mux");
+  g_object_set (mux, "prog-map", prog_map, NULL);
+  gst_structure_free (prog_map);
+  gst_object_unref (mux);
+
+  caps = gst_caps_from_string ("video/mpeg, mpegversion=(int)2, "
+      "systemstream=(boolean)false, parsed=(boolean)true");
+  for (i = 0; i < N_PROGRAMS; i++) {
+    gchar *name = g_strdup_printf ("src%u", i);
+
+    src[i] = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    gst_app_src_set_caps (GST_APP_SRC (src[i]), caps);
+    g_free (name);
+  }
+  gst_caps_unref (caps);
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  for (i = 0; i < N_FRAMES; i++) {
+    for (j = 0; j < N_PROGRAMS; j++) {
+      GstBuffer *buf = gst_buffer_new_and_alloc (FRAME_SIZE);
+
+      gst_buffer_memset (buf, 0, i, FRAME_SIZE);
+      GST_BUFFER_PTS (buf) = GST_BUFFER_DTS (buf) = i * FRAME_DURATION;
+      GST_BUFFER_DURATION (buf) = FRAME_DURATION;
+      fail_unless_equals_int (gst_app_src_push_buffer (GST_APP_SRC (src[j]),
+              buf), GST_FLOW_OK);
+    }
+  }
+  for (j = 0; j < N_PROGRAMS; j++) {
+    gst_app_src_end_of_stream (GST_APP_SRC (src[j]));
+    gst_object_unref (src[j]);
+  }
+
+  output = g_byte_array_new ();
+  while ((sample = gst_app_sink_pull_sample (GST_APP_SINK (sink)))) {
+    GstMapInfo map;
+
+    gst_buffer_map (gst_sample_get_buffer (sample), &map, GST_MAP_READ);
+    g_byte_array_append (output, map.data, map.size);
+    gst_buffer_unmap (gst_sample_get_buffer (sample), &map);
+    gst_sample_unref (sample);
+  }
+  fail_unless (gst_app_sink_is_eos (GST_APP_SINK (sink)));
+  gst_object_unref (sink);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  /* all of it in a single memory */
+  size = output->len;
+  return gst_buffer_new_wrapped (g_byte_array_free (output, FALSE), size);
+}
+
+/* Number of the program listed in the PAT @packet, which must only list
+ * one */
+static guint
+pat_program_number (const guint8 * packet)
+{
+  const guint8 *data = packet + 5 + packet[4];
+  GstMpegtsPatProgram *program;
+  GstMpegtsSection *section;
+  guint section_length, program_number;
+  GPtrArray *pat;
+
+  section_length = (GST_READ_UINT16_BE (data + 1) & 0x0fff) + 3;
+  section = gst_mpegts_section_new (0x0000, g_memdup (data, section_length),
+      section_length);
+  fail_unless (section != NULL);
+  pat = gst_mpegts_section_get_pat (section);
+  fail_unless (pat != NULL);
+
+  fail_unless_equals_int (pat->len, 1);
+  program = g_ptr_array_index (pat, 0);
+  program_number = program->program_number;
+
+  g_ptr_array_unref (pat);
+  gst_mpegts_section_unref (section);
+
+  return program_number;
+}
+
+static void
+pad_added_cb (GstElement * parse, GstPad * pad, GstHarness ** programs)
+{
+  gchar *name = gst_pad_get_name (pad);
+  guint program;
+
+  /* The pad only gets packets at the end of the current input buffer, so
+   * it can still be linked from here */
+  if (sscanf (name, "program_%u", &program) == 1) {
+    fail_unless (program >= 1 && program <= N_PROGRAMS);
+    fail_unless (programs[program - 1] == NULL);
+    programs[program - 1] = gst_harness_new_with_element (parse, NULL, name);
+  }
+  g_free (name);
+}
+
+GST_START_TEST (test_split_programs)
+{
+  GstHarness *h, *programs[N_PROGRAMS] = { NULL, };
+  GstMapInfo in_map, map;
+  GstBuffer *input, *buf;
+  guint i, n_pat_in = 0;
+  gsize offset;
+
+  gst_mpegts_initialize ();
+
+  input = mux_programs ();
+  fail_unless (gst_buffer_map (input, &in_map, GST_MAP_READ));
+  fail_unless_equals_int (in_map.size % PACKET_SIZE, 0);
+  for (offset = 0; offset < in_map.size; offset += PACKET_SIZE) {
+    if (PACKET_PID (in_map.data + offset) == 0x0000)
+      n_pat_in++;
+  }
+  fail_unless (n_pat_in > 2);
+
+  h = gst_harness_new_with_padnames ("tsparse", "sink", "src");
+  g_object_set (h->element, "split-programs", TRUE, NULL);
+  g_signal_connect (h->element, "pad-added", G_CALLBACK (pad_added_cb),
+      programs);
+  gst_harness_set_src_caps_str (h, "video/mpegts, "
+      "systemstream=(boolean)true, packetsize=(int)188");
+
+  fail_unless_equals_int (gst_harness_push (h, gst_buffer_ref (input)),
+      GST_FLOW_OK);
+  gst_harness_push_event (h, gst_event_new_eos ());
+
+  for (i = 0; i < N_PROGRAMS; i++) {
+    guint n_pat = 0, n_video = 0;
+
+    /* a pad appeared for each program */
+    fail_unless (programs[i] != NULL);
+
+    while ((buf = gst_harness_try_pull (programs[i]))) {
+      fail_unless (gst_buffer_map (buf, &map, GST_MAP_READ));
+      fail_unless_equals_int (map.size % PACKET_SIZE, 0);
+
+      if (map.data >= in_map.data && map.data < in_map.data + in_map.size) {
+        /* a region of the input, which never contains the input PAT */
+        fail_unless (map.data + map.size <= in_map.data + in_map.size);
+        for (offset = 0; offset < map.size; offset += PACKET_SIZE) {
+          guint16 pid = PACKET_PID (map.data + offset);
+
+          fail_if (pid == 0x0000);
+          if (pid == TEST_PID (i + 1))
+            n_video++;
+          else
+            fail_unless (pid < TEST_PID (1) || pid > TEST_PID (N_PROGRAMS));
+        }
+      } else {
+        /* the only new packets are the PATs listing the program */
+        fail_unless_equals_int (map.size, PACKET_SIZE);
+        fail_unless_equals_int (PACKET_PID (map.data), 0x0000);
+        fail_unless_equals_int (pat_program_number (map.data), i + 1);
+        n_pat++;
+      }
+
+      gst_buffer_unmap (buf, &map);
+      gst_buffer_unref (buf);
+    }
+
+    fail_unless (n_video > 0);
+    /* the PAT is repeated along with the input one. The first input PAT
+     * comes before the PMTs, and thereby before the pads */
+    fail_unless (n_pat + 1 >= n_pat_in);
+
+    gst_harness_teardown (programs[i]);
+  }
+
+  gst_buffer_unmap (input, &in_map);
+  gst_buffer_unref (input);
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsparse_suite (void)
+{
+  Suite *s = suite_create ("tsparse");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_split_programs);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsparse);
@@ -0,0 +1,138 @@
+/* GStreamer
+ *
+ * vp9parse.c: unit tests for vp9parse
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/check.h>
+
+/* 320x240 profile 0 key frame */
+static const guint8 key_frame[] = {
+  0x82, 0x49, 0x83, 0x42, 0x20, 0x13, 0xf0, 0x0e, 0xf6, 0x14, 0x07, 0x80,
+  0x00, 0x01, 0xaa
+};
+
+/* superframe of a hidden inter frame and a shown existing frame */
+static const guint8 superframe[] = {
+  0x84, 0x00, 0x40, 0x01, 0x38, 0x50, 0x1e, 0x00, 0x00, 0x04, 0xbb, 0x88,
+  0xc1, 0x0b, 0x01, 0xc1
+};
+
+static void
+push_data (GstHarness * h, const guint8 * data, gsize size, GstClockTime pts)
+{
+  GstBuffer *buf;
+
+  buf = gst_buffer_new_and_alloc (size);
+  gst_buffer_fill (buf, 0, data, size);
+  GST_BUFFER_PTS (buf) = GST_BUFFER_DTS (buf) = pts;
+  GST_BUFFER_DURATION (buf) = 40 * GST_MSECOND;
+  fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+}
+
+static void
+pull_and_check (GstHarness * h, const guint8 * data, gsize size,
+    gboolean keyframe, GstClockTime pts)
+{
+  GstBuffer *buf;
+
+  buf = gst_harness_pull (h);
+  fail_unless (buf != NULL);
+  fail_unless_equals_int (gst_buffer_get_size (buf), size);
+  fail_unless (gst_buffer_memcmp (buf, 0, data, size) == 0);
+  fail_unless_equals_int (!GST_BUFFER_FLAG_IS_SET (buf,
+          GST_BUFFER_FLAG_DELTA_UNIT), keyframe);
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buf), pts);
+  gst_buffer_unref (buf);
+}
+
+GST_START_TEST (test_vp9parse_super_frame)
+{
+  GstHarness *h;
+  GstCaps *caps;
+  GstStructure *s;
+  gint width, height;
+  guint bit_depth;
+
+  h = gst_harness_new ("vp9parse");
+  gst_harness_set_src_caps_str (h, "video/x-vp9");
+
+  push_data (h, key_frame, sizeof (key_frame), 0);
+  push_data (h, superframe, sizeof (superframe), 40 * GST_MSECOND);
+
+  pull_and_check (h, key_frame, sizeof (key_frame), TRUE, 0);
+  pull_and_check (h, superframe, sizeof (superframe), FALSE,
+      40 * GST_MSECOND);
+
+  caps = gst_pad_get_current_caps (h->sinkpad);
+  fail_unless (caps != NULL);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless_equals_string (gst_structure_get_string (s, "alignment"),
+      "super-frame");
+  fail_unless (gst_structure_get_int (s, "width", &width));
+  fail_unless (gst_structure_get_int (s, "height", &height));
+  fail_unless_equals_int (width, 320);
+  fail_unless_equals_int (height, 240);
+  fail_unless_equals_string (gst_structure_get_string (s, "profile"), "0");
+  fail_unless (gst_structure_get_uint (s, "bit-depth-luma", &bit_depth));
+  fail_unless_equals_int (bit_depth, 8);
+  fail_unless_equals_string (gst_structure_get_string (s, "chroma-format"),
+      "4:2:0");
+  gst_caps_unref (caps);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_vp9parse_split_super_frame)
+{
+  GstHarness *h;
+
+  h = gst_harness_new ("vp9parse");
+  gst_harness_set_caps_str (h, "video/x-vp9",
+      "video/x-vp9, alignment=(string)frame");
+
+  push_data (h, key_frame, sizeof (key_frame), 0);
+  push_data (h, superframe, sizeof (superframe), 40 * GST_MSECOND);
+
+  /* the superframe index is dropped and only the shown frame keeps the
+   * presentation timestamp */
+  fail_unless_equals_int (gst_harness_buffers_in_queue (h), 3);
+  pull_and_check (h, key_frame, sizeof (key_frame), TRUE, 0);
+  pull_and_check (h, superframe, 11, FALSE, GST_CLOCK_TIME_NONE);
+  pull_and_check (h, superframe + 11, 1, FALSE, 40 * GST_MSECOND);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+static Suite *
+vp9parse_suite (void)
+{
+  Suite *s = suite_create ("vp9parse");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_vp9parse_super_frame);
+  tcase_add_test (tc_chain, test_vp9parse_split_super_frame);
+
+  return s;
+}
+
+GST_CHECK_MAIN (vp9parse);
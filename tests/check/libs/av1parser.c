@@ -0,0 +1,184 @@
+/* GStreamer
+ *
+ * av1parser.c: unit tests for the AV1 OBU parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/codecparsers/gstav1parser.h>
+
+/* temporal delimiter, sequence header (320x240, main profile, 8 bit 4:2:0),
+ * key frame header and a tile group */
+static const guint8 av1_tu_key[] = {
+  0x12, 0x00, 0x0a, 0x0b, 0x00, 0x00, 0x00, 0x42, 0x61, 0x3f, 0x77, 0xbf,
+  0xff, 0x30, 0x08, 0x1a, 0x02, 0x10, 0x01, 0x22, 0x03, 0xaa, 0xbb, 0xcc
+};
+
+/* temporal delimiter, inter frame header and a tile group */
+static const guint8 av1_tu_inter[] = {
+  0x12, 0x00, 0x1a, 0x07, 0x30, 0x03, 0xc0, 0x40, 0x00, 0x00, 0x40, 0x22,
+  0x03, 0xaa, 0xbb, 0xcc
+};
+
+GST_START_TEST (test_av1_read_leb128)
+{
+  const guint8 data[] = { 0xe5, 0x8e, 0x26 };
+  guint32 value;
+  guint len;
+
+  assert_equals_int (gst_av1_read_leb128 (data, sizeof (data), &value, &len),
+      GST_AV1_PARSER_OK);
+  assert_equals_uint64 (value, 624485);
+  assert_equals_int (len, 3);
+
+  assert_equals_int (gst_av1_read_leb128 (data, 2, &value, &len),
+      GST_AV1_PARSER_NO_MORE_DATA);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_av1_identify_obus)
+{
+  const GstAV1OBUType types[] = { GST_AV1_OBU_TEMPORAL_DELIMITER,
+    GST_AV1_OBU_SEQUENCE_HEADER, GST_AV1_OBU_FRAME_HEADER,
+    GST_AV1_OBU_TILE_GROUP
+  };
+  const guint sizes[] = { 0, 11, 2, 3 };
+  GstAV1Parser *parser;
+  GstAV1OBU obu;
+  gsize offset = 0;
+  guint i;
+
+  parser = gst_av1_parser_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (types); i++) {
+    assert_equals_int (gst_av1_parser_identify_obu (parser,
+            av1_tu_key + offset, sizeof (av1_tu_key) - offset, &obu),
+        GST_AV1_PARSER_OK);
+    assert_equals_int (obu.header.obu_type, types[i]);
+    assert_equals_int (obu.header.obu_has_size_field, TRUE);
+    assert_equals_int (obu.header_size, 2);
+    assert_equals_int (obu.obu_size, sizes[i]);
+    fail_unless (obu.data == av1_tu_key + offset + 2);
+    offset += obu.header_size + obu.obu_size;
+  }
+  assert_equals_int (offset, sizeof (av1_tu_key));
+
+  /* truncated tile group */
+  assert_equals_int (gst_av1_parser_identify_obu (parser,
+          av1_tu_key + offset - 5, 4, &obu), GST_AV1_PARSER_NO_MORE_DATA);
+
+  /* forbidden bit set */
+  {
+    const guint8 broken[] = { 0x92, 0x00 };
+
+    assert_equals_int (gst_av1_parser_identify_obu (parser, broken,
+            sizeof (broken), &obu), GST_AV1_PARSER_BROKEN_DATA);
+  }
+
+  gst_av1_parser_free (parser);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_av1_parse_headers)
+{
+  GstAV1Parser *parser;
+  GstAV1OBU obu;
+  GstAV1SequenceHeaderOBU seq_header;
+  GstAV1FrameHeaderOBU frame_header;
+
+  parser = gst_av1_parser_new ();
+
+  /* frame headers need a sequence header */
+  assert_equals_int (gst_av1_parser_identify_obu (parser, av1_tu_key + 15,
+          4, &obu), GST_AV1_PARSER_OK);
+  assert_equals_int (gst_av1_parser_parse_frame_header_obu (parser, &obu,
+          &frame_header), GST_AV1_PARSER_MISSING_OBU_REFERENCE);
+
+  assert_equals_int (gst_av1_parser_identify_obu (parser, av1_tu_key + 2,
+          13, &obu), GST_AV1_PARSER_OK);
+  assert_equals_int (gst_av1_parser_parse_sequence_header_obu (parser, &obu,
+          &seq_header), GST_AV1_PARSER_OK);
+  assert_equals_int (seq_header.seq_profile, GST_AV1_PROFILE_0);
+  assert_equals_int (seq_header.operating_points_cnt_minus_1, 0);
+  assert_equals_int (seq_header.operating_points[0].seq_level_idx, 8);
+  assert_equals_int (seq_header.max_frame_width_minus_1, 319);
+  assert_equals_int (seq_header.max_frame_height_minus_1, 239);
+  assert_equals_int (seq_header.enable_order_hint, TRUE);
+  assert_equals_int (seq_header.order_hint_bits, 7);
+  assert_equals_int (seq_header.seq_force_screen_content_tools,
+      GST_AV1_SELECT_SCREEN_CONTENT_TOOLS);
+  assert_equals_int (seq_header.seq_force_integer_mv,
+      GST_AV1_SELECT_INTEGER_MV);
+  assert_equals_int (seq_header.color_config.bit_depth, 8);
+  assert_equals_int (seq_header.color_config.mono_chrome, FALSE);
+  assert_equals_int (seq_header.color_config.subsampling_x, 1);
+  assert_equals_int (seq_header.color_config.subsampling_y, 1);
+  fail_unless (parser->have_seq_header);
+
+  /* key frame */
+  assert_equals_int (gst_av1_parser_identify_obu (parser, av1_tu_key + 15,
+          4, &obu), GST_AV1_PARSER_OK);
+  assert_equals_int (gst_av1_parser_parse_frame_header_obu (parser, &obu,
+          &frame_header), GST_AV1_PARSER_OK);
+  assert_equals_int (frame_header.show_existing_frame, FALSE);
+  assert_equals_int (frame_header.frame_type, GST_AV1_KEY_FRAME);
+  assert_equals_int (frame_header.show_frame, TRUE);
+  assert_equals_int (frame_header.refresh_frame_flags, 0xff);
+  assert_equals_int (frame_header.frame_size_known, TRUE);
+  assert_equals_int (frame_header.frame_width, 320);
+  assert_equals_int (frame_header.frame_height, 240);
+  assert_equals_int (frame_header.render_width, 320);
+  assert_equals_int (frame_header.render_height, 240);
+
+  /* inter frame, predicted from the key frame */
+  assert_equals_int (gst_av1_parser_identify_obu (parser, av1_tu_inter + 2,
+          9, &obu), GST_AV1_PARSER_OK);
+  assert_equals_int (obu.header.obu_type, GST_AV1_OBU_FRAME_HEADER);
+  assert_equals_int (gst_av1_parser_parse_frame_header_obu (parser, &obu,
+          &frame_header), GST_AV1_PARSER_OK);
+  assert_equals_int (frame_header.frame_type, GST_AV1_INTER_FRAME);
+  assert_equals_int (frame_header.show_frame, TRUE);
+  assert_equals_int (frame_header.order_hint, 1);
+  assert_equals_int (frame_header.primary_ref_frame,
+      GST_AV1_PRIMARY_REF_NONE);
+  assert_equals_int (frame_header.refresh_frame_flags, 0x01);
+  assert_equals_int (frame_header.frame_width, 320);
+  assert_equals_int (frame_header.frame_height, 240);
+
+  gst_av1_parser_free (parser);
+}
+
+GST_END_TEST;
+
+static Suite *
+av1parsers_suite (void)
+{
+  Suite *s = suite_create ("AV1 Parser library");
+
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_av1_read_leb128);
+  tcase_add_test (tc_chain, test_av1_identify_obus);
+  tcase_add_test (tc_chain, test_av1_parse_headers);
+
+  return s;
+}
+
+GST_CHECK_MAIN (av1parsers);
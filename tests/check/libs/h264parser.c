@@ -229,6 +229,49 @@ GST_START_TEST (test_h264_parse_slice_5bytes)
 
 GST_END_TEST;
 
+/* Start codes at every position relative to the blocks that the start code
+ * scanner checks at once, with zero bytes in between that aren't part of
+ * one */
+GST_START_TEST (test_h264_parse_start_code_positions)
+{
+  GstH264NalParser *const parser = gst_h264_nal_parser_new ();
+  guint8 buf[128];
+  guint first, second;
+
+  for (first = 0; first < 48; first++) {
+    for (second = first + 5; second <= sizeof (buf) - 4; second++) {
+      GstH264ParserResult res;
+      GstH264NalUnit nalu;
+
+      memset (buf, 0x80, sizeof (buf));
+      buf[first + 2] = 0x01;
+      buf[first] = buf[first + 1] = 0x00;
+      buf[first + 3] = GST_H264_NAL_AU_DELIMITER;
+      if (second >= first + 8) {
+        /* emulation prevention */
+        buf[first + 4] = buf[first + 5] = 0x00;
+        buf[first + 6] = 0x03;
+      }
+      buf[second] = buf[second + 1] = 0x00;
+      buf[second + 2] = 0x01;
+      buf[second + 3] = GST_H264_NAL_SEQ_END;
+
+      res = gst_h264_parser_identify_nalu (parser, buf, 0, sizeof (buf),
+          &nalu);
+
+      assert_equals_int (res, GST_H264_PARSER_OK);
+      assert_equals_int (nalu.type, GST_H264_NAL_AU_DELIMITER);
+      assert_equals_int (nalu.sc_offset, first);
+      assert_equals_int (nalu.offset, first + 3);
+      assert_equals_int (nalu.size, second - first - 3);
+    }
+  }
+
+  gst_h264_nal_parser_free (parser);
+}
+
+GST_END_TEST;
+
 static Suite *
 h264parser_suite (void)
 {
@@ -240,6 +283,7 @@ h264parser_suite (void)
   tcase_add_test (tc_chain, test_h264_parse_slice_dpa);
   tcase_add_test (tc_chain, test_h264_parse_slice_eoseq_slice);
   tcase_add_test (tc_chain, test_h264_parse_slice_5bytes);
+  tcase_add_test (tc_chain, test_h264_parse_start_code_positions);
 
   return s;
 }
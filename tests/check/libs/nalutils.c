@@ -0,0 +1,191 @@
+/* GStreamer
+ *
+ * nalutils.c: unit tests for the NAL bit reader
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+/* The reader is internal to the library */
+#include "../../../gst-libs/gst/codecparsers/nalutils.c"
+
+GST_START_TEST (test_nal_reader_bits)
+{
+  static const guint8 data[] = {
+    0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf1, 0x23, 0x45, 0x67
+  };
+  NalReader nr;
+  guint8 val8;
+  guint16 val16;
+  guint32 val32;
+
+  nal_reader_init (&nr, data, sizeof (data));
+
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val8, 4));
+  assert_equals_int (val8, 0x1);
+  fail_unless (nal_reader_get_bits_uint16 (&nr, &val16, 12));
+  assert_equals_int (val16, 0x234);
+  fail_unless (nal_reader_get_bits_uint32 (&nr, &val32, 32));
+  assert_equals_uint64 (val32, 0x56789abc);
+  assert_equals_int (nal_reader_get_pos (&nr), 48);
+  assert_equals_int (nal_reader_get_remaining (&nr), 40);
+
+  fail_unless (nal_reader_skip_long (&nr, 36));
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val8, 4));
+  assert_equals_int (val8, 0x7);
+  assert_equals_int (nal_reader_get_remaining (&nr), 0);
+  fail_if (nal_reader_get_bits_uint8 (&nr, &val8, 1));
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_nal_reader_epb)
+{
+  /* 00 00 03 03 keeps the second 03, 00 03 isn't an escape */
+  static const guint8 data[] = {
+    0xff, 0x00, 0x00, 0x03, 0x03, 0x00, 0x03, 0xff, 0x00, 0x00, 0x03, 0x01,
+    0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x11, 0x22
+  };
+  NalReader nr;
+  guint8 val;
+  guint i;
+
+  nal_reader_init (&nr, data, sizeof (data));
+
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+  assert_equals_int (val, 0xff);
+  assert_equals_int (nal_reader_get_pos (&nr), 8);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+
+  fail_unless (nal_reader_skip (&nr, 16));
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+  assert_equals_int (val, 0x03);
+  assert_equals_int (nal_reader_get_pos (&nr), 40);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 1);
+
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+  assert_equals_int (val, 0x00);
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+  assert_equals_int (val, 0x03);
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+  assert_equals_int (val, 0xff);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 1);
+
+  fail_unless (nal_reader_skip (&nr, 16));
+  fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+  assert_equals_int (val, 0x01);
+  assert_equals_int (nal_reader_get_pos (&nr), 96);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 2);
+
+  for (i = 12; i < sizeof (data); i++) {
+    fail_unless (nal_reader_get_bits_uint8 (&nr, &val, 8));
+    assert_equals_int (val, data[i]);
+    assert_equals_int (nal_reader_get_pos (&nr), i * 8 + 8);
+    assert_equals_int (nal_reader_get_epb_count (&nr), 2);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_nal_reader_exp_golomb)
+{
+  /* ue 0, 1, 2, 3, 7 and se +1, -1, +2 as
+   * 1 010 011 00100 0001000 010 011 00100, followed by padding */
+  static const guint8 data[] = {
+    0xa6, 0x41, 0x09, 0x90, 0xff, 0xff, 0xff, 0xff
+  };
+  static const guint32 ue[] = { 0, 1, 2, 3, 7 };
+  static const gint32 se[] = { 1, -1, 2 };
+  NalReader nr;
+  guint32 uval;
+  gint32 sval;
+  guint i;
+
+  nal_reader_init (&nr, data, sizeof (data));
+
+  for (i = 0; i < G_N_ELEMENTS (ue); i++) {
+    fail_unless (nal_reader_get_ue (&nr, &uval));
+    assert_equals_int (uval, ue[i]);
+  }
+  for (i = 0; i < G_N_ELEMENTS (se); i++) {
+    fail_unless (nal_reader_get_se (&nr, &sval));
+    assert_equals_int (sval, se[i]);
+  }
+  assert_equals_int (nal_reader_get_pos (&nr), 30);
+
+  /* 32 leading zeros aren't valid */
+  {
+    static const guint8 zeros[] = { 0x00, 0x00, 0x00, 0x00, 0x80 };
+
+    nal_reader_init (&nr, zeros, sizeof (zeros));
+    fail_if (nal_reader_get_ue (&nr, &uval));
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_nal_reader_trailing_epb)
+{
+  /* The prefetch of the Exp-Golomb decoder runs into an emulation
+   * prevention byte without a following byte */
+  static const guint8 data[] = { 0x46, 0x00, 0x00, 0x03 };
+  NalReader nr;
+  guint32 val;
+  guint8 bit;
+
+  nal_reader_init (&nr, data, sizeof (data));
+
+  fail_unless (nal_reader_get_ue (&nr, &val));
+  assert_equals_int (val, 1);
+  assert_equals_int (nal_reader_get_pos (&nr), 3);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+
+  while (nal_reader_get_bits_uint8 (&nr, &bit, 1));
+  assert_equals_int (nal_reader_get_pos (&nr), 24);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+
+  nal_reader_init (&nr, data, sizeof (data));
+  fail_unless (nal_reader_skip (&nr, 1));
+  fail_unless (nal_reader_get_ue (&nr, &val));
+  assert_equals_int (val, 0);
+  fail_unless (nal_reader_get_ue (&nr, &val));
+  assert_equals_int (val, 11);
+  assert_equals_int (nal_reader_get_pos (&nr), 9);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+}
+
+GST_END_TEST;
+
+static Suite *
+nalutils_suite (void)
+{
+  Suite *s = suite_create ("NAL utils");
+
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_nal_reader_bits);
+  tcase_add_test (tc_chain, test_nal_reader_epb);
+  tcase_add_test (tc_chain, test_nal_reader_exp_golomb);
+  tcase_add_test (tc_chain, test_nal_reader_trailing_epb);
+
+  return s;
+}
+
+GST_CHECK_MAIN (nalutils);
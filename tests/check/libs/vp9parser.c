@@ -0,0 +1,125 @@
+/* GStreamer
+ *
+ * vp9parser.c: unit tests for the VP9 parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/codecparsers/gstvp9parser.h>
+
+/* 320x240 profile 0 key frame */
+static const guint8 vp9_key_frame[] = {
+  0x82, 0x49, 0x83, 0x42, 0x20, 0x13, 0xf0, 0x0e, 0xf6, 0x14, 0x07, 0x80,
+  0x00, 0x01, 0xaa
+};
+
+/* superframe of a hidden inter frame and a shown existing frame */
+static const guint8 vp9_superframe[] = {
+  0x84, 0x00, 0x40, 0x01, 0x38, 0x50, 0x1e, 0x00, 0x00, 0x04, 0xbb, 0x88,
+  0xc1, 0x0b, 0x01, 0xc1
+};
+
+GST_START_TEST (test_vp9_parse_key_frame)
+{
+  GstVp9Parser *parser;
+  GstVp9FrameHdr frame_hdr;
+
+  parser = gst_vp9_parser_new ();
+
+  assert_equals_int (gst_vp9_parser_parse_frame_header (parser, &frame_hdr,
+          vp9_key_frame, sizeof (vp9_key_frame)), GST_VP9_PARSER_OK);
+
+  assert_equals_int (frame_hdr.profile, GST_VP9_PROFILE_0);
+  assert_equals_int (frame_hdr.show_existing_frame, 0);
+  assert_equals_int (frame_hdr.frame_type, GST_VP9_KEY_FRAME);
+  assert_equals_int (frame_hdr.show_frame, 1);
+  assert_equals_int (frame_hdr.width, 320);
+  assert_equals_int (frame_hdr.height, 240);
+  assert_equals_int (frame_hdr.frame_header_length_in_bytes, 14);
+  assert_equals_int (parser->bit_depth, GST_VP9_BIT_DEPTH_8);
+  assert_equals_int (parser->subsampling_x, 1);
+  assert_equals_int (parser->subsampling_y, 1);
+
+  gst_vp9_parser_free (parser);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_vp9_parse_superframe_info)
+{
+  GstVp9Parser *parser;
+  GstVp9SuperframeInfo superframe_info;
+  GstVp9FrameHdr frame_hdr;
+  const guint8 broken[] = { 0x00, 0xc1, 0x20, 0x01, 0xc1 };
+
+  parser = gst_vp9_parser_new ();
+
+  assert_equals_int (gst_vp9_parser_parse_superframe_info (parser,
+          &superframe_info, vp9_superframe, sizeof (vp9_superframe)),
+      GST_VP9_PARSER_OK);
+  assert_equals_int (superframe_info.frames_in_superframe, 2);
+  assert_equals_int (superframe_info.bytes_per_framesize, 1);
+  assert_equals_int (superframe_info.superframe_index_size, 4);
+  assert_equals_int (superframe_info.frame_sizes[0], 11);
+  assert_equals_int (superframe_info.frame_sizes[1], 1);
+
+  /* the frames can be parsed as they are */
+  assert_equals_int (gst_vp9_parser_parse_frame_header (parser, &frame_hdr,
+          vp9_key_frame, sizeof (vp9_key_frame)), GST_VP9_PARSER_OK);
+  assert_equals_int (gst_vp9_parser_parse_frame_header (parser, &frame_hdr,
+          vp9_superframe, 11), GST_VP9_PARSER_OK);
+  assert_equals_int (frame_hdr.frame_type, GST_VP9_INTER_FRAME);
+  assert_equals_int (frame_hdr.show_frame, 0);
+  assert_equals_int (frame_hdr.width, 320);
+  assert_equals_int (gst_vp9_parser_parse_frame_header (parser, &frame_hdr,
+          vp9_superframe + 11, 1), GST_VP9_PARSER_OK);
+  assert_equals_int (frame_hdr.show_existing_frame, 1);
+  assert_equals_int (frame_hdr.frame_to_show, 0);
+
+  /* a single frame */
+  assert_equals_int (gst_vp9_parser_parse_superframe_info (parser,
+          &superframe_info, vp9_key_frame, sizeof (vp9_key_frame)),
+      GST_VP9_PARSER_OK);
+  assert_equals_int (superframe_info.frames_in_superframe, 1);
+  assert_equals_int (superframe_info.superframe_index_size, 0);
+  assert_equals_int (superframe_info.frame_sizes[0], sizeof (vp9_key_frame));
+
+  /* frame sizes larger than the data */
+  assert_equals_int (gst_vp9_parser_parse_superframe_info (parser,
+          &superframe_info, broken, sizeof (broken)),
+      GST_VP9_PARSER_BROKEN_DATA);
+
+  gst_vp9_parser_free (parser);
+}
+
+GST_END_TEST;
+
+static Suite *
+vp9parsers_suite (void)
+{
+  Suite *s = suite_create ("VP9 Parser library");
+
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_vp9_parse_key_frame);
+  tcase_add_test (tc_chain, test_vp9_parse_superframe_info);
+
+  return s;
+}
+
+GST_CHECK_MAIN (vp9parsers);